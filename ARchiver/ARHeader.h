@@ -7,13 +7,86 @@
 
 #ifndef ARHEADER_H
 #define	ARHEADER_H
+
+#define AR_ID 117 /* First field of every .ar file */
+
+#define AR_FLAG_ADAPTIVE 1 /* Data is a single adaptive Huffman stream instead of blocks */
+#define AR_FLAG_DEDUP 2 /* Each block header is followed by a chunk list, and repeated chunks are stored once */
+#define AR_FLAG_DELTA 4 /* Blocks are copies from a base file plus new bytes, and need the same base to decompress */
+#define AR_FLAG_STREAMED 8 /* Written front to back with no block count, so the blocks end with an AR_METHOD_END header */
+
+#define AR_MEMBER_NAME_SIZE 256 /* Bytes kept of each member's file name in the index */
+
+#define AR_METHOD_HUFFMAN 0 /* Block is Huffman coded bytes, or stored if it has no tree */
+#define AR_METHOD_LZ77 1 /* Block is LZ77 tokens with literal/length and distance trees */
+#define AR_METHOD_BWT 2 /* Block is Burrows-Wheeler transformed, move-to-front and zero run coded */
+#define AR_METHOD_DELTA 3 /* Block is copies from the base file and Huffman coded new bytes */
+#define AR_METHOD_END 4 /* Not a block, ends the blocks of an AR_FLAG_STREAMED archive */
+#define AR_METHOD_SPLIT 5 /* Block is Huffman coded segments, each with its own tree or an earlier one */
+#define AR_METHOD_WORDS 6 /* Block is words from a dictionary in the block and literal bytes, Huffman coded */
+
+/* A compact frame from Tiny.c starts with a tag byte instead of AR_ID. Its top three bits are AR_TINY_TAG,
+   bits 2 to 4 the padding after the last code of an AR_TINY_TRAINED frame, and bits 0 and 1 the mode */
+#define AR_TINY_TAG 0xA0
+#define AR_TINY_RAW 1 /* Data is stored as it is */
+#define AR_TINY_RUN 2 /* Data is one byte repeated, stored once */
+#define AR_TINY_TRAINED 3 /* Data is Huffman coded with the built in table */
+
+/* These structs are only the decoded form. Format.c reads and writes them with a fixed little endian layout */
 typedef struct
 {
 	short arID; /*Is this an AR file?*/
 	char arText[14];    /* Human-readable. Always "ARchiver file\0"*/
-	int huffTreeSize;  /* Size of Huffman tree 'table', in bytes */
-	int compressedDataSize;  /* Size of compressed data in bits - number of 1s and 0s*/
-	int uncompressedDataSize; /* Size of data when uncompressed */
+	int version; /* AR_FORMAT_VERSION the file was written with */
+	int blockSize;  /* Maximum uncompressed size of each block, in bytes */
+	long long numBlocks;  /* Number of blocks following the header, over all members */
+	int flags; /* AR_FLAG_* options the file was written with */
+	int numMembers; /* Number of entries in the index */
+	int numChunks; /* Number of entries in the chunk table after the index, with AR_FLAG_DEDUP */
+	long long uncompressedDataSize; /* Size of data when uncompressed, over all members */
+	long long indexOffset; /* Position of the index after the last block, or 0 if there is none */
+	long long baseSize; /* Size of the base file, with AR_FLAG_DELTA */
+	unsigned long long baseFingerprint[2]; /* Hash of the base file, with AR_FLAG_DELTA */
 } ARHeader;
-#endif
 
+/* The index follows the last block, with one entry per file added to the archive. Appending a file
+   writes its blocks over the old index and then writes the extended index after them */
+typedef struct
+{
+	char name[AR_MEMBER_NAME_SIZE];  /* Name of the file the member was compressed from */
+	long long offset;  /* Position of the member's first block header */
+	long long uncompressedDataSize;  /* Size of the member when uncompressed */
+	int numBlocks;  /* Number of blocks in the member */
+	int level;  /* Compression level the member was written with */
+	unsigned int checksum;  /* CRC32C of the member's uncompressed data */
+} ARMember;
+
+/* Chunk table entry, one for each unique chunk in a deduplicated archive */
+typedef struct
+{
+	unsigned long long fingerprint[2];  /* First 128 bits of the SHA-256 of the chunk's bytes */
+	long long offset;  /* Position of the chunk's first copy in the uncompressed data */
+	int size;  /* Length of the chunk in bytes */
+	int reserved;
+} ARChunk;
+
+/* With AR_FLAG_DEDUP, each block header is followed by a 32 bit count and then one of these per chunk
+   in the block, in order. The block's own data holds only the chunks that are new */
+typedef struct
+{
+	long long offset;  /* Position of an earlier copy in the uncompressed data, or -1 if the chunk is in this block */
+	int size;  /* Length of the chunk in bytes */
+	int reserved;
+} ARChunkRef;
+
+/* Written before each block. A block with no tree is stored uncompressed */
+typedef struct
+{
+	int method;  /* AR_METHOD_* used to compress the block */
+	int huffTreeSize;  /* Size of Huffman tree 'table', in bytes */
+	int compressedDataSize;  /* Size of compressed data in bits - number of 1s and 0s. 64 bit in the file, but
+								a block is at most AR_MAX_BLOCK_SIZE so it always fits */
+	int uncompressedDataSize; /* Size of block when uncompressed */
+	unsigned int checksum;  /* CRC32C of the block's uncompressed data. With AR_FLAG_DEDUP, of the new chunks it holds */
+} ARBlockHeader;
+#endif
@@ -4,33 +4,128 @@
  *
  * @brief A program to compress text files using Huffman Coding, or to decompress .ar files.
  * Usage: ./ARchiver [file]    for compression
- *		  ./ARchiver -d [file] for decompression
+ *		  ./ARchiver -1 to -9 [file] for compression at a level, from fastest to best ratio
+ *		  ./ARchiver --level-info for what each level does
+ *		  ./ARchiver -w [file] for compression of text or logs as word tokens from a dictionary in each block
+ *		  ./ARchiver -D [file] for compression that stores repeated chunks of the file once
+ *		  ./ARchiver -a [archive] [file] to add a file to the end of an existing archive
+ *		  ./ARchiver -m [file] [file]... to compress many files into one archive, reading them ahead together
+ *		  ./ARchiver --base [old] [file] to store only the differences from an older version of the file
+ *		  ./ARchiver --base [old] -d [file] to decompress such an archive with the same older version
+ *		  ./ARchiver -s [file] for single pass compression of a pipe, socket or FIFO, or - for stdin to stdout
+ *		  ./ARchiver -d [file] for decompression, to a directory of its files if it holds more than one, or - for stdin to stdout
+ *		  ./ARchiver --verify [file] to check an archive's checksums without writing anything, --base [old] --verify [file] with a base
+ *		  ./ARchiver --serve [socket] to run a server that compresses and decompresses for --connect
+ *		  ./ARchiver --connect [socket] [file], or with -1 to -9 or -d before the file, to have a running server do the work
+ *		  ./ARchiver --stats followed by any of the above to print the time, hardware counters and memory of each stage
+ *		  ./ARchiver --max-memory [bytes, or with K, M or G] followed by any of the above to use fewer threads or smaller blocks
+ *		  ./ARchiver -T [threads] followed by any of the above to code with that many threads, which never changes the output
+ *		  ./ARchiver --check-determinism [file], or with -1 to -9 or -w before the file, to compress it with several
+ *		  thread counts and check every archive is byte for byte the same
  * @date 15 November 2012, 9:01 PM
- * @version 1.0 - Compression/Decompression of one file
+ * @version 1.1 - Files are read, compressed and written in blocks by a threaded pipeline
  */
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
 #include <stdlib.h>
 #include <math.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
 #include "ARHeader.h"
 #include "ARchiver.h"
 #include "Huffman.h"
-#include "Heap.h"
-#define _CRTDBG_MAP_ALLOC
-#ifdef _CRTDBG_MAP_ALLOC
-#include <stdlib.h>
-#include <crtdbg.h>
-#endif
+#include "Pipeline.h"
+#include "Adaptive.h"
+#include "Format.h"
+#include "Server.h"
+#include "Stats.h"
+#include "Memory.h"
+#include "Tiny.h"
+#include "Report.h"
 
 int main(int argc, char* argv[])
 {
-	int status;
+	int status, showStats;
+	long long budget;
+	long threads;
+	char *end, *budgetText;
+	const ARLevel *level;
 	FILE* file;
+	StatsTable stats;
 
 	status = EXIT_SUCCESS;
+    showStats = 0;
+    budget = 0;
+    budgetText = NULL;
+    /*The codec is silent unless told where to say why something failed*/
+    setErrorOutput(stderr);
+    /*--stats, --max-memory and -T can go in front of any command*/
+    for (;;)
+    {
+        if ( argc >= 2 && strcmp("--stats", argv[1]) == 0)
+        {
+            showStats = 1;
+            argc--;
+            argv++;
+        }
+        else if ( argc >= 3 && strcmp("--max-memory", argv[1]) == 0)
+        {
+            budget = parseSize(argv[2]);
+            budgetText = argv[2];
+            if ( budget <= 0)
+            {
+                reportError("Invalid memory budget %s, must be a size such as 64M\n", argv[2]);
+                return EXIT_FAILURE;
+            }
+            argc -= 2;
+            argv += 2;
+        }
+        else if ( argc >= 3 && strcmp("-T", argv[1]) == 0)
+        {
+            threads = strtol(argv[2], &end, 10);
+            if ( *end != '\0' || threads < 1 || threads > AR_MAX_THREADS)
+            {
+                reportError("Invalid thread count %s, must be from 1 to %d\n", argv[2], AR_MAX_THREADS);
+                return EXIT_FAILURE;
+            }
+            setDefaultThreads((int) threads);
+            argc -= 2;
+            argv += 2;
+        }
+        else
+        {
+            break;
+        }
+    }
+    /*The budget only has to fit the level the command codes with*/
+    level = commandLevel(argc, argv);
+    if ( budget > 0 && setMemoryBudget(budget, level) != EXIT_SUCCESS)
+    {
+        reportError("Invalid memory budget %s, must be at least %lldK at this level\n", budgetText,
+               pipelineMemory(level, AR_MIN_BUDGET_BLOCK, 1) / 1024 + 1);
+        return EXIT_FAILURE;
+    }
+    if ( showStats)
+    {
+        initStatsTable(&stats);
+        setStatsCallback(&collectStats, &stats);
+    }
     /*Check command line parameters are either -d flag with file, or just file*/
-    if (argc == 2) /*Compression*/
+    if (argc == 2 && strcmp("--level-info", argv[1]) == 0)
+    {
+        printLevelInfo(stdout);
+    }
+    else if (argc >= 3 && strcmp("-m", argv[1]) == 0) /*Many files into one archive*/
+    {
+        status = compressFiles(argv + 2, argc - 2, getLevel(AR_DEFAULT_LEVEL));
+    }
+    else if (argc == 2) /*Compression*/
     {
         /*Check if file can be opened, otherwise exit*/
         file = fopen( argv[1], "r");
@@ -41,28 +136,94 @@ int main(int argc, char* argv[])
         else
         {
             fclose(file);
-			status = compressFile(argv[1]);
+			status = compressFile(argv[1], getLevel(AR_DEFAULT_LEVEL), 0, NULL);
         }
     }
-    else if (argc == 3)/*Decompression*/
+    else if (argc == 3)/*Decompression, single pass compression or compression at a level*/
     {
         if ((strcmp("-d", argv[1]) == 0))
         {
-            status = decompressFile(argv[2]);
+            status = decompressFile(argv[2], NULL, 0);
+        }
+        else if ((strcmp("--verify", argv[1]) == 0))
+        {
+            status = decompressFile(argv[2], NULL, 1);
+        }
+        else if ((strcmp("-s", argv[1]) == 0))
+        {
+            status = compressStream(argv[2]);
+        }
+        else if ((strcmp("--serve", argv[1]) == 0))
+        {
+            status = runServer(argv[2]);
+        }
+        else if ((strcmp("-D", argv[1]) == 0))
+        {
+            status = compressFile(argv[2], getLevel(AR_DEFAULT_LEVEL), AR_FLAG_DEDUP, NULL);
+        }
+        else if ((strcmp("-w", argv[1]) == 0))
+        {
+            status = compressFile(argv[2], getWordsLevel(), 0, NULL);
+        }
+        else if ((strcmp("--check-determinism", argv[1]) == 0))
+        {
+            status = checkDeterminism(argv[2], getLevel(AR_DEFAULT_LEVEL));
+        }
+        else if ( argv[1][0] == '-' && argv[1][1] >= '1' && argv[1][1] <= '9' && argv[1][2] == '\0')
+        {
+            status = compressFile(argv[2], getLevel(argv[1][1] - '0'), 0, NULL);
         }
         else
         {
-            printf("Invalid flag %s, must use -d to decompress", argv[1]);
+            reportError("Invalid flag %s, must use -d to decompress, --verify to check, -1 to -9 for a level, -w for word tokens, -D to deduplicate, -s to compress a stream, --check-determinism to compare thread counts or --serve to start a server\n", argv[1]);
         }
     }
+    else if (argc == 4 && strcmp("--check-determinism", argv[1]) == 0 && strcmp("-w", argv[2]) == 0)
+    {
+        status = checkDeterminism(argv[3], getWordsLevel());
+    }
+    else if (argc == 4 && strcmp("--check-determinism", argv[1]) == 0 && argv[2][0] == '-' && argv[2][1] >= '1' && argv[2][1] <= '9' && argv[2][2] == '\0')
+    {
+        status = checkDeterminism(argv[3], getLevel(argv[2][1] - '0'));
+    }
+    else if (argc == 4 && strcmp("-a", argv[1]) == 0) /*Append to an archive*/
+    {
+        status = appendFile(argv[2], argv[3], getLevel(AR_DEFAULT_LEVEL));
+    }
+    else if (argc == 4 && strcmp("--connect", argv[1]) == 0) /*Compression by a running server*/
+    {
+        status = runClient(argv[2], AR_SERVE_COMPRESS, AR_DEFAULT_LEVEL, argv[3]);
+    }
+    else if (argc == 5 && strcmp("--connect", argv[1]) == 0 && strcmp("-d", argv[3]) == 0)
+    {
+        status = runClient(argv[2], AR_SERVE_DECOMPRESS, AR_DEFAULT_LEVEL, argv[4]);
+    }
+    else if (argc == 5 && strcmp("--connect", argv[1]) == 0 && argv[3][0] == '-' && argv[3][1] >= '1' && argv[3][1] <= '9' && argv[3][2] == '\0')
+    {
+        status = runClient(argv[2], AR_SERVE_COMPRESS, argv[3][1] - '0', argv[4]);
+    }
+    else if (argc == 4 && strcmp("--base", argv[1]) == 0) /*Delta compression against an older file*/
+    {
+        status = compressFile(argv[3], getLevel(AR_DEFAULT_LEVEL), AR_FLAG_DELTA, argv[2]);
+    }
+    else if (argc == 5 && strcmp("--base", argv[1]) == 0 && strcmp("-d", argv[3]) == 0)
+    {
+        status = decompressFile(argv[4], argv[2], 0);
+    }
+    else if (argc == 5 && strcmp("--base", argv[1]) == 0 && strcmp("--verify", argv[3]) == 0)
+    {
+        status = decompressFile(argv[4], argv[2], 1);
+    }
     else
     {
-        printf("Parameters must be either -d with the .ar file, or just the file to compress");
+        reportError("Parameters must be either -d with the .ar file, -1 to -9, -w, -D or -s with the file to compress, just the file to compress, -a with the archive and file to add, -m with the files to archive, --base with the older file and then the file, -d or --verify and the .ar file, --verify with the .ar file, --serve with a socket, --connect with the socket, optionally -d or -1 to -9, and the file, --check-determinism optionally with -1 to -9 or -w and the file, or --level-info, any of them after --stats, --max-memory with a size or -T with a thread count\n");
     }
 
-#ifdef _CRTDBG_MAP_ALLOC
-	_CrtDumpMemoryLeaks();
-#endif
+    if ( showStats)
+    {
+        setStatsCallback(NULL, NULL);
+        printStats(stderr, &stats);
+    }
     return status;
 }
 
@@ -70,614 +231,1660 @@ int main(int argc, char* argv[])
  * Method:    compressFile
  * FullName:  compressFile
  * Access:    public 
- * @brief   Used to compress the provided text file using Huffman Compression
+ * @brief   Used to compress the provided text file using Huffman Compression. The file is split into
+ *			blocks which are read, compressed and written by a {@link runPipeline} pipeline, each with its own tree.
+ *			The archive is written with a one member index, so more files can be added by {@link appendFile}
  * @param 	  file - the name of the file to use
+ * @param 	  level - settings from {@link getLevel}: the method, block size, search effort and threads to use
+ * @param 	  flags - AR_FLAG_DEDUP to store repeated chunks once, AR_FLAG_DELTA to store differences from baseFile, or 0
+ * @param 	  baseFile - name of the older version of the file with AR_FLAG_DELTA, otherwise NULL
  * @return   return status of the function, either EXIT_SUCCESS or EXIT_FAILURE
  **/
-int compressFile( char* file )
-{
-	int maxSize = 1048576, currSize;
-    HuffNode **freqTable, **pQ, *root;
-    int symbolSize = 1;
-    char **codeTable, **compressed;
-    char* code;
-    ARHeader header;
-    int num, i, numElements;
-    HuffNodeSerial *treeSerial;
-
-    /*Get frequency of each character in file and sort in lowest to highest*/
-    freqTable = createFreqTable(file, &header.uncompressedDataSize);
-
-	pQ = sortPriority(freqTable, &num);
-	numElements = num;
-	/*Create Huffman tree from frequencies and build code table for each char*/
-	root = buildTree(pQ, &num);
-	if ( root == NULL)
-	{
-		printf("Could not build tree, exiting");
-		return EXIT_FAILURE;
-	}
-
-	codeTable = (char**) malloc(256 * symbolSize * sizeof(char*));
-	if ( codeTable == NULL)
-	{
-		printf("Could not allocate memory for codeTable\n");
-		return EXIT_FAILURE;
-	}
-		
-	for (i = 0; i < 256 * symbolSize; i++)
-	{
-		codeTable[i] = NULL;
-	}
-	/*Max code length in worst case is 256*n - 1, so +1 for null terminator*/
-	code = (char*) malloc(256 * symbolSize);
-	buildCodeTable(codeTable, root, code, 0);
-
-	/*Serialize tree for storage in .ar file*/
-	treeSerial = compressTree(root, numElements, &header.huffTreeSize);
-
-	/*Small file, handle normally*/
-	if ( header.uncompressedDataSize <= maxSize)
-	{
-				
-		/*Compress symbols*/
-		/*************************
-		*TODO:
-		* Compressed data size may need to represent number of bits minus padding,
-		* or otherwise need to include EOF character in tree.
-		*
-		*/
-		compressed = encode(file, codeTable, &header.compressedDataSize, header.uncompressedDataSize);
-		if ( compressed != NULL)
-		{
-			header.arID = 117;
-			strcpy(header.arText, "ARchiver file");
-	
-			/*Create .ar file from the header, serialized tree and compressed data*/
-			writeARFile(&header, treeSerial, header.huffTreeSize, compressed, header.compressedDataSize);
-	
-			/*Free serial tree*/
-			free(treeSerial);
-			treeSerial = NULL;
-	
-			/*free compressed*/
-			for ( i = 0; i < header.uncompressedDataSize; i++)
-			{
-				free(compressed[i]);
-				compressed[i] = NULL;
-			}
-			free(compressed);
-			compressed = NULL;
-		}
-		else
-		{
-			printf("File could not be compressed, compressed size would be greater than original");
-		}
-		/*Free remaining allocated memory*/
-		freeTree(root);
-	
-		for (i = 0; i < 256; i++)
-		{
-			/*Only free allocated memory, skip unused elements*/
-			if (codeTable[i] != NULL)
-			{
-				free(codeTable[i]);
-				codeTable[i] = NULL;
-			}
-		}
-		free(code);
-		code = NULL;
-	
-		free(codeTable);
-		codeTable = NULL;
-	}
-	else /*File too large, handle in chunks*/
-	{
-		/*Compress symbols*/
-		/*************************
-		*TODO:
-		* Compressed data size may need to represent number of bits minus padding,
-		* or otherwise need to include EOF character in tree.
-		*
-		*/
-		currSize = header.uncompressedDataSize;
-		while ( currSize >= 0)
-		{
-			if ( currSize >= maxSize)
-			{
-				compressed = encode(file, codeTable, &header.compressedDataSize, maxSize);
-				currSize -= maxSize;
-			}
-			else
-			{
-				compressed = encode(file, codeTable, &header.compressedDataSize, currSize);
-			}
-
-			if ( compressed != NULL)
-			{
-				header.arID = 117;
-				strcpy(header.arText, "ARchiver file");
-		
-				/*Create .ar file from the header, serialized tree and compressed data*/
-				writeARFile(&header, treeSerial, 0, compressed, 0);
-		
-				/*Free serial tree*/
-				free(treeSerial);
-				treeSerial = NULL;
-		
-				/*free compressed*/
-				for ( i = 0; i < header.uncompressedDataSize; i++)
-				{
-					free(compressed[i]);
-					compressed[i] = NULL;
-				}
-				free(compressed);
-				compressed = NULL;
-			}
-			else
-			{
-				printf("File could not be compressed, compressed size would be greater than original");
-			}
-			/*Free remaining allocated memory*/
-			freeTree(root);
-		
-			for (i = 0; i < 256; i++)
-			{
-				/*Only free allocated memory, skip unused elements*/
-				if (codeTable[i] != NULL)
-				{
-					free(codeTable[i]);
-					codeTable[i] = NULL;
-				}
-			}
-			free(code);
-			code = NULL;
-		
-			free(codeTable);
-			codeTable = NULL;
-
-			/*Seek  back to start and write header*/
-			/*Create .ar file from the header, serialized tree and compressed data*/
-			writeARFile(&header, treeSerial, header.huffTreeSize, compressed, header.compressedDataSize);	
-
-		}
-	}
-	
-	printf("Done\n"); 	
-	return EXIT_SUCCESS;
-}
-
-/**
- * Method:    decompressFile
- * FullName:  decompressFile
- * Access:    public 
- * @brief   Decompresses a given .ar file, to create original file
- * @param 	  file name of compressed file with .ar extension
- * @return   return status of function, EXIT_SUCCESS or EXIT_FAILURE
- **/
-int decompressFile( char* file )
+int compressFile( char* file, const ARLevel *level, int flags, char* baseFile )
 {
+    char name[101];
+    DeltaBase base;
+    Pipeline pipeline;
+    int status;
 
-    int compressedSizeBytes;
-    ARHeader header;
-    HuffNode *tree;
-    HuffNodeSerial *treeSerial;
-    char *compressed, *uncompressed, *binary;
-    FILE* input = fopen(file, "rb");
-
-    if ( input == NULL)
+    pipeline.input = fopen(file, "rb");
+    if ( pipeline.input == NULL)
     {
         perror(file);
+        return EXIT_FAILURE;
     }
-    else
+    /*The base is indexed before anything is written, so a bad base leaves no output behind*/
+    if ( (flags & AR_FLAG_DELTA) && openBase(&base, baseFile, 1) != EXIT_SUCCESS)
     {
-        fread( &header, sizeof(header), 1, input);
-        if ( header.arID != 117)
+        fclose(pipeline.input);
+        return EXIT_FAILURE;
+    }
+
+    printf("Enter name of output file.\n");
+    if ( scanf("%97s", name) != 1)
+    {
+        reportError("No output file name given\n");
+        fclose(pipeline.input);
+        if ( flags & AR_FLAG_DELTA)
         {
-            printf("Not a valid .ar file, wrong id %d", header.arID);
+            closeBase(&base);
         }
-        else
+        return EXIT_FAILURE;
+    }
+    strcat(name, ".ar");
+    pipeline.output = fopen(name, "wb");
+    if ( pipeline.output == NULL)
+    {
+        perror(name);
+        fclose(pipeline.input);
+        if ( flags & AR_FLAG_DELTA)
         {
-            /*compressedDataSize is in bits, convert to bytes*/
-            compressedSizeBytes = (header.compressedDataSize + 7)/ 8;
-            compressed = (char*) malloc( compressedSizeBytes);
-            if ( compressed == NULL)
-            {
-            	printf("Could not allocate memory for compressed\n");
-            	return EXIT_FAILURE;
-            }
-
-            treeSerial = (HuffNodeSerial*) malloc( header.huffTreeSize);
-			if ( treeSerial == NULL)
-			{
-				printf("Could not allocate memory for treeSerial\n");
-				return EXIT_FAILURE;
-			}
-
-			fread( treeSerial, header.huffTreeSize, 1, input);	
-			tree = decompressTree( treeSerial);
-			fread( compressed, compressedSizeBytes, 1, input);
-
-			/*Compressed is an array of chars, need to convert to binary representation*/
-			binary = toBinary( compressed, header.compressedDataSize);
-			uncompressed = decode( binary, header.compressedDataSize, header.uncompressedDataSize, tree);
-			free(binary);
-			
-			writeFile( uncompressed, header.uncompressedDataSize);
-
-			freeTree(tree);
-			tree = NULL;
-			
-			free(treeSerial);
-			treeSerial = NULL;
-
-			free(uncompressed);
-			uncompressed = NULL;
-
-			free(compressed);
-			compressed = NULL;
+            closeBase(&base);
         }
-		fclose(input);
+        return EXIT_FAILURE;
+    }
+
+    status = writeArchive(&pipeline, file, level, flags, (flags & AR_FLAG_DELTA) ? &base : NULL);
+    if ( flags & AR_FLAG_DELTA)
+    {
+        closeBase(&base);
+    }
+    fclose(pipeline.input);
+    if ( fclose(pipeline.output) != 0)
+    {
+        perror(name);
+        status = EXIT_FAILURE;
     }
 
-	return EXIT_SUCCESS;
+    if ( status == EXIT_SUCCESS)
+    {
+        printf("Done\n");
+    }
+    return status;
 }
 
 /**
- * Method:    createFreqTable
- * FullName:  createFreqTable
+ * Method:    writeArchive
+ * FullName:  writeArchive
  * Access:    public 
- * @brief   Generates a table of frequencies in the form of an array of HuffNodes with symbol, 
- * frequency and left and right pointers, for use in Huffman Coding 
- * @param 	  file - name of input file to be compressed, used to get the frequency of each symbol
- * @param 	  uncompressed - location to save uncompressed size in bytes to
- * @return    the frequency table
+ * @brief   Writes a one member archive of a file: the header, the file's blocks from {@link compressMember}
+ *			and the index. Used by {@link compressFile} once the output is open, and by {@link checkDeterminism}
+ * @param 	  pipeline - pipeline with the file open for input and the archive open for output
+ * @param 	  file - name of the file, saved in the index entry
+ * @param 	  level - settings to compress with
+ * @param 	  flags - AR_FLAG_DEDUP to store repeated chunks once, AR_FLAG_DELTA to store differences from base, or 0
+ * @param 	  base - the opened base file with AR_FLAG_DELTA, otherwise NULL
+ * @return   return status of the function, either EXIT_SUCCESS or EXIT_FAILURE
  **/
-HuffNode** createFreqTable(char* file, int* uncompressed)
+int writeArchive( Pipeline *pipeline, char* file, const ARLevel *level, int flags, DeltaBase *base )
 {
-    int tableSize, i;
-    unsigned char symbol;
-    HuffNode** freqTable = NULL;
-    FILE* input = fopen(file, "r");
-    *uncompressed = 0;
-    /*Check file is valid and openable*/
-    if (input == NULL)
+    ARHeader header;
+    ARMember member;
+    ARContext context;
+    int status;
+
+    memset(&header, 0, sizeof(header));
+    header.arID = AR_ID;
+    strcpy(header.arText, "ARchiver file");
+    header.blockSize = level->blockSize;
+    header.flags = flags;
+    memset(&context, 0, sizeof(context));
+    context.level = level;
+    context.flags = flags;
+    if ( flags & AR_FLAG_DELTA)
     {
-        perror(file);
+        header.baseSize = base->size;
+        header.baseFingerprint[0] = base->fingerprint[0];
+        header.baseFingerprint[1] = base->fingerprint[1];
+        context.base = base;
     }
-    else
+    /*Block count and size are unknown until the input is read, so the header is written again with the index*/
+    writeHeader(pipeline->output, &header);
+
+    status = EXIT_SUCCESS;
+    if ( flags & AR_FLAG_DEDUP)
     {
-        tableSize = 256;
-        freqTable = (HuffNode**) malloc(tableSize * sizeof ( HuffNode*));
-		if ( freqTable == NULL)
-		{
-			printf("Could not allocate memory for freqTable\n");
-			return NULL;
-		}
-
-        for (i = 0; i < tableSize; i++)
-        {
-            freqTable[i] = (HuffNode*) malloc(sizeof (HuffNode));
-			if ( freqTable[i] == NULL)
-			{
-				printf("Could not allocate memory for freqTable[%d]\n", i);
-				return NULL;
-			}
-            freqTable[i]->freq = 0;
-            freqTable[i]->left = NULL;
-            freqTable[i]->right = NULL;
-        }
-
-        /*Go through file, add symbol each time a new one is found or otherwise increment frequency*/
-        while (!feof(input))
-        {
-            symbol = fgetc(input);
-            /**************************
-            CHECK FOR SYMBOL SIZE =2 OR 3
-             ***************************/
-            if (!feof(input))
-            {
-                *uncompressed += sizeof (symbol);
-                freqTable[(int) symbol]->freq++;
-                freqTable[(int) symbol]->symbol = symbol;
-            }
-        }
-        fclose(input);
+        status = initDedup(&context.dedup, level->blockSize, NULL, 0, 0);
+    }
+    if ( status == EXIT_SUCCESS)
+    {
+        status = compressMember(pipeline, file, &context, &member);
+    }
+    if ( status == EXIT_SUCCESS)
+    {
+        header.numBlocks = member.numBlocks;
+        header.uncompressedDataSize = member.uncompressedDataSize;
+        status = writeIndex(pipeline->output, &header, &member, 1, context.dedup.chunks, context.dedup.numChunks);
     }
-    return freqTable;
+    freeDedup(&context.dedup);
+    return status;
 }
 
 /**
- * Method:    sortPriority
- * FullName:  sortPriority
+ * Method:    checkDeterminism
+ * FullName:  checkDeterminism
  * Access:    public 
- * @brief   Sorts the frequency table into priority order, where lowest frequency = highest priority. Implemented as a heap, 
- * see {@link Heap.c}
- * @param 	  freqTable - table of HuffNodes with symbol, frequency and null left and right pointers
- * @param 	  numElements - number of unique symbols in the frequency table
- * @return    the priority queue in heap form
+ * @brief   Compresses a file with 1, 2, 3, 4 and 8 coder threads and one per CPU, each time to a temporary file,
+ *			and checks every archive is byte for byte the same as the first. Prints the size and CRC32C of each,
+ *			so the hashes can be compared with those of other machines. Levels that limit their threads, and
+ *			--max-memory, may run with fewer threads than asked for; the count used is printed
+ * @param 	  file - the name of the file to use
+ * @param 	  level - settings to compress with
+ * @return   EXIT_SUCCESS if every archive was the same, otherwise EXIT_FAILURE
  **/
-HuffNode** sortPriority(HuffNode** freqTable, int *numElements)
+int checkDeterminism( char* file, const ARLevel *level )
 {
-    int i, size;
-    HuffNode **pQ;
+    int threads[AR_DETERMINISM_RUNS] = { 1, 2, 3, 4, 8, 0 };
+    unsigned char *data, *first;
+    FILE *reference;
+    Pipeline pipeline;
+    long long size, firstSize;
+    unsigned int crc;
+    size_t got, gotFirst;
+    int i, same, status;
 
-    *numElements = 0;
-    for (i = 0; i < 256; i++)
+    data = (unsigned char*) arMalloc(2 * AR_DETERMINISM_BUFFER);
+    if ( data == NULL)
+    {
+        reportError("Could not allocate memory for comparison\n");
+        return EXIT_FAILURE;
+    }
+    first = data + AR_DETERMINISM_BUFFER;
+    reference = NULL;
+    firstSize = 0;
+    status = EXIT_SUCCESS;
+    for ( i = 0; i < AR_DETERMINISM_RUNS && status == EXIT_SUCCESS; i++)
     {
-        if (freqTable[i]->freq > 0)
+        setDefaultThreads(threads[i]);
+        pipeline.input = fopen(file, "rb");
+        if ( pipeline.input == NULL)
         {
-            (*numElements)++;
+            perror(file);
+            status = EXIT_FAILURE;
+            break;
         }
-    }
-
-    pQ = (HuffNode**) malloc(*numElements * sizeof (HuffNode*));
+        pipeline.output = tmpfile();
+        if ( pipeline.output == NULL)
+        {
+            perror("tmpfile");
+            fclose(pipeline.input);
+            status = EXIT_FAILURE;
+            break;
+        }
+        status = writeArchive(&pipeline, file, level, 0, NULL);
+        fclose(pipeline.input);
 
-    /*Partially sort using a heap, only removing from front so doesn't need to be
-     completely sorted*/
-    size = 0;
-    for (i = 0; i < 256; i++)
-    {
-        if (freqTable[i]->freq > 0)
+        /*Hash the archive, comparing it with the first one as it goes*/
+        fseeko(pipeline.output, 0, SEEK_END);
+        size = (long long) ftello(pipeline.output);
+        same = reference == NULL || size == firstSize;
+        crc = 0;
+        rewind(pipeline.output);
+        if ( reference != NULL)
+        {
+            rewind(reference);
+        }
+        while ( status == EXIT_SUCCESS && (got = fread(data, 1, AR_DETERMINISM_BUFFER, pipeline.output)) > 0)
+        {
+            crc = crc32c(crc, data, got);
+            if ( reference != NULL && same)
+            {
+                gotFirst = fread(first, 1, got, reference);
+                same = gotFirst == got && memcmp(data, first, got) == 0;
+            }
+        }
+        if ( status == EXIT_SUCCESS)
+        {
+            printf("%d threads: %lld bytes, crc32c %08x%s\n", levelThreads(level), size, crc,
+                   same ? "" : ", DIFFERENT from the first archive");
+            if ( !same)
+            {
+                status = EXIT_FAILURE;
+            }
+        }
+        if ( reference == NULL)
         {
-            insert(pQ, &size, freqTable[i]);
+            reference = pipeline.output;
+            firstSize = size;
         }
         else
         {
-            /*Free unused elements*/
-            free(freqTable[i]);
-            freqTable[i] = NULL;
+            fclose(pipeline.output);
         }
     }
-    free(freqTable);
+    setDefaultThreads(0);
+    if ( reference != NULL)
+    {
+        fclose(reference);
+    }
+    arFree(data);
 
-    return pQ;
+    if ( status == EXIT_SUCCESS)
+    {
+        printf("Output is the same with every thread count\n");
+    }
+    return status;
 }
 
 /**
- * Method:    encode
- * FullName:  encode
+ * Method:    appendFile
+ * FullName:  appendFile
  * Access:    public 
- * @brief   Reads in the symbols from the file and converts them to the compressed version,
- * saving them in a table along with the compressed size.
- * If compressed size exceeds (uncompressedSize - headerSize - treeSize), then
- * compression should not be done.
- * @param 	  inputName - name of the input file to get encoded form for each character
- * @param 	  codeTable - array of the codes corresponding to each symbol
- * @param 	  compressedSize - address to save compressed size of symbols to
- * @param 	  uncompressedSize - the size of the original data
- * @return    the compressed table of blocks of 8 chars (e.g. 10110101)
+ * @brief   Adds a file to the end of an existing block archive without touching its other members. The new
+ *			blocks are written over the old index, then the index is written again after them with the new
+ *			member added. If anything fails, the old index is put back so the archive is unchanged.
+ *			In a deduplicated archive, chunks already stored by earlier members are not stored again
+ * @param 	  archive - name of the .ar file to add to
+ * @param 	  file - name of the file to add
+ * @param 	  level - settings to compress the file with. The archive's own block size is always used
+ * @return   return status of the function, either EXIT_SUCCESS or EXIT_FAILURE
  **/
-char** encode(char *inputName, char *codeTable[], int *compressedSize, int uncompressedSize)
+int appendFile( char* archive, char* file, const ARLevel *level )
 {
-    /*Create space for the compressed code
-     Size will be a multiple of 8, as 8 bits = 1 byte, minimum size that can
-     be simply written to a file*/
-
-    int numBits, byte, i, j;
-    char ch, *code, **compressed;
-    FILE* input = fopen(inputName, "r");
-
-    /*TODO: Work out size to malloc*/
-    compressed = (char**) malloc(uncompressedSize * sizeof (char*));
-	if ( compressed == NULL)
-	{
-		printf("Could not allocate memory for compressed\n");
-		return NULL;
-	}
-    for ( j = 0; j < uncompressedSize; j++)
-    {
-        compressed[j] = (char*) malloc( 9);
-		if ( compressed[j] == NULL)
-		{
-			printf("Could not allocate memory for compressed[%d]\n", j);
-			return NULL;
-		}
-    }
-
-
-    if (input != NULL)
-    {
-        *compressedSize = 0;
-        byte = 0;
-        numBits = 0;
-        i = 0;
-        ch = fgetc(input);
-        code = codeTable[(int)ch];
-        while (!feof(input) && byte < uncompressedSize)
-        {
-            if (!feof(input))
-            {
-                /*Build buffer until 8 bits or all parts of code is used*/
-                /*Byte determines which block of 8 bits, numBits which individual bit*/
-                while (numBits < 8 && i < (int)strlen(code))
-                {
-                    compressed[byte][numBits++] = code[i++];
-                }
-				
-                /*Filled up single byte, move to next byte*/
-                if (numBits == 8)
-                {
-                    compressed[byte][numBits] = '\0';
-					*compressedSize += 8;
-                    numBits = 0;
-                    byte++;
-                }
+    ARHeader header, oldHeader;
+    ARMember *members;
+    ARChunk *chunks;
+    ARLevel appendLevel;
+    ARContext context;
+    Pipeline pipeline;
+    int status;
 
-                /*Get next character from input file*/
-                if (i >= (int)strlen(code))
-                {
-                    ch = fgetc(input);
-                    if (!feof(input))
-                    {
-                        code = codeTable[(int)ch];
-                        i = 0;
-                    }
-                }
-            }
+    pipeline.input = fopen(file, "rb");
+    if ( pipeline.input == NULL)
+    {
+        perror(file);
+        return EXIT_FAILURE;
+    }
+    pipeline.output = fopen(archive, "r+b");
+    if ( pipeline.output == NULL)
+    {
+        perror(archive);
+        fclose(pipeline.input);
+        return EXIT_FAILURE;
+    }
+
+    status = EXIT_FAILURE;
+    members = NULL;
+    chunks = NULL;
+    memset(&context, 0, sizeof(context));
+    if ( readHeader(pipeline.output, &header) != EXIT_SUCCESS)
+    {
+        /*readHeader has said why*/
+    }
+    else if ( header.flags & AR_FLAG_ADAPTIVE)
+    {
+        reportError("Cannot add to a single pass stream archive\n");
+    }
+    else if ( header.flags & AR_FLAG_DELTA)
+    {
+        reportError("Cannot add to an archive of differences from a base file\n");
+    }
+    else if ( header.flags & AR_FLAG_STREAMED)
+    {
+        reportError("Cannot add to a streamed archive, it has no index\n");
+    }
+    else if ( (members = readIndex(pipeline.output, &header)) != NULL &&
+              (!(header.flags & AR_FLAG_DEDUP) || (chunks = readChunkTable(pipeline.output, &header)) != NULL))
+    {
+        oldHeader = header;
+        /*New blocks have to fit the buffers the archive is decompressed with*/
+        appendLevel = *level;
+        appendLevel.blockSize = header.blockSize;
+        context.level = &appendLevel;
+        context.flags = header.flags;
+
+        if ( (!(header.flags & AR_FLAG_DEDUP) ||
+              initDedup(&context.dedup, header.blockSize, chunks, header.numChunks, header.uncompressedDataSize) == EXIT_SUCCESS) &&
+             fseeko(pipeline.output, (off_t) header.indexOffset, SEEK_SET) == 0)
+        {
+            status = compressMember(&pipeline, file, &context, &members[header.numMembers]);
         }
-        if (numBits < 8)
+        if ( status == EXIT_SUCCESS)
         {
-            /*Exclude padding from count of total bits*/
-            *compressedSize += numBits;
-            /*Write final buffer with padding to file*/
-            for (numBits = numBits; numBits < 8; numBits++)
-            {
-                compressed[byte][numBits] = '0';
-            }
+            header.numBlocks += members[header.numMembers].numBlocks;
+            header.uncompressedDataSize += members[header.numMembers].uncompressedDataSize;
+            status = writeIndex(pipeline.output, &header, members, header.numMembers + 1,
+                                context.dedup.chunks, context.dedup.numChunks);
         }
-        fclose(input);
-
-        if ( byte >= uncompressedSize)
+        if ( status != EXIT_SUCCESS)
         {
-            *compressedSize = 0;
-            compressed = NULL;
+            /*Restore the old index where the old header expects it, and drop any new blocks*/
+            fseeko(pipeline.output, (off_t) oldHeader.indexOffset, SEEK_SET);
+            writeIndex(pipeline.output, &oldHeader, members, oldHeader.numMembers, chunks, oldHeader.numChunks);
+            ftruncate(fileno(pipeline.output), (off_t) (oldHeader.indexOffset + oldHeader.numMembers * (long long) AR_MEMBER_SIZE +
+                                                         oldHeader.numChunks * (long long) AR_CHUNK_SIZE));
         }
     }
+    freeDedup(&context.dedup);
+    arFree(chunks);
+    arFree(members);
+
+    fclose(pipeline.input);
+    if ( fclose(pipeline.output) != 0)
+    {
+        perror(archive);
+        status = EXIT_FAILURE;
+    }
 
-    return compressed;
+    if ( status == EXIT_SUCCESS)
+    {
+        printf("Done\n");
+    }
+    return status;
 }
 
 /**
- * Method:    writeARFile
- * FullName:  writeARFile
+ * Method:    compressFiles
+ * FullName:  compressFiles
  * Access:    public 
- * @brief   Writes the header, tree and compressed data to a new .ar file
- * @param 	  header - struct containing size of tree, compressed and uncompressed data, as well as id and description
- * @param 	  tree - the created Huffman tree in a serialized form
- * @param 	  treeSize - size in bytes of the serialized tree
- * @param 	  compressed - the compressed data to write to the file
- * @param 	  compressedDataSize - size of compressed data
+ * @brief   Compresses many files into one archive, one member each. The files are read ahead together by
+ *			{@link openBatch} and all go through a single {@link runPipeline} pipeline, so small files don't each
+ *			wait for their own open and read, or start their own threads. A block never holds data from two files
+ * @param 	  files - names of the files
+ * @param 	  numFiles - number of files, at least 1
+ * @param 	  level - settings to compress with
+ * @return   return status of the function, either EXIT_SUCCESS or EXIT_FAILURE
  **/
-void writeARFile( ARHeader *header, char *tree, int treeSize, char **compressed, int compressedDataSize)
+int compressFiles( char** files, int numFiles, const ARLevel *level )
 {
-    int i, j;
-    char file[101];
-	unsigned char result;
-    FILE* output;
+    char name[101];
+    ARHeader header;
+    ARMember *members;
+    ARContext context;
+    Batch batch;
+    Pipeline pipeline;
+    int status, i;
+
+    if ( numFiles >= AR_MAX_MEMBERS)
+    {
+        reportError("Too many files, at most %d can be archived at once\n", AR_MAX_MEMBERS - 1);
+        return EXIT_FAILURE;
+    }
+    members = (ARMember*) arCalloc(numFiles, sizeof(ARMember));
+    if ( members == NULL)
+    {
+        reportError("Could not allocate memory for index\n");
+        return EXIT_FAILURE;
+    }
 
     printf("Enter name of output file.\n");
-    scanf("%97s", file);
-    strcat(file, ".ar");
-    output = fopen(file, "wb");
+    if ( scanf("%97s", name) != 1)
+    {
+        reportError("No output file name given\n");
+        arFree(members);
+        return EXIT_FAILURE;
+    }
+    strcat(name, ".ar");
+    pipeline.output = fopen(name, "wb");
+    if ( pipeline.output == NULL)
+    {
+        perror(name);
+        arFree(members);
+        return EXIT_FAILURE;
+    }
 
-    if ( output == NULL)
+    memset(&header, 0, sizeof(header));
+    header.arID = AR_ID;
+    strcpy(header.arText, "ARchiver file");
+    header.blockSize = level->blockSize;
+    writeHeader(pipeline.output, &header);
+    for ( i = 0; i < numFiles; i++)
     {
-        perror( file);
+        strncpy(members[i].name, files[i], AR_MEMBER_NAME_SIZE - 1);
+        members[i].level = level->level;
     }
-    else
+    members[0].offset = AR_HEADER_SIZE;
+
+    memset(&context, 0, sizeof(context));
+    context.level = level;
+    context.batch = &batch;
+    context.batchMembers = members;
+    pipeline.input = NULL;
+    pipeline.context = &context;
+    pipeline.reader = &readBatchBlock;
+    pipeline.coder = &compressBlock;
+    pipeline.writer = &writeBatchFile;
+    pipeline.numThreads = levelThreads(level);
+    pipeline.inputCapacity = level->blockSize;
+    pipeline.outputCapacity = level->blockSize + AR_MAX_TREE_SIZE;
+    pipeline.sideCapacity = 0;
+
+    status = openBatch(&batch, files, numFiles);
+    if ( status == EXIT_SUCCESS)
     {
-        fwrite(header, sizeof(*header), 1, output);
-		/*Write each 8 bits of compressed data*/
-		for ( i = 0; i < treeSize; i++)
-		{
-			if ( tree[i] == '0')
-			{
-				result |= 0 << (7 - j);
-			}
-			else
-			{
-				result |= 1 << (7 - j);
-				
-			}
-			result = 0;
-			for (j = 0; j < 8; j++)
-			{
-				result |= (compressed[i][j] == '1') << (7 - j);
-			}
-			fwrite( &result, 1, 1, output);
-		}
-		fwrite(tree, treeSize, 1, output);
-        /*Round size to nearest multiple of 8, to get actual size with padding*/
-        while ( compressedDataSize % 8 != 0)
-        {
-            compressedDataSize++;
-        }
-        compressedDataSize /= 8;
-        /*Write each 8 bits of compressed data*/
-        for ( i = 0; i < compressedDataSize; i++)
-        {
-            result = 0;
-			for (j = 0; j < 8; j++)
-            {
-                result |= (compressed[i][j] == '1') << (7 - j);
-            }
-            fwrite( &result, 1, 1, output);
+        status = runPipeline(&pipeline);
+        closeBatch(&batch);
+    }
+    if ( status == EXIT_SUCCESS)
+    {
+        /*Empty files at the end have no blocks to move the writer on to them*/
+        finishBatchMembers(&context, numFiles - 1, pipeline.output);
+        for ( i = 0; i < numFiles; i++)
+        {
+            header.numBlocks += members[i].numBlocks;
+            header.uncompressedDataSize += members[i].uncompressedDataSize;
         }
-        fclose(output);
+        status = writeIndex(pipeline.output, &header, members, numFiles, NULL, 0);
+    }
+    arFree(members);
+    if ( fclose(pipeline.output) != 0)
+    {
+        perror(name);
+        status = EXIT_FAILURE;
+    }
+
+    if ( status == EXIT_SUCCESS)
+    {
+        printf("Done\n");
     }
+    return status;
 }
 
 /**
- * Method:    toBinary
- * FullName:  toBinary
+ * Method:    compressMember
+ * FullName:  compressMember
  * Access:    public 
- * @brief   Converts an array of compressed characters into their 'compressed binary' form, just using 0 and 1,
- *				as the compressed file must be read in bytes, and so the read data will consist of random symbols corresponding
- *				to the actual bits written
- * @param 	  compressed - array of characters in 'compressed' form from the .ar file
- * @param 	  sizeBits - size in bits of the compressed array
- * @return    array of characters which are either '1' or '0', to be decoded
+ * @brief   Compresses one file into blocks at the current position of the archive, and fills in its index entry.
+ *			With AR_FLAG_DEDUP the reader stage splits the input into chunks, so the coders only see new data
+ * @param 	  pipeline - pipeline with the file open for input and the archive open for output
+ * @param 	  file - name of the file, saved in the index entry
+ * @param 	  context - level to compress with, and the chunk table if deduplicating
+ * @param 	  member - index entry to fill in
+ * @return   return status of the function, either EXIT_SUCCESS or EXIT_FAILURE
  **/
-char* toBinary( char* compressed, int sizeBits)
+int compressMember( Pipeline *pipeline, char* file, ARContext *context, ARMember *member )
 {
-    int i, j, k, sizeBytes;
-    unsigned char ch;
-	char *binary;
-	/*binary will need to be mallocd size as a multiple of 8, sizeBits doesn't include padding*/
-	/*int division to get nearest multiple of 8*/
-	sizeBytes = ( sizeBits + 7)/8;
-    binary = (char*) malloc( sizeBytes * 8);/*Size????*/
-	if ( binary == NULL)
-	{
-		printf("Could not allocate memory for binary\n");
-		return NULL;
-	}
-    k = 0;
-    for ( i = 0; i < sizeBytes; i++)
-    {
-        ch = compressed[i];
-        for( j = 0; j < 8; j++)
-        {
-            if ( ((ch >> (7 - j)) & 1) == 0)
-            {
-                binary[k++] = '0';
-            }
-            else
-            {
-                binary[k++] = '1';
-            }
+    const ARLevel *level = context->level;
+    long long start;
+    int status;
+
+    memset(member, 0, sizeof(*member));
+    strncpy(member->name, file, AR_MEMBER_NAME_SIZE - 1);
+    member->level = level->level;
+    member->offset = (long long) ftello(pipeline->output);
+    start = context->dedup.position;
+    context->checksum = 0;
+    context->dedup.checksum = 0;
+
+    pipeline->context = context;
+    pipeline->reader = &readBlock;
+    pipeline->coder = &compressBlock;
+    pipeline->writer = &writeARFile;
+    pipeline->numThreads = levelThreads(level);
+    pipeline->inputCapacity = level->blockSize;
+    /*Compressed blocks larger than the input are stored instead, so this is never exceeded*/
+    pipeline->outputCapacity = level->blockSize + AR_MAX_TREE_SIZE;
+    pipeline->sideCapacity = 0;
+    context->refs = NULL;
+    if ( context->flags & AR_FLAG_DEDUP)
+    {
+        pipeline->reader = &readDedupBlock;
+        pipeline->sideCapacity = 4 + AR_DEDUP_MAX_REFS(level->blockSize) * AR_CHUNK_REF_SIZE;
+        context->refs = (ARChunkRef*) arMalloc(AR_DEDUP_MAX_REFS(level->blockSize) * sizeof(ARChunkRef));
+        if ( context->refs == NULL)
+        {
+            reportError("Could not allocate memory for chunk list\n");
+            return EXIT_FAILURE;
         }
     }
+    status = runPipeline(pipeline);
+    arFree(context->refs);
+    context->refs = NULL;
 
-    return binary;
+    member->numBlocks = (int) pipeline->numBlocks;
+    member->uncompressedDataSize = (context->flags & AR_FLAG_DEDUP) ? context->dedup.position - start : (long long) pipeline->bytesRead;
+    /*A deduplicated block only holds its new chunks, so the chunker checksums everything it splits instead*/
+    member->checksum = (context->flags & AR_FLAG_DEDUP) ? context->dedup.checksum : context->checksum;
+    return status;
 }
 
 /**
- * Method:    writeFile
- * FullName:  writeFile
+ * Method:    compressStream
+ * FullName:  compressStream
  * Access:    public 
- * @brief   Writes the decompressed data to a new file, i.e., original data
- * @param 	  uncompressed - decompressed data in array
- * @param 	  size - size of decompressed data
+ * @brief   Compresses a source that can only be read once, such as a pipe, socket or FIFO, using single pass
+ *			adaptive Huffman coding (see {@link adaptiveCompress}). Output is written as soon as input arrives.
+ *			The name - reads from stdin and writes to stdout without prompting
+ * @param 	  file - the name of the stream to compress, or -
+ * @return   return status of the function, either EXIT_SUCCESS or EXIT_FAILURE
  **/
-void writeFile( char* uncompressed, int size)
+int compressStream( char* file )
 {
-    int i;
-    char file[101];
-    FILE* output;
+    char name[101];
+    ARHeader header;
+    FILE *input, *output;
+    long size;
+    int status;
+
+    if ( strcmp(file, "-") == 0)
+    {
+        input = stdin;
+        output = stdout;
+    }
+    else
+    {
+        input = fopen(file, "rb");
+        if ( input == NULL)
+        {
+            perror(file);
+            return EXIT_FAILURE;
+        }
+
+        printf("Enter name of output file.\n");
+        if ( scanf("%97s", name) != 1)
+        {
+            reportError("No output file name given\n");
+            fclose(input);
+            return EXIT_FAILURE;
+        }
+        strcat(name, ".ar");
+        output = fopen(name, "wb");
+        if ( output == NULL)
+        {
+            perror(name);
+            fclose(input);
+            return EXIT_FAILURE;
+        }
+    }
+    /*Input is read directly so nothing waits in a stdio buffer*/
+    setvbuf(input, NULL, _IONBF, 0);
 
-    printf("Enter output file name\n");
-    scanf("%99s", file);
-    output = fopen(file,"w");
+    memset(&header, 0, sizeof(header));
+    header.arID = AR_ID;
+    strcpy(header.arText, "ARchiver file");
+    header.flags = AR_FLAG_ADAPTIVE;
+    writeHeader(output, &header);
 
+    status = adaptiveCompress(input, output, &size);
+
+    /*Size is only informational, so leave it as 0 if the output can't seek*/
+    if ( status == EXIT_SUCCESS && fseek(output, 0, SEEK_SET) == 0)
+    {
+        header.uncompressedDataSize = (long long) size;
+        writeHeader(output, &header);
+    }
+    if ( fflush(output) != 0)
+    {
+        perror("Could not write output");
+        status = EXIT_FAILURE;
+    }
 
-    if ( output != NULL)
+    if ( input != stdin)
     {
-        for ( i = 0; i < size; i++)
+        fclose(input);
+        fclose(output);
+        if ( status == EXIT_SUCCESS)
         {
-            fputc( uncompressed[i], output);
+            printf("Done\n");
         }
-        fclose(output);
     }
+    return status;
+}
+
+/**
+ * Method:    decompressFile
+ * FullName:  decompressFile
+ * Access:    public 
+ * @brief   Decompresses a given .ar file, to create original file. Blocks are decoded by a
+ *			{@link runPipeline} pipeline, so only a few blocks are held in memory at once. An archive of many
+ *			files, made with -a or -m, is extracted into a directory with each file under its own name. Read
+ *			from stdin it has no index, so its members are written one after another.
+ *			When the output is a regular file and the header gives its size, the file is allocated at that size and
+ *			mapped, and each block is decoded straight into its place by {@link mapOutput}. If anything fails,
+ *			the output file, or the files extracted so far, are removed so nothing half written is left
+ * @param 	  file name of compressed file with .ar extension
+ * @param 	  baseFile name of the base file the archive was made against with --base, otherwise NULL
+ * @return   return status of function, EXIT_SUCCESS or EXIT_FAILURE
+ **/
+int decompressFile( char* file, char* baseFile, int verify )
+{
+    char name[101], path[AR_MEMBER_PATH_SIZE];
+    long size;
+    long long total, start, archiveSize;
+    int first, tiny;
+    struct stat info;
+    ARHeader header;
+    ARMember *members;
+    ARContext context;
+    DeltaBase base;
+    Pipeline pipeline;
+    int status, useStdio, extract, ready, created, named, i;
+
+    created = 0;
+    useStdio = strcmp(file, "-") == 0;
+    pipeline.input = useStdio ? stdin : fopen(file, "rb");
+    if ( pipeline.input == NULL)
+    {
+        perror(file);
+        return EXIT_FAILURE;
+    }
+    /*An adaptive stream is read directly after the header, so nothing may be left in a stdio buffer*/
+    setvbuf(pipeline.input, NULL, _IONBF, 0);
+
+    status = EXIT_FAILURE;
+    members = NULL;
+    memset(&base, 0, sizeof(base));
+    memset(&header, 0, sizeof(header));
+    /*A compact frame from a small input starts with a tag byte instead of the header*/
+    first = getc(pipeline.input);
+    tiny = isTinyTag(first);
+    if ( first != EOF)
+    {
+        ungetc(first, pipeline.input);
+    }
+    /*Bounds the number of blocks, -1 when reading from a pipe*/
+    archiveSize = fstat(fileno(pipeline.input), &info) == 0 && S_ISREG(info.st_mode) ? (long long) info.st_size : -1;
+    if ( !tiny && readHeader(pipeline.input, &header) != EXIT_SUCCESS)
+    {
+        /*readHeader has said why*/
+    }
+    else if ( !tiny && !(header.flags & AR_FLAG_ADAPTIVE) &&
+              (header.blockSize <= 0 || header.blockSize > AR_MAX_BLOCK_SIZE || header.numBlocks < 0))
+    {
+        reportError("Not a valid .ar file, bad block size %d\n", header.blockSize);
+    }
+    else if ( !tiny && checkArchiveSizes(&header, archiveSize) != EXIT_SUCCESS)
+    {
+        /*checkArchiveSizes has said why*/
+    }
+    else if ( (header.flags & AR_FLAG_DELTA) && baseFile == NULL)
+    {
+        reportError("Archive holds differences from a base file, use --base with the same file to decompress it\n");
+    }
+    else if ( (header.flags & AR_FLAG_DELTA) && openBase(&base, baseFile, 0) != EXIT_SUCCESS)
+    {
+        /*openBase has said why*/
+    }
+    else if ( (header.flags & AR_FLAG_DELTA) &&
+              (base.size != header.baseSize || base.fingerprint[0] != header.baseFingerprint[0] ||
+               base.fingerprint[1] != header.baseFingerprint[1]))
+    {
+        reportError("%s is not the base file the archive was made from\n", baseFile);
+    }
+    else if ( (header.flags & AR_FLAG_DEDUP) && useStdio && !verify)
+    {
+        reportError("Repeated chunks are read back from the output, so a deduplicated archive must be decompressed to a file\n");
+    }
+    /*The index is after the blocks, so member checksums can only be checked when the archive can seek*/
+    else if ( !useStdio && !(header.flags & AR_FLAG_ADAPTIVE) && header.indexOffset > 0 &&
+              ((members = readIndex(pipeline.input, &header)) == NULL ||
+               fseeko(pipeline.input, (off_t) AR_HEADER_SIZE, SEEK_SET) != 0))
+    {
+        /*readIndex has said why*/
+    }
+    else
+    {
+        /*An archive of many files is extracted to one file each, which needs the index to know where they start*/
+        extract = !verify && !useStdio && members != NULL && header.numMembers > 1;
+        ready = 1;
+        named = 1;
+        pipeline.output = NULL;
+        if ( verify)
+        {
+            /*Repeated chunks still have to be read back, so a deduplicated archive is decoded to a temporary file*/
+            strcpy(name, "verify output");
+            pipeline.output = (header.flags & AR_FLAG_DEDUP) ? tmpfile() : fopen("/dev/null", "wb");
+        }
+        else if ( useStdio)
+        {
+            pipeline.output = stdout;
+        }
+        else if ( extract)
+        {
+            printf("Enter name of directory to extract the %d files to\n", header.numMembers);
+            named = scanf("%99s", name) == 1;
+            created = named && mkdir(name, 0777) == 0;
+            ready = created || (named && errno == EEXIST);
+        }
+        else
+        {
+            printf("Enter output file name\n");
+            named = scanf("%99s", name) == 1;
+            /*Opened for reading too, so repeated chunks can be read back and the file can be mapped*/
+            pipeline.output = named ? fopen(name, "w+b") : NULL;
+        }
+        if ( !named)
+        {
+            reportError("No output %s name given\n", extract ? "directory" : "file");
+        }
+        else if ( extract ? !ready : pipeline.output == NULL)
+        {
+            perror(name);
+        }
+        else if ( tiny)
+        {
+            status = decompressTiny(pipeline.input, pipeline.output);
+        }
+        else if ( header.flags & AR_FLAG_ADAPTIVE)
+        {
+            status = adaptiveDecompress(pipeline.input, pipeline.output, &size);
+        }
+        else
+        {
+            memset(&context, 0, sizeof(context));
+            context.flags = header.flags;
+            context.remaining = (header.flags & AR_FLAG_STREAMED) ? -1 : header.numBlocks;
+            context.base = (header.flags & AR_FLAG_DELTA) ? &base : NULL;
+            pipeline.context = &context;
+            pipeline.reader = &readARBlock;
+            pipeline.coder = &decompressBlock;
+            pipeline.writer = &writeFile;
+            pipeline.numThreads = budgetThreads(NULL, header.blockSize, defaultThreads());
+            pipeline.inputCapacity = header.blockSize + AR_MAX_TREE_SIZE;
+            pipeline.sideCapacity = 0;
+            context.blockSize = header.blockSize;
+            context.directory = extract ? name : NULL;
+            context.outputFd = extract ? -1 : fileno(pipeline.output);
+            /*Blocks of a file whose size is known are decoded into the mapped file, so the writer has nothing to copy*/
+            if ( !verify && !useStdio && !extract && !(header.flags & (AR_FLAG_DEDUP | AR_FLAG_STREAMED)) && header.uncompressedDataSize > 0 &&
+                 header.uncompressedDataSize <= header.numBlocks * (long long) header.blockSize)
+            {
+                context.map = mapOutput(pipeline.output, header.uncompressedDataSize);
+                context.mapSize = header.uncompressedDataSize;
+            }
+            pipeline.outputCapacity = context.map != NULL ? 0 : header.blockSize;
+            status = EXIT_SUCCESS;
+            if ( members != NULL)
+            {
+                context.starts = (long long*) arMalloc((header.numMembers + 1) * sizeof(long long));
+                context.renamed = extract ? findRenamed(members, header.numMembers) : NULL;
+                total = 0;
+                start = 0;
+                for ( i = 0; context.starts != NULL && i < header.numMembers; i++)
+                {
+                    context.starts[i] = start;
+                    /*Checked one at a time so a corrupt entry can't overflow the sums*/
+                    if ( members[i].numBlocks < 0 || members[i].uncompressedDataSize < 0 ||
+                         members[i].uncompressedDataSize > header.uncompressedDataSize - start)
+                    {
+                        start = -1;
+                        break;
+                    }
+                    total += members[i].numBlocks;
+                    start += members[i].uncompressedDataSize;
+                }
+                if ( context.starts == NULL || (extract && context.renamed == NULL))
+                {
+                    reportError("Could not allocate memory for index\n");
+                    status = EXIT_FAILURE;
+                }
+                else if ( total != header.numBlocks || start != header.uncompressedDataSize)
+                {
+                    reportError("Not a valid .ar file, index does not match the blocks\n");
+                    status = EXIT_FAILURE;
+                }
+                else
+                {
+                    context.starts[header.numMembers] = start;
+                }
+                context.members = members;
+                context.numMembers = header.numMembers;
+                context.blocksLeft = header.numMembers > 0 ? members[0].numBlocks : 0;
+                if ( status == EXIT_SUCCESS && extract)
+                {
+                    status = extractMember(&context);
+                }
+                if ( status == EXIT_SUCCESS)
+                {
+                    status = checkMembers(&context);
+                }
+            }
+            if ( header.flags & AR_FLAG_DEDUP)
+            {
+                pipeline.sideCapacity = 4 + AR_DEDUP_MAX_REFS(header.blockSize) * AR_CHUNK_REF_SIZE;
+                context.chunk = (unsigned char*) arMalloc(AR_CDC_MAX_CHUNK);
+                if ( context.chunk == NULL)
+                {
+                    reportError("Could not allocate memory for chunk buffer\n");
+                    status = EXIT_FAILURE;
+                }
+            }
+            if ( status == EXIT_SUCCESS)
+            {
+                status = runPipeline(&pipeline);
+            }
+            arFree(context.chunk);
+            arFree(context.starts);
+            /*Only still open if extracting stopped part way through a member*/
+            if ( extract && context.outputFd >= 0)
+            {
+                close(context.outputFd);
+            }
+
+            if ( status == EXIT_SUCCESS && (header.flags & AR_FLAG_STREAMED) && context.checksum != context.endChecksum)
+            {
+                reportError("Archive is corrupt, data does not match its checksum\n");
+                status = EXIT_FAILURE;
+            }
+            else if ( status == EXIT_SUCCESS && !(header.flags & AR_FLAG_STREAMED) && pipeline.numBlocks != header.numBlocks)
+            {
+                reportError("Archive is truncated, expected %lld blocks but found %ld\n", header.numBlocks, pipeline.numBlocks);
+                status = EXIT_FAILURE;
+            }
+            /*Checked however the output was written, mapped, written in turn, extracted, verified or to stdout*/
+            else if ( status == EXIT_SUCCESS && !(header.flags & AR_FLAG_STREAMED) && context.written != header.uncompressedDataSize)
+            {
+                reportError("Not a valid .ar file, blocks do not add up to the size in the header\n");
+                status = EXIT_FAILURE;
+            }
+            if ( context.map != NULL && munmap(context.map, (size_t) context.mapSize) != 0)
+            {
+                perror(name);
+                status = EXIT_FAILURE;
+            }
+            /*Files extracted before the failure are removed, and the directory too if it was made for them*/
+            for ( i = 0; status != EXIT_SUCCESS && i < context.extracted; i++)
+            {
+                memberPath(&context, i, path);
+                unlink(path);
+            }
+            if ( status != EXIT_SUCCESS && created)
+            {
+                rmdir(name);
+            }
+            arFree(context.renamed);
+        }
+
+        if ( pipeline.output != NULL && !(useStdio && !verify) && fclose(pipeline.output) != 0)
+        {
+            perror(name);
+            status = EXIT_FAILURE;
+        }
+        /*A half written file could be taken for the real one, so it is removed*/
+        if ( status != EXIT_SUCCESS && pipeline.output != NULL && !verify && !useStdio)
+        {
+            unlink(name);
+        }
+        if ( verify && status == EXIT_SUCCESS)
+        {
+            printf("%s: OK\n", file);
+        }
+    }
+    arFree(members);
+    closeBase(&base);
+    if ( !useStdio)
+    {
+        fclose(pipeline.input);
+    }
+
+    return status;
+}
+
+/**
+ * Method:    decompressTiny
+ * FullName:  decompressTiny
+ * Access:    public 
+ * @brief   Decompresses a compact frame, which {@link ar_compress} writes for small inputs. The frame has no
+ *			header saying how long it is, so it is the rest of the file
+ * @param 	  input - archive positioned at its tag byte
+ * @param 	  output - file to write the data to
+ * @return   EXIT_SUCCESS, or EXIT_FAILURE if the frame is corrupt or the data could not be written
+ **/
+int decompressTiny( FILE *input, FILE *output)
+{
+    unsigned char frame[AR_TINY_FRAME_MAX + 1], data[AR_TINY_MAX];
+    size_t frameSize;
+    int size;
+
+    frameSize = fread(frame, 1, sizeof(frame), input);
+    size = tinySize(frame, frameSize);
+    if ( frameSize > AR_TINY_FRAME_MAX || size < 0)
+    {
+        reportError("Not a valid .ar file, bad compact frame\n");
+        return EXIT_FAILURE;
+    }
+    if ( tinyDecompress(frame, frameSize, data, size) != EXIT_SUCCESS)
+    {
+        /*tinyDecompress has said why*/
+        return EXIT_FAILURE;
+    }
+    if ( fwrite(data, 1, size, output) != (size_t) size)
+    {
+        perror("Could not write output");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    readBlock
+ * FullName:  readBlock
+ * Access:    public 
+ * @brief   Reader stage for compression, fills a block with the next part of the input file
+ * @param 	  pipeline - pipeline with the input file open
+ * @param 	  block - block to fill, inputSize is left as 0 at end of file
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the file could not be read
+ **/
+int readBlock( Pipeline *pipeline, Block *block)
+{
+    block->inputSize = (int) fread(block->input, 1, block->inputCapacity, pipeline->input);
+    if ( ferror(pipeline->input))
+    {
+        perror("Could not read input");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    readDedupBlock
+ * FullName:  readDedupBlock
+ * Access:    public 
+ * @brief   Reader stage for compression with AR_FLAG_DEDUP. Splits the next part of the input into chunks with
+ *			{@link dedupRead}, leaving only new chunks in block->input and the encoded list of all of them in block->side
+ * @param 	  pipeline - pipeline with the input file open, context points to the ARContext holding the chunk table
+ * @param 	  block - block to fill, inputSize and sideSize are left as 0 at end of file
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the file could not be read
+ **/
+int readDedupBlock( Pipeline *pipeline, Block *block)
+{
+    ARContext *context = (ARContext*) pipeline->context;
+    int numRefs, i;
+
+    if ( dedupRead(&context->dedup, pipeline->input, block->input, &block->inputSize, context->refs, &numRefs) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    if ( numRefs > 0)
+    {
+        /*The side buffer holds the chunk list as it is written to the file*/
+        putLE32(block->side, (unsigned int) numRefs);
+        for ( i = 0; i < numRefs; i++)
+        {
+            packChunkRef(&context->refs[i], block->side + 4 + i * AR_CHUNK_REF_SIZE);
+        }
+        block->sideSize = 4 + numRefs * AR_CHUNK_REF_SIZE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    readBatchBlock
+ * FullName:  readBatchBlock
+ * Access:    public 
+ * @brief   Reader stage for compression of many files, fills a block from the next file read ahead by the batch
+ *			and tags it with the file's position in the list
+ * @param 	  pipeline - pipeline whose context points to the ARContext holding the batch
+ * @param 	  block - block to fill, inputSize is left as 0 after the last file
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if a file could not be read
+ **/
+int readBatchBlock( Pipeline *pipeline, Block *block)
+{
+    ARContext *context = (ARContext*) pipeline->context;
+
+    return readBatch(context->batch, block->input, block->inputCapacity, &block->inputSize, &block->tag);
+}
+
+/**
+ * Method:    writeARFile
+ * FullName:  writeARFile
+ * Access:    public 
+ * @brief   Writer stage for compression, writes the block header, chunk list if there is one, tree and
+ *			compressed data to the .ar file. The block's checksum is joined onto the member's
+ * @param 	  pipeline - pipeline with the .ar file open for output
+ * @param 	  block - compressed block, with output holding the serialized tree and compressed data
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the block could not be written
+ **/
+int writeARFile( Pipeline *pipeline, Block *block)
+{
+    ARContext *context = (ARContext*) pipeline->context;
+    unsigned char header[AR_BLOCK_HEADER_SIZE];
+
+    packBlockHeader(&block->header, header);
+    /*Only deduplicated blocks have a chunk list, the side buffer of any other block is NULL*/
+    if ( fwrite(header, 1, AR_BLOCK_HEADER_SIZE, pipeline->output) != AR_BLOCK_HEADER_SIZE ||
+         (block->sideSize > 0 && fwrite(block->side, 1, block->sideSize, pipeline->output) != (size_t) block->sideSize) ||
+         fwrite(block->output, 1, block->outputSize, pipeline->output) != (size_t) block->outputSize)
+    {
+        perror("Could not write .ar file");
+        return EXIT_FAILURE;
+    }
+    context->checksum = crc32cCombine(context->checksum, block->header.checksum, block->header.uncompressedDataSize);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    writeBatchFile
+ * FullName:  writeBatchFile
+ * Access:    public 
+ * @brief   Writer stage for compression of many files. Writes the block as {@link writeARFile} does, and adds
+ *			it to the index entry of the file it is tagged with, closing the entries of any files before it
+ * @param 	  pipeline - pipeline with the .ar file open for output, context points to the ARContext with the index
+ * @param 	  block - compressed block, tagged by {@link readBatchBlock}
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the block could not be written
+ **/
+int writeBatchFile( Pipeline *pipeline, Block *block)
+{
+    ARContext *context = (ARContext*) pipeline->context;
+    ARMember *member;
+
+    finishBatchMembers(context, block->tag, pipeline->output);
+    if ( writeARFile(pipeline, block) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    member = &context->batchMembers[context->member];
+    member->numBlocks++;
+    member->uncompressedDataSize += block->header.uncompressedDataSize;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    finishBatchMembers
+ * FullName:  finishBatchMembers
+ * Access:    public 
+ * @brief   Closes index entries until the given one is being written. Each closed entry takes the checksum
+ *			of the blocks written for it, and the next one starts at the current end of the archive
+ * @param 	  context - context holding the index, with member the entry being written
+ * @param 	  member - entry to move on to
+ * @param 	  output - the .ar file
+ **/
+void finishBatchMembers( ARContext *context, int member, FILE *output)
+{
+    context->batchMembers[context->member].checksum = context->checksum;
+    while ( context->member < member)
+    {
+        context->member++;
+        context->batchMembers[context->member].offset = (long long) ftello(output);
+        context->batchMembers[context->member].checksum = 0;
+        context->checksum = 0;
+    }
+}
+
+/**
+ * Method:    readARBlock
+ * FullName:  readARBlock
+ * Access:    public 
+ * @brief   Reader stage for decompression, reads the next block header, chunk list if there is one, tree and compressed data.
+ *			With the output mapped, the block's output is pointed at its place in the file
+ * @param 	  pipeline - pipeline with the .ar file open, context points to the ARContext with the number of blocks left
+ * @param 	  block - block to fill, inputSize and sideSize are left as 0 once every block has been read
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the block is missing or its sizes are invalid
+ **/
+int readARBlock( Pipeline *pipeline, Block *block)
+{
+    ARContext *context = (ARContext*) pipeline->context;
+    ARBlockHeader *header = &block->header;
+    unsigned char data[AR_BLOCK_HEADER_SIZE];
+    ARChunkRef ref;
+    int size, numRefs, i;
+
+    if ( context->remaining == 0)
+    {
+        return EXIT_SUCCESS;
+    }
+    if ( fread(data, 1, AR_BLOCK_HEADER_SIZE, pipeline->input) != AR_BLOCK_HEADER_SIZE)
+    {
+        reportError("Archive is truncated, missing block header\n");
+        return EXIT_FAILURE;
+    }
+    unpackBlockHeader(data, header);
+    if ( header->method == AR_METHOD_END && (context->flags & AR_FLAG_STREAMED))
+    {
+        /*Leaving the block empty ends the pipeline*/
+        context->remaining = 0;
+        context->endChecksum = header->checksum;
+        return EXIT_SUCCESS;
+    }
+
+    if ( context->flags & AR_FLAG_DEDUP)
+    {
+        if ( fread(block->side, 1, 4, pipeline->input) != 4)
+        {
+            reportError("Archive is truncated, missing chunk list\n");
+            return EXIT_FAILURE;
+        }
+        numRefs = (int) getLE32(block->side);
+        if ( numRefs <= 0 || numRefs > (block->sideCapacity - 4) / AR_CHUNK_REF_SIZE ||
+             fread(block->side + 4, AR_CHUNK_REF_SIZE, numRefs, pipeline->input) != (size_t) numRefs)
+        {
+            reportError("Not a valid .ar file, bad chunk list\n");
+            return EXIT_FAILURE;
+        }
+        for ( i = 0; i < numRefs; i++)
+        {
+            unpackChunkRef(block->side + 4 + i * AR_CHUNK_REF_SIZE, &ref);
+            if ( ref.size <= 0 || ref.size > AR_CDC_MAX_CHUNK || ref.offset < -1)
+            {
+                reportError("Not a valid .ar file, bad chunk list\n");
+                return EXIT_FAILURE;
+            }
+        }
+        block->sideSize = 4 + numRefs * AR_CHUNK_REF_SIZE;
+    }
+
+    /*Sizes come from the file, so check them before trusting them*/
+    if ( checkBlockHeader(header, context->blockSize, context->base != NULL, block->sideSize > 0) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    size = header->huffTreeSize + (header->compressedDataSize + 7) / 8;
+    if ( fread(block->input, 1, size, pipeline->input) != (size_t) size)
+    {
+        reportError("Archive is truncated, missing block data\n");
+        return EXIT_FAILURE;
+    }
+    block->inputSize = size;
+    if ( context->map != NULL)
+    {
+        /*Blocks are read in order, so each one's place in the file follows the one before*/
+        if ( header->uncompressedDataSize > context->mapSize - context->mapped)
+        {
+            reportError("Not a valid .ar file, blocks add up to more than the size in the header\n");
+            return EXIT_FAILURE;
+        }
+        block->output = context->map + context->mapped;
+        block->outputCapacity = header->uncompressedDataSize;
+        context->mapped += header->uncompressedDataSize;
+    }
+    if ( context->remaining > 0)
+    {
+        context->remaining--;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    writeFile
+ * FullName:  writeFile
+ * Access:    public 
+ * @brief   Writer stage for decompression, writes a decompressed block to the new file, i.e., original data.
+ *			The whole block goes to the file descriptor in one call, with no copy through a stdio buffer, or
+ *			is already in place if the output is mapped. The block's checksum is joined onto its member's, so
+ *			the data is not read again
+ * @param 	  pipeline - pipeline with the output file open
+ * @param 	  block - decompressed block
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the block could not be written
+ **/
+int writeFile( Pipeline *pipeline, Block *block)
+{
+    ARContext *context = (ARContext*) pipeline->context;
+
+    if ( block->sideSize > 0)
+    {
+        return writeChunks(pipeline, block);
+    }
+
+    if ( context->map == NULL && writeAll(context->outputFd, block->output, block->outputSize) != EXIT_SUCCESS)
+    {
+        perror("Could not write output file");
+        return EXIT_FAILURE;
+    }
+    context->written += block->outputSize;
+    context->checksum = crc32cCombine(context->checksum, block->header.checksum, block->outputSize);
+    context->blocksLeft--;
+    return checkMembers(context);
+}
+
+/**
+ * Method:    writeAll
+ * FullName:  writeAll
+ * Access:    public 
+ * @brief   Writes a buffer to a file descriptor, continuing after short writes and interrupted calls
+ * @param 	  fd - file descriptor to write to
+ * @param 	  data - data to write
+ * @param 	  size - number of bytes to write
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE with errno set if the data could not be written
+ **/
+int writeAll( int fd, const unsigned char *data, size_t size)
+{
+    ssize_t written;
+
+    while ( size > 0)
+    {
+        written = write(fd, data, size);
+        if ( written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if ( written <= 0)
+        {
+            return EXIT_FAILURE;
+        }
+        data += written;
+        size -= (size_t) written;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    checkArchiveSizes
+ * FullName:  checkArchiveSizes
+ * Access:    public 
+ * @brief   Checks the block count and size in a header against each other and the archive, before either is
+ *			used to size the output. Every block has a header in the archive, and decodes to at most the block
+ *			size, or with a chunk list to every reference at the largest chunk size
+ * @param 	  header - header of a block archive, with a valid block size
+ * @param 	  archiveSize - bytes in the archive, or -1 if it is not a regular file
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if they can't be right
+ **/
+int checkArchiveSizes( const ARHeader *header, long long archiveSize)
+{
+    long long limit;
+
+    if ( header->flags & (AR_FLAG_ADAPTIVE | AR_FLAG_STREAMED))
+    {
+        return EXIT_SUCCESS;
+    }
+    limit = (header->flags & AR_FLAG_DEDUP) ? AR_DEDUP_MAX_REFS((long long) header->blockSize) * AR_CDC_MAX_CHUNK :
+            header->blockSize;
+    /*Divided rather than multiplied, so a huge count from a pipe can't overflow*/
+    if ( (archiveSize >= 0 && header->numBlocks > (archiveSize - AR_HEADER_SIZE) / AR_BLOCK_HEADER_SIZE) ||
+         header->uncompressedDataSize < 0 ||
+         header->numBlocks < header->uncompressedDataSize / limit + (header->uncompressedDataSize % limit != 0))
+    {
+        reportError("Not a valid .ar file, %lld blocks and %lld bytes do not fit in the archive\n", header->numBlocks,
+               header->uncompressedDataSize);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    mapOutput
+ * FullName:  mapOutput
+ * Access:    public 
+ * @brief   Allocates a new output file's space at its final size and maps it for writing, so coder threads can
+ *			decode blocks straight into it. The space is allocated rather than left sparse, so running out of
+ *			disk shows up here instead of as SIGBUS when a block is stored into the map
+ * @param 	  output - output file, open for reading and writing
+ * @param 	  size - size of the decompressed data
+ * @return    the mapped file, or NULL if it is not a regular file, the space could not be allocated or it could not
+ *			be mapped, and should be written instead
+ **/
+unsigned char* mapOutput( FILE *output, long long size)
+{
+    struct stat info;
+    void *map;
+    int fd = fileno(output);
+
+    if ( fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || (long long) (size_t) size != size)
+    {
+        return NULL;
+    }
+    map = posix_fallocate(fd, 0, (off_t) size) == 0 ?
+          mmap(NULL, (size_t) size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if ( map == MAP_FAILED)
+    {
+        /*Written normally from here, from the start of an empty file*/
+        if ( ftruncate(fd, 0) != 0)
+        {
+            perror("Could not write output file");
+        }
+        return NULL;
+    }
+    return (unsigned char*) map;
+}
+
+/**
+ * Method:    writeChunks
+ * FullName:  writeChunks
+ * Access:    public 
+ * @brief   Writer stage for decompression of a block with a chunk list. New chunks are taken from the decoded
+ *			block in order, and repeated chunks are read back from the output file where they were first written.
+ *			Repeated chunks are not covered by the block's checksum, so every piece is added to the member's as it is written
+ * @param 	  pipeline - pipeline with the output file open for reading and writing, context points to the ARContext
+ * @param 	  block - decompressed block, with side holding its chunk list
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the chunk list doesn't match the block or the output could not be written
+ **/
+int writeChunks( Pipeline *pipeline, Block *block)
+{
+    ARContext *context = (ARContext*) pipeline->context;
+    ARChunkRef ref;
+    int numRefs, position, i;
+
+    numRefs = (int) getLE32(block->side);
+    position = 0;
+    for ( i = 0; i < numRefs; i++)
+    {
+        unpackChunkRef(block->side + 4 + i * AR_CHUNK_REF_SIZE, &ref);
+        if ( ref.offset < 0)
+        {
+            if ( ref.size > block->outputSize - position)
+            {
+                reportError("Not a valid .ar file, chunk list does not match block\n");
+                return EXIT_FAILURE;
+            }
+            if ( writeAll(context->outputFd, block->output + position, ref.size) != EXIT_SUCCESS)
+            {
+                perror("Could not write output file");
+                return EXIT_FAILURE;
+            }
+            context->checksum = crc32c(context->checksum, block->output + position, ref.size);
+            position += ref.size;
+        }
+        else
+        {
+            if ( ref.offset + ref.size > context->written)
+            {
+                reportError("Not a valid .ar file, chunk refers past the data written so far\n");
+                return EXIT_FAILURE;
+            }
+            if ( readBack(context, ref.offset, ref.size) != EXIT_SUCCESS)
+            {
+                return EXIT_FAILURE;
+            }
+            if ( writeAll(context->outputFd, context->chunk, ref.size) != EXIT_SUCCESS)
+            {
+                perror("Could not write output file");
+                return EXIT_FAILURE;
+            }
+            context->checksum = crc32c(context->checksum, context->chunk, ref.size);
+        }
+        context->written += ref.size;
+    }
+
+    if ( position != block->outputSize)
+    {
+        reportError("Not a valid .ar file, chunk list does not match block\n");
+        return EXIT_FAILURE;
+    }
+    context->blocksLeft--;
+    return checkMembers(context);
+}
+
+/**
+ * Method:    checkMembers
+ * FullName:  checkMembers
+ * Access:    public 
+ * @brief   Called when decompressing with an index, before the first block and after each block is written.
+ *			Once every block of the current member has been written, compares the checksum of the member's data
+ *			with the one in the index and moves on to the next member
+ * @param 	  context - context holding the index and the checksum of the current member so far
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if a member does not match its checksum
+ **/
+int checkMembers( ARContext *context)
+{
+    while ( context->member < context->numMembers && context->blocksLeft == 0)
+    {
+        if ( context->written - context->starts[context->member] != context->members[context->member].uncompressedDataSize)
+        {
+            reportError("Not a valid .ar file, %s does not match its size in the index\n", context->members[context->member].name);
+            return EXIT_FAILURE;
+        }
+        if ( context->checksum != context->members[context->member].checksum)
+        {
+            reportError("Archive is corrupt, %s does not match its checksum\n", context->members[context->member].name);
+            return EXIT_FAILURE;
+        }
+        context->checksum = 0;
+        context->member++;
+        if ( context->member < context->numMembers)
+        {
+            context->blocksLeft = context->members[context->member].numBlocks;
+        }
+        if ( context->directory != NULL && extractMember(context) != EXIT_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    extractMember
+ * FullName:  extractMember
+ * Access:    public 
+ * @brief   Closes the file of the member just finished, if any, and creates the file of the member blocks now
+ *			go to. Called when decompressing an archive of many files, which are each extracted to their own
+ * @param 	  context - context holding the index, the directory and the member blocks now go to
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if a file could not be closed or created
+ **/
+int extractMember( ARContext *context)
+{
+    char path[AR_MEMBER_PATH_SIZE];
+    int status = EXIT_SUCCESS;
+
+    if ( context->outputFd >= 0 && close(context->outputFd) != 0)
+    {
+        perror("Could not write output file");
+        status = EXIT_FAILURE;
+    }
+    context->outputFd = -1;
+    if ( status == EXIT_SUCCESS && context->member < context->numMembers)
+    {
+        memberPath(context, context->member, path);
+        /*Read as well as written, so repeated chunks can be read back*/
+        context->outputFd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+        if ( context->outputFd < 0)
+        {
+            perror(path);
+            status = EXIT_FAILURE;
+        }
+        else
+        {
+            context->extracted++;
+        }
+    }
+    return status;
+}
+
+/**
+ * Method:    memberPath
+ * FullName:  memberPath
+ * Access:    public 
+ * @brief   Gives the file a member is extracted to, in the directory, named with the last part of the name in the
+ *			index so nothing is written outside the directory. A member whose name an earlier member also has, such
+ *			as a file added twice, gets its number on the end so the earlier one is kept
+ * @param 	  context - context holding the index, the directory and which members are renamed
+ * @param 	  member - index of the member
+ * @param 	  path - filled in with the path, AR_MEMBER_PATH_SIZE bytes
+ **/
+void memberPath( const ARContext *context, int member, char *path)
+{
+    const char *name = memberName(&context->members[member]);
+
+    if ( context->renamed[member])
+    {
+        snprintf(path, AR_MEMBER_PATH_SIZE, "%s/%s.%d", context->directory, name, member + 1);
+    }
+    else
+    {
+        snprintf(path, AR_MEMBER_PATH_SIZE, "%s/%s", context->directory, name);
+    }
+}
+
+/**
+ * Method:    memberName
+ * FullName:  memberName
+ * Access:    public 
+ * @brief   Gives the last part of a member's name, or "member" if that is empty, . or ..
+ * @param 	  member - index entry
+ * @return    the name, pointing into the entry or to a constant
+ **/
+const char* memberName( const ARMember *member)
+{
+    const char *name = strrchr(member->name, '/');
+
+    name = name != NULL ? name + 1 : member->name;
+    if ( name[0] == '\0' || strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+    {
+        return "member";
+    }
+    return name;
+}
+
+/**
+ * Method:    compareNames
+ * FullName:  compareNames
+ * Access:    private 
+ * @brief   qsort comparison of index entries by name, then by position in the index
+ **/
+static int compareNames( const void *a, const void *b)
+{
+    const ARMember *first = *(const ARMember* const*) a;
+    const ARMember *second = *(const ARMember* const*) b;
+    int order = strcmp(memberName(first), memberName(second));
+
+    if ( order != 0)
+    {
+        return order;
+    }
+    return first < second ? -1 : first > second;
+}
+
+/**
+ * Method:    findRenamed
+ * FullName:  findRenamed
+ * Access:    public 
+ * @brief   Finds the members that would be extracted to the same file as an earlier member, by sorting the index
+ *			by name, so an archive of many files costs no more than sorting them
+ * @param 	  members - the index
+ * @param 	  numMembers - number of entries
+ * @return    array with a 1 for each member that needs renaming, or NULL if out of memory. Must be freed by the caller
+ **/
+unsigned char* findRenamed( const ARMember *members, int numMembers)
+{
+    const ARMember **sorted;
+    unsigned char *renamed;
+    int i;
+
+    sorted = (const ARMember**) arMalloc((numMembers + 1) * sizeof(ARMember*));
+    renamed = (unsigned char*) arCalloc(numMembers + 1, 1);
+    if ( sorted == NULL || renamed == NULL)
+    {
+        arFree(sorted);
+        arFree(renamed);
+        return NULL;
+    }
+    for ( i = 0; i < numMembers; i++)
+    {
+        sorted[i] = &members[i];
+    }
+    qsort(sorted, numMembers, sizeof(ARMember*), &compareNames);
+    for ( i = 1; i < numMembers; i++)
+    {
+        if ( strcmp(memberName(sorted[i - 1]), memberName(sorted[i])) == 0)
+        {
+            renamed[sorted[i] - members] = 1;
+        }
+    }
+    arFree(sorted);
+    return renamed;
+}
+
+/**
+ * Method:    readBack
+ * FullName:  readBack
+ * Access:    public 
+ * @brief   Reads a repeated chunk back from where it was first written into the chunk buffer. When extracting, a
+ *			chunk first written by an earlier member is read from that member's file
+ * @param 	  context - context with the output and, when extracting, the index
+ * @param 	  offset - position of the chunk in the archive's data
+ * @param 	  size - length of the chunk
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if it could not be read
+ **/
+int readBack( ARContext *context, long long offset, int size)
+{
+    char path[AR_MEMBER_PATH_SIZE];
+    int low, high, middle, fd;
+    ssize_t got;
+
+    if ( context->directory == NULL || offset >= context->starts[context->member])
+    {
+        got = pread(context->outputFd, context->chunk, size,
+                    (off_t) (offset - (context->directory != NULL ? context->starts[context->member] : 0)));
+    }
+    else
+    {
+        /*The member the chunk starts in is the last one starting at or before it*/
+        low = 0;
+        high = context->member;
+        while ( high - low > 1)
+        {
+            middle = low + (high - low) / 2;
+            if ( context->starts[middle] <= offset)
+            {
+                low = middle;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        if ( offset + size > context->starts[low + 1])
+        {
+            reportError("Not a valid .ar file, chunk refers across two files\n");
+            return EXIT_FAILURE;
+        }
+        memberPath(context, low, path);
+        fd = open(path, O_RDONLY);
+        got = fd < 0 ? -1 : pread(fd, context->chunk, size, (off_t) (offset - context->starts[low]));
+        if ( fd >= 0)
+        {
+            close(fd);
+        }
+    }
+    if ( got != size)
+    {
+        perror("Could not read back output file");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    parseSize
+ * FullName:  parseSize
+ * Access:    public 
+ * @brief   Reads a size given on the command line, such as 512K, 64M or 2G
+ * @param 	  text - the size, in bytes unless it ends in K, M or G
+ * @return    the size in bytes, or -1 if it is not a valid size
+ **/
+long long parseSize( const char *text)
+{
+    char *end;
+    long long size;
+    int shift;
+
+    errno = 0;
+    size = strtoll(text, &end, 10);
+    if ( end == text || size < 0 || errno == ERANGE)
+    {
+        return -1;
+    }
+    if ( *end == 'K' || *end == 'M' || *end == 'G')
+    {
+        shift = *end == 'K' ? 10 : *end == 'M' ? 20 : 30;
+        /*Too big to shift is invalid, not wrapped round to a small size*/
+        if ( size > (LLONG_MAX >> shift))
+        {
+            return -1;
+        }
+        size <<= shift;
+        end++;
+    }
+    return *end == '\0' ? size : -1;
+}
+
+/**
+ * Method:    commandLevel
+ * FullName:  commandLevel
+ * Access:    public 
+ * @brief   Finds the level a command line will compress with, so --max-memory can be checked against it alone
+ * @param 	  argc - number of arguments, after --stats, --max-memory and -T
+ * @param 	  argv - the arguments
+ * @return    settings the command codes with, or NULL if it does not compress here
+ **/
+const ARLevel* commandLevel( int argc, char* argv[])
+{
+    char *flag;
+
+    if ( argc < 2 || strcmp("-d", argv[1]) == 0 || strcmp("--verify", argv[1]) == 0 ||
+         strcmp("--serve", argv[1]) == 0 || strcmp("--connect", argv[1]) == 0 || strcmp("--level-info", argv[1]) == 0 ||
+         (argc == 5 && strcmp("--base", argv[1]) == 0))
+    {
+        return NULL;
+    }
+    flag = argc == 4 && strcmp("--check-determinism", argv[1]) == 0 ? argv[2] : argv[1];
+    if ( strcmp("-w", flag) == 0)
+    {
+        return getWordsLevel();
+    }
+    if ( flag[0] == '-' && flag[1] >= '1' && flag[1] <= '9' && flag[2] == '\0')
+    {
+        return getLevel(flag[1] - '0');
+    }
+    return getLevel(AR_DEFAULT_LEVEL);
 }
@@ -4,17 +4,42 @@
  *
  * Created on 15 November 2012, 9:29 PM
  */
-#include "Huffman.h"
+#include "Codec.h"
+#include "Index.h"
 #ifndef ARCHIVER_H
 #define	ARCHIVER_H
 
-int compressFile( char* file);
-int decompressFile( char* file);
-HuffNode** createFreqTable( char* file, int* uncompressed);
-HuffNode** sortPriority( HuffNode** freqTable, int *numElements);
-void writeARFile( ARHeader *header, HuffNodeSerial *tree, int treeSize, char **compressed, int compressedDataSize);
-void writeFile( char* uncompressed, int size);
-char** encode(char *inputName, char *codeTable[], int *compressedSize, int uncompressedSize);
-char* decompress( char* compressed, int compressedSize, int decompressedSize, HuffNode *tree);
-char* toBinary( char* compressed, int size);
+#define AR_DETERMINISM_RUNS 6  /* Thread counts --check-determinism compresses with */
+#define AR_DETERMINISM_BUFFER 65536  /* Bytes of each archive it compares at a time */
+#define AR_MEMBER_PATH_SIZE (100 + AR_MEMBER_NAME_SIZE + 16)  /* Directory, member name and number when extracting */
+
+int compressFile( char* file, const ARLevel *level, int flags, char* baseFile);
+int writeArchive( Pipeline *pipeline, char* file, const ARLevel *level, int flags, DeltaBase *base);
+int checkDeterminism( char* file, const ARLevel *level);
+int appendFile( char* archive, char* file, const ARLevel *level);
+int compressFiles( char** files, int numFiles, const ARLevel *level);
+int compressMember( Pipeline *pipeline, char* file, ARContext *context, ARMember *member);
+int compressStream( char* file);
+int decompressFile( char* file, char* baseFile, int verify);
+int decompressTiny( FILE *input, FILE *output);
+int readBlock( Pipeline *pipeline, Block *block);
+int readDedupBlock( Pipeline *pipeline, Block *block);
+int readBatchBlock( Pipeline *pipeline, Block *block);
+int writeBatchFile( Pipeline *pipeline, Block *block);
+void finishBatchMembers( ARContext *context, int member, FILE *output);
+int writeARFile( Pipeline *pipeline, Block *block);
+int readARBlock( Pipeline *pipeline, Block *block);
+int writeFile( Pipeline *pipeline, Block *block);
+int writeChunks( Pipeline *pipeline, Block *block);
+int checkMembers( ARContext *context);
+int extractMember( ARContext *context);
+void memberPath( const ARContext *context, int member, char *path);
+const char* memberName( const ARMember *member);
+unsigned char* findRenamed( const ARMember *members, int numMembers);
+int readBack( ARContext *context, long long offset, int size);
+int writeAll( int fd, const unsigned char *data, size_t size);
+int checkArchiveSizes( const ARHeader *header, long long archiveSize);
+unsigned char* mapOutput( FILE *output, long long size);
+long long parseSize( const char *text);
+const ARLevel* commandLevel( int argc, char* argv[]);
 #endif
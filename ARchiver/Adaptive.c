@@ -0,0 +1,577 @@
+/**
+ * @file   Adaptive.c
+ * @author Adrian Rasmussen
+ *
+ * @brief Single pass adaptive Huffman coding (Vitter's algorithm), for inputs that can only be read once
+ *		  such as pipes, sockets and FIFOs. The encoder and decoder start from the same empty tree and
+ *		  update it after every symbol, so no frequency table or tree is stored. A symbol is sent as its
+ *		  raw 9 bit value after the code of the "not yet transmitted" (NYT) leaf the first time it appears,
+ *		  and the stream ends with AR_ADAPTIVE_EOS. Memory use is fixed. When the input has nothing more
+ *		  ready, AR_ADAPTIVE_FLUSH pads the output to a whole byte and it is flushed, so each piece of input
+ *		  can be decoded as soon as it has been read.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include "Adaptive.h"
+#include "Memory.h"
+#include "Report.h"
+
+#define AR_ADAPTIVE_BUFFER 4096
+
+typedef struct BitStream
+{
+	FILE *file;
+	unsigned char buffer[AR_ADAPTIVE_BUFFER];
+	int size;      /* Bytes in buffer, when reading */
+	int position;  /* Next byte of buffer, when reading */
+	FILE *pending;  /* Output flushed before waiting for more input, when reading */
+	unsigned char byte;
+	int numBits;
+} BitStream;
+
+static int isLeaf( AdaptiveTree *tree, int node);
+static void swapNodes( AdaptiveTree *tree, int a, int b);
+static int slideAndIncrement( AdaptiveTree *tree, int p);
+static int readInput( BitStream *stream);
+static int inputReady( BitStream *stream);
+static void putBit( BitStream *stream, int bit);
+static int getBit( BitStream *stream);
+static void putSymbol( AdaptiveTree *tree, BitStream *stream, int symbol);
+static int getSymbol( AdaptiveTree *tree, BitStream *stream);
+
+/**
+ * Method:    initAdaptiveTree
+ * FullName:  initAdaptiveTree
+ * Access:    public
+ * @brief     Resets the tree to a single NYT leaf, which is also the root
+ * @param 	  tree - tree to reset
+ **/
+void initAdaptiveTree( AdaptiveTree *tree)
+{
+	int i;
+
+	for ( i = 0; i < AR_ADAPTIVE_SYMBOLS; i++)
+	{
+		tree->leaf[i] = -1;
+	}
+	for ( i = 0; i < AR_ADAPTIVE_NODES; i++)
+	{
+		tree->byNumber[i] = -1;
+	}
+	tree->numNodes = 1;
+	tree->root = 0;
+	tree->nyt = 0;
+	tree->nodes[0].weight = 0;
+	tree->nodes[0].parent = -1;
+	tree->nodes[0].left = -1;
+	tree->nodes[0].right = -1;
+	tree->nodes[0].symbol = -1;
+	tree->nodes[0].number = AR_ADAPTIVE_NODES - 1;
+	tree->byNumber[AR_ADAPTIVE_NODES - 1] = 0;
+}
+
+/**
+ * Method:    isLeaf
+ * FullName:  isLeaf
+ * Access:    private
+ * @param 	  tree - the tree
+ * @param 	  node - index of the node
+ * @return    1 if node has no children, otherwise 0
+ **/
+static int isLeaf( AdaptiveTree *tree, int node)
+{
+	return tree->nodes[node].left == -1;
+}
+
+/**
+ * Method:    swapNodes
+ * FullName:  swapNodes
+ * Access:    private
+ * @brief     Exchanges the positions of two subtrees, along with their implicit numbers.
+ *			  Neither node may be an ancestor of the other
+ * @param 	  tree - the tree
+ * @param 	  a - first node
+ * @param 	  b - second node
+ **/
+static void swapNodes( AdaptiveTree *tree, int a, int b)
+{
+	AdaptiveNode *nodeA = &tree->nodes[a], *nodeB = &tree->nodes[b];
+	AdaptiveNode *parentA = &tree->nodes[nodeA->parent], *parentB = &tree->nodes[nodeB->parent];
+	short temp;
+
+	if ( nodeA->parent == nodeB->parent)
+	{
+		temp = parentA->left;
+		parentA->left = parentA->right;
+		parentA->right = temp;
+	}
+	else
+	{
+		if ( parentA->left == a)
+		{
+			parentA->left = (short) b;
+		}
+		else
+		{
+			parentA->right = (short) b;
+		}
+		if ( parentB->left == b)
+		{
+			parentB->left = (short) a;
+		}
+		else
+		{
+			parentB->right = (short) a;
+		}
+		temp = nodeA->parent;
+		nodeA->parent = nodeB->parent;
+		nodeB->parent = temp;
+	}
+
+	temp = nodeA->number;
+	nodeA->number = nodeB->number;
+	nodeB->number = temp;
+	tree->byNumber[nodeA->number] = (short) a;
+	tree->byNumber[nodeB->number] = (short) b;
+}
+
+/**
+ * Method:    slideAndIncrement
+ * FullName:  slideAndIncrement
+ * Access:    private
+ * @brief     Increments the weight of p, first sliding it past the next block in the implicit numbering
+ *			  if needed to keep Vitter's invariant: weights never decrease with number, and among equal
+ *			  weights leaves come before internal nodes. An internal node slides past the leaves of weight
+ *			  wt + 1, a leaf slides past the internal nodes of weight wt. The slide is done as a series of
+ *			  swaps, each moving one node of the block down a place
+ * @param 	  tree - the tree
+ * @param 	  p - leader of its block
+ * @return    the next node whose weight must be incremented
+ **/
+static int slideAndIncrement( AdaptiveTree *tree, int p)
+{
+	int wt, number, next, previousParent, leaf, sliding;
+
+	wt = tree->nodes[p].weight;
+	previousParent = tree->nodes[p].parent;
+	leaf = isLeaf(tree, p);
+
+	number = tree->nodes[p].number + 1;
+	sliding = 1;
+	while ( sliding && number < AR_ADAPTIVE_NODES)
+	{
+		next = tree->byNumber[number];
+		if ( next != tree->root &&
+			 ((leaf && !isLeaf(tree, next) && tree->nodes[next].weight == wt) ||
+			  (!leaf && isLeaf(tree, next) && tree->nodes[next].weight == wt + 1)))
+		{
+			swapNodes( tree, p, next);
+			number = tree->nodes[p].number + 1;
+		}
+		else
+		{
+			sliding = 0;
+		}
+	}
+	tree->nodes[p].weight++;
+
+	/*A leaf that moved has a new parent whose weight grew, an internal node leaves
+	 *a heavier leaf with its old parent instead*/
+	return leaf ? tree->nodes[p].parent : previousParent;
+}
+
+/**
+ * Method:    updateAdaptiveTree
+ * FullName:  updateAdaptiveTree
+ * Access:    public
+ * @brief     Updates the tree after a symbol has been coded, which must be done identically by the
+ *			  encoder and decoder. A new symbol splits the NYT leaf into a new NYT leaf and a leaf for the
+ *			  symbol. Otherwise the symbol's leaf is first swapped with the leader of its block. Each node
+ *			  on the path to the root is then incremented with {@link slideAndIncrement}
+ * @param 	  tree - the tree
+ * @param 	  symbol - symbol that was just coded
+ **/
+void updateAdaptiveTree( AdaptiveTree *tree, int symbol)
+{
+	int q, leader, next, oldNyt, leafToIncrement;
+	AdaptiveNode *node;
+
+	leafToIncrement = -1;
+	q = tree->leaf[symbol];
+	if ( q == -1)
+	{
+		/*Give the NYT node two children: the new NYT leaf on the left and the symbol on the right*/
+		oldNyt = tree->nyt;
+		node = &tree->nodes[tree->numNodes];
+		node->weight = 0;
+		node->parent = (short) oldNyt;
+		node->left = -1;
+		node->right = -1;
+		node->symbol = -1;
+		node->number = (short) (tree->nodes[oldNyt].number - 2);
+		tree->byNumber[node->number] = tree->numNodes;
+		tree->nyt = tree->numNodes++;
+
+		node = &tree->nodes[tree->numNodes];
+		node->weight = 0;
+		node->parent = (short) oldNyt;
+		node->left = -1;
+		node->right = -1;
+		node->symbol = (short) symbol;
+		node->number = (short) (tree->nodes[oldNyt].number - 1);
+		tree->byNumber[node->number] = tree->numNodes;
+		tree->leaf[symbol] = tree->numNodes++;
+
+		tree->nodes[oldNyt].left = tree->nyt;
+		tree->nodes[oldNyt].right = tree->leaf[symbol];
+		q = oldNyt;
+		leafToIncrement = tree->leaf[symbol];
+	}
+	else
+	{
+		/*Find the highest numbered leaf of the same weight*/
+		leader = q;
+		next = tree->nodes[q].number + 1;
+		while ( next < AR_ADAPTIVE_NODES && isLeaf(tree, tree->byNumber[next]) &&
+				tree->nodes[tree->byNumber[next]].weight == tree->nodes[q].weight)
+		{
+			leader = tree->byNumber[next++];
+		}
+		if ( leader != q)
+		{
+			swapNodes( tree, q, leader);
+		}
+		/*Incrementing q would put it above its parent, so increment the parent first*/
+		if ( tree->nodes[tree->nodes[q].parent].left == tree->nyt)
+		{
+			leafToIncrement = q;
+			q = tree->nodes[q].parent;
+		}
+	}
+
+	while ( q != tree->root)
+	{
+		q = slideAndIncrement( tree, q);
+	}
+	tree->nodes[tree->root].weight++;
+	if ( leafToIncrement != -1)
+	{
+		slideAndIncrement( tree, leafToIncrement);
+	}
+}
+
+/**
+ * Method:    putBit
+ * FullName:  putBit
+ * Access:    private
+ * @brief     Adds a bit to the output, highest bit of each byte first
+ * @param 	  stream - output stream
+ * @param 	  bit - 0 or 1
+ **/
+static void putBit( BitStream *stream, int bit)
+{
+	stream->byte |= bit << (7 - stream->numBits);
+	if ( ++stream->numBits == 8)
+	{
+		putc( stream->byte, stream->file);
+		stream->byte = 0;
+		stream->numBits = 0;
+	}
+}
+
+/**
+ * Method:    putSymbol
+ * FullName:  putSymbol
+ * Access:    private
+ * @brief     Writes the code of a symbol, or the NYT code and its raw value if it is new, then updates the tree
+ * @param 	  tree - the encoder's tree
+ * @param 	  stream - output stream
+ * @param 	  symbol - byte value or AR_ADAPTIVE_EOS
+ **/
+static void putSymbol( AdaptiveTree *tree, BitStream *stream, int symbol)
+{
+	char path[AR_ADAPTIVE_NODES];
+	int node, length, i;
+
+	node = tree->leaf[symbol] == -1 ? tree->nyt : tree->leaf[symbol];
+	/*Walk up to the root, then write the path back down*/
+	length = 0;
+	while ( node != tree->root)
+	{
+		path[length++] = (char) (tree->nodes[tree->nodes[node].parent].right == node);
+		node = tree->nodes[node].parent;
+	}
+	while ( length > 0)
+	{
+		putBit( stream, path[--length]);
+	}
+	if ( tree->leaf[symbol] == -1)
+	{
+		for ( i = AR_ADAPTIVE_SYMBOL_BITS - 1; i >= 0; i--)
+		{
+			putBit( stream, (symbol >> i) & 1);
+		}
+	}
+	updateAdaptiveTree( tree, symbol);
+}
+
+/**
+ * Method:    adaptiveCompress
+ * FullName:  adaptiveCompress
+ * Access:    public
+ * @brief     Compresses input in a single pass. Each read takes whatever input is available, and the output
+ *			  is flushed once it has been coded, so a slow source such as a log tail is passed through promptly
+ * @param 	  input - stream to compress, only read once
+ * @param 	  output - stream to write the coded bits to
+ * @param 	  uncompressedSize - location to save the number of bytes read to
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the input could not be read or memory allocated
+ **/
+int adaptiveCompress( FILE *input, FILE *output, long *uncompressedSize)
+{
+	AdaptiveTree *tree;
+	BitStream *reader, *writer;
+	int i, status;
+
+	tree = (AdaptiveTree*) arMalloc( sizeof(AdaptiveTree));
+	reader = (BitStream*) arMalloc( 2 * sizeof(BitStream));
+	if ( tree == NULL || reader == NULL)
+	{
+		reportError("Could not allocate memory for adaptive tree\n");
+		arFree(tree);
+		arFree(reader);
+		return EXIT_FAILURE;
+	}
+	initAdaptiveTree(tree);
+	writer = reader + 1;
+	reader->file = input;
+	writer->file = output;
+	writer->byte = 0;
+	writer->numBits = 0;
+	*uncompressedSize = 0;
+
+	status = readInput(reader);
+	while ( status == EXIT_SUCCESS && reader->size > 0)
+	{
+		for ( i = 0; i < reader->size; i++)
+		{
+			putSymbol( tree, writer, reader->buffer[i]);
+		}
+		*uncompressedSize += reader->size;
+		/*About to wait for the source, so let everything read so far be decoded*/
+		if ( !inputReady(reader))
+		{
+			putSymbol( tree, writer, AR_ADAPTIVE_FLUSH);
+			if ( writer->numBits > 0)
+			{
+				putc( writer->byte, output);
+				writer->byte = 0;
+				writer->numBits = 0;
+			}
+			fflush(output);
+		}
+		status = readInput(reader);
+	}
+
+	if ( status == EXIT_SUCCESS)
+	{
+		putSymbol( tree, writer, AR_ADAPTIVE_EOS);
+		if ( writer->numBits > 0)
+		{
+			putc( writer->byte, output);
+		}
+		fflush(output);
+	}
+
+	arFree(tree);
+	arFree(reader);
+	return status;
+}
+
+/**
+ * Method:    readInput
+ * FullName:  readInput
+ * Access:    private
+ * @brief     Refills the stream's buffer with a single read, so it returns as soon as any input is available.
+ *			  The stream's FILE must be unbuffered so that nothing is held back inside stdio
+ * @param 	  stream - stream to fill, size is left as 0 at end of input
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the read failed
+ **/
+static int readInput( BitStream *stream)
+{
+	ssize_t size;
+
+	do
+	{
+		size = read( fileno(stream->file), stream->buffer, AR_ADAPTIVE_BUFFER);
+	} while ( size < 0 && errno == EINTR);
+
+	stream->position = 0;
+	stream->size = size > 0 ? (int) size : 0;
+	if ( size < 0)
+	{
+		reportSystemError("Could not read input");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    inputReady
+ * FullName:  inputReady
+ * Access:    private
+ * @brief     Checks without blocking whether the next read would return straight away
+ * @param 	  stream - input stream
+ * @return    1 if input (or end of input) is ready, 0 if a read would wait
+ **/
+static int inputReady( BitStream *stream)
+{
+	struct pollfd request;
+
+	request.fd = fileno(stream->file);
+	request.events = POLLIN;
+	request.revents = 0;
+	return poll(&request, 1, 0) != 0;
+}
+
+/**
+ * Method:    getBit
+ * FullName:  getBit
+ * Access:    private
+ * @brief     Reads the next bit of input, refilling the buffer when it runs out
+ * @param 	  stream - input stream
+ * @return    0 or 1, or -1 at end of input
+ **/
+static int getBit( BitStream *stream)
+{
+	if ( stream->numBits == 0)
+	{
+		if ( stream->position == stream->size && stream->pending != NULL)
+		{
+			fflush(stream->pending);
+		}
+		if ( stream->position == stream->size &&
+			 (readInput(stream) != EXIT_SUCCESS || stream->size == 0))
+		{
+			return -1;
+		}
+		stream->byte = stream->buffer[stream->position++];
+		stream->numBits = 8;
+	}
+	stream->numBits--;
+	return (stream->byte >> stream->numBits) & 1;
+}
+
+/**
+ * Method:    getSymbol
+ * FullName:  getSymbol
+ * Access:    private
+ * @brief     Follows the input bits down the tree to a leaf, reading the raw value if it is the NYT leaf,
+ *			  then updates the tree
+ * @param 	  tree - the decoder's tree
+ * @param 	  stream - input stream
+ * @return    the symbol, or -1 if the input ended early or is not valid
+ **/
+static int getSymbol( AdaptiveTree *tree, BitStream *stream)
+{
+	int node, bit, symbol, i;
+
+	node = tree->root;
+	while ( !isLeaf(tree, node))
+	{
+		bit = getBit(stream);
+		if ( bit == -1)
+		{
+			return -1;
+		}
+		node = bit ? tree->nodes[node].right : tree->nodes[node].left;
+	}
+
+	if ( node == tree->nyt)
+	{
+		symbol = 0;
+		for ( i = 0; i < AR_ADAPTIVE_SYMBOL_BITS; i++)
+		{
+			bit = getBit(stream);
+			if ( bit == -1)
+			{
+				return -1;
+			}
+			symbol = (symbol << 1) | bit;
+		}
+		if ( symbol >= AR_ADAPTIVE_SYMBOLS || tree->leaf[symbol] != -1)
+		{
+			return -1;
+		}
+	}
+	else
+	{
+		symbol = tree->nodes[node].symbol;
+	}
+	updateAdaptiveTree( tree, symbol);
+
+	return symbol;
+}
+
+/**
+ * Method:    adaptiveDecompress
+ * FullName:  adaptiveDecompress
+ * Access:    public
+ * @brief     Decodes a stream written by {@link adaptiveCompress} until its end of stream symbol, flushing
+ *			  the output before waiting for more input
+ * @param 	  input - unbuffered stream positioned after the archive header
+ * @param 	  output - stream to write the decoded bytes to
+ * @param 	  uncompressedSize - location to save the number of bytes decoded to
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the stream is truncated or corrupt
+ **/
+int adaptiveDecompress( FILE *input, FILE *output, long *uncompressedSize)
+{
+	AdaptiveTree *tree;
+	BitStream *stream;
+	int symbol;
+
+	tree = (AdaptiveTree*) arMalloc( sizeof(AdaptiveTree));
+	stream = (BitStream*) arMalloc( sizeof(BitStream));
+	if ( tree == NULL || stream == NULL)
+	{
+		reportError("Could not allocate memory for adaptive tree\n");
+		arFree(tree);
+		arFree(stream);
+		return EXIT_FAILURE;
+	}
+	initAdaptiveTree(tree);
+	stream->file = input;
+	stream->pending = output;
+	stream->size = 0;
+	stream->position = 0;
+	stream->numBits = 0;
+	*uncompressedSize = 0;
+
+	symbol = getSymbol( tree, stream);
+	while ( symbol >= 0 && symbol != AR_ADAPTIVE_EOS)
+	{
+		if ( symbol == AR_ADAPTIVE_FLUSH)
+		{
+			/*Skip the padding*/
+			stream->numBits = 0;
+		}
+		else
+		{
+			putc( symbol, output);
+			(*uncompressedSize)++;
+		}
+		symbol = getSymbol( tree, stream);
+	}
+	fflush(output);
+
+	arFree(tree);
+	arFree(stream);
+	if ( symbol != AR_ADAPTIVE_EOS)
+	{
+		reportError("Archive is truncated or corrupt, no end of stream\n");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
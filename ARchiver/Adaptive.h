@@ -0,0 +1,42 @@
+/*
+ * File:   Adaptive.h
+ * Author: adrian
+ *
+ * Single pass adaptive Huffman coding using Vitter's algorithm
+ */
+
+#ifndef ADAPTIVE_H
+#define	ADAPTIVE_H
+#include <stdio.h>
+
+#define AR_ADAPTIVE_EOS 256  /* Sent after the last symbol of the stream */
+#define AR_ADAPTIVE_FLUSH 257  /* Followed by padding to a byte boundary, so all output so far can be decoded */
+#define AR_ADAPTIVE_SYMBOLS 258  /* Every byte value plus AR_ADAPTIVE_EOS and AR_ADAPTIVE_FLUSH */
+#define AR_ADAPTIVE_NODES (2 * (AR_ADAPTIVE_SYMBOLS + 1) - 1)  /* All symbols plus the NYT leaf */
+#define AR_ADAPTIVE_SYMBOL_BITS 9  /* Bits used to send a symbol the first time it is seen */
+
+typedef struct AdaptiveNode
+{
+	int weight;
+	short parent;
+	short left;
+	short right;
+	short symbol;  /* -1 for internal nodes */
+	short number;  /* Position in Vitter's implicit numbering, the root is highest */
+} AdaptiveNode;
+
+typedef struct AdaptiveTree
+{
+	AdaptiveNode nodes[AR_ADAPTIVE_NODES];
+	short byNumber[AR_ADAPTIVE_NODES];  /* Node with each implicit number */
+	short leaf[AR_ADAPTIVE_SYMBOLS];  /* Leaf of each symbol, or -1 if not seen yet */
+	short nyt;  /* The zero weight "not yet transmitted" leaf */
+	short root;
+	short numNodes;
+} AdaptiveTree;
+
+void initAdaptiveTree( AdaptiveTree *tree);
+void updateAdaptiveTree( AdaptiveTree *tree, int symbol);
+int adaptiveCompress( FILE *input, FILE *output, long *uncompressedSize);
+int adaptiveDecompress( FILE *input, FILE *output, long *uncompressedSize);
+#endif	/* ADAPTIVE_H */
@@ -0,0 +1,541 @@
+/**
+ * @file   BWT.c
+ * @author Adrian Rasmussen
+ *
+ * @brief High ratio mode for archival use. Each block is Burrows-Wheeler transformed, which groups bytes
+ *		  that appear in similar contexts, then move-to-front coding turns those groups into runs of small
+ *		  numbers. Runs of zeros are written as RUNA/RUNB digits in bijective base 2 (as in bzip2) and the
+ *		  result is Huffman coded. The suffix array for the transform is built with SA-IS in linear time.
+ *		  A compressed block holds the row of the original string, the serialized tree and then the codes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "BWT.h"
+#include "Huffman.h"
+#include "Bits.h"
+#include "Format.h"
+#include "Memory.h"
+#include "Report.h"
+
+/*Suffix i is an LMS (leftmost S-type) suffix*/
+#define isLMS(stype, i) ((i) > 0 && (stype)[i] && !(stype)[(i) - 1])
+
+static void getBuckets( int *text, int *buckets, int size, int alphabetSize, int end);
+static void induceL( int *text, int *sa, unsigned char *stype, int *buckets, int size, int alphabetSize);
+static void induceS( int *text, int *sa, unsigned char *stype, int *buckets, int size, int alphabetSize);
+
+/**
+ * Method:    getBuckets
+ * FullName:  getBuckets
+ * Access:    private
+ * @brief     Finds the start or end of each symbol's bucket in the suffix array
+ * @param 	  text - the text
+ * @param 	  buckets - location to save the bucket positions to
+ * @param 	  size - length of the text
+ * @param 	  alphabetSize - number of possible symbols
+ * @param 	  end - 1 for one past the end of each bucket, 0 for the start
+ **/
+static void getBuckets( int *text, int *buckets, int size, int alphabetSize, int end)
+{
+	int i, sum;
+
+	for ( i = 0; i < alphabetSize; i++)
+	{
+		buckets[i] = 0;
+	}
+	for ( i = 0; i < size; i++)
+	{
+		buckets[text[i]]++;
+	}
+	sum = 0;
+	for ( i = 0; i < alphabetSize; i++)
+	{
+		sum += buckets[i];
+		buckets[i] = end ? sum : sum - buckets[i];
+	}
+}
+
+/**
+ * Method:    induceL
+ * FullName:  induceL
+ * Access:    private
+ * @brief     Places L-type suffixes at the front of their buckets, scanning left to right
+ **/
+static void induceL( int *text, int *sa, unsigned char *stype, int *buckets, int size, int alphabetSize)
+{
+	int i, j;
+
+	getBuckets( text, buckets, size, alphabetSize, 0);
+	for ( i = 0; i < size; i++)
+	{
+		j = sa[i] - 1;
+		if ( j >= 0 && !stype[j])
+		{
+			sa[buckets[text[j]]++] = j;
+		}
+	}
+}
+
+/**
+ * Method:    induceS
+ * FullName:  induceS
+ * Access:    private
+ * @brief     Places S-type suffixes at the back of their buckets, scanning right to left
+ **/
+static void induceS( int *text, int *sa, unsigned char *stype, int *buckets, int size, int alphabetSize)
+{
+	int i, j;
+
+	getBuckets( text, buckets, size, alphabetSize, 1);
+	for ( i = size - 1; i >= 0; i--)
+	{
+		j = sa[i] - 1;
+		if ( j >= 0 && stype[j])
+		{
+			sa[--buckets[text[j]]] = j;
+		}
+	}
+}
+
+/**
+ * Method:    suffixArray
+ * FullName:  suffixArray
+ * Access:    public
+ * @brief     Builds the suffix array of text in linear time using SA-IS (Nong, Zhang and Chan). LMS substrings
+ *			  are sorted by induced sorting and named; if any names repeat, the same algorithm is applied to
+ *			  the shorter string of names. The sorted LMS suffixes then induce the order of every suffix.
+ * @param 	  text - the text, ending in a unique 0 that is smaller than every other symbol
+ * @param 	  sa - location to save the suffix array to, room for size entries
+ * @param 	  size - length of the text, including the final 0
+ * @param 	  alphabetSize - every symbol is less than this
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if memory could not be allocated
+ **/
+int suffixArray( int *text, int *sa, int size, int alphabetSize)
+{
+	unsigned char *stype;
+	int *buckets, *reduced, *reducedSA;
+	int i, j, d, n1, name, prev, pos, diff, status;
+
+	if ( size == 1)
+	{
+		sa[0] = 0;
+		return EXIT_SUCCESS;
+	}
+
+	stype = (unsigned char*) arMalloc( size);
+	buckets = (int*) arMalloc( alphabetSize * sizeof(int));
+	if ( stype == NULL || buckets == NULL)
+	{
+		reportError("Could not allocate memory for suffix array\n");
+		arFree(stype);
+		arFree(buckets);
+		return EXIT_FAILURE;
+	}
+
+	/*Classify each suffix as S-type (smaller than the next suffix) or L-type*/
+	stype[size - 1] = 1;
+	stype[size - 2] = 0;
+	for ( i = size - 3; i >= 0; i--)
+	{
+		stype[i] = (unsigned char) (text[i] < text[i + 1] || (text[i] == text[i + 1] && stype[i + 1]));
+	}
+
+	/*Stage 1: sort the LMS substrings*/
+	getBuckets( text, buckets, size, alphabetSize, 1);
+	for ( i = 0; i < size; i++)
+	{
+		sa[i] = -1;
+	}
+	for ( i = 1; i < size; i++)
+	{
+		if ( isLMS(stype, i))
+		{
+			sa[--buckets[text[i]]] = i;
+		}
+	}
+	induceL( text, sa, stype, buckets, size, alphabetSize);
+	induceS( text, sa, stype, buckets, size, alphabetSize);
+
+	/*Move the sorted LMS substrings to the front and name them, equal substrings sharing a name*/
+	n1 = 0;
+	for ( i = 0; i < size; i++)
+	{
+		if ( isLMS(stype, sa[i]))
+		{
+			sa[n1++] = sa[i];
+		}
+	}
+	for ( i = n1; i < size; i++)
+	{
+		sa[i] = -1;
+	}
+	name = 0;
+	prev = -1;
+	for ( i = 0; i < n1; i++)
+	{
+		pos = sa[i];
+		diff = 0;
+		for ( d = 0; d < size && !diff; d++)
+		{
+			if ( prev == -1 || text[pos + d] != text[prev + d] || stype[pos + d] != stype[prev + d])
+			{
+				diff = 1;
+			}
+			else if ( d > 0 && (isLMS(stype, pos + d) || isLMS(stype, prev + d)))
+			{
+				d = size;
+			}
+		}
+		if ( diff)
+		{
+			name++;
+			prev = pos;
+		}
+		/*LMS suffixes are at least two apart, so pos / 2 is unique*/
+		sa[n1 + pos / 2] = name - 1;
+	}
+	for ( i = size - 1, j = size - 1; i >= n1; i--)
+	{
+		if ( sa[i] >= 0)
+		{
+			sa[j--] = sa[i];
+		}
+	}
+
+	/*Stage 2: sort the LMS suffixes, recursing if their names are not yet unique*/
+	reducedSA = sa;
+	reduced = sa + size - n1;
+	status = EXIT_SUCCESS;
+	if ( name < n1)
+	{
+		status = suffixArray( reduced, reducedSA, n1, name);
+	}
+	else
+	{
+		for ( i = 0; i < n1; i++)
+		{
+			reducedSA[reduced[i]] = i;
+		}
+	}
+
+	/*Stage 3: induce the full suffix array from the sorted LMS suffixes*/
+	if ( status == EXIT_SUCCESS)
+	{
+		getBuckets( text, buckets, size, alphabetSize, 1);
+		for ( i = 1, j = 0; i < size; i++)
+		{
+			if ( isLMS(stype, i))
+			{
+				reduced[j++] = i;
+			}
+		}
+		for ( i = 0; i < n1; i++)
+		{
+			reducedSA[i] = reduced[reducedSA[i]];
+		}
+		for ( i = n1; i < size; i++)
+		{
+			sa[i] = -1;
+		}
+		for ( i = n1 - 1; i >= 0; i--)
+		{
+			j = sa[i];
+			sa[i] = -1;
+			sa[--buckets[text[j]]] = j;
+		}
+		induceL( text, sa, stype, buckets, size, alphabetSize);
+		induceS( text, sa, stype, buckets, size, alphabetSize);
+	}
+
+	arFree(stype);
+	arFree(buckets);
+	return status;
+}
+
+/**
+ * Method:    bwtCompress
+ * FullName:  bwtCompress
+ * Access:    public
+ * @brief     Transforms a block with the Burrows-Wheeler transform, move-to-front and zero run coding,
+ *			  then Huffman codes the result
+ * @param 	  input - the block
+ * @param 	  size - size of the block
+ * @param 	  output - buffer to save the primary row, tree and codes to
+ * @param 	  capacity - size of output
+ * @param 	  treeSize - location to save the size of the primary row and tree to, in bytes
+ * @param 	  compressedSize - location to save the size of the codes to, in bits without padding
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the result did not fit in capacity or memory could not be allocated
+ **/
+int bwtCompress( unsigned char *input, int size, unsigned char *output, int capacity, int *treeSize, int *compressedSize)
+{
+	int *text, *sa;
+	unsigned char *bwt, list[256], ch;
+	unsigned short *symbols;
+	int counts[AR_BWT_SYMBOLS];
+	unsigned long long codes[AR_BWT_SYMBOLS];
+	unsigned char lengths[AR_BWT_SYMBOLS];
+	int i, j, k, primary, numSymbols, run, serialSize, status;
+	HuffNodeSerial *serial;
+	BitWriter writer;
+
+	text = (int*) arMalloc( (size + 1) * sizeof(int));
+	sa = (int*) arMalloc( (size + 1) * sizeof(int));
+	bwt = (unsigned char*) arMalloc( size);
+	symbols = (unsigned short*) arMalloc( size * sizeof(unsigned short));
+	if ( text == NULL || sa == NULL || bwt == NULL || symbols == NULL)
+	{
+		reportError("Could not allocate memory for BWT\n");
+		arFree(text);
+		arFree(sa);
+		arFree(bwt);
+		arFree(symbols);
+		return EXIT_FAILURE;
+	}
+
+	/*Shift bytes up by one so 0 can end the text*/
+	for ( i = 0; i < size; i++)
+	{
+		text[i] = input[i] + 1;
+	}
+	text[size] = 0;
+	status = suffixArray( text, sa, size + 1, 257);
+	arFree(text);
+	text = NULL;
+	if ( status != EXIT_SUCCESS)
+	{
+		arFree(sa);
+		arFree(bwt);
+		arFree(symbols);
+		return EXIT_FAILURE;
+	}
+
+	/*Last column of the sorted rotations, leaving out the end marker and remembering its row*/
+	primary = 0;
+	for ( i = 0, k = 0; i <= size; i++)
+	{
+		if ( sa[i] == 0)
+		{
+			primary = i;
+		}
+		else
+		{
+			bwt[k++] = input[sa[i] - 1];
+		}
+	}
+	arFree(sa);
+	sa = NULL;
+
+	/*Move-to-front, with runs of zeros as RUNA/RUNB digits and other positions shifted up by one*/
+	for ( i = 0; i < 256; i++)
+	{
+		list[i] = (unsigned char) i;
+	}
+	memset(counts, 0, sizeof(counts));
+	numSymbols = 0;
+	run = 0;
+	for ( i = 0; i <= size; i++)
+	{
+		j = 0;
+		if ( i < size)
+		{
+			ch = bwt[i];
+			while ( list[j] != ch)
+			{
+				j++;
+			}
+			memmove( list + 1, list, j);
+			list[0] = ch;
+		}
+		if ( j == 0 && i < size)
+		{
+			run++;
+		}
+		else
+		{
+			while ( run > 0)
+			{
+				if ( run & 1)
+				{
+					symbols[numSymbols++] = AR_BWT_RUNA;
+					run = (run - 1) / 2;
+				}
+				else
+				{
+					symbols[numSymbols++] = AR_BWT_RUNB;
+					run = (run - 2) / 2;
+				}
+				counts[symbols[numSymbols - 1]]++;
+			}
+			if ( i < size)
+			{
+				symbols[numSymbols++] = (unsigned short) (j + 1);
+				counts[j + 1]++;
+			}
+		}
+	}
+	arFree(bwt);
+	bwt = NULL;
+
+	status = EXIT_FAILURE;
+	serial = buildCodes( counts, AR_BWT_SYMBOLS, lengths, codes, &serialSize);
+	if ( serial != NULL && (int) sizeof(int) + serialSize < capacity)
+	{
+		*treeSize = (int) sizeof(int) + serialSize;
+		putLE32( output, (unsigned int) primary);
+		memcpy( output + sizeof(int), serial, serialSize);
+		initBitWriter( &writer, output + *treeSize, capacity - *treeSize);
+		for ( i = 0; i < numSymbols && !writer.overflow; i++)
+		{
+			putCode( &writer, codes[symbols[i]], lengths[symbols[i]]);
+		}
+		*compressedSize = flushBits(&writer);
+		if ( *compressedSize >= 0)
+		{
+			status = EXIT_SUCCESS;
+		}
+	}
+
+	arFree(serial);
+	arFree(symbols);
+	return status;
+}
+
+/**
+ * Method:    bwtDecompress
+ * FullName:  bwtDecompress
+ * Access:    public
+ * @brief     Decodes the Huffman codes, undoes the zero runs and move-to-front coding, then inverts the
+ *			  Burrows-Wheeler transform by following the last-to-first mapping back from the end marker's row
+ * @param 	  input - the primary row and tree followed by the codes
+ * @param 	  treeSize - size of the primary row and tree in bytes
+ * @param 	  compressedSize - size of the codes in bits
+ * @param 	  output - buffer to save the block to
+ * @param 	  size - size of the block when uncompressed
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the data is corrupt or memory could not be allocated
+ **/
+int bwtDecompress( unsigned char *input, int treeSize, int compressedSize, unsigned char *output, int size)
+{
+	DecodeTable *table;
+	BitReader reader;
+	unsigned char *bwt, list[256], ch;
+	int *lf;
+	int counts[256], starts[256];
+	int i, k, row, primary, symbol, run, weight, status;
+
+	primary = (int) getLE32(input);
+	if ( primary < 1 || primary > size ||
+		 (treeSize - (int) sizeof(int)) <= 0 || (treeSize - (int) sizeof(int)) % (int) sizeof(HuffNodeSerial) != 0)
+	{
+		reportError("Not a valid .ar file, bad BWT block\n");
+		return EXIT_FAILURE;
+	}
+
+	bwt = (unsigned char*) arMalloc( size);
+	lf = (int*) arMalloc( (size + 1) * sizeof(int));
+	table = (DecodeTable*) arMalloc( sizeof(DecodeTable));
+	if ( bwt == NULL || lf == NULL || table == NULL)
+	{
+		reportError("Could not allocate memory for BWT\n");
+		arFree(bwt);
+		arFree(lf);
+		arFree(table);
+		return EXIT_FAILURE;
+	}
+
+	/*Huffman codes back to the last column, undoing the zero runs and move-to-front*/
+	for ( i = 0; i < 256; i++)
+	{
+		list[i] = (unsigned char) i;
+	}
+	initBitReader( &reader, input + treeSize, compressedSize);
+	status = buildDecodeTable( (const HuffNodeSerial*) (input + sizeof(int)), treeSize - (int) sizeof(int),
+							   AR_BWT_SYMBOLS, table);
+	k = 0;
+	run = 0;
+	weight = 1;
+	while ( status == EXIT_SUCCESS && (k < size || run > 0))
+	{
+		symbol = k + run < size ? decodeSymbol( &reader, table) : AR_BWT_SYMBOLS;
+		if ( symbol == AR_BWT_RUNA || symbol == AR_BWT_RUNB)
+		{
+			run += (symbol + 1) * weight;
+			weight <<= 1;
+			if ( k + run > size)
+			{
+				status = EXIT_FAILURE;
+			}
+		}
+		else if ( symbol < 0 || (symbol == AR_BWT_SYMBOLS && run == 0))
+		{
+			status = EXIT_FAILURE;
+		}
+		else
+		{
+			memset( bwt + k, list[0], run);
+			k += run;
+			run = 0;
+			weight = 1;
+			if ( symbol < AR_BWT_SYMBOLS)
+			{
+				ch = list[symbol - 1];
+				memmove( list + 1, list, symbol - 1);
+				list[0] = ch;
+				bwt[k++] = ch;
+			}
+		}
+	}
+	freeDecodeTable(table);
+	arFree(table);
+
+	if ( status == EXIT_SUCCESS)
+	{
+		/*Row i of the last column, with the end marker at row primary*/
+		memset( counts, 0, sizeof(counts));
+		for ( i = 0; i < size; i++)
+		{
+			counts[bwt[i]]++;
+		}
+		/*The end marker is smallest, so every other symbol starts one row later*/
+		starts[0] = 1;
+		for ( i = 1; i < 256; i++)
+		{
+			starts[i] = starts[i - 1] + counts[i - 1];
+		}
+		for ( row = 0; row <= size; row++)
+		{
+			if ( row == primary)
+			{
+				lf[row] = 0;
+			}
+			else
+			{
+				ch = bwt[row < primary ? row : row - 1];
+				lf[row] = starts[ch]++;
+			}
+		}
+
+		/*Row 0 is the rotation starting with the end marker, so its last column is the final byte*/
+		row = 0;
+		for ( k = size - 1; k >= 0 && status == EXIT_SUCCESS; k--)
+		{
+			if ( row == primary)
+			{
+				status = EXIT_FAILURE;
+			}
+			else
+			{
+				output[k] = bwt[row < primary ? row : row - 1];
+				row = lf[row];
+			}
+		}
+	}
+	if ( status != EXIT_SUCCESS)
+	{
+		reportError("Not a valid .ar file, BWT block does not match its tree\n");
+	}
+
+	arFree(bwt);
+	arFree(lf);
+	return status;
+}
@@ -0,0 +1,18 @@
+/*
+ * File:   BWT.h
+ * Author: adrian
+ *
+ * Burrows-Wheeler transform, move-to-front and zero run coding in front of Huffman coding
+ */
+
+#ifndef BWT_H
+#define	BWT_H
+
+#define AR_BWT_RUNA 0  /* Zero run digits, in bijective base 2 */
+#define AR_BWT_RUNB 1
+#define AR_BWT_SYMBOLS 257  /* RUNA, RUNB and move-to-front positions 1 to 255 */
+
+int suffixArray( int *text, int *sa, int size, int alphabetSize);
+int bwtCompress( unsigned char *input, int size, unsigned char *output, int capacity, int *treeSize, int *compressedSize);
+int bwtDecompress( unsigned char *input, int treeSize, int compressedSize, unsigned char *output, int size);
+#endif	/* BWT_H */
@@ -0,0 +1,708 @@
+/**
+ * @file   Batch.c
+ * @author Adrian Rasmussen
+ *
+ * @brief Read ahead for archiving many small files, where the open, read and close of each file cost more
+ *		  than compressing it. Up to AR_BATCH_AHEAD files are read into memory ahead of the compressor. With
+ *		  io_uring every open, size lookup, read and close is queued in one ring and a single thread waits
+ *		  for whichever finishes first, so a whole window of files costs a handful of system calls. The ring
+ *		  is set up with raw system calls, so no library is needed. Without io_uring, AR_BATCH_THREADS threads
+ *		  each read one file at a time with ordinary calls.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "Batch.h"
+#include "Memory.h"
+#include "Report.h"
+
+#if defined(__linux__) && defined(__GNUC__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#ifdef __NR_io_uring_setup
+#define AR_BATCH_URING
+#endif
+#endif
+#endif
+
+static void* readerThread( void *arg);
+static void loadFile( Batch *batch, int index);
+static void finishFile( Batch *batch, int index);
+
+#ifdef AR_BATCH_URING
+#define AR_RING_ENTRIES (2 * AR_BATCH_AHEAD)  /* At most AR_BATCH_AHEAD files are in the ring, each with at most two operations */
+
+/* Operation a completion is for, kept in the low bits of its user_data */
+#define AR_OP_OPEN 0
+#define AR_OP_STAT 1
+#define AR_OP_READ 2
+#define AR_OP_CLOSE 3
+
+typedef struct Ring
+{
+	int fd;
+	unsigned int *sqHead;
+	unsigned int *sqTail;
+	unsigned int sqMask;
+	unsigned int *sqArray;
+	struct io_uring_sqe *sqes;
+	unsigned int *cqHead;
+	unsigned int *cqTail;
+	unsigned int cqMask;
+	struct io_uring_cqe *cqes;
+	void *sqMap;
+	size_t sqMapSize;
+	void *cqMap;
+	size_t cqMapSize;
+	size_t sqesSize;
+	unsigned int queued;  /* Entries added since the last io_uring_enter */
+	int active;  /* Files with operations in the ring */
+	struct statx stats[AR_BATCH_AHEAD];  /* Size lookups in flight, by file index modulo AR_BATCH_AHEAD */
+	long long got[AR_BATCH_AHEAD];  /* Bytes read so far, by file index modulo AR_BATCH_AHEAD */
+} Ring;
+
+/**
+ * Method:    openRing
+ * FullName:  openRing
+ * Access:    private
+ * @brief     Sets up an io_uring and maps its queues. Open, statx, read and close in the ring all arrived in
+ *			  Linux 5.6, as did IORING_FEAT_RW_CUR_POS, so an older kernel is turned away by that feature bit
+ * @return    the ring, or NULL if io_uring can't be used
+ **/
+static Ring* openRing( void)
+{
+	struct io_uring_params params;
+	Ring *ring;
+	unsigned char *sq, *cq;
+
+	ring = (Ring*) arCalloc(1, sizeof(Ring));
+	if ( ring == NULL)
+	{
+		return NULL;
+	}
+	memset(&params, 0, sizeof(params));
+	ring->fd = (int) syscall(__NR_io_uring_setup, AR_RING_ENTRIES, &params);
+	if ( ring->fd < 0 || !(params.features & IORING_FEAT_RW_CUR_POS))
+	{
+		if ( ring->fd >= 0)
+		{
+			close(ring->fd);
+		}
+		arFree(ring);
+		return NULL;
+	}
+
+	ring->sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	ring->cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if ( params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if ( ring->cqMapSize > ring->sqMapSize)
+		{
+			ring->sqMapSize = ring->cqMapSize;
+		}
+		ring->cqMapSize = 0;
+	}
+	ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqMap = mmap(NULL, ring->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	ring->cqMap = ring->cqMapSize == 0 ? ring->sqMap :
+				  mmap(NULL, ring->cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+	ring->sqes = (struct io_uring_sqe*) mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+											 ring->fd, IORING_OFF_SQES);
+	if ( ring->sqMap == MAP_FAILED || ring->cqMap == MAP_FAILED || ring->sqes == MAP_FAILED)
+	{
+		if ( ring->sqes != MAP_FAILED)
+		{
+			munmap(ring->sqes, ring->sqesSize);
+		}
+		if ( ring->cqMapSize != 0 && ring->cqMap != MAP_FAILED)
+		{
+			munmap(ring->cqMap, ring->cqMapSize);
+		}
+		if ( ring->sqMap != MAP_FAILED)
+		{
+			munmap(ring->sqMap, ring->sqMapSize);
+		}
+		close(ring->fd);
+		arFree(ring);
+		return NULL;
+	}
+
+	sq = (unsigned char*) ring->sqMap;
+	cq = (unsigned char*) ring->cqMap;
+	ring->sqHead = (unsigned int*) (sq + params.sq_off.head);
+	ring->sqTail = (unsigned int*) (sq + params.sq_off.tail);
+	ring->sqMask = *(unsigned int*) (sq + params.sq_off.ring_mask);
+	ring->sqArray = (unsigned int*) (sq + params.sq_off.array);
+	ring->cqHead = (unsigned int*) (cq + params.cq_off.head);
+	ring->cqTail = (unsigned int*) (cq + params.cq_off.tail);
+	ring->cqMask = *(unsigned int*) (cq + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+	return ring;
+}
+
+/**
+ * Method:    closeRing
+ * FullName:  closeRing
+ * Access:    private
+ * @param 	  ring - ring to unmap and close, with nothing in flight
+ **/
+static void closeRing( Ring *ring)
+{
+	munmap(ring->sqes, ring->sqesSize);
+	if ( ring->cqMapSize != 0)
+	{
+		munmap(ring->cqMap, ring->cqMapSize);
+	}
+	munmap(ring->sqMap, ring->sqMapSize);
+	close(ring->fd);
+	arFree(ring);
+}
+
+/**
+ * Method:    queueOp
+ * FullName:  queueOp
+ * Access:    private
+ * @brief     Adds an operation to the submission queue, to be sent with the next io_uring_enter. There is
+ *			  always room, as the ring has two entries for every file that can be in it
+ * @param 	  ring - the ring
+ * @param 	  opcode - IORING_OP_*
+ * @param 	  fd - file or directory the operation is on
+ * @param 	  address - path or buffer
+ * @param 	  length - buffer size, or the statx mask
+ * @param 	  offset - file offset, or the statx buffer
+ * @param 	  flags - open or statx flags
+ * @param 	  index - file the operation is for
+ * @param 	  op - AR_OP_* to tell the completion apart
+ **/
+static void queueOp( Ring *ring, int opcode, int fd, const void *address, unsigned int length, unsigned long long offset,
+					 int flags, int index, int op)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int tail;
+
+	tail = *ring->sqTail;
+	sqe = &ring->sqes[tail & ring->sqMask];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = (unsigned char) opcode;
+	sqe->fd = fd;
+	sqe->addr = (unsigned long long) (size_t) address;
+	sqe->len = length;
+	sqe->off = offset;
+	sqe->open_flags = (unsigned int) flags;
+	sqe->user_data = (unsigned long long) index << 2 | (unsigned long long) op;
+	ring->sqArray[tail & ring->sqMask] = tail & ring->sqMask;
+	__atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+	ring->queued++;
+}
+
+/**
+ * Method:    startFile
+ * FullName:  startFile
+ * Access:    private
+ * @brief     Queues the open of a file and the lookup of its size, which run at the same time
+ * @param 	  batch - the batch
+ * @param 	  ring - its ring
+ * @param 	  index - file to start
+ **/
+static void startFile( Batch *batch, Ring *ring, int index)
+{
+	BatchFile *file = &batch->files[index];
+
+	file->fd = -1;
+	file->pending = 2;
+	ring->got[index % AR_BATCH_AHEAD] = 0;
+	queueOp(ring, IORING_OP_OPENAT, AT_FDCWD, batch->names[index], 0, 0, O_RDONLY, index, AR_OP_OPEN);
+	queueOp(ring, IORING_OP_STATX, AT_FDCWD, batch->names[index], STATX_TYPE | STATX_SIZE,
+			(unsigned long long) (size_t) &ring->stats[index % AR_BATCH_AHEAD], 0, index, AR_OP_STAT);
+	ring->active++;
+}
+
+/**
+ * Method:    completeOp
+ * FullName:  completeOp
+ * Access:    private
+ * @brief     Moves a file on once one of its operations finishes. When the open and size lookup are both
+ *			  done the whole file is read into one buffer, then it is handed over and closed
+ * @param 	  batch - the batch
+ * @param 	  ring - its ring
+ * @param 	  index - file the operation was for
+ * @param 	  op - AR_OP_* of the operation
+ * @param 	  result - the operation's result, or -errno
+ **/
+static void completeOp( Batch *batch, Ring *ring, int index, int op, int result)
+{
+	BatchFile *file = &batch->files[index];
+	struct statx *stat = &ring->stats[index % AR_BATCH_AHEAD];
+	long long *got = &ring->got[index % AR_BATCH_AHEAD];
+
+	file->pending--;
+	if ( op == AR_OP_CLOSE)
+	{
+		ring->active--;
+		return;
+	}
+	if ( result < 0 && file->error == 0)
+	{
+		file->error = -result;
+	}
+	if ( op == AR_OP_OPEN && result >= 0)
+	{
+		file->fd = result;
+	}
+	if ( op == AR_OP_READ && result > 0)
+	{
+		/*One byte more than the size is asked for, so a file that grew is noticed and left to be read directly*/
+		*got += result;
+		if ( *got < file->size)
+		{
+			queueOp(ring, IORING_OP_READ, file->fd, file->data + *got, (unsigned int) (file->size + 1 - *got),
+					(unsigned long long) *got, 0, index, AR_OP_READ);
+			file->pending++;
+			return;
+		}
+		file->direct = *got > file->size;
+	}
+	if ( file->pending > 0)
+	{
+		return;
+	}
+
+	if ( op != AR_OP_READ && file->error == 0 && S_ISREG(stat->stx_mode) && stat->stx_size <= AR_BATCH_MAX_FILE)
+	{
+		file->size = (long long) stat->stx_size;
+		file->data = (unsigned char*) arMalloc(file->size + 1);
+		if ( file->data == NULL)
+		{
+			file->error = ENOMEM;
+		}
+		else
+		{
+			queueOp(ring, IORING_OP_READ, file->fd, file->data, (unsigned int) (file->size + 1), 0, 0, index, AR_OP_READ);
+			file->pending++;
+			return;
+		}
+	}
+	else if ( op != AR_OP_READ && file->error == 0)
+	{
+		file->direct = 1;
+	}
+
+	if ( op == AR_OP_READ && file->error == 0 && !file->direct)
+	{
+		file->size = *got;
+	}
+	if ( file->error != 0 || file->direct)
+	{
+		arFree(file->data);
+		file->data = NULL;
+	}
+	if ( file->fd >= 0)
+	{
+		queueOp(ring, IORING_OP_CLOSE, file->fd, NULL, 0, 0, 0, index, AR_OP_CLOSE);
+		file->pending++;
+		file->fd = -1;
+	}
+	else
+	{
+		ring->active--;
+	}
+	pthread_mutex_lock(&batch->mutex);
+	finishFile(batch, index);
+	pthread_mutex_unlock(&batch->mutex);
+}
+
+/**
+ * Method:    ringThread
+ * FullName:  ringThread
+ * Access:    private
+ * @brief     Keeps the window of files ahead of the caller in flight, submitting new operations and
+ *			  collecting completions with one io_uring_enter each time round
+ * @param 	  arg - the Batch
+ * @return    NULL, once closeBatch has stopped it or every file has been read
+ **/
+static void* ringThread( void *arg)
+{
+	Batch *batch = (Batch*) arg;
+	Ring *ring = (Ring*) batch->ring;
+	struct io_uring_cqe *cqe;
+	unsigned int head, tail;
+	int result, i;
+
+	for ( ;;)
+	{
+		pthread_mutex_lock(&batch->mutex);
+		/*Files still closing count too, so the ring can never overflow*/
+		while ( !batch->stop && batch->next < batch->numFiles && batch->next < batch->released + AR_BATCH_AHEAD &&
+				ring->active < AR_BATCH_AHEAD)
+		{
+			startFile(batch, ring, batch->next++);
+		}
+		if ( ring->active == 0)
+		{
+			if ( batch->stop || batch->next >= batch->numFiles)
+			{
+				pthread_mutex_unlock(&batch->mutex);
+				return NULL;
+			}
+			/*Window is full of files the caller hasn't reached yet*/
+			pthread_cond_wait(&batch->cond, &batch->mutex);
+			pthread_mutex_unlock(&batch->mutex);
+			continue;
+		}
+		pthread_mutex_unlock(&batch->mutex);
+
+		result = (int) syscall(__NR_io_uring_enter, ring->fd, ring->queued, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+		if ( result < 0 && errno != EINTR)
+		{
+			reportSystemError("io_uring_enter");
+			/*Anything still in the ring is lost, so fail the files waiting on it*/
+			pthread_mutex_lock(&batch->mutex);
+			for ( i = batch->released; i < batch->next; i++)
+			{
+				if ( !batch->files[i].ready)
+				{
+					batch->files[i].error = EIO;
+					batch->files[i].ready = 1;
+				}
+			}
+			batch->stop = 1;
+			pthread_cond_broadcast(&batch->cond);
+			pthread_mutex_unlock(&batch->mutex);
+			return NULL;
+		}
+		if ( result > 0)
+		{
+			ring->queued -= (unsigned int) result < ring->queued ? (unsigned int) result : ring->queued;
+		}
+
+		head = *ring->cqHead;
+		tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+		while ( head != tail)
+		{
+			cqe = &ring->cqes[head & ring->cqMask];
+			completeOp(batch, ring, (int) (cqe->user_data >> 2), (int) (cqe->user_data & 3), cqe->res);
+			head++;
+		}
+		__atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+	}
+}
+#endif
+
+/**
+ * Method:    openBatch
+ * FullName:  openBatch
+ * Access:    public
+ * @brief     Starts reading a list of files ahead, with io_uring if the kernel allows it, otherwise with threads
+ * @param 	  batch - batch to start
+ * @param 	  names - files to read, kept until closeBatch
+ * @param 	  numFiles - number of files
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if memory or threads could not be had
+ **/
+int openBatch( Batch *batch, char **names, int numFiles)
+{
+	const char *choice = getenv("ARCHIVER_IO");
+	int i;
+
+	memset(batch, 0, sizeof(*batch));
+	batch->names = names;
+	batch->numFiles = numFiles;
+	batch->files = (BatchFile*) arCalloc(numFiles > 0 ? numFiles : 1, sizeof(BatchFile));
+	batch->threads = (pthread_t*) arMalloc(AR_BATCH_THREADS * sizeof(pthread_t));
+	if ( batch->files == NULL || batch->threads == NULL)
+	{
+		reportError("Could not allocate memory for file list\n");
+		arFree(batch->files);
+		arFree(batch->threads);
+		return EXIT_FAILURE;
+	}
+	pthread_mutex_init(&batch->mutex, NULL);
+	pthread_cond_init(&batch->cond, NULL);
+
+#ifdef AR_BATCH_URING
+	if ( choice == NULL || strcmp(choice, "threads") != 0)
+	{
+		batch->ring = openRing();
+	}
+	if ( batch->ring != NULL)
+	{
+		batch->backend = "io_uring";
+		if ( pthread_create(&batch->threads[0], NULL, &ringThread, batch) == 0)
+		{
+			batch->numThreads = 1;
+			return EXIT_SUCCESS;
+		}
+		closeRing((Ring*) batch->ring);
+		batch->ring = NULL;
+	}
+#else
+	(void) choice;
+#endif
+	batch->backend = "threads";
+	for ( i = 0; i < AR_BATCH_THREADS; i++)
+	{
+		if ( pthread_create(&batch->threads[batch->numThreads], NULL, &readerThread, batch) == 0)
+		{
+			batch->numThreads++;
+		}
+	}
+	if ( batch->numThreads == 0)
+	{
+		reportError("Could not start reader threads\n");
+		closeBatch(batch);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    readerThread
+ * FullName:  readerThread
+ * Access:    private
+ * @brief     Reads the next file in the window with ordinary calls, until every file has been read
+ * @param 	  arg - the Batch
+ * @return    NULL
+ **/
+static void* readerThread( void *arg)
+{
+	Batch *batch = (Batch*) arg;
+	int index;
+
+	for ( ;;)
+	{
+		pthread_mutex_lock(&batch->mutex);
+		while ( !batch->stop && batch->next < batch->numFiles && batch->next >= batch->released + AR_BATCH_AHEAD)
+		{
+			pthread_cond_wait(&batch->cond, &batch->mutex);
+		}
+		if ( batch->stop || batch->next >= batch->numFiles)
+		{
+			pthread_mutex_unlock(&batch->mutex);
+			return NULL;
+		}
+		index = batch->next++;
+		pthread_mutex_unlock(&batch->mutex);
+
+		loadFile(batch, index);
+		pthread_mutex_lock(&batch->mutex);
+		finishFile(batch, index);
+		pthread_mutex_unlock(&batch->mutex);
+	}
+}
+
+/**
+ * Method:    loadFile
+ * FullName:  loadFile
+ * Access:    private
+ * @brief     Reads a whole file into memory, unless it is too big or not a regular file
+ * @param 	  batch - the batch
+ * @param 	  index - file to read
+ **/
+static void loadFile( Batch *batch, int index)
+{
+	BatchFile *file = &batch->files[index];
+	struct stat info;
+	ssize_t got;
+	long long size;
+	int fd;
+
+	fd = open(batch->names[index], O_RDONLY);
+	if ( fd < 0)
+	{
+		file->error = errno;
+		return;
+	}
+	if ( fstat(fd, &info) != 0)
+	{
+		file->error = errno;
+	}
+	else if ( !S_ISREG(info.st_mode) || info.st_size > AR_BATCH_MAX_FILE)
+	{
+		file->direct = 1;
+	}
+	else if ( (file->data = (unsigned char*) arMalloc(info.st_size + 1)) == NULL)
+	{
+		file->error = ENOMEM;
+	}
+	else
+	{
+		/*One byte more than the size is asked for, so a file that grew is noticed*/
+		size = 0;
+		while ( size <= (long long) info.st_size)
+		{
+			got = read(fd, file->data + size, (size_t) (info.st_size + 1 - size));
+			if ( got < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if ( got < 0)
+			{
+				file->error = errno;
+			}
+			if ( got <= 0)
+			{
+				break;
+			}
+			size += got;
+		}
+		file->size = size;
+		if ( size > (long long) info.st_size)
+		{
+			file->direct = 1;
+		}
+		if ( file->error != 0 || file->direct)
+		{
+			arFree(file->data);
+			file->data = NULL;
+		}
+	}
+	close(fd);
+}
+
+/**
+ * Method:    finishFile
+ * FullName:  finishFile
+ * Access:    private
+ * @brief     Marks a file ready and wakes the caller. Called with the batch's mutex held
+ * @param 	  batch - the batch
+ * @param 	  index - file that is ready
+ **/
+static void finishFile( Batch *batch, int index)
+{
+	batch->files[index].ready = 1;
+	pthread_cond_broadcast(&batch->cond);
+}
+
+/**
+ * Method:    readBatch
+ * FullName:  readBatch
+ * Access:    public
+ * @brief     Gives the next part of the files, in order, waiting for a file if it hasn't been read yet.
+ *			  A part never spans two files, so the caller can tell which file it came from. A file's memory
+ *			  is freed as soon as all of it has been given out, making room for another to be read ahead
+ * @param 	  batch - the batch
+ * @param 	  buffer - buffer to fill
+ * @param 	  capacity - size of buffer
+ * @param 	  size - set to the bytes given, or 0 once every file has been read
+ * @param 	  file - set to the index of the file the bytes came from
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if a file could not be read
+ **/
+int readBatch( Batch *batch, unsigned char *buffer, int capacity, int *size, int *file)
+{
+	BatchFile *current;
+	long long count;
+
+	*size = 0;
+	while ( batch->current < batch->numFiles)
+	{
+		current = &batch->files[batch->current];
+		pthread_mutex_lock(&batch->mutex);
+		while ( !current->ready && !batch->stop)
+		{
+			pthread_cond_wait(&batch->cond, &batch->mutex);
+		}
+		/*Reading ahead gave up before this file was started*/
+		if ( !current->ready)
+		{
+			current->error = EIO;
+		}
+		pthread_mutex_unlock(&batch->mutex);
+
+		if ( current->error != 0)
+		{
+			errno = current->error;
+			reportSystemError(batch->names[batch->current]);
+			return EXIT_FAILURE;
+		}
+		count = 0;
+		if ( current->direct)
+		{
+			if ( batch->input == NULL && (batch->input = fopen(batch->names[batch->current], "rb")) == NULL)
+			{
+				reportSystemError(batch->names[batch->current]);
+				return EXIT_FAILURE;
+			}
+			count = (long long) fread(buffer, 1, capacity, batch->input);
+			if ( ferror(batch->input))
+			{
+				reportSystemError(batch->names[batch->current]);
+				return EXIT_FAILURE;
+			}
+		}
+		else
+		{
+			count = current->size - batch->position < capacity ? current->size - batch->position : capacity;
+			memcpy(buffer, current->data + batch->position, (size_t) count);
+			batch->position += count;
+		}
+		if ( count > 0)
+		{
+			*size = (int) count;
+			*file = batch->current;
+			return EXIT_SUCCESS;
+		}
+
+		/*All of this file has been given out*/
+		if ( batch->input != NULL)
+		{
+			fclose(batch->input);
+			batch->input = NULL;
+		}
+		pthread_mutex_lock(&batch->mutex);
+		arFree(current->data);
+		current->data = NULL;
+		batch->released++;
+		pthread_cond_broadcast(&batch->cond);
+		pthread_mutex_unlock(&batch->mutex);
+		batch->current++;
+		batch->position = 0;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    closeBatch
+ * FullName:  closeBatch
+ * Access:    public
+ * @brief     Stops reading ahead, waits for anything in flight and frees every file still held
+ * @param 	  batch - batch to close
+ **/
+void closeBatch( Batch *batch)
+{
+	int i;
+
+	pthread_mutex_lock(&batch->mutex);
+	batch->stop = 1;
+	pthread_cond_broadcast(&batch->cond);
+	pthread_mutex_unlock(&batch->mutex);
+	for ( i = 0; i < batch->numThreads; i++)
+	{
+		pthread_join(batch->threads[i], NULL);
+	}
+#ifdef AR_BATCH_URING
+	if ( batch->ring != NULL)
+	{
+		closeRing((Ring*) batch->ring);
+	}
+#endif
+	if ( batch->input != NULL)
+	{
+		fclose(batch->input);
+	}
+	for ( i = 0; i < batch->numFiles; i++)
+	{
+		arFree(batch->files[i].data);
+	}
+	pthread_mutex_destroy(&batch->mutex);
+	pthread_cond_destroy(&batch->cond);
+	arFree(batch->files);
+	arFree(batch->threads);
+}
@@ -0,0 +1,55 @@
+/*
+ * File:   Batch.h
+ * Author: adrian
+ *
+ * Reads a list of small files ahead of the compressor, with many opens and reads
+ * in flight at once. On Linux one thread drives them all through io_uring; where
+ * that isn't available a few threads each read a file at a time. ARCHIVER_IO=threads
+ * always uses the threads
+ */
+
+#ifndef BATCH_H
+#define	BATCH_H
+#include <stdio.h>
+#include <pthread.h>
+
+#define AR_BATCH_AHEAD 64  /* Most files read ahead of the one being compressed */
+#define AR_BATCH_MAX_FILE 1048576  /* Larger files are read a block at a time by the caller instead */
+#define AR_BATCH_THREADS 8  /* Threads reading files when io_uring can't be used */
+
+typedef struct BatchFile
+{
+	unsigned char *data;  /* Whole file, once ready, unless direct */
+	long long size;
+	int direct;  /* 1 if the file is too big or not a regular file, and is read by readBatch itself */
+	int error;  /* errno if the file could not be read, otherwise 0 */
+	int ready;  /* 1 once the fields above are final */
+	int fd;  /* Open file, while io_uring is reading it */
+	int pending;  /* io_uring operations not yet completed */
+} BatchFile;
+
+typedef struct Batch
+{
+	char **names;
+	int numFiles;
+	BatchFile *files;
+	const char *backend;  /* "io_uring" or "threads" */
+	int next;  /* Next file to start reading */
+	int released;  /* Files the caller has finished with */
+	int stop;  /* Set by closeBatch, nothing new is started */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;  /* Signalled when a file is ready or released */
+	pthread_t *threads;
+	int numThreads;
+	void *ring;  /* io_uring state, or NULL with threads */
+
+	/*Read position of the caller, used by readBatch*/
+	int current;
+	long long position;
+	FILE *input;  /* The current file, when it is direct */
+} Batch;
+
+int openBatch( Batch *batch, char **names, int numFiles);
+int readBatch( Batch *batch, unsigned char *buffer, int capacity, int *size, int *file);
+void closeBatch( Batch *batch);
+#endif	/* BATCH_H */
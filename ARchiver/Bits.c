@@ -0,0 +1,203 @@
+/**
+ * @file   Bits.c
+ * @author Adrian Rasmussen
+ *
+ * @brief Bit level writing and reading of packed data, used for codes and the extra bits that follow them.
+ *		  Bits are packed with the first bit of each byte in the highest position, as in the rest of the .ar format
+ */
+#include <stdlib.h>
+#include "Bits.h"
+
+/**
+ * Method:    initBitWriter
+ * FullName:  initBitWriter
+ * Access:    public
+ * @brief     Prepares a writer to pack bits into a buffer
+ * @param 	  writer - writer to initialise
+ * @param 	  data - buffer to write to
+ * @param 	  capacity - size of data in bytes
+ **/
+void initBitWriter( BitWriter *writer, unsigned char *data, int capacity)
+{
+	writer->data = data;
+	writer->capacity = capacity;
+	writer->size = 0;
+	writer->byte = 0;
+	writer->numBits = 0;
+	writer->overflow = 0;
+}
+
+/**
+ * Method:    putBits
+ * FullName:  putBits
+ * Access:    public
+ * @brief     Writes the lowest count bits of value, highest of them first. Sets overflow instead of
+ *			  writing past the end of the buffer
+ * @param 	  writer - the writer
+ * @param 	  value - bits to write
+ * @param 	  count - number of bits, 0 to 32
+ **/
+void putBits( BitWriter *writer, unsigned int value, int count)
+{
+	int take;
+
+	/*As many bits at a time as the partly filled byte has room for*/
+	while ( count > 0)
+	{
+		take = count < 8 - writer->numBits ? count : 8 - writer->numBits;
+		count -= take;
+		writer->byte |= ((value >> count) & ((1u << take) - 1)) << (8 - writer->numBits - take);
+		writer->numBits += take;
+		if ( writer->numBits == 8)
+		{
+			if ( writer->size < writer->capacity)
+			{
+				writer->data[writer->size++] = writer->byte;
+			}
+			else
+			{
+				writer->overflow = 1;
+			}
+			writer->byte = 0;
+			writer->numBits = 0;
+		}
+	}
+}
+
+/**
+ * Method:    putCode
+ * FullName:  putCode
+ * Access:    public
+ * @brief     Writes a code from {@link canonicalCodes}, highest bit first
+ * @param 	  writer - the writer
+ * @param 	  code - the code, in its lowest length bits
+ * @param 	  length - length of the code, at most AR_MAX_CODE_LENGTH
+ **/
+void putCode( BitWriter *writer, unsigned long long code, int length)
+{
+	if ( length > 32)
+	{
+		putBits( writer, (unsigned int) (code >> 32), length - 32);
+		length = 32;
+	}
+	putBits( writer, (unsigned int) code, length);
+}
+
+/**
+ * Method:    flushBits
+ * FullName:  flushBits
+ * Access:    public
+ * @brief     Writes the last partly filled byte, padded with 0s
+ * @param 	  writer - the writer
+ * @return    number of bits written excluding padding, or -1 if they did not fit in the buffer
+ **/
+int flushBits( BitWriter *writer)
+{
+	int sizeBits = writer->size * 8 + writer->numBits;
+
+	if ( writer->numBits > 0)
+	{
+		if ( writer->size < writer->capacity)
+		{
+			writer->data[writer->size++] = writer->byte;
+		}
+		else
+		{
+			writer->overflow = 1;
+		}
+		writer->byte = 0;
+		writer->numBits = 0;
+	}
+	return writer->overflow ? -1 : sizeBits;
+}
+
+/**
+ * Method:    initBitReader
+ * FullName:  initBitReader
+ * Access:    public
+ * @brief     Prepares a reader to unpack bits from a buffer
+ * @param 	  reader - reader to initialise
+ * @param 	  data - packed bits
+ * @param 	  sizeBits - number of valid bits in data
+ **/
+void initBitReader( BitReader *reader, unsigned char *data, int sizeBits)
+{
+	reader->data = data;
+	reader->sizeBits = sizeBits;
+	reader->position = 0;
+}
+
+/**
+ * Method:    getBits
+ * FullName:  getBits
+ * Access:    public
+ * @brief     Reads count bits, the first read becoming the highest bit of the result
+ * @param 	  reader - the reader
+ * @param 	  count - number of bits, 0 to 30
+ * @return    the bits, or -1 if there are not enough left
+ **/
+int getBits( BitReader *reader, int count)
+{
+	int value = 0;
+
+	if ( reader->position + count > reader->sizeBits)
+	{
+		return -1;
+	}
+	while ( count > 0)
+	{
+		value = (value << 1) |
+				((reader->data[reader->position >> 3] >> (7 - (reader->position & 7))) & 1);
+		reader->position++;
+		count--;
+	}
+	return value;
+}
+
+/**
+ * Method:    decodeSymbol
+ * FullName:  decodeSymbol
+ * Access:    public
+ * @brief     Decodes one symbol, looking up the next AR_DECODE_BITS bits in the table and following the tree's
+ *			  child list a bit at a time only for longer codes
+ * @param 	  reader - the reader
+ * @param 	  table - decode table from {@link buildDecodeTable}
+ * @return    the symbol, or -1 if the bits run out or do not match the tree
+ **/
+int decodeSymbol( BitReader *reader, const DecodeTable *table)
+{
+	const DecodeEntry *entry;
+	int first, numBytes, window, peek, node, bit, i;
+
+	/*Bits past the end read as 0, which only matters if a code does not fit in what is left*/
+	first = reader->position >> 3;
+	numBytes = (reader->sizeBits + 7) >> 3;
+	window = 0;
+	for ( i = 0; i < 3; i++)
+	{
+		window = (window << 8) | (first + i < numBytes ? reader->data[first + i] : 0);
+	}
+	peek = (window >> (24 - AR_DECODE_BITS - (reader->position & 7))) & ((1 << AR_DECODE_BITS) - 1);
+	entry = &table->entries[peek];
+	if ( entry->symbol == -1 || entry->length > reader->sizeBits - reader->position)
+	{
+		return -1;
+	}
+	reader->position += entry->length;
+	if ( entry->symbol != -2)
+	{
+		return entry->symbol;
+	}
+
+	node = table->nodes[peek];
+	while ( node != -1 && table->children[2 * node] != -1)
+	{
+		bit = getBits( reader, 1);
+		if ( bit == -1)
+		{
+			return -1;
+		}
+		node = table->children[2 * node + bit];
+	}
+	return node == -1 ? -1 : table->symbols[node];
+}
@@ -0,0 +1,36 @@
+/*
+ * File:   Bits.h
+ * Author: adrian
+ *
+ * Packing and unpacking of bit strings, highest bit of each byte first
+ */
+
+#ifndef BITS_H
+#define	BITS_H
+#include "Huffman.h"
+
+typedef struct BitWriter
+{
+	unsigned char *data;
+	int capacity;   /* Size of data in bytes */
+	int size;       /* Whole bytes written */
+	unsigned char byte;  /* Partly filled byte */
+	int numBits;    /* Bits used in byte */
+	int overflow;   /* Set once a write did not fit in capacity */
+} BitWriter;
+
+typedef struct BitReader
+{
+	unsigned char *data;
+	int sizeBits;   /* Number of valid bits in data, excluding padding */
+	int position;   /* Next bit to read */
+} BitReader;
+
+void initBitWriter( BitWriter *writer, unsigned char *data, int capacity);
+void putBits( BitWriter *writer, unsigned int value, int count);
+void putCode( BitWriter *writer, unsigned long long code, int length);
+int flushBits( BitWriter *writer);
+void initBitReader( BitReader *reader, unsigned char *data, int sizeBits);
+int getBits( BitReader *reader, int count);
+int decodeSymbol( BitReader *reader, const DecodeTable *table);
+#endif	/* BITS_H */
@@ -0,0 +1,273 @@
+/**
+ * @file   Codec.c
+ * @author Adrian Rasmussen
+ *
+ * @brief Compression and decompression of a single block, independent of where blocks come from or go to.
+ *		  The file pipeline in ARchiver.c and the in-memory API in libarchiver.c both code blocks through here.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Codec.h"
+#include "Stats.h"
+#include "Memory.h"
+#include "Report.h"
+
+/**
+ * Method:    compressBlock
+ * FullName:  compressBlock
+ * Access:    public 
+ * @brief   Coder stage for compression. With AR_METHOD_HUFFMAN, gives each byte a canonical Huffman code and saves
+ *			the serialized tree of the codes followed by the compressed data in block->output. AR_METHOD_LZ77 and AR_METHOD_BWT
+ *			do the same with {@link lz77Compress} and {@link bwtCompress}, and with a base file every block
+ *			uses {@link deltaCompress}. AR_METHOD_SPLIT codes the block in segments with {@link splitCompress},
+ *			or as one AR_METHOD_HUFFMAN block if that is no bigger, and AR_METHOD_WORDS codes it as words and
+ *			literals with {@link wordsCompress}, or as AR_METHOD_HUFFMAN if no word is worth a symbol. If this
+ *			would not be smaller than the block itself, the block is stored uncompressed with no tree. With
+ *			stats on, each stage of a Huffman block is timed on its own, and the other methods as one encode stage
+ * @param 	  pipeline - pipeline whose context points to the ARContext with the level to use
+ * @param 	  block - block holding the uncompressed data
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if memory could not be allocated
+ **/
+int compressBlock( Pipeline *pipeline, Block *block)
+{
+    const ARContext *context = (const ARContext*) pipeline->context;
+    const ARLevel *level = context->level;
+    HuffNodeSerial *treeSerial;
+    unsigned long long codes[256];
+    unsigned char lengths[256];
+    int counts[256];
+    int treeSize, status;
+    StageTimer timer;
+
+    block->header.method = context->base != NULL ? AR_METHOD_DELTA : level->method;
+    block->header.uncompressedDataSize = block->inputSize;
+    block->header.checksum = crc32c(0, block->input, block->inputSize);
+    startStage(&timer, block->header.method == AR_METHOD_HUFFMAN ? AR_STAGE_HISTOGRAM : AR_STAGE_ENCODE);
+    if ( block->inputSize == 0)
+    {
+        /*Every chunk in the block was a repeat, so it is stored empty*/
+        status = EXIT_FAILURE;
+    }
+    else if ( block->header.method == AR_METHOD_DELTA)
+    {
+        status = deltaCompress(context->base, block->input, block->inputSize, block->output, block->inputSize,
+                               &block->header.huffTreeSize, &block->header.compressedDataSize);
+        if ( status == EXIT_SUCCESS)
+        {
+            block->outputSize = block->header.huffTreeSize + (block->header.compressedDataSize + 7) / 8;
+        }
+    }
+    else if ( block->header.method == AR_METHOD_LZ77)
+    {
+        status = lz77Compress(block->input, block->inputSize, block->output, block->inputSize, level->maxChain, level->lazy,
+                              &block->header.huffTreeSize, &block->header.compressedDataSize);
+        if ( status == EXIT_SUCCESS)
+        {
+            block->outputSize = block->header.huffTreeSize + (block->header.compressedDataSize + 7) / 8;
+        }
+    }
+    else if ( block->header.method == AR_METHOD_BWT)
+    {
+        status = bwtCompress(block->input, block->inputSize, block->output, block->inputSize,
+                             &block->header.huffTreeSize, &block->header.compressedDataSize);
+        if ( status == EXIT_SUCCESS)
+        {
+            block->outputSize = block->header.huffTreeSize + (block->header.compressedDataSize + 7) / 8;
+        }
+    }
+    else if ( block->header.method == AR_METHOD_SPLIT &&
+              splitCompress(block->input, block->inputSize, block->output, block->inputSize,
+                            &block->header.huffTreeSize, &block->header.compressedDataSize) == EXIT_SUCCESS)
+    {
+        block->outputSize = block->header.huffTreeSize + block->header.compressedDataSize / 8;
+        status = EXIT_SUCCESS;
+    }
+    else if ( block->header.method == AR_METHOD_WORDS &&
+              wordsCompress(block->input, block->inputSize, block->output, block->inputSize,
+                            &block->header.huffTreeSize, &block->header.compressedDataSize) == EXIT_SUCCESS)
+    {
+        block->outputSize = block->header.huffTreeSize + (block->header.compressedDataSize + 7) / 8;
+        status = EXIT_SUCCESS;
+    }
+    else
+    {
+        /*A split or word block that fell back was timed as encode, so the histogram is timed afresh*/
+        if ( block->header.method == AR_METHOD_SPLIT || block->header.method == AR_METHOD_WORDS)
+        {
+            startStage(&timer, AR_STAGE_HISTOGRAM);
+        }
+        block->header.method = AR_METHOD_HUFFMAN;
+        /*Get frequency of each character in the block*/
+        countBytes(block->input, block->inputSize, counts);
+        endStage(&timer, block->inputSize);
+        startStage(&timer, AR_STAGE_TREE);
+        /*Canonical code of each byte from the frequencies, and the tree of those codes for the .ar file*/
+        treeSerial = buildCodes(counts, 256, lengths, codes, &treeSize);
+        if ( treeSerial == NULL)
+        {
+            /*Ended so the thread's allocations stop counting against the tree*/
+            endStage(&timer, block->inputSize);
+            reportError("Could not build tree, exiting\n");
+            return EXIT_FAILURE;
+        }
+        endStage(&timer, block->inputSize);
+        startStage(&timer, AR_STAGE_ENCODE);
+        memcpy(block->output, treeSerial, treeSize);
+        status = packCodes(block->input, block->inputSize, codes, lengths, block->output + treeSize,
+                           block->inputSize - treeSize, &block->header.compressedDataSize);
+        block->header.huffTreeSize = treeSize;
+        block->outputSize = treeSize + (block->header.compressedDataSize + 7) / 8;
+        arFree(treeSerial);
+    }
+
+    if ( status != EXIT_SUCCESS) /*Compressed size would be greater than original, store the block as it is*/
+    {
+        block->header.method = AR_METHOD_HUFFMAN;
+        block->header.huffTreeSize = 0;
+        block->header.compressedDataSize = block->inputSize * 8;
+        memcpy(block->output, block->input, block->inputSize);
+        block->outputSize = block->inputSize;
+    }
+    if ( block->inputSize > 0)
+    {
+        endCodingStage(&timer, block->input, block->inputSize, block->header.compressedDataSize);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    decompressBlock
+ * FullName:  decompressBlock
+ * Access:    public 
+ * @brief   Coder stage for decompression, reads the block's tree into a decode table and decodes its data into
+ *			block->output, then checks the data against the block's checksum. With stats on, reading a Huffman
+ *			block's tree is timed apart from decoding it
+ * @param 	  pipeline - the pipeline
+ * @param 	  block - block holding the serialized tree and compressed data
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the data is corrupt or memory could not be allocated
+ **/
+int decompressBlock( Pipeline *pipeline, Block *block)
+{
+    ARBlockHeader *header = &block->header;
+    DecodeTable *table;
+    int status;
+    StageTimer timer;
+
+    status = EXIT_FAILURE;
+    block->outputSize = header->uncompressedDataSize;
+    startStage(&timer, header->method == AR_METHOD_HUFFMAN && header->huffTreeSize > 0 ? AR_STAGE_READ_TREE : AR_STAGE_DECODE);
+    if ( header->method == AR_METHOD_LZ77)
+    {
+        status = lz77Decompress(block->input, header->huffTreeSize, header->compressedDataSize,
+                                block->output, header->uncompressedDataSize);
+    }
+    else if ( header->method == AR_METHOD_DELTA)
+    {
+        status = deltaDecompress(((ARContext*) pipeline->context)->base, block->input, header->huffTreeSize,
+                                 header->compressedDataSize, block->output, header->uncompressedDataSize);
+    }
+    else if ( header->method == AR_METHOD_BWT)
+    {
+        status = bwtDecompress(block->input, header->huffTreeSize, header->compressedDataSize,
+                               block->output, header->uncompressedDataSize);
+    }
+    else if ( header->method == AR_METHOD_SPLIT)
+    {
+        status = splitDecompress(block->input, header->huffTreeSize, header->compressedDataSize,
+                                 block->output, header->uncompressedDataSize);
+    }
+    else if ( header->method == AR_METHOD_WORDS)
+    {
+        status = wordsDecompress(block->input, header->huffTreeSize, header->compressedDataSize,
+                                 block->output, header->uncompressedDataSize);
+    }
+    else if ( header->huffTreeSize == 0) /*Stored block*/
+    {
+        if ( header->compressedDataSize != header->uncompressedDataSize * 8)
+        {
+            reportError("Not a valid .ar file, bad stored block\n");
+            return EXIT_FAILURE;
+        }
+        memcpy(block->output, block->input, header->uncompressedDataSize);
+        status = EXIT_SUCCESS;
+    }
+    else
+    {
+        table = (DecodeTable*) arMalloc( sizeof(DecodeTable));
+        if ( table == NULL)
+        {
+            reportError("Could not allocate memory for decode table\n");
+            return EXIT_FAILURE;
+        }
+        if ( buildDecodeTable( (HuffNodeSerial*) block->input, header->huffTreeSize, 256, table) != EXIT_SUCCESS)
+        {
+            reportError("Not a valid .ar file, bad tree\n");
+        }
+        else
+        {
+            endStage(&timer, header->huffTreeSize);
+            startStage(&timer, AR_STAGE_DECODE);
+            block->outputSize = decodeBytes( block->input + header->huffTreeSize, header->compressedDataSize,
+                                             block->output, header->uncompressedDataSize, table);
+            if ( block->outputSize == header->uncompressedDataSize)
+            {
+                status = EXIT_SUCCESS;
+            }
+            else
+            {
+                reportError("Not a valid .ar file, block does not match its tree\n");
+            }
+            freeDecodeTable(table);
+        }
+        arFree(table);
+    }
+
+    if ( status == EXIT_SUCCESS)
+    {
+        endCodingStage(&timer, block->output, block->outputSize, header->compressedDataSize);
+    }
+
+    /*Checked while the block is still in cache, on the coder thread so blocks are checked in parallel*/
+    if ( status == EXIT_SUCCESS && crc32c(0, block->output, block->outputSize) != header->checksum)
+    {
+        reportError("Archive is corrupt, block %ld does not match its checksum\n", block->seq);
+        status = EXIT_FAILURE;
+    }
+    return status;
+}
+
+/**
+ * Method:    checkBlockHeader
+ * FullName:  checkBlockHeader
+ * Access:    public 
+ * @brief   Checks the sizes in a block header read from an archive before they are trusted
+ * @param 	  header - the block header
+ * @param 	  blockSize - block size from the archive's header
+ * @param 	  hasBase - 1 if a base file is open for AR_METHOD_DELTA blocks
+ * @param 	  hasChunks - 1 if the block has a chunk list, so it may hold no new data
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the header is invalid
+ **/
+int checkBlockHeader( const ARBlockHeader *header, int blockSize, int hasBase, int hasChunks)
+{
+    if ( header->method < AR_METHOD_HUFFMAN || header->method > AR_METHOD_WORDS || header->method == AR_METHOD_END ||
+         header->huffTreeSize < 0 ||
+         (header->method != AR_METHOD_SPLIT && header->method != AR_METHOD_WORDS && header->huffTreeSize > AR_MAX_TREE_SIZE) ||
+         /*Segment trees and word dictionaries can add up to more, but such a block is always smaller than its data*/
+         (header->method == AR_METHOD_SPLIT && (header->huffTreeSize <= 4 ||
+          header->huffTreeSize > header->uncompressedDataSize - header->compressedDataSize / 8)) ||
+         (header->method == AR_METHOD_WORDS && (header->huffTreeSize <= 8 ||
+          header->huffTreeSize > header->uncompressedDataSize - (header->compressedDataSize + 7) / 8)) ||
+         (header->method == AR_METHOD_HUFFMAN && header->huffTreeSize % sizeof(HuffNodeSerial) != 0) ||
+         ((header->method == AR_METHOD_LZ77 || header->method == AR_METHOD_BWT) && header->huffTreeSize <= (int) sizeof(int)) ||
+         (header->method == AR_METHOD_DELTA && (!hasBase || header->huffTreeSize < (int) sizeof(int))) ||
+         header->uncompressedDataSize < (hasChunks ? 0 : 1) ||
+         header->uncompressedDataSize > blockSize ||
+         header->compressedDataSize < 0 || header->compressedDataSize / 8 > header->uncompressedDataSize)
+    {
+        reportError("Not a valid .ar file, bad block sizes\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,61 @@
+/*
+ * File:   Codec.h
+ * Author: adrian
+ *
+ * Coding of single blocks, shared by the file pipeline and the in-memory API
+ */
+
+#ifndef CODEC_H
+#define	CODEC_H
+#include "ARHeader.h"
+#include "Huffman.h"
+#include "Pipeline.h"
+#include "LZ77.h"
+#include "BWT.h"
+#include "Level.h"
+#include "Dedup.h"
+#include "Delta.h"
+#include "Crc32c.h"
+#include "Kernels.h"
+#include "Batch.h"
+#include "Split.h"
+#include "Words.h"
+
+#define AR_MAX_BLOCK_SIZE 67108864 /* Largest block size accepted when decompressing */
+/* Largest trees section of any block, from the LZ77 literal/length and distance trees */
+#define AR_MAX_TREE_SIZE ((int) sizeof(int) + (2 * AR_LZ_LITLEN_SYMBOLS - 1 + 2 * AR_LZ_DIST_SYMBOLS - 1) * (int) sizeof(HuffNodeSerial))
+
+/* Passed to every pipeline stage as its context */
+typedef struct ARContext
+{
+	const ARLevel *level;  /* Settings blocks are compressed with */
+	int flags;  /* AR_FLAG_* of the archive */
+	Dedup dedup;  /* Chunk table, when compressing with AR_FLAG_DEDUP */
+	ARChunkRef *refs;  /* Chunk list of the block being read, when compressing with AR_FLAG_DEDUP */
+	DeltaBase *base;  /* File blocks are copied from with AR_FLAG_DELTA, otherwise NULL */
+	long remaining;  /* Blocks left to read when decompressing, or -1 until the end of an AR_FLAG_STREAMED archive */
+	long long written;  /* Bytes written so far, when decompressing */
+	int blockSize;  /* Block size from the archive's header, when decompressing */
+	unsigned char *map;  /* Output file mapped for writing, which blocks are decoded straight into, or NULL */
+	long long mapSize;
+	long long mapped;  /* Bytes of the map the reader has given to blocks so far */
+	unsigned int checksum;  /* CRC32C of the current member's data written so far */
+	const ARMember *members;  /* Index to check member checksums against when decompressing, or NULL */
+	int numMembers;
+	int member;  /* Member the next block belongs to */
+	int blocksLeft;  /* Blocks of that member not yet written */
+	long long *starts;  /* Position of each member's data in the whole archive's, numMembers + 1 of them, with an index */
+	const char *directory;  /* Directory each member is extracted to a file of its own in, or NULL to write them in turn */
+	unsigned char *renamed;  /* 1 for each member whose name an earlier member also has, when extracting */
+	int outputFd;  /* File decompressed blocks are written to, the current member's when extracting */
+	int extracted;  /* Member files created so far, which are removed again if extracting fails */
+	unsigned int endChecksum;  /* Checksum of all the data, from the end of an AR_FLAG_STREAMED archive */
+	unsigned char *chunk;  /* Buffer repeated chunks are copied through, when decompressing with AR_FLAG_DEDUP */
+	Batch *batch;  /* Files read ahead, when compressing many files with -m */
+	ARMember *batchMembers;  /* Their index entries, filled in as blocks are written */
+} ARContext;
+
+int compressBlock( Pipeline *pipeline, Block *block);
+int decompressBlock( Pipeline *pipeline, Block *block);
+int checkBlockHeader( const ARBlockHeader *header, int blockSize, int hasBase, int hasChunks);
+#endif	/* CODEC_H */
@@ -0,0 +1,104 @@
+/**
+ * @file   Cpu.c
+ * @author Adrian Rasmussen
+ *
+ * @brief Detects instruction set extensions with cpuid, once per run. Builds are portable, so nothing newer
+ *		  than the base instruction set is used unless it is found here. On other architectures no extensions
+ *		  are reported and every kernel uses its plain C version.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "Cpu.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <cpuid.h>
+#define AR_CPU_X86
+#endif
+
+static int features;
+static pthread_once_t cpuOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Method:    detectCpu
+ * FullName:  detectCpu
+ * Access:    private
+ * @brief     Reads the feature bits from cpuid. AVX2 also needs the OS to save the 256 bit registers on a
+ *			  context switch, which xgetbv reports
+ **/
+static void detectCpu( void)
+{
+	const char *limit;
+#ifdef AR_CPU_X86
+	unsigned int eax, ebx, ecx, edx, xcr0Low, xcr0High;
+	int avxSaved;
+
+	features = 0;
+	if ( __get_cpuid(1, &eax, &ebx, &ecx, &edx))
+	{
+		if ( ecx & bit_SSE4_2)
+		{
+			features |= AR_CPU_SSE42;
+		}
+		avxSaved = 0;
+		if ( (ecx & bit_OSXSAVE) && (ecx & bit_AVX))
+		{
+			__asm__ ("xgetbv" : "=a" (xcr0Low), "=d" (xcr0High) : "c" (0));
+			avxSaved = (xcr0Low & 6) == 6;
+		}
+		if ( __get_cpuid_max(0, NULL) >= 7)
+		{
+			__cpuid_count(7, 0, eax, ebx, ecx, edx);
+			if ( (ebx & bit_AVX2) && avxSaved)
+			{
+				features |= AR_CPU_AVX2;
+			}
+			if ( ebx & bit_BMI2)
+			{
+				features |= AR_CPU_BMI2;
+			}
+		}
+	}
+#else
+	features = 0;
+#endif
+
+	limit = getenv("ARCHIVER_CPU");
+	if ( limit != NULL && strcmp(limit, "scalar") == 0)
+	{
+		features = 0;
+	}
+	else if ( limit != NULL && strcmp(limit, "sse4.2") == 0)
+	{
+		features &= AR_CPU_SSE42;
+	}
+}
+
+/**
+ * Method:    cpuFeatures
+ * FullName:  cpuFeatures
+ * Access:    public
+ * @return    AR_CPU_* extensions that may be used
+ **/
+int cpuFeatures( void)
+{
+	pthread_once(&cpuOnce, &detectCpu);
+	return features;
+}
+
+/**
+ * Method:    cpuName
+ * FullName:  cpuName
+ * Access:    public
+ * @return    name of the best kernel versions available, for reports
+ **/
+const char* cpuName( void)
+{
+	int found = cpuFeatures();
+
+	if ( (found & AR_CPU_AVX2) && (found & AR_CPU_BMI2))
+	{
+		return "avx2";
+	}
+	return (found & AR_CPU_SSE42) ? "sse4.2" : "scalar";
+}
@@ -0,0 +1,19 @@
+/*
+ * File:   Cpu.h
+ * Author: adrian
+ *
+ * Instruction set extensions of the CPU we are running on, so the codec can pick
+ * the fastest version of its inner loops at run time. Setting ARCHIVER_CPU to
+ * scalar, sse4.2 or avx2 caps what is used, to compare or test the versions
+ */
+
+#ifndef CPU_H
+#define	CPU_H
+
+#define AR_CPU_SSE42 1  /* crc32 instruction */
+#define AR_CPU_AVX2 2  /* 256 bit integer vectors, with the OS saving the registers */
+#define AR_CPU_BMI2 4  /* bzhi, shlx and shrx */
+
+int cpuFeatures( void);
+const char* cpuName( void);
+#endif	/* CPU_H */
@@ -0,0 +1,220 @@
+/**
+ * @file   Crc32c.c
+ * @author Adrian Rasmussen
+ *
+ * @brief CRC32C, the Castagnoli polynomial used by iSCSI and ext4. On x86-64 CPUs with SSE4.2 the crc32
+ *		  instruction does 8 bytes at a time; elsewhere a slicing-by-8 table does the same in software.
+ *		  Both give identical results, so archives check the same on any machine.
+ *		  Checksums of neighbouring pieces of data can be joined with {@link crc32cCombine}, so blocks
+ *		  checksummed in parallel give the checksum of the whole member without reading it again.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "Crc32c.h"
+#include "Cpu.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#define AR_CRC_HARDWARE
+#endif
+
+#define AR_CRC_POLY 0x82F63B78u  /* Castagnoli polynomial, bit reversed */
+
+static unsigned int crcTable[8][256];  /* crcTable[k][b] is the CRC of byte b followed by k zero bytes */
+static unsigned int (*crcUpdate)( unsigned int crc, const unsigned char *data, size_t size);
+static pthread_once_t crcOnce = PTHREAD_ONCE_INIT;
+
+static void initCrc32c( void);
+static unsigned int crc32cSoftware( unsigned int crc, const unsigned char *data, size_t size);
+static unsigned int multModP( unsigned int a, unsigned int b);
+static unsigned int powerModP( long long n);
+
+#ifdef AR_CRC_HARDWARE
+/**
+ * Method:    crc32cHardware
+ * FullName:  crc32cHardware
+ * Access:    private
+ * @brief     Updates a CRC with the SSE4.2 crc32 instruction, 8 bytes per instruction once data is aligned
+ * @param 	  crc - CRC so far, already inverted
+ * @param 	  data - bytes to add
+ * @param 	  size - number of bytes
+ * @return    the updated CRC, still inverted
+ **/
+__attribute__((target("sse4.2")))
+static unsigned int crc32cHardware( unsigned int crc, const unsigned char *data, size_t size)
+{
+	unsigned long long crc64, word;
+
+	while ( size > 0 && ((size_t) data & 7) != 0)
+	{
+		crc = _mm_crc32_u8(crc, *data++);
+		size--;
+	}
+	crc64 = crc;
+	while ( size >= 8)
+	{
+		memcpy(&word, data, 8);
+		crc64 = _mm_crc32_u64(crc64, word);
+		data += 8;
+		size -= 8;
+	}
+	crc = (unsigned int) crc64;
+	while ( size > 0)
+	{
+		crc = _mm_crc32_u8(crc, *data++);
+		size--;
+	}
+	return crc;
+}
+#endif
+
+/**
+ * Method:    initCrc32c
+ * FullName:  initCrc32c
+ * Access:    private
+ * @brief     Fills the slicing tables and picks the hardware or software version. Run once, by whichever
+ *			  thread checksums first
+ **/
+static void initCrc32c( void)
+{
+	unsigned int crc;
+	int i, j;
+
+	for ( i = 0; i < 256; i++)
+	{
+		crc = (unsigned int) i;
+		for ( j = 0; j < 8; j++)
+		{
+			crc = (crc & 1) ? (crc >> 1) ^ AR_CRC_POLY : crc >> 1;
+		}
+		crcTable[0][i] = crc;
+	}
+	for ( i = 0; i < 256; i++)
+	{
+		for ( j = 1; j < 8; j++)
+		{
+			crcTable[j][i] = (crcTable[j - 1][i] >> 8) ^ crcTable[0][crcTable[j - 1][i] & 0xFF];
+		}
+	}
+
+	crcUpdate = &crc32cSoftware;
+#ifdef AR_CRC_HARDWARE
+	if ( cpuFeatures() & AR_CPU_SSE42)
+	{
+		crcUpdate = &crc32cHardware;
+	}
+#endif
+}
+
+/**
+ * Method:    crc32cSoftware
+ * FullName:  crc32cSoftware
+ * Access:    private
+ * @brief     Updates a CRC 8 bytes at a time with eight table lookups. Bytes are read one at a time, so this
+ *			  works on any byte order
+ * @param 	  crc - CRC so far, already inverted
+ * @param 	  data - bytes to add
+ * @param 	  size - number of bytes
+ * @return    the updated CRC, still inverted
+ **/
+static unsigned int crc32cSoftware( unsigned int crc, const unsigned char *data, size_t size)
+{
+	while ( size >= 8)
+	{
+		crc ^= (unsigned int) data[0] | (unsigned int) data[1] << 8 | (unsigned int) data[2] << 16 | (unsigned int) data[3] << 24;
+		crc = crcTable[7][crc & 0xFF] ^ crcTable[6][(crc >> 8) & 0xFF] ^ crcTable[5][(crc >> 16) & 0xFF] ^
+			  crcTable[4][crc >> 24] ^ crcTable[3][data[4]] ^ crcTable[2][data[5]] ^ crcTable[1][data[6]] ^ crcTable[0][data[7]];
+		data += 8;
+		size -= 8;
+	}
+	while ( size > 0)
+	{
+		crc = (crc >> 8) ^ crcTable[0][(crc ^ *data++) & 0xFF];
+		size--;
+	}
+	return crc;
+}
+
+/**
+ * Method:    crc32c
+ * FullName:  crc32c
+ * Access:    public
+ * @brief     Adds data to a CRC32C. Start with 0, and pass the result back in to continue with more data
+ * @param 	  crc - CRC of the data so far, 0 for none
+ * @param 	  data - bytes to add
+ * @param 	  size - number of bytes
+ * @return    CRC of the data so far followed by data
+ **/
+unsigned int crc32c( unsigned int crc, const unsigned char *data, size_t size)
+{
+	pthread_once(&crcOnce, &initCrc32c);
+	return ~crcUpdate(~crc, data, size);
+}
+
+/**
+ * Method:    multModP
+ * FullName:  multModP
+ * Access:    private
+ * @brief     Multiplies two polynomials modulo the CRC polynomial, both in bit reversed form
+ * @param 	  a - first polynomial
+ * @param 	  b - second polynomial
+ * @return    a * b modulo the polynomial
+ **/
+static unsigned int multModP( unsigned int a, unsigned int b)
+{
+	unsigned int m, product;
+
+	product = 0;
+	for ( m = 1u << 31; m != 0; m >>= 1)
+	{
+		if ( a & m)
+		{
+			product ^= b;
+		}
+		b = (b & 1) ? (b >> 1) ^ AR_CRC_POLY : b >> 1;
+	}
+	return product;
+}
+
+/**
+ * Method:    powerModP
+ * FullName:  powerModP
+ * Access:    private
+ * @brief     Works out x^(8n) modulo the CRC polynomial by repeated squaring, which is the effect on a CRC
+ *			  of appending n zero bytes
+ * @param 	  n - number of bytes
+ * @return    x^(8n) modulo the polynomial, in bit reversed form
+ **/
+static unsigned int powerModP( long long n)
+{
+	unsigned int power, square;
+
+	power = 1u << 31;  /* x^0 */
+	square = 1u << 23;  /* x^8 */
+	while ( n > 0)
+	{
+		if ( n & 1)
+		{
+			power = multModP(square, power);
+		}
+		square = multModP(square, square);
+		n >>= 1;
+	}
+	return power;
+}
+
+/**
+ * Method:    crc32cCombine
+ * FullName:  crc32cCombine
+ * Access:    public
+ * @brief     Gives the CRC of two pieces of data one after the other from the CRC of each, without the data
+ * @param 	  crcA - CRC of the first piece
+ * @param 	  crcB - CRC of the second piece
+ * @param 	  sizeB - length of the second piece in bytes
+ * @return    CRC of the first piece followed by the second
+ **/
+unsigned int crc32cCombine( unsigned int crcA, unsigned int crcB, long long sizeB)
+{
+	return multModP(powerModP(sizeB), crcA) ^ crcB;
+}
@@ -0,0 +1,15 @@
+/*
+ * File:   Crc32c.h
+ * Author: adrian
+ *
+ * CRC32C (Castagnoli) checksums of blocks and members, using the SSE4.2 crc32
+ * instruction where the CPU has it
+ */
+
+#ifndef CRC32C_H
+#define	CRC32C_H
+#include <stddef.h>
+
+unsigned int crc32c( unsigned int crc, const unsigned char *data, size_t size);
+unsigned int crc32cCombine( unsigned int crcA, unsigned int crcB, long long sizeB);
+#endif	/* CRC32C_H */
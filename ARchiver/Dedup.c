@@ -0,0 +1,423 @@
+/**
+ * @file   Dedup.c
+ * @author Adrian Rasmussen
+ *
+ * @brief Splits input into chunks at positions chosen by its content, using the FastCDC Gear rolling hash,
+ *		  so an insertion only changes the chunks around it. Each chunk is fingerprinted with SHA-256, and a chunk
+ *		  seen before is replaced by a reference to its first copy. The chunk table is kept in the archive index,
+ *		  so files added later are matched against everything already in the archive.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Dedup.h"
+#include "Crc32c.h"
+#include "Sha256.h"
+#include "Memory.h"
+#include "Report.h"
+
+static unsigned long long gear[256];
+static int gearReady = 0;
+
+static int findChunk( const Dedup *dedup, const unsigned long long hash[2], int size);
+static int addChunk( Dedup *dedup, const unsigned long long hash[2], int size, long long offset);
+static int growTable( Dedup *dedup);
+
+/**
+ * Method:    initDedup
+ * FullName:  initDedup
+ * Access:    public
+ * @brief     Sets up an empty chunk table, or one holding the chunks of an existing archive
+ * @param 	  dedup - the table to set up
+ * @param 	  blockSize - most bytes returned by each {@link dedupRead}, at least AR_CDC_MAX_CHUNK
+ * @param 	  chunks - chunks already in the archive, may be NULL if numChunks is 0
+ * @param 	  numChunks - number of chunks
+ * @param 	  position - uncompressed position the new data starts at
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if memory could not be allocated
+ **/
+int initDedup( Dedup *dedup, int blockSize, const ARChunk *chunks, int numChunks, long long position)
+{
+	unsigned long long seed;
+	int i;
+
+	/*Gear values only need to look random, and must be the same on every run*/
+	if ( !gearReady)
+	{
+		seed = 0;
+		for ( i = 0; i < 256; i++)
+		{
+			seed += 0x9e3779b97f4a7c15ULL;
+			gear[i] = seed;
+			gear[i] = (gear[i] ^ (gear[i] >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			gear[i] = (gear[i] ^ (gear[i] >> 27)) * 0x94d049bb133111ebULL;
+			gear[i] ^= gear[i] >> 31;
+		}
+		gearReady = 1;
+	}
+
+	memset(dedup, 0, sizeof(*dedup));
+	dedup->position = position;
+	dedup->bufferCapacity = blockSize;
+	dedup->buffer = (unsigned char*) arMalloc(blockSize);
+	dedup->chunkCapacity = numChunks + 1024;
+	dedup->chunks = (ARChunk*) arMalloc(dedup->chunkCapacity * sizeof(ARChunk));
+	if ( dedup->buffer == NULL || dedup->chunks == NULL || growTable(dedup) != EXIT_SUCCESS)
+	{
+		reportError("Could not allocate memory for chunk table\n");
+		freeDedup(dedup);
+		return EXIT_FAILURE;
+	}
+
+	for ( i = 0; i < numChunks; i++)
+	{
+		if ( findChunk(dedup, chunks[i].fingerprint, chunks[i].size) < 0 &&
+			 addChunk(dedup, chunks[i].fingerprint, chunks[i].size, chunks[i].offset) != EXIT_SUCCESS)
+		{
+			freeDedup(dedup);
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    freeDedup
+ * FullName:  freeDedup
+ * Access:    public
+ * @param 	  dedup - the table to free
+ **/
+void freeDedup( Dedup *dedup)
+{
+	arFree(dedup->buffer);
+	arFree(dedup->chunks);
+	arFree(dedup->table);
+	dedup->buffer = NULL;
+	dedup->chunks = NULL;
+	dedup->table = NULL;
+}
+
+/**
+ * Method:    cdcCut
+ * FullName:  cdcCut
+ * Access:    public
+ * @brief     Finds the end of the first chunk with FastCDC's normalized chunking. The Gear hash only
+ *			  depends on the last 64 bytes, so cut points move with the data when bytes are inserted
+ * @param 	  data - the data to chunk
+ * @param 	  size - number of bytes in data
+ * @return    length of the first chunk. If it is size and size is less than AR_CDC_MAX_CHUNK,
+ *			  no cut point was found and more data could make the chunk longer
+ **/
+int cdcCut( const unsigned char *data, int size)
+{
+	unsigned long long hash;
+	int i, normal;
+
+	if ( size <= AR_CDC_MIN_CHUNK)
+	{
+		return size;
+	}
+	if ( size > AR_CDC_MAX_CHUNK)
+	{
+		size = AR_CDC_MAX_CHUNK;
+	}
+	normal = size < AR_CDC_AVG_CHUNK ? size : AR_CDC_AVG_CHUNK;
+
+	hash = 0;
+	for ( i = AR_CDC_MIN_CHUNK; i < normal; i++)
+	{
+		hash = (hash << 1) + gear[data[i]];
+		if ( (hash & AR_CDC_MASK_S) == 0)
+		{
+			return i + 1;
+		}
+	}
+	for ( ; i < size; i++)
+	{
+		hash = (hash << 1) + gear[data[i]];
+		if ( (hash & AR_CDC_MASK_L) == 0)
+		{
+			return i + 1;
+		}
+	}
+	return size;
+}
+
+/**
+ * Method:    fingerprint
+ * FullName:  fingerprint
+ * Access:    public
+ * @brief     128 bit MurmurHash3 (x64 variant) of some data, which is quick but easy to collide on purpose.
+ *			  Identifies a delta base file, where a wrong base is also caught by the checksums. Chunks use
+ *			  {@link chunkFingerprint}
+ * @param 	  data - the data
+ * @param 	  size - number of bytes in data
+ * @param 	  hash - array to save the two halves of the hash to
+ **/
+void fingerprint( const unsigned char *data, int size, unsigned long long hash[2])
+{
+	const unsigned long long c1 = 0x87c37b91114253d5ULL, c2 = 0x4cf5ad432745937fULL;
+	unsigned long long h1, h2, k1, k2;
+	int i, j, tail;
+
+	h1 = 0;
+	h2 = 0;
+	for ( i = 0; i + 16 <= size; i += 16)
+	{
+		k1 = 0;
+		k2 = 0;
+		for ( j = 7; j >= 0; j--)
+		{
+			k1 = (k1 << 8) | data[i + j];
+			k2 = (k2 << 8) | data[i + 8 + j];
+		}
+		k1 *= c1; k1 = (k1 << 31) | (k1 >> 33); k1 *= c2; h1 ^= k1;
+		h1 = (h1 << 27) | (h1 >> 37); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+		k2 *= c2; k2 = (k2 << 33) | (k2 >> 31); k2 *= c1; h2 ^= k2;
+		h2 = (h2 << 31) | (h2 >> 33); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+	}
+
+	tail = size - i;
+	k1 = 0;
+	k2 = 0;
+	for ( j = tail - 1; j >= 8; j--)
+	{
+		k2 = (k2 << 8) | data[i + j];
+	}
+	for ( j = (tail < 8 ? tail : 8) - 1; j >= 0; j--)
+	{
+		k1 = (k1 << 8) | data[i + j];
+	}
+	if ( tail > 8)
+	{
+		k2 *= c2; k2 = (k2 << 33) | (k2 >> 31); k2 *= c1; h2 ^= k2;
+	}
+	if ( tail > 0)
+	{
+		k1 *= c1; k1 = (k1 << 31) | (k1 >> 33); k1 *= c2; h1 ^= k1;
+	}
+
+	h1 ^= (unsigned long long) size;
+	h2 ^= (unsigned long long) size;
+	h1 += h2;
+	h2 += h1;
+	for ( j = 0; j < 2; j++)
+	{
+		k1 = j == 0 ? h1 : h2;
+		k1 ^= k1 >> 33;
+		k1 *= 0xff51afd7ed558ccdULL;
+		k1 ^= k1 >> 33;
+		k1 *= 0xc4ceb9fe1a85ec53ULL;
+		k1 ^= k1 >> 33;
+		hash[j] = k1;
+	}
+	hash[0] += hash[1];
+	hash[1] += hash[0];
+}
+
+/**
+ * Method:    chunkFingerprint
+ * FullName:  chunkFingerprint
+ * Access:    public
+ * @brief     The first 128 bits of the SHA-256 of a chunk. Chunks with the same fingerprint and size are
+ *			  treated as equal without comparing their bytes, since an earlier copy may only be in the archive,
+ *			  so it has to be a hash that can't be collided on purpose
+ * @param 	  data - the chunk
+ * @param 	  size - number of bytes in the chunk
+ * @param 	  hash - array to save the two halves of the fingerprint to
+ **/
+void chunkFingerprint( const unsigned char *data, int size, unsigned long long hash[2])
+{
+	unsigned char digest[AR_SHA256_SIZE];
+	int i;
+
+	sha256(data, (size_t) size, digest);
+	hash[0] = 0;
+	hash[1] = 0;
+	for ( i = 7; i >= 0; i--)
+	{
+		hash[0] = (hash[0] << 8) | digest[i];
+		hash[1] = (hash[1] << 8) | digest[8 + i];
+	}
+}
+
+/**
+ * Method:    dedupRead
+ * FullName:  dedupRead
+ * Access:    public
+ * @brief     Reads the next block of input and splits it into chunks. New chunks are added to the table and
+ *			  copied to output, and every chunk gets a reference. A chunk that runs off the end of what has
+ *			  been read is kept for the next call, so cut points don't depend on where blocks end
+ * @param 	  dedup - the chunk table
+ * @param 	  input - file to read from
+ * @param 	  output - buffer of the dedup block size to save the new chunks to
+ * @param 	  outputSize - address to save the number of bytes in output to
+ * @param 	  refs - array of AR_DEDUP_MAX_REFS(block size) references to fill
+ * @param 	  numRefs - address to save the number of references to, 0 at end of input
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the input could not be read or memory could not be allocated
+ **/
+int dedupRead( Dedup *dedup, FILE *input, unsigned char *output, int *outputSize, ARChunkRef *refs, int *numRefs)
+{
+	unsigned long long hash[2];
+	int position, size, index;
+
+	*outputSize = 0;
+	*numRefs = 0;
+	while ( !dedup->eof && dedup->bufferSize < dedup->bufferCapacity)
+	{
+		size = (int) fread(dedup->buffer + dedup->bufferSize, 1, dedup->bufferCapacity - dedup->bufferSize, input);
+		if ( ferror(input))
+		{
+			reportSystemError("Could not read input");
+			return EXIT_FAILURE;
+		}
+		dedup->bufferSize += size;
+		dedup->eof = size == 0;
+	}
+
+	position = 0;
+	while ( position < dedup->bufferSize)
+	{
+		size = cdcCut(dedup->buffer + position, dedup->bufferSize - position);
+		if ( !dedup->eof && position + size == dedup->bufferSize && size < AR_CDC_MAX_CHUNK)
+		{
+			break; /*The chunk may continue past what has been read*/
+		}
+
+		chunkFingerprint(dedup->buffer + position, size, hash);
+		index = findChunk(dedup, hash, size);
+		memset(&refs[*numRefs], 0, sizeof(ARChunkRef));
+		refs[*numRefs].size = size;
+		if ( index >= 0)
+		{
+			refs[*numRefs].offset = dedup->chunks[index].offset;
+		}
+		else
+		{
+			if ( addChunk(dedup, hash, size, dedup->position + position) != EXIT_SUCCESS)
+			{
+				return EXIT_FAILURE;
+			}
+			refs[*numRefs].offset = -1;
+			memcpy(output + *outputSize, dedup->buffer + position, size);
+			*outputSize += size;
+		}
+		(*numRefs)++;
+		position += size;
+	}
+
+	dedup->checksum = crc32c(dedup->checksum, dedup->buffer, position);
+	memmove(dedup->buffer, dedup->buffer + position, dedup->bufferSize - position);
+	dedup->bufferSize -= position;
+	dedup->position += position;
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    findChunk
+ * FullName:  findChunk
+ * Access:    private
+ * @param 	  dedup - the chunk table
+ * @param 	  hash - fingerprint of the chunk
+ * @param 	  size - length of the chunk
+ * @return    index of the matching chunk, or -1 if it hasn't been seen
+ **/
+static int findChunk( const Dedup *dedup, const unsigned long long hash[2], int size)
+{
+	const ARChunk *chunk;
+	int slot;
+
+	for ( slot = (int) (hash[0] & (dedup->tableSize - 1)); dedup->table[slot] >= 0;
+		  slot = (slot + 1) & (dedup->tableSize - 1))
+	{
+		chunk = &dedup->chunks[dedup->table[slot]];
+		if ( chunk->fingerprint[0] == hash[0] && chunk->fingerprint[1] == hash[1] && chunk->size == size)
+		{
+			return dedup->table[slot];
+		}
+	}
+	return -1;
+}
+
+/**
+ * Method:    addChunk
+ * FullName:  addChunk
+ * Access:    private
+ * @brief     Adds a chunk that isn't in the table yet
+ * @param 	  dedup - the chunk table
+ * @param 	  hash - fingerprint of the chunk
+ * @param 	  size - length of the chunk
+ * @param 	  offset - uncompressed position of the chunk
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if memory could not be allocated
+ **/
+static int addChunk( Dedup *dedup, const unsigned long long hash[2], int size, long long offset)
+{
+	ARChunk *chunks;
+	int slot;
+
+	if ( dedup->numChunks == dedup->chunkCapacity)
+	{
+		chunks = (ARChunk*) arRealloc(dedup->chunks, 2 * dedup->chunkCapacity * sizeof(ARChunk));
+		if ( chunks == NULL)
+		{
+			reportError("Could not allocate memory for chunk table\n");
+			return EXIT_FAILURE;
+		}
+		dedup->chunks = chunks;
+		dedup->chunkCapacity *= 2;
+	}
+	memset(&dedup->chunks[dedup->numChunks], 0, sizeof(ARChunk));
+	dedup->chunks[dedup->numChunks].fingerprint[0] = hash[0];
+	dedup->chunks[dedup->numChunks].fingerprint[1] = hash[1];
+	dedup->chunks[dedup->numChunks].offset = offset;
+	dedup->chunks[dedup->numChunks].size = size;
+	dedup->numChunks++;
+
+	/*Keep the table at most half full so probe sequences stay short*/
+	if ( 2 * dedup->numChunks > dedup->tableSize)
+	{
+		return growTable(dedup);
+	}
+	for ( slot = (int) (hash[0] & (dedup->tableSize - 1)); dedup->table[slot] >= 0;
+		  slot = (slot + 1) & (dedup->tableSize - 1))
+	{
+	}
+	dedup->table[slot] = dedup->numChunks - 1;
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    growTable
+ * FullName:  growTable
+ * Access:    private
+ * @brief     Replaces the hash table with one large enough for twice the chunk capacity, and adds every chunk to it
+ * @param 	  dedup - the chunk table
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if memory could not be allocated
+ **/
+static int growTable( Dedup *dedup)
+{
+	int *table;
+	int i, slot, size;
+
+	for ( size = 1024; size < 4 * dedup->numChunks; size *= 2)
+	{
+	}
+	table = (int*) arMalloc(size * sizeof(int));
+	if ( table == NULL)
+	{
+		reportError("Could not allocate memory for chunk table\n");
+		return EXIT_FAILURE;
+	}
+	arFree(dedup->table);
+	dedup->table = table;
+	dedup->tableSize = size;
+	memset(table, -1, size * sizeof(int));
+
+	for ( i = 0; i < dedup->numChunks; i++)
+	{
+		for ( slot = (int) (dedup->chunks[i].fingerprint[0] & (size - 1)); table[slot] >= 0; slot = (slot + 1) & (size - 1))
+		{
+		}
+		table[slot] = i;
+	}
+	return EXIT_SUCCESS;
+}
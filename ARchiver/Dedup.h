@@ -0,0 +1,42 @@
+/*
+ * File:   Dedup.h
+ * Author: adrian
+ *
+ * Content defined chunking (FastCDC) and a table of chunk fingerprints, so repeated data is stored once
+ */
+
+#ifndef DEDUP_H
+#define	DEDUP_H
+#include <stdio.h>
+#include "ARHeader.h"
+
+#define AR_CDC_MIN_CHUNK 2048  /* No cut point is looked for before this many bytes */
+#define AR_CDC_AVG_CHUNK 8192  /* Chunk size the masks aim for */
+#define AR_CDC_MAX_CHUNK 65536  /* A chunk is always cut here */
+#define AR_CDC_MASK_S 0x0003590703530000ULL  /* 15 bits, used before the average size so small chunks are rarer */
+#define AR_CDC_MASK_L 0x0000d90003530000ULL  /* 11 bits, used after it so large chunks are rarer */
+/* Most chunk references in a block, counting the cut at the end of the input */
+#define AR_DEDUP_MAX_REFS(blockSize) ((blockSize) / AR_CDC_MIN_CHUNK + 1)
+
+typedef struct Dedup
+{
+	ARChunk *chunks;  /* Every unique chunk seen, in the order they were first seen */
+	int numChunks;
+	int chunkCapacity;
+	int *table;  /* Open addressed hash table of indexes into chunks, -1 if empty */
+	int tableSize;  /* Always a power of 2 */
+	unsigned char *buffer;  /* Input read but not yet chunked */
+	int bufferSize;
+	int bufferCapacity;
+	long long position;  /* Uncompressed position of the first byte in buffer */
+	unsigned int checksum;  /* CRC32C of all the data chunked so far, repeats included */
+	int eof;
+} Dedup;
+
+int initDedup( Dedup *dedup, int blockSize, const ARChunk *chunks, int numChunks, long long position);
+void freeDedup( Dedup *dedup);
+int cdcCut( const unsigned char *data, int size);
+void fingerprint( const unsigned char *data, int size, unsigned long long hash[2]);
+void chunkFingerprint( const unsigned char *data, int size, unsigned long long hash[2]);
+int dedupRead( Dedup *dedup, FILE *input, unsigned char *output, int *outputSize, ARChunkRef *refs, int *numRefs);
+#endif	/* DEDUP_H */
@@ -0,0 +1,502 @@
+/**
+ * @file   Delta.c
+ * @author Adrian Rasmussen
+ *
+ * @brief Encodes a block as copies from a base file plus the bytes that are new. The base is mapped into
+ *		  memory once and indexed by a rolling hash of every AR_DELTA_STEP'th string of AR_DELTA_MATCH bytes,
+ *		  so coder threads can share it. Each copy is first tried at the position that follows on from the
+ *		  last one, which finds the rest of the base after a small edit without a hash lookup. Copy positions
+ *		  are sent relative to that position, so an unchanged region costs a few bits, and the new bytes
+ *		  are Huffman coded with a tree built from them alone.
+ *		  The payload is [int literal tree size][literal tree][codes]. The codes are a sequence of insert
+ *		  length, inserted bytes, copy length, copy position, ending after the insert that completes the block.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Delta.h"
+#include "Dedup.h"
+#include "Huffman.h"
+#include "Bits.h"
+#include "Format.h"
+#include "Memory.h"
+#include "Report.h"
+
+#define AR_DELTA_MULTIPLIER 0x9e3779b1u
+
+typedef struct DeltaOp
+{
+	int insert;  /* New bytes before the copy */
+	int copy;  /* Length of the copy, 0 for the last op of a block */
+	int offset;  /* Base position of the copy */
+} DeltaOp;
+
+static unsigned int hashString( const unsigned char *data);
+static unsigned int rollPower( void);
+static void putGamma( BitWriter *writer, unsigned int value);
+static long long getGamma( BitReader *reader);
+
+/**
+ * Method:    hashString
+ * FullName:  hashString
+ * Access:    private
+ * @param 	  data - AR_DELTA_MATCH bytes to hash
+ * @return    polynomial hash of the bytes, the same value the rolling update in {@link deltaCompress} gives
+ **/
+static unsigned int hashString( const unsigned char *data)
+{
+	unsigned int hash = 0;
+	int i;
+
+	for ( i = 0; i < AR_DELTA_MATCH; i++)
+	{
+		hash = hash * AR_DELTA_MULTIPLIER + data[i];
+	}
+	return hash;
+}
+
+/**
+ * Method:    rollPower
+ * FullName:  rollPower
+ * Access:    private
+ * @return    weight of the oldest byte in a hash, AR_DELTA_MULTIPLIER to the power AR_DELTA_MATCH - 1
+ **/
+static unsigned int rollPower( void)
+{
+	unsigned int power = 1;
+	int i;
+
+	for ( i = 1; i < AR_DELTA_MATCH; i++)
+	{
+		power *= AR_DELTA_MULTIPLIER;
+	}
+	return power;
+}
+
+/*Index slot for a hash, using its best mixed high bits*/
+#define indexSlot(base, hash) ((int) (((hash) * 2654435761u) >> (32 - (base)->indexBits)))
+
+/**
+ * Method:    openBase
+ * FullName:  openBase
+ * Access:    public
+ * @brief     Maps a base file into memory and fingerprints it. The hash index is only needed to compress
+ * @param 	  base - base to fill in
+ * @param 	  file - name of the base file
+ * @param 	  buildIndex - 1 to build the hash index as well
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the file could not be mapped or memory could not be allocated
+ **/
+int openBase( DeltaBase *base, const char *file, int buildIndex)
+{
+	struct stat info;
+	unsigned int hash, power;
+	int fd, i, entries;
+
+	memset(base, 0, sizeof(*base));
+	fd = open(file, O_RDONLY);
+	if ( fd < 0 || fstat(fd, &info) != 0)
+	{
+		reportSystemError(file);
+		if ( fd >= 0)
+		{
+			close(fd);
+		}
+		return EXIT_FAILURE;
+	}
+	if ( (long long) info.st_size > AR_DELTA_MAX_BASE)
+	{
+		reportError("Base file %s is too large, the limit is %lld bytes\n", file, AR_DELTA_MAX_BASE);
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	base->size = (int) info.st_size;
+	if ( base->size > 0)
+	{
+		base->data = (unsigned char*) mmap(NULL, base->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if ( base->data == MAP_FAILED)
+		{
+			reportSystemError(file);
+			base->data = NULL;
+			close(fd);
+			return EXIT_FAILURE;
+		}
+	}
+	close(fd);
+	fingerprint(base->data, base->size, base->fingerprint);
+
+	if ( buildIndex)
+	{
+		for ( base->indexBits = 10; (1 << base->indexBits) < base->size / AR_DELTA_STEP && base->indexBits < 30; base->indexBits++)
+		{
+		}
+		entries = 1 << base->indexBits;
+		base->index = (int*) arMalloc(entries * sizeof(int));
+		if ( base->index == NULL)
+		{
+			reportError("Could not allocate memory for base index\n");
+			closeBase(base);
+			return EXIT_FAILURE;
+		}
+		memset(base->index, -1, entries * sizeof(int));
+
+		if ( base->size >= AR_DELTA_MATCH)
+		{
+			power = rollPower();
+			hash = hashString(base->data);
+			for ( i = 0; ; i++)
+			{
+				if ( i % AR_DELTA_STEP == 0)
+				{
+					base->index[indexSlot(base, hash)] = i;
+				}
+				if ( i + AR_DELTA_MATCH >= base->size)
+				{
+					break;
+				}
+				hash = (hash - base->data[i] * power) * AR_DELTA_MULTIPLIER + base->data[i + AR_DELTA_MATCH];
+			}
+		}
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    closeBase
+ * FullName:  closeBase
+ * Access:    public
+ * @param 	  base - base to unmap and free
+ **/
+void closeBase( DeltaBase *base)
+{
+	if ( base->data != NULL)
+	{
+		munmap(base->data, base->size);
+	}
+	arFree(base->index);
+	base->data = NULL;
+	base->index = NULL;
+}
+
+/**
+ * Method:    putGamma
+ * FullName:  putGamma
+ * Access:    private
+ * @brief     Writes a number with Elias gamma coding, so small numbers take few bits
+ * @param 	  writer - writer to use
+ * @param 	  value - number to write, at least 1
+ **/
+static void putGamma( BitWriter *writer, unsigned int value)
+{
+	int bits = 0;
+
+	while ( (value >> bits) > 1)
+	{
+		bits++;
+	}
+	putBits(writer, 0, bits);
+	putBits(writer, value, bits + 1);
+}
+
+/**
+ * Method:    getGamma
+ * FullName:  getGamma
+ * Access:    private
+ * @param 	  reader - reader to use
+ * @return    the number read, or -1 if the data ran out or is not a valid code
+ **/
+static long long getGamma( BitReader *reader)
+{
+	long long value;
+	int bits, bit, count;
+
+	bits = 0;
+	while ( (bit = getBits(reader, 1)) == 0)
+	{
+		if ( ++bits > 31)
+		{
+			return -1;
+		}
+	}
+	if ( bit < 0)
+	{
+		return -1;
+	}
+	value = 1;
+	while ( bits > 0)
+	{
+		count = bits < 16 ? bits : 16;
+		bit = getBits(reader, count);
+		if ( bit < 0)
+		{
+			return -1;
+		}
+		value = value << count | bit;
+		bits -= count;
+	}
+	return value;
+}
+
+/**
+ * Method:    deltaCompress
+ * FullName:  deltaCompress
+ * Access:    public
+ * @brief     Finds copies of the block in the base, then codes the copies and the new bytes between them
+ * @param 	  base - base opened with its index
+ * @param 	  input - the block
+ * @param 	  size - size of the block
+ * @param 	  output - buffer to save the literal tree and codes to
+ * @param 	  capacity - size of output
+ * @param 	  treeSize - location to save the size of the tree section to, in bytes
+ * @param 	  compressedSize - location to save the size of the codes to, in bits without padding
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the result did not fit in capacity or memory could not be allocated
+ **/
+int deltaCompress( const DeltaBase *base, unsigned char *input, int size, unsigned char *output, int capacity,
+				   int *treeSize, int *compressedSize)
+{
+	DeltaOp *ops;
+	HuffNodeSerial *serial;
+	BitWriter writer;
+	unsigned long long codes[256];
+	unsigned char lengths[256];
+	int counts[256];
+	unsigned int hash, power;
+	int numOps, i, j, start, next, guess, candidate, length, litSize, inserted, hashValid, status;
+	long long distance;
+
+	ops = (DeltaOp*) arMalloc( (size / AR_DELTA_MATCH + 1) * sizeof(DeltaOp));
+	if ( ops == NULL)
+	{
+		reportError("Could not allocate memory for delta ops\n");
+		return EXIT_FAILURE;
+	}
+
+	/*Find the copies. start is the first new byte not yet covered, next is where the last copy ended*/
+	power = rollPower();
+	hash = 0;
+	hashValid = 0;
+	numOps = 0;
+	start = 0;
+	next = 0;
+	i = 0;
+	while ( i + AR_DELTA_MATCH <= size)
+	{
+		candidate = -1;
+		guess = next + (i - start);
+		if ( guess + AR_DELTA_MATCH <= base->size && base->data[guess] == input[i] &&
+			 memcmp(base->data + guess, input + i, AR_DELTA_MATCH) == 0)
+		{
+			candidate = guess;
+		}
+		else if ( base->index != NULL)
+		{
+			if ( !hashValid)
+			{
+				hash = hashString(input + i);
+				hashValid = 1;
+			}
+			candidate = base->index[indexSlot(base, hash)];
+			if ( candidate >= 0 && memcmp(base->data + candidate, input + i, AR_DELTA_MATCH) != 0)
+			{
+				candidate = -1;
+			}
+		}
+
+		if ( candidate >= 0)
+		{
+			/*Take back any new bytes just before the copy that also match*/
+			while ( i > start && candidate > 0 && base->data[candidate - 1] == input[i - 1])
+			{
+				i--;
+				candidate--;
+			}
+			length = AR_DELTA_MATCH;
+			while ( i + length < size && candidate + length < base->size && base->data[candidate + length] == input[i + length])
+			{
+				length++;
+			}
+			ops[numOps].insert = i - start;
+			ops[numOps].copy = length;
+			ops[numOps].offset = candidate;
+			numOps++;
+			i += length;
+			start = i;
+			next = candidate + length;
+			hashValid = 0;
+		}
+		else
+		{
+			if ( hashValid && i + AR_DELTA_MATCH < size)
+			{
+				hash = (hash - input[i] * power) * AR_DELTA_MULTIPLIER + input[i + AR_DELTA_MATCH];
+			}
+			else
+			{
+				hashValid = 0;
+			}
+			i++;
+		}
+	}
+	ops[numOps].insert = size - start;
+	ops[numOps].copy = 0;
+	ops[numOps].offset = 0;
+	numOps++;
+
+	/*Build a tree for the new bytes only*/
+	memset(counts, 0, sizeof(counts));
+	start = 0;
+	inserted = 0;
+	for ( i = 0; i < numOps; i++)
+	{
+		inserted += ops[i].insert;
+		for ( j = start; j < start + ops[i].insert; j++)
+		{
+			counts[input[j]]++;
+		}
+		start += ops[i].insert + ops[i].copy;
+	}
+	serial = buildCodes(counts, 256, lengths, codes, &litSize);
+
+	status = EXIT_FAILURE;
+	*treeSize = (int) sizeof(int) + litSize;
+	if ( (inserted == 0 || serial != NULL) && *treeSize < capacity)
+	{
+		putLE32(output, (unsigned int) litSize);
+		memcpy(output + sizeof(int), serial, litSize);
+
+		initBitWriter(&writer, output + *treeSize, capacity - *treeSize);
+		start = 0;
+		next = 0;
+		for ( i = 0; i < numOps && !writer.overflow; i++)
+		{
+			putGamma(&writer, ops[i].insert + 1);
+			for ( j = start; j < start + ops[i].insert; j++)
+			{
+				putCode(&writer, codes[input[j]], lengths[input[j]]);
+			}
+			start += ops[i].insert;
+			if ( ops[i].copy > 0)
+			{
+				putGamma(&writer, ops[i].copy - AR_DELTA_MATCH + 1);
+				distance = (long long) ops[i].offset - (next + ops[i].insert);
+				putBits(&writer, distance < 0, 1);
+				putGamma(&writer, (unsigned int) (distance < 0 ? -distance : distance) + 1);
+				start += ops[i].copy;
+				next = ops[i].offset + ops[i].copy;
+			}
+		}
+		*compressedSize = flushBits(&writer);
+		if ( *compressedSize >= 0)
+		{
+			status = EXIT_SUCCESS;
+		}
+	}
+
+	arFree(serial);
+	arFree(ops);
+	return status;
+}
+
+/**
+ * Method:    deltaDecompress
+ * FullName:  deltaDecompress
+ * Access:    public
+ * @brief     Rebuilds a block from the base and the new bytes
+ * @param 	  base - the base the block was compressed against
+ * @param 	  input - the literal tree section followed by the codes
+ * @param 	  treeSize - size of the tree section in bytes
+ * @param 	  compressedSize - size of the codes in bits
+ * @param 	  output - buffer to save the block to
+ * @param 	  size - size of the block when uncompressed
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the data is corrupt
+ **/
+int deltaDecompress( const DeltaBase *base, unsigned char *input, int treeSize, int compressedSize,
+					 unsigned char *output, int size)
+{
+	DecodeTable *table;
+	BitReader reader;
+	long long insert, length, distance, candidate, next;
+	int litSize, pos, symbol, sign, status;
+
+	litSize = (int) getLE32(input);
+	if ( litSize < 0 || litSize != treeSize - (int) sizeof(int) || litSize % (int) sizeof(HuffNodeSerial) != 0)
+	{
+		reportError("Not a valid .ar file, bad delta tree size\n");
+		return EXIT_FAILURE;
+	}
+
+	table = NULL;
+	if ( litSize > 0)
+	{
+		table = (DecodeTable*) arMalloc(sizeof(DecodeTable));
+		if ( table == NULL)
+		{
+			reportError("Could not allocate memory for decode table\n");
+			return EXIT_FAILURE;
+		}
+		if ( buildDecodeTable((const HuffNodeSerial*) (input + sizeof(int)), litSize, 256, table) != EXIT_SUCCESS)
+		{
+			reportError("Not a valid .ar file, bad delta tree\n");
+			arFree(table);
+			return EXIT_FAILURE;
+		}
+	}
+
+	initBitReader(&reader, input + treeSize, compressedSize);
+	status = EXIT_SUCCESS;
+	pos = 0;
+	next = 0;
+	while ( pos < size && status == EXIT_SUCCESS)
+	{
+		insert = getGamma(&reader) - 1;
+		if ( insert < 0 || insert > size - pos || (insert > 0 && table == NULL))
+		{
+			status = EXIT_FAILURE;
+			break;
+		}
+		while ( insert-- > 0)
+		{
+			symbol = decodeSymbol(&reader, table);
+			if ( symbol < 0 || symbol > 255)
+			{
+				status = EXIT_FAILURE;
+				break;
+			}
+			output[pos++] = (unsigned char) symbol;
+			next++;
+		}
+		if ( pos == size || status != EXIT_SUCCESS)
+		{
+			break;
+		}
+
+		length = getGamma(&reader) - 1 + AR_DELTA_MATCH;
+		sign = getBits(&reader, 1);
+		distance = getGamma(&reader) - 1;
+		candidate = next + (sign ? -distance : distance);
+		if ( length < AR_DELTA_MATCH || sign < 0 || distance < 0 || length > size - pos ||
+			 candidate < 0 || candidate + length > base->size)
+		{
+			status = EXIT_FAILURE;
+			break;
+		}
+		memcpy(output + pos, base->data + candidate, length);
+		pos += (int) length;
+		next = candidate + length;
+	}
+
+	if ( status != EXIT_SUCCESS)
+	{
+		reportError("Not a valid .ar file, delta block does not match its base\n");
+	}
+	if ( table != NULL)
+	{
+		freeDecodeTable(table);
+		arFree(table);
+	}
+	return status;
+}
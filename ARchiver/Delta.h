@@ -0,0 +1,30 @@
+/*
+ * File:   Delta.h
+ * Author: adrian
+ *
+ * Delta compression of a file against an earlier version of it, the base
+ */
+
+#ifndef DELTA_H
+#define	DELTA_H
+
+#define AR_DELTA_MATCH 32  /* Bytes hashed to find a copy in the base, and the shortest copy */
+#define AR_DELTA_STEP 16  /* Base positions are indexed every AR_DELTA_STEP bytes */
+#define AR_DELTA_MAX_BASE 2147483647LL  /* Largest base file, so positions fit in an int */
+
+typedef struct DeltaBase
+{
+	unsigned char *data;  /* The base file, mapped read only */
+	int size;
+	int *index;  /* Base position for each hash of AR_DELTA_MATCH bytes, or -1 */
+	int indexBits;  /* The index has 1 << indexBits entries */
+	unsigned long long fingerprint[2];  /* Hash of the whole base, so decompression can check it has the same one */
+} DeltaBase;
+
+int openBase( DeltaBase *base, const char *file, int buildIndex);
+void closeBase( DeltaBase *base);
+int deltaCompress( const DeltaBase *base, unsigned char *input, int size, unsigned char *output, int capacity,
+				   int *treeSize, int *compressedSize);
+int deltaDecompress( const DeltaBase *base, unsigned char *input, int treeSize, int compressedSize,
+					 unsigned char *output, int size);
+#endif	/* DELTA_H */
@@ -0,0 +1,349 @@
+/**
+ * @file   Format.c
+ * @author Adrian Rasmussen
+ *
+ * @brief Converts the .ar headers and tables to and from bytes. Every field is written little endian at a
+ *		  fixed offset, so an archive reads the same on any machine and can be parsed straight from a mapping.
+ *
+ *		  File header, AR_HEADER_SIZE bytes:
+ *			0 id (16 bit), 2 "ARchiver file" and a nul (14 bytes), 16 version (16 bit), 18 reserved (16 bit),
+ *			20 flags (32 bit), 24 block size (32 bit), 28 member count (32 bit), 32 block count (64 bit),
+ *			40 uncompressed size (64 bit), 48 index offset (64 bit), 56 chunk count (32 bit), 60 reserved (32 bit),
+ *			64 base size (64 bit), 72 base fingerprint (2 x 64 bit)
+ *		  Block header, AR_BLOCK_HEADER_SIZE bytes:
+ *			0 method (32 bit), 4 tree size (32 bit), 8 compressed size in bits (64 bit), 16 uncompressed size (32 bit),
+ *			20 CRC32C of the uncompressed data (32 bit)
+ *		  With AR_FLAG_STREAMED the last block header has method AR_METHOD_END, sizes 0 and the CRC32C of all the data
+ *		  Index entry, AR_MEMBER_SIZE bytes:
+ *			0 name (AR_MEMBER_NAME_SIZE bytes), then offset (64 bit), uncompressed size (64 bit), block count (32 bit), level (32 bit),
+ *			CRC32C of the uncompressed data (32 bit), reserved (32 bit)
+ *		  Chunk table entry, AR_CHUNK_SIZE bytes:
+ *			0 fingerprint (2 x 64 bit), 16 offset (64 bit), 24 size (32 bit), 28 reserved (32 bit)
+ *		  Chunk reference, AR_CHUNK_REF_SIZE bytes:
+ *			0 offset (64 bit, -1 if the chunk is in the block), 8 size (32 bit), 12 reserved (32 bit)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Format.h"
+#include "Report.h"
+
+/**
+ * Method:    putLE16
+ * FullName:  putLE16
+ * Access:    public
+ * @param 	  data - location to write 2 bytes to
+ * @param 	  value - value to write, lowest byte first
+ **/
+void putLE16( unsigned char *data, unsigned int value)
+{
+	data[0] = (unsigned char) value;
+	data[1] = (unsigned char) (value >> 8);
+}
+
+/**
+ * Method:    putLE32
+ * FullName:  putLE32
+ * Access:    public
+ * @param 	  data - location to write 4 bytes to
+ * @param 	  value - value to write, lowest byte first
+ **/
+void putLE32( unsigned char *data, unsigned int value)
+{
+	putLE16(data, value & 0xFFFF);
+	putLE16(data + 2, value >> 16);
+}
+
+/**
+ * Method:    putLE64
+ * FullName:  putLE64
+ * Access:    public
+ * @param 	  data - location to write 8 bytes to
+ * @param 	  value - value to write, lowest byte first
+ **/
+void putLE64( unsigned char *data, unsigned long long value)
+{
+	putLE32(data, (unsigned int) (value & 0xFFFFFFFFu));
+	putLE32(data + 4, (unsigned int) (value >> 32));
+}
+
+/**
+ * Method:    getLE16
+ * FullName:  getLE16
+ * Access:    public
+ * @param 	  data - 2 bytes, lowest first
+ * @return    the value
+ **/
+unsigned int getLE16( const unsigned char *data)
+{
+	return (unsigned int) data[0] | (unsigned int) data[1] << 8;
+}
+
+/**
+ * Method:    getLE32
+ * FullName:  getLE32
+ * Access:    public
+ * @param 	  data - 4 bytes, lowest first
+ * @return    the value
+ **/
+unsigned int getLE32( const unsigned char *data)
+{
+	return getLE16(data) | getLE16(data + 2) << 16;
+}
+
+/**
+ * Method:    getLE64
+ * FullName:  getLE64
+ * Access:    public
+ * @param 	  data - 8 bytes, lowest first
+ * @return    the value
+ **/
+unsigned long long getLE64( const unsigned char *data)
+{
+	return (unsigned long long) getLE32(data) | (unsigned long long) getLE32(data + 4) << 32;
+}
+
+/**
+ * Method:    unpackHeader
+ * FullName:  unpackHeader
+ * Access:    public
+ * @brief     Decodes the file header, and checks this version can read the archive
+ * @param 	  data - AR_HEADER_SIZE bytes
+ * @param 	  header - header to fill in
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if it is not an .ar file or uses a newer format
+ **/
+int unpackHeader( const unsigned char *data, ARHeader *header)
+{
+	memset(header, 0, sizeof(*header));
+	if ( getLE16(data) != AR_ID || memcmp(data + 2, "ARchiver file", 14) != 0)
+	{
+		reportError("Not a valid .ar file\n");
+		return EXIT_FAILURE;
+	}
+	header->arID = (short) getLE16(data);
+	memcpy(header->arText, data + 2, 14);
+	header->version = (int) getLE16(data + 16);
+	header->flags = (int) getLE32(data + 20);
+	header->blockSize = (int) getLE32(data + 24);
+	header->numMembers = (int) getLE32(data + 28);
+	header->numBlocks = (long long) getLE64(data + 32);
+	header->uncompressedDataSize = (long long) getLE64(data + 40);
+	header->indexOffset = (long long) getLE64(data + 48);
+	header->numChunks = (int) getLE32(data + 56);
+	header->baseSize = (long long) getLE64(data + 64);
+	header->baseFingerprint[0] = getLE64(data + 72);
+	header->baseFingerprint[1] = getLE64(data + 80);
+
+	if ( header->version != AR_FORMAT_VERSION)
+	{
+		reportError("Archive is format version %d, only version %d can be read\n", header->version, AR_FORMAT_VERSION);
+		return EXIT_FAILURE;
+	}
+	if ( header->flags & ~AR_KNOWN_FLAGS)
+	{
+		reportError("Archive uses features this version does not support, flags %#x\n", header->flags & ~AR_KNOWN_FLAGS);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    packHeader
+ * FullName:  packHeader
+ * Access:    public
+ * @brief     Encodes the file header, with the current format version
+ * @param 	  header - header to encode
+ * @param 	  data - location to write AR_HEADER_SIZE bytes to
+ **/
+void packHeader( const ARHeader *header, unsigned char *data)
+{
+	memset(data, 0, AR_HEADER_SIZE);
+	putLE16(data, AR_ID);
+	memcpy(data + 2, "ARchiver file", 14);
+	putLE16(data + 16, AR_FORMAT_VERSION);
+	putLE32(data + 20, (unsigned int) header->flags);
+	putLE32(data + 24, (unsigned int) header->blockSize);
+	putLE32(data + 28, (unsigned int) header->numMembers);
+	putLE64(data + 32, (unsigned long long) header->numBlocks);
+	putLE64(data + 40, (unsigned long long) header->uncompressedDataSize);
+	putLE64(data + 48, (unsigned long long) header->indexOffset);
+	putLE32(data + 56, (unsigned int) header->numChunks);
+	putLE64(data + 64, (unsigned long long) header->baseSize);
+	putLE64(data + 72, header->baseFingerprint[0]);
+	putLE64(data + 80, header->baseFingerprint[1]);
+}
+
+/**
+ * Method:    readHeader
+ * FullName:  readHeader
+ * Access:    public
+ * @brief     Reads and decodes the file header with {@link unpackHeader}
+ * @param 	  input - archive positioned at its start
+ * @param 	  header - header to fill in
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if it is not an .ar file or uses a newer format
+ **/
+int readHeader( FILE *input, ARHeader *header)
+{
+	unsigned char data[AR_HEADER_SIZE];
+
+	if ( fread(data, 1, AR_HEADER_SIZE, input) != AR_HEADER_SIZE)
+	{
+		memset(header, 0, sizeof(*header));
+		reportError("Not a valid .ar file\n");
+		return EXIT_FAILURE;
+	}
+	return unpackHeader(data, header);
+}
+
+/**
+ * Method:    writeHeader
+ * FullName:  writeHeader
+ * Access:    public
+ * @brief     Encodes and writes the file header, with the current format version
+ * @param 	  output - archive positioned at its start
+ * @param 	  header - header to write
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if it could not be written
+ **/
+int writeHeader( FILE *output, const ARHeader *header)
+{
+	unsigned char data[AR_HEADER_SIZE];
+
+	packHeader(header, data);
+	if ( fwrite(data, 1, AR_HEADER_SIZE, output) != AR_HEADER_SIZE)
+	{
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    packBlockHeader
+ * FullName:  packBlockHeader
+ * Access:    public
+ * @param 	  header - block header to encode
+ * @param 	  data - location to write AR_BLOCK_HEADER_SIZE bytes to
+ **/
+void packBlockHeader( const ARBlockHeader *header, unsigned char *data)
+{
+	putLE32(data, (unsigned int) header->method);
+	putLE32(data + 4, (unsigned int) header->huffTreeSize);
+	putLE64(data + 8, (unsigned long long) header->compressedDataSize);
+	putLE32(data + 16, (unsigned int) header->uncompressedDataSize);
+	putLE32(data + 20, header->checksum);
+}
+
+/**
+ * Method:    unpackBlockHeader
+ * FullName:  unpackBlockHeader
+ * Access:    public
+ * @brief     Decodes a block header. A compressed size too large for a block is saved as -1, so the
+ *			  usual size checks reject it
+ * @param 	  data - AR_BLOCK_HEADER_SIZE bytes
+ * @param 	  header - block header to fill in
+ **/
+void unpackBlockHeader( const unsigned char *data, ARBlockHeader *header)
+{
+	unsigned long long bits = getLE64(data + 8);
+
+	header->method = (int) getLE32(data);
+	header->huffTreeSize = (int) getLE32(data + 4);
+	header->compressedDataSize = bits > 0x7FFFFFFFu ? -1 : (int) bits;
+	header->uncompressedDataSize = (int) getLE32(data + 16);
+	header->checksum = getLE32(data + 20);
+}
+
+/**
+ * Method:    packMember
+ * FullName:  packMember
+ * Access:    public
+ * @param 	  member - index entry to encode
+ * @param 	  data - location to write AR_MEMBER_SIZE bytes to
+ **/
+void packMember( const ARMember *member, unsigned char *data)
+{
+	memcpy(data, member->name, AR_MEMBER_NAME_SIZE);
+	putLE64(data + AR_MEMBER_NAME_SIZE, (unsigned long long) member->offset);
+	putLE64(data + AR_MEMBER_NAME_SIZE + 8, (unsigned long long) member->uncompressedDataSize);
+	putLE32(data + AR_MEMBER_NAME_SIZE + 16, (unsigned int) member->numBlocks);
+	putLE32(data + AR_MEMBER_NAME_SIZE + 20, (unsigned int) member->level);
+	putLE32(data + AR_MEMBER_NAME_SIZE + 24, member->checksum);
+	putLE32(data + AR_MEMBER_NAME_SIZE + 28, 0);
+}
+
+/**
+ * Method:    unpackMember
+ * FullName:  unpackMember
+ * Access:    public
+ * @param 	  data - AR_MEMBER_SIZE bytes
+ * @param 	  member - index entry to fill in, its name is always nul terminated
+ **/
+void unpackMember( const unsigned char *data, ARMember *member)
+{
+	memcpy(member->name, data, AR_MEMBER_NAME_SIZE);
+	member->name[AR_MEMBER_NAME_SIZE - 1] = '\0';
+	member->offset = (long long) getLE64(data + AR_MEMBER_NAME_SIZE);
+	member->uncompressedDataSize = (long long) getLE64(data + AR_MEMBER_NAME_SIZE + 8);
+	member->numBlocks = (int) getLE32(data + AR_MEMBER_NAME_SIZE + 16);
+	member->level = (int) getLE32(data + AR_MEMBER_NAME_SIZE + 20);
+	member->checksum = getLE32(data + AR_MEMBER_NAME_SIZE + 24);
+}
+
+/**
+ * Method:    packChunk
+ * FullName:  packChunk
+ * Access:    public
+ * @param 	  chunk - chunk table entry to encode
+ * @param 	  data - location to write AR_CHUNK_SIZE bytes to
+ **/
+void packChunk( const ARChunk *chunk, unsigned char *data)
+{
+	putLE64(data, chunk->fingerprint[0]);
+	putLE64(data + 8, chunk->fingerprint[1]);
+	putLE64(data + 16, (unsigned long long) chunk->offset);
+	putLE32(data + 24, (unsigned int) chunk->size);
+	putLE32(data + 28, 0);
+}
+
+/**
+ * Method:    unpackChunk
+ * FullName:  unpackChunk
+ * Access:    public
+ * @param 	  data - AR_CHUNK_SIZE bytes
+ * @param 	  chunk - chunk table entry to fill in
+ **/
+void unpackChunk( const unsigned char *data, ARChunk *chunk)
+{
+	chunk->fingerprint[0] = getLE64(data);
+	chunk->fingerprint[1] = getLE64(data + 8);
+	chunk->offset = (long long) getLE64(data + 16);
+	chunk->size = (int) getLE32(data + 24);
+	chunk->reserved = 0;
+}
+
+/**
+ * Method:    packChunkRef
+ * FullName:  packChunkRef
+ * Access:    public
+ * @param 	  ref - chunk reference to encode
+ * @param 	  data - location to write AR_CHUNK_REF_SIZE bytes to
+ **/
+void packChunkRef( const ARChunkRef *ref, unsigned char *data)
+{
+	putLE64(data, (unsigned long long) ref->offset);
+	putLE32(data + 8, (unsigned int) ref->size);
+	putLE32(data + 12, 0);
+}
+
+/**
+ * Method:    unpackChunkRef
+ * FullName:  unpackChunkRef
+ * Access:    public
+ * @param 	  data - AR_CHUNK_REF_SIZE bytes
+ * @param 	  ref - chunk reference to fill in
+ **/
+void unpackChunkRef( const unsigned char *data, ARChunkRef *ref)
+{
+	ref->offset = (long long) getLE64(data);
+	ref->size = (int) getLE32(data + 8);
+	ref->reserved = 0;
+}
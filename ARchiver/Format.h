@@ -0,0 +1,42 @@
+/*
+ * File:   Format.h
+ * Author: adrian
+ *
+ * Fixed layout, little endian encoding of the .ar headers and tables, independent of
+ * struct padding and the byte order of the machine
+ */
+
+#ifndef FORMAT_H
+#define	FORMAT_H
+#include <stdio.h>
+#include "ARHeader.h"
+
+#define AR_FORMAT_VERSION 3  /* Version 1 was the raw ARHeader struct, as laid out by the compiler. Version 2 had no checksums */
+#define AR_KNOWN_FLAGS (AR_FLAG_ADAPTIVE | AR_FLAG_DEDUP | AR_FLAG_DELTA | AR_FLAG_STREAMED)  /* Flags this version can read */
+
+#define AR_HEADER_SIZE 88
+#define AR_BLOCK_HEADER_SIZE 24
+#define AR_MEMBER_SIZE (AR_MEMBER_NAME_SIZE + 32)
+#define AR_CHUNK_SIZE 32
+#define AR_CHUNK_REF_SIZE 16
+
+void putLE16( unsigned char *data, unsigned int value);
+void putLE32( unsigned char *data, unsigned int value);
+void putLE64( unsigned char *data, unsigned long long value);
+unsigned int getLE16( const unsigned char *data);
+unsigned int getLE32( const unsigned char *data);
+unsigned long long getLE64( const unsigned char *data);
+
+int unpackHeader( const unsigned char *data, ARHeader *header);
+void packHeader( const ARHeader *header, unsigned char *data);
+int readHeader( FILE *input, ARHeader *header);
+int writeHeader( FILE *output, const ARHeader *header);
+void packBlockHeader( const ARBlockHeader *header, unsigned char *data);
+void unpackBlockHeader( const unsigned char *data, ARBlockHeader *header);
+void packMember( const ARMember *member, unsigned char *data);
+void unpackMember( const unsigned char *data, ARMember *member);
+void packChunk( const ARChunk *chunk, unsigned char *data);
+void unpackChunk( const unsigned char *data, ARChunk *chunk);
+void packChunkRef( const ARChunkRef *ref, unsigned char *data);
+void unpackChunkRef( const unsigned char *data, ARChunkRef *ref);
+#endif	/* FORMAT_H */
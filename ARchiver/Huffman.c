@@ -1,287 +1,475 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
 #include "Huffman.h"
-#include "Heap.h"
+#include "Format.h"
+#include "Kernels.h"
+#include "Memory.h"
+#include "Report.h"
+
+static int compareKeys( const void *a, const void *b);
+static void putField( short *field, int value);
+static int getField( const HuffNodeSerial *tree, int node, size_t field);
+
+/**
+ * Method:    compareKeys
+ * FullName:  compareKeys
+ * Access:    private
+ * @brief     Orders the sort keys of {@link buildLengths}, which hold a count above its symbol
+ * @param 	  a - a key
+ * @param 	  b - another key
+ * @return    negative if a is smaller, positive if b is, 0 if they are equal
+ **/
+static int compareKeys( const void *a, const void *b)
+{
+    long long first = *(const long long*) a, second = *(const long long*) b;
+
+    return first < second ? -1 : first > second;
+}
 
 /**
- * Method:    buildTree
- * FullName:  buildTree
- * Access:    public 
- * @brief     Builds a Huffman tree from a priority queue of HuffNodes.
- *			  Removes first two elements from the queue, adds them as the left and right children of a new node,
- *			  and then inserts the new tree into the queue in the correct place according to its new total frequency
- * @param 	  pQ - priority queue, with minimum frequency = highest priority
- * @param 	  num - number of elements in the queue
- * @return    the Huffman tree
+ * Method:    buildLengths
+ * FullName:  buildLengths
+ * Access:    public
+ * @brief     Finds the length of each symbol's Huffman code from its count, with no tree of nodes. Symbols are
+ *			  sorted by count and then by symbol, and the two lightest of the next symbol and the next merged
+ *			  weight are merged until one is left. Merged weights are made in order, so they need a plain list
+ *			  rather than a heap. A code's length is the depth of its symbol, found by following parents back
+ *			  from the last merge. Ties always go the same way, so the same counts always give the same lengths
+ * @param 	  counts - number of times each symbol occurs
+ * @param 	  alphabetSize - number of possible symbols, i.e. size of counts and lengths, at most 65536
+ * @param 	  lengths - location to save each symbol's code length to, 0 if it does not occur
+ * @return    number of symbols that occur, or -1 if memory could not be allocated
  **/
-HuffNode* buildTree( HuffNode** pQ, int *num)
+int buildLengths( const int *counts, int alphabetSize, unsigned char *lengths)
 {
-    /*pQ is a priority queue of tree nodes*/
-    HuffNode *node1, *node2, *newNode, *root;
-    
-    while ( *num > 1)
+    long long *keys, *weights;
+    int *parents;
+    int num, i, leaf, merged, next, pick, k;
+
+    memset(lengths, 0, alphabetSize);
+    num = 0;
+    for (i = 0; i < alphabetSize; i++)
+    {
+        if ( counts[i] > 0)
+        {
+            num++;
+        }
+    }
+    if ( num <= 1)
     {
-        /*Remove first two elements from pQ*/
-        node1 = removeNode(pQ, num);
-        node2 = removeNode(pQ, num);
-        
-        /*Make them left and right child of new tree*/
-        newNode = (HuffNode*) malloc(sizeof(HuffNode));
-		if ( newNode == NULL)
-		{
-			printf("Could not allocate memory for newNode\n");
-			break;
-		}
-        newNode->symbol = -1;
-        newNode->left = node1;
-        newNode->right = node2;
-        newNode->freq = node1->freq + node2->freq;
+        /*A single symbol still needs a one bit code*/
+        for (i = 0; i < alphabetSize; i++)
+        {
+            lengths[i] = counts[i] > 0;
+        }
+        return num;
+    }
 
-        /*Insert new tree back into pQ*/
-        insert( pQ, num, newNode);
-        
-        /*Element at num should be nulled*/
-        pQ[*num] = NULL;
+    keys = (long long*) arMalloc(num * sizeof(long long));
+    weights = (long long*) arMalloc((2 * num - 1) * sizeof(long long));
+    parents = (int*) arMalloc((2 * num - 1) * sizeof(int));
+    if ( keys == NULL || weights == NULL || parents == NULL)
+    {
+        reportError("Could not allocate memory for code lengths\n");
+        arFree(keys);
+        arFree(weights);
+        arFree(parents);
+        return -1;
+    }
+    num = 0;
+    for (i = 0; i < alphabetSize; i++)
+    {
+        if ( counts[i] > 0)
+        {
+            keys[num++] = ((long long) counts[i] << 16) | i;
+        }
+    }
+    qsort(keys, num, sizeof(long long), &compareKeys);
+    for (i = 0; i < num; i++)
+    {
+        weights[i] = keys[i] >> 16;
     }
-	
-	if ( newNode == NULL)
-	{
-		*num = 0;
-		root = NULL;
-	}
-	else
-	{
-		*num = 1;
-		root = removeNode(pQ, num);
-	}
 
-	free(pQ);
-    pQ = NULL;
+    /*Symbols are 0 to num - 1 and merged weights follow them, with a symbol taken first on a tie*/
+    leaf = 0;
+    merged = num;
+    for (next = num; next < 2 * num - 1; next++)
+    {
+        weights[next] = 0;
+        for (k = 0; k < 2; k++)
+        {
+            pick = leaf < num && (merged == next || weights[leaf] <= weights[merged]) ? leaf++ : merged++;
+            weights[next] += weights[pick];
+            parents[pick] = next;
+        }
+    }
+    /*A parent always comes after its children, so working back from the root turns parents into depths*/
+    parents[2 * num - 2] = 0;
+    for (i = 2 * num - 3; i >= 0; i--)
+    {
+        parents[i] = parents[parents[i]] + 1;
+    }
+    for (i = 0; i < num; i++)
+    {
+        lengths[keys[i] & 0xFFFF] = (unsigned char) parents[i];
+    }
 
-    return root;
+    arFree(keys);
+    arFree(weights);
+    arFree(parents);
+    return num;
 }
 
-/*Recursive function*/
 /**
- * Method:    buildCodeTable
- * FullName:  buildCodeTable
- * Access:    public 
- * @brief     Recursively builds the table of codes for each symbol. 
- *			  Appends '0' for left or '1' for right until leaf is found, in which case it adds the code to the codeTable
- *			  with the symbol at that location
- * @param 	  codeTable - single char array where index represents symbol, contents = code
- * @param 	  node - current node, originally root
- * @param 	  code - current built up string of 0s and 1s
- * @param 	  level - current depth in tree
+ * Method:    canonicalCodes
+ * FullName:  canonicalCodes
+ * Access:    public
+ * @brief     Gives each symbol the canonical code of its length: shorter codes first, and codes of one length in
+ *			  order of symbol, each one more than the last. Codes are numbers, first bit highest, so they go
+ *			  straight to {@link packCodes} or {@link putCode}
+ * @param 	  lengths - code length of each symbol, 0 if it has no code, at most AR_MAX_CODE_LENGTH
+ * @param 	  alphabetSize - number of possible symbols, i.e. size of lengths and codes
+ * @param 	  codes - location to save each symbol's code to, in its lowest bits
  **/
-void buildCodeTable( char* codeTable[], HuffNode *node, char* code, int level)
+void canonicalCodes( const unsigned char *lengths, int alphabetSize, unsigned long long *codes)
 {
-    /*Code Table is an array of chars, where index = symbol and
-     values are the code. */
-    if ( node->left == NULL && node->right == NULL)
+    unsigned long long next[AR_MAX_CODE_LENGTH + 1];
+    int numLength[AR_MAX_CODE_LENGTH + 1];
+    int i, length;
+
+    memset(numLength, 0, sizeof(numLength));
+    for (i = 0; i < alphabetSize; i++)
+    {
+        numLength[lengths[i]]++;
+    }
+    numLength[0] = 0;
+    next[0] = 0;
+    for (length = 1; length <= AR_MAX_CODE_LENGTH; length++)
     {
-        code[level]= '\0';
-        /*Make a copy of the code so that it is separate and won't be changed*/
-		codeTable[(int)node->symbol] = (char*) malloc( strlen(code) + 1);
-		if ( codeTable[(int)node->symbol] == NULL)
-		{
-			printf("Could not allocate memory for codeTable[%d]\n", (int) node->symbol);
-		}
-		else
-		{
-	        strcpy(codeTable[(int)node->symbol], code);
-    
-		}
-	}
-    else
+        next[length] = (next[length - 1] + numLength[length - 1]) << 1;
+    }
+    for (i = 0; i < alphabetSize; i++)
     {
-        code[level] = '0';
-        buildCodeTable( codeTable, node->left, code, level + 1);
-        
-        code[level] = '1';
-        buildCodeTable( codeTable, node->right, code, level + 1);
+        codes[i] = lengths[i] > 0 ? next[lengths[i]]++ : 0;
     }
 }
 
-/*Serialize tree for storing in .ar file*/
 /**
- * Method:    compressTree
- * FullName:  compressTree
- * Access:    public 
- * @brief     Serializes the Huffman tree into an array with two additional data fields to hold indexes of left and right child
- * @param 	  root - root node of the Huffman tree
- * @param 	  numElements - number of symbols in the tree (Not the total number of nodes)
+ * Method:    serializeLengths
+ * FullName:  serializeLengths
+ * Access:    public
+ * @brief     Writes the tree of canonical codes in pre-order, each node holding the index of its children or -1,
+ *			  without making the tree first. Sorted by length and then symbol, canonical codes are in order as bit
+ *			  strings too, so their leaves come left to right in that order. Each leaf adds the nodes of its path
+ *			  from where it parts from the previous leaf's path, which is always a right turn, down to itself
+ * @param 	  lengths - code length of each symbol, 0 if it has no code
+ * @param 	  codes - canonical code of each symbol, from {@link canonicalCodes}
+ * @param 	  alphabetSize - number of possible symbols, i.e. size of lengths and codes
  * @param 	  compressedSize - location to save the size of the serialized tree to, in bytes
- * @return    the serialized tree
+ * @return    the serialized tree, or NULL if no symbol has a code or memory could not be allocated
  **/
-char* compressTree(HuffNode *root, int numElements, int* compressedSize)
+HuffNodeSerial* serializeLengths( const unsigned char *lengths, const unsigned long long *codes, int alphabetSize,
+                                  int *compressedSize)
 {
-    /*Number of nodes will be 2*elements - 1*/
-    int i = 0;
-    char *compressed;
-    compressed = (char*) calloc( (10 * numElements - 1), sizeof(char));
-    serializeRecurse( compressed, root, &i);
-    
-    *compressedSize = (10*numElements-1)*sizeof(char);
+    HuffNodeSerial *compressed;
+    unsigned long long code, previousCode;
+    int start[AR_MAX_CODE_LENGTH + 2];
+    int path[AR_MAX_CODE_LENGTH + 1];
+    int *order;
+    int num, i, symbol, length, previousLength, depth, node;
 
-	return compressed;
+    *compressedSize = 0;
+    /*Counting sort by length, keeping symbols of a length in order*/
+    memset(start, 0, sizeof(start));
+    for (i = 0; i < alphabetSize; i++)
+    {
+        if ( lengths[i] > 0)
+        {
+            start[lengths[i] + 1]++;
+        }
+    }
+    for (length = 1; length <= AR_MAX_CODE_LENGTH + 1; length++)
+    {
+        start[length] += start[length - 1];
+    }
+    num = start[AR_MAX_CODE_LENGTH + 1];
+    if ( num == 0)
+    {
+        return NULL;
+    }
+    /*Number of nodes will be 2*elements - 1, or 2 for a single symbol*/
+    order = (int*) arMalloc(num * sizeof(int));
+    compressed = (HuffNodeSerial*) arCalloc(2 * num, sizeof(HuffNodeSerial));
+    if ( order == NULL || compressed == NULL)
+    {
+        reportError("Could not allocate memory for compressed tree\n");
+        arFree(order);
+        arFree(compressed);
+        return NULL;
+    }
+    for (i = 0; i < alphabetSize; i++)
+    {
+        if ( lengths[i] > 0)
+        {
+            order[start[lengths[i]]++] = i;
+        }
+    }
+
+    putField( &compressed[0].symbol, -1);
+    putField( &compressed[0].left, -1);
+    putField( &compressed[0].right, -1);
+    path[0] = 0;
+    node = 1;
+    previousCode = 0;
+    previousLength = 0;
+    for (i = 0; i < num; i++)
+    {
+        symbol = order[i];
+        length = lengths[symbol];
+        code = codes[symbol];
+        depth = 1;
+        if ( i > 0)
+        {
+            /*The first bit that differs is the highest set bit of the difference*/
+            depth = previousLength - (63 - __builtin_clzll((code >> (length - previousLength)) ^ previousCode));
+        }
+        for ( ; depth <= length; depth++)
+        {
+            if ( (code >> (length - depth)) & 1)
+            {
+                putField( &compressed[path[depth - 1]].right, node);
+            }
+            else
+            {
+                putField( &compressed[path[depth - 1]].left, node);
+            }
+            putField( &compressed[node].symbol, depth == length ? symbol : -1);
+            putField( &compressed[node].left, -1);
+            putField( &compressed[node].right, -1);
+            path[depth] = node++;
+        }
+        previousCode = code;
+        previousLength = length;
+    }
+    *compressedSize = node * sizeof(HuffNodeSerial);
+
+    arFree(order);
+    return compressed;
 }
 
 /**
- * Method:    serializeRecurse
- * FullName:  serializeRecurse
- * Access:    public 
- * @brief     Recursively serializes the tree, passing the index as a pointer to keep its value
- * @param 	  compressed - serialized tree
- * @param 	  node - current node
- * @param 	  i - current index
+ * Method:    buildCodes
+ * FullName:  buildCodes
+ * Access:    public
+ * @brief     Everything an encoder needs from its counts: code lengths from {@link buildLengths}, canonical
+ *			  codes from {@link canonicalCodes} and the serialized tree from {@link serializeLengths}
+ * @param 	  counts - number of times each symbol occurs
+ * @param 	  alphabetSize - number of possible symbols, i.e. size of counts, lengths and codes
+ * @param 	  lengths - location to save each symbol's code length to, 0 if it does not occur
+ * @param 	  codes - location to save each symbol's code to
+ * @param 	  compressedSize - location to save the size of the serialized tree to, in bytes
+ * @return    the serialized tree, or NULL if no symbol occurs or memory could not be allocated
  **/
-void serializeRecurse(char *compressed, HuffNode* node, int *i)
+HuffNodeSerial* buildCodes( const int *counts, int alphabetSize, unsigned char *lengths, unsigned long long *codes,
+                            int *compressedSize)
 {
-	/*If leaf-node: Output 1-bit + N-bit character/byte
-		If not leaf-node, output 0-bit. Then encode both child nodes (left first then right) the same way*/
-	if ( node->left == NULL && node->right == NULL)
-	{
-		compressed[(*i)++] = 1;
-		compressed[(*i)++] = node->symbol;
-	}
-	else
-	{
-		compressed[(*i)++] = 0;
-		serializeRecurse( compressed, node->left, i);
-		serializeRecurse( compressed, node->right, i);
-	}
+    *compressedSize = 0;
+    if ( buildLengths(counts, alphabetSize, lengths) <= 0)
+    {
+        return NULL;
+    }
+    canonicalCodes(lengths, alphabetSize, codes);
+    return serializeLengths(lengths, codes, alphabetSize, compressedSize);
+}
 
+/**
+ * Method:    putField
+ * FullName:  putField
+ * Access:    private
+ * @brief     Stores one field of a serialized node as 16 bit little endian, so trees read the same on any machine
+ * @param 	  field - the field to store to
+ * @param 	  value - node symbol or child index, -1 for none
+ **/
+static void putField( short *field, int value)
+{
+	putLE16( (unsigned char*) field, (unsigned int) value & 0xFFFF);
 }
 
 /**
- * Method:    decompressTree
- * FullName:  decompressTree
- * Access:    public 
- * @brief     Recreates the original tree from its serialized form.
- * @param 	  treeSerial - the serialized tree
- * @return    the original tree using pointers
+ * Method:    getField
+ * FullName:  getField
+ * Access:    private
+ * @brief     Loads one field of a serialized node stored by {@link putField}. The tree may sit at any
+ *			  address inside a caller's buffer, so the field is found by byte offset
+ * @param 	  tree - the serialized tree
+ * @param 	  node - index of the node
+ * @param 	  field - offsetof the field to load
+ * @return    the signed value of the field
  **/
-HuffNode* decompressTree( HuffNodeSerial* treeSerial)
+static int getField( const HuffNodeSerial *tree, int node, size_t field)
 {
-    HuffNode* root = (HuffNode*) malloc( sizeof(HuffNode));
-	if ( root == NULL)
-	{
-		printf("Could not allocate memory for root\n");
-		return NULL;
-	}
-    root->symbol = treeSerial[0].symbol;
-	root->freq = -1;
-	root->left = NULL;
-	root->right = NULL;
-    
-    deserializeRecurse( treeSerial, root, 0);
+	int value = (int) getLE16( (const unsigned char*) tree + node * sizeof(HuffNodeSerial) + field);
 
-    return root;
+	return value >= 0x8000 ? value - 0x10000 : value;
 }
 
 /**
- * Method:    deserializeRecurse
- * FullName:  deserializeRecurse
- * Access:    public 
- * @brief     Recursively deserializes the tree, doing the inverse of the {@link serializeTree} function
- * @param 	  node - current node
- * @param 	  treeSerial - serialized tree
- * @param 	  i - current index, not a pointer and so will use original values when recursive calls ends
+ * Method:    checkTree
+ * FullName:  checkTree
+ * Access:    public
+ * @brief     Checks that a serialized tree read from a file is one {@link serializeLengths} could have written,
+ *			  before {@link buildDecodeTable} follows its indexes. Children come after their parent in pre-order,
+ *			  so requiring that and that every node but the root is a child once rules out loops and sharing
+ * @param 	  treeSerial - the serialized tree
+ * @param 	  size - size of the serialized tree in bytes
+ * @param 	  alphabetSize - number of symbols the tree may have
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if it is not a valid tree of the alphabet or memory could not be allocated
  **/
-void deserializeRecurse( HuffNodeSerial* treeSerial, HuffNode* node, int i )
+int checkTree( const HuffNodeSerial *treeSerial, int size, int alphabetSize)
 {
-    HuffNode* newNode;
-    int temp;
+    char *used;
+    int nodes, i, left, right, symbol, status;
 
-    node->left = NULL;
-	node->right = NULL;
-    /*Left*/
-    if ( treeSerial[i].left != -1)
+    nodes = size / (int) sizeof(HuffNodeSerial);
+    if ( nodes < 2 || nodes > 2 * alphabetSize - 1 || size % (int) sizeof(HuffNodeSerial) != 0)
     {
-        newNode = (HuffNode*) malloc( sizeof(HuffNode));
-		if ( newNode == NULL)
-		{
-			printf("Could not allocate memory for newNode\n");
-		}
-		else
-		{
-			temp = treeSerial[i].left;
-			newNode->freq = -1;
-			newNode->symbol = treeSerial[temp].symbol;
-			node->left = newNode;
-			deserializeRecurse( treeSerial, node->left, temp);
-		}
+        return EXIT_FAILURE;
+    }
+    used = (char*) arCalloc(nodes, 1);
+    if ( used == NULL)
+    {
+        reportError("Could not allocate memory for tree check\n");
+        return EXIT_FAILURE;
+    }
+    status = EXIT_SUCCESS;
+    for (i = 0; i < nodes && status == EXIT_SUCCESS; i++)
+    {
+        left = getField( treeSerial, i, offsetof(HuffNodeSerial, left));
+        right = getField( treeSerial, i, offsetof(HuffNodeSerial, right));
+        symbol = getField( treeSerial, i, offsetof(HuffNodeSerial, symbol));
+        if ( (left == -1 && (right != -1 || symbol < 0 || symbol >= alphabetSize || i == 0)) ||
+             (left != -1 && (left <= i || left >= nodes || used[left] || (right == -1 && i != 0))) ||
+             (right != -1 && (right <= i || right >= nodes || used[right] || right == left)))
+        {
+            status = EXIT_FAILURE;
+        }
+        else
+        {
+            if ( left != -1)
+            {
+                used[left] = 1;
+            }
+            if ( right != -1)
+            {
+                used[right] = 1;
+            }
+        }
     }
-	
-    /*Right*/
-    if ( treeSerial[i].right != -1)
+    for (i = 1; i < nodes && status == EXIT_SUCCESS; i++)
     {
-        newNode = (HuffNode*) malloc( sizeof(HuffNode));
-		if ( newNode == NULL)
-		{
-			printf("Could not allocate memory for newNode\n");
-		}
-		else
-		{
-			temp = treeSerial[i].right;
-			newNode->freq = -1;
-			newNode->symbol = treeSerial[temp].symbol;
-			node->right = newNode;
-			deserializeRecurse( treeSerial, node->right, temp);
-		}
+        if ( !used[i])
+        {
+            status = EXIT_FAILURE;
+        }
     }
+    arFree(used);
+    return status;
 }
 
 /**
- * Method:    decode
- * FullName:  decode
- * Access:    public 
- * @brief     Converts the binary string of 1s and 0s to the original symbols
- * @param 	  binary - array of 0s and 1s
- * @param 	  sizeBits - size in bits of binary, i.e. number of 1s and 0s
- * @param 	  uncompressed - size of the file when uncompressed
- * @param 	  root - root node of the Huffman tree
- * @return    the decoded symbols
+ * Method:    buildDecodeTable
+ * FullName:  buildDecodeTable
+ * Access:    public
+ * @brief     Builds the lookup table the decoders use, so most codes are decoded with one lookup instead of one
+ *			  step down the tree per bit. The serialized tree is checked with {@link checkTree}, then read in one
+ *			  pass: children come after their parent, so each node's prefix and depth are known when it is reached.
+ *			  Leaves at most AR_DECODE_BITS deep fill every entry their code starts, and nodes at that depth mark
+ *			  theirs to go on down the tree's child list. Trees of any shape can be read, not only canonical ones
+ * @param 	  treeSerial - the serialized tree
+ * @param 	  size - size of the serialized tree in bytes
+ * @param 	  alphabetSize - number of symbols the tree may have
+ * @param 	  table - table to fill, freed with {@link freeDecodeTable}
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the tree is not valid or memory could not be allocated
  **/
-char* decode( char *binary, int sizeBits, int uncompressed, HuffNode *root)
+int buildDecodeTable( const HuffNodeSerial *treeSerial, int size, int alphabetSize, DecodeTable *table)
 {
-    /*Binary is a single long string of 1s and 0s*/
-    int i, j;
-    char ch;
-    char *decoded;
-    HuffNode* node;
+    int *prefixes;
+    int nodes, i, side, child, depth, first, count, j;
 
-    /*+1 for null terminator space*/
-    decoded = (char*) malloc( uncompressed + 1);
-	if ( decoded == NULL)
-	{
-		printf("Could not allocate memory for decoded\n");
-		return NULL;
-	}
-    j = 0;
-    node = root;
-    /*Size in bits excludes padding*/
-    for (i = 0; i < sizeBits; i++)
+    table->children = NULL;
+    table->symbols = NULL;
+    if ( checkTree( treeSerial, size, alphabetSize) != EXIT_SUCCESS)
     {
-        ch = binary[i];
-        
-        if ( ch == '0')
-        {
-            node = node->left;
-        }
-        else /*ch == '1'*/ 
+        return EXIT_FAILURE;
+    }
+    nodes = size / (int) sizeof(HuffNodeSerial);
+    table->children = (int*) arMalloc(2 * nodes * sizeof(int));
+    table->symbols = (int*) arMalloc(nodes * sizeof(int));
+    /*Bits of the path to each node, then its depth*/
+    prefixes = (int*) arMalloc(2 * nodes * sizeof(int));
+    if ( table->children == NULL || table->symbols == NULL || prefixes == NULL)
+    {
+        reportError("Could not allocate memory for decode table\n");
+        arFree(prefixes);
+        freeDecodeTable(table);
+        return EXIT_FAILURE;
+    }
+
+    /*A root with no right child matches no code starting with 1*/
+    for (i = 0; i < 1 << AR_DECODE_BITS; i++)
+    {
+        table->entries[i].symbol = -1;
+        table->entries[i].length = 1;
+        table->nodes[i] = -1;
+    }
+    prefixes[0] = 0;
+    prefixes[1] = 0;
+    for (i = 0; i < nodes; i++)
+    {
+        table->symbols[i] = getField( treeSerial, i, offsetof(HuffNodeSerial, symbol));
+        table->children[2 * i] = getField( treeSerial, i, offsetof(HuffNodeSerial, left));
+        table->children[2 * i + 1] = getField( treeSerial, i, offsetof(HuffNodeSerial, right));
+        depth = prefixes[2 * i + 1];
+        for (side = 0; side < 2; side++)
         {
-            node = node->right;
+            child = table->children[2 * i + side];
+            if ( child != -1)
+            {
+                prefixes[2 * child] = depth < AR_DECODE_BITS ? (prefixes[2 * i] << 1) | side : 0;
+                prefixes[2 * child + 1] = depth + 1;
+            }
         }
-        
-        if ( node->symbol != -1) /*Leaf node*/
+
+        if ( i > 0 && depth <= AR_DECODE_BITS && (table->children[2 * i] == -1 || depth == AR_DECODE_BITS))
         {
-            decoded[j++] = node->symbol;
-            node = root;
+            first = prefixes[2 * i] << (AR_DECODE_BITS - depth);
+            count = 1 << (AR_DECODE_BITS - depth);
+            for (j = first; j < first + count; j++)
+            {
+                table->entries[j].symbol = table->children[2 * i] == -1 ? table->symbols[i] : -2;
+                table->entries[j].length = depth;
+                table->nodes[j] = i;
+            }
         }
     }
-	decoded[j] = '\0';
-    return decoded;
-}
\ No newline at end of file
+
+    arFree(prefixes);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    freeDecodeTable
+ * FullName:  freeDecodeTable
+ * Access:    public
+ * @brief     Frees the child list of a table from {@link buildDecodeTable}, leaving it NULL
+ * @param 	  table - the table
+ **/
+void freeDecodeTable( DecodeTable *table)
+{
+    arFree(table->children);
+    arFree(table->symbols);
+    table->children = NULL;
+    table->symbols = NULL;
+}
@@ -1,4 +1,4 @@
-/* 
+/*
  * File:   Huffman.h
  * Author: adrian
  *
@@ -7,27 +7,43 @@
 
 #ifndef HUFFMAN_H
 #define	HUFFMAN_H
-typedef struct HuffNode
-{
-	char symbol;
-    int freq;
-    struct HuffNode* left;
-    struct HuffNode* right;
-} HuffNode;
 
-typedef struct 
+/* Longest code the flat tables hold. The counts of any block give codes under 46 bits, as a code of length n
+   needs a count total of at least the (n + 2)th Fibonacci number */
+#define AR_MAX_CODE_LENGTH 64
+
+typedef struct
 {
-    char symbol;
+    short symbol;
     short left;
     short right;
 } HuffNodeSerial;
 
-HuffNode* buildTree( HuffNode** pQ, int *num);
-void buildCodeTable( char* codeTable[], HuffNode *node, char* code, int level);
-char* compressTree(HuffNode *root, int numElements, int* compressedSize);
-void serializeRecurse(HuffNodeSerial *compressed, HuffNode* node, int *i);
-HuffNode* decompressTree( HuffNodeSerial* treeSerial);
-void deserializeRecurse( HuffNodeSerial* treeSerial, HuffNode* node, int i );
-char* decode( char *binary, int compressed, int uncompressed, HuffNode *tree);
+#define AR_DECODE_BITS 11  /* Bits looked up at once when decoding, longer codes finish down the tree */
+
+/* One entry per AR_DECODE_BITS bit prefix, read by the decode kernels */
+typedef struct
+{
+	int symbol;  /* Symbol of the code the prefix starts with, -1 if no code does, -2 if the code is longer */
+	int length;  /* Length of that code, or of the prefix if the code is longer or there is none */
+} DecodeEntry;
+
+typedef struct
+{
+	DecodeEntry entries[1 << AR_DECODE_BITS];
+	int nodes[1 << AR_DECODE_BITS];  /* Node to continue from, for prefixes of longer codes */
+	int *children;  /* Left then right child of each node of the tree, -1 for none */
+	int *symbols;  /* Symbol of each node, -1 for inner nodes */
+} DecodeTable;
+
+int buildLengths( const int *counts, int alphabetSize, unsigned char *lengths);
+void canonicalCodes( const unsigned char *lengths, int alphabetSize, unsigned long long *codes);
+HuffNodeSerial* serializeLengths( const unsigned char *lengths, const unsigned long long *codes, int alphabetSize,
+                                  int *compressedSize);
+HuffNodeSerial* buildCodes( const int *counts, int alphabetSize, unsigned char *lengths, unsigned long long *codes,
+                            int *compressedSize);
+int checkTree( const HuffNodeSerial *treeSerial, int size, int alphabetSize);
+int buildDecodeTable( const HuffNodeSerial *treeSerial, int size, int alphabetSize, DecodeTable *table);
+void freeDecodeTable( DecodeTable *table);
 #endif	/* HUFFMAN_H */
 
@@ -0,0 +1,167 @@
+/**
+ * @file   Index.c
+ * @author Adrian Rasmussen
+ *
+ * @brief Keeps the list of members in a block archive. The index sits after the last block, so a new
+ *		  member can be appended by writing its blocks where the index was and then writing a longer
+ *		  index after them. Nothing that was already compressed has to be read or rewritten. A deduplicated
+ *		  archive keeps its chunk table straight after the index, so it is rewritten the same way.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include "Index.h"
+#include "Format.h"
+#include "Memory.h"
+#include "Report.h"
+
+/**
+ * Method:    readIndex
+ * FullName:  readIndex
+ * Access:    public
+ * @brief     Reads the index of an archive, leaving room for one more entry to be appended
+ * @param 	  archive - the open archive
+ * @param 	  header - the archive's header, giving the index position and length
+ * @return    array of header->numMembers entries with space for one more, or NULL if the
+ *			  index is missing or could not be read. Must be freed by the caller
+ **/
+ARMember* readIndex( FILE *archive, const ARHeader *header)
+{
+	unsigned char data[AR_MEMBER_SIZE];
+	ARMember *members;
+	int i;
+
+	if ( header->indexOffset <= 0 || header->numMembers < 0 || header->numMembers >= AR_MAX_MEMBERS)
+	{
+		reportError("Archive has no valid index\n");
+		return NULL;
+	}
+
+	members = (ARMember*) arMalloc( (header->numMembers + 1) * sizeof(ARMember));
+	if ( members == NULL)
+	{
+		reportError("Could not allocate memory for index\n");
+		return NULL;
+	}
+	if ( fseeko( archive, (off_t) header->indexOffset, SEEK_SET) != 0)
+	{
+		reportError("Archive is truncated, could not read index\n");
+		arFree(members);
+		return NULL;
+	}
+	for ( i = 0; i < header->numMembers; i++)
+	{
+		if ( fread( data, 1, AR_MEMBER_SIZE, archive) != AR_MEMBER_SIZE)
+		{
+			reportError("Archive is truncated, could not read index\n");
+			arFree(members);
+			return NULL;
+		}
+		unpackMember(data, &members[i]);
+	}
+	return members;
+}
+
+/**
+ * Method:    readChunkTable
+ * FullName:  readChunkTable
+ * Access:    public
+ * @brief     Reads the chunk table that follows the index of a deduplicated archive
+ * @param 	  archive - the open archive
+ * @param 	  header - the archive's header, giving the index position and table length
+ * @return    array of header->numChunks entries, or NULL if the table could not be read. Must be freed by the caller
+ **/
+ARChunk* readChunkTable( FILE *archive, const ARHeader *header)
+{
+	unsigned char data[AR_CHUNK_SIZE];
+	ARChunk *chunks;
+	int i;
+
+	if ( header->indexOffset <= 0 || header->numChunks < 0 || header->numChunks >= AR_MAX_CHUNKS)
+	{
+		reportError("Archive has no valid chunk table\n");
+		return NULL;
+	}
+
+	chunks = (ARChunk*) arMalloc( (header->numChunks + 1) * sizeof(ARChunk));
+	if ( chunks == NULL)
+	{
+		reportError("Could not allocate memory for chunk table\n");
+		return NULL;
+	}
+	if ( fseeko( archive, (off_t) (header->indexOffset + header->numMembers * (long long) AR_MEMBER_SIZE), SEEK_SET) != 0)
+	{
+		reportError("Archive is truncated, could not read chunk table\n");
+		arFree(chunks);
+		return NULL;
+	}
+	for ( i = 0; i < header->numChunks; i++)
+	{
+		if ( fread( data, 1, AR_CHUNK_SIZE, archive) != AR_CHUNK_SIZE)
+		{
+			reportError("Archive is truncated, could not read chunk table\n");
+			arFree(chunks);
+			return NULL;
+		}
+		unpackChunk(data, &chunks[i]);
+	}
+	return chunks;
+}
+
+/**
+ * Method:    writeIndex
+ * FullName:  writeIndex
+ * Access:    public
+ * @brief     Writes the index and chunk table at the current position, then rewrites the header to point to them.
+ *			  The header is written last, so an interrupted update leaves it describing the old index
+ * @param 	  archive - the archive, positioned just after the last block
+ * @param 	  header - header to update with the index position and member count, and write
+ * @param 	  members - the entries to write
+ * @param 	  numMembers - number of entries
+ * @param 	  chunks - the chunk table, may be NULL if numChunks is 0
+ * @param 	  numChunks - number of chunk table entries
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the index or header could not be written
+ **/
+int writeIndex( FILE *archive, ARHeader *header, const ARMember *members, int numMembers, const ARChunk *chunks, int numChunks)
+{
+	unsigned char data[AR_MEMBER_SIZE];
+	off_t offset = ftello(archive);
+	int i;
+
+	if ( offset < 0)
+	{
+		reportSystemError("Could not write index");
+		return EXIT_FAILURE;
+	}
+	for ( i = 0; i < numMembers; i++)
+	{
+		packMember(&members[i], data);
+		if ( fwrite( data, 1, AR_MEMBER_SIZE, archive) != AR_MEMBER_SIZE)
+		{
+			reportSystemError("Could not write index");
+			return EXIT_FAILURE;
+		}
+	}
+	for ( i = 0; i < numChunks; i++)
+	{
+		packChunk(&chunks[i], data);
+		if ( fwrite( data, 1, AR_CHUNK_SIZE, archive) != AR_CHUNK_SIZE)
+		{
+			reportSystemError("Could not write index");
+			return EXIT_FAILURE;
+		}
+	}
+
+	header->indexOffset = (long long) offset;
+	header->numMembers = numMembers;
+	header->numChunks = numChunks;
+	if ( fflush(archive) != 0 ||
+		 fseeko( archive, 0, SEEK_SET) != 0 ||
+		 writeHeader(archive, header) != EXIT_SUCCESS ||
+		 fflush(archive) != 0)
+	{
+		reportSystemError("Could not write header");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
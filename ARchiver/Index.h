@@ -0,0 +1,20 @@
+/*
+ * File:   Index.h
+ * Author: adrian
+ *
+ * Reading and writing the member index at the end of a block archive
+ */
+
+#ifndef INDEX_H
+#define	INDEX_H
+#include <stdio.h>
+#include "ARHeader.h"
+
+#define AR_MAX_MEMBERS 1048576 /* Most index entries accepted when reading an archive */
+
+#define AR_MAX_CHUNKS 268435456 /* Most chunk table entries accepted when reading an archive */
+
+ARMember* readIndex( FILE *archive, const ARHeader *header);
+ARChunk* readChunkTable( FILE *archive, const ARHeader *header);
+int writeIndex( FILE *archive, ARHeader *header, const ARMember *members, int numMembers, const ARChunk *chunks, int numChunks);
+#endif	/* INDEX_H */
@@ -0,0 +1,401 @@
+/**
+ * @file   Kernels.c
+ * @author Adrian Rasmussen
+ *
+ * @brief The loops that touch every byte of a Huffman block: counting symbols, packing codes and decoding them.
+ *		  Each kernel's body is written once as an inline function and compiled twice, plainly and for CPUs with
+ *		  AVX2 and BMI2, where the variable shifts of the bit reader and writer become shlx/shrx and masks become
+ *		  bzhi. The first call picks the version with {@link cpuFeatures}, so a portable build still runs the
+ *		  newer instructions where they exist. Both versions give identical output.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "Kernels.h"
+#include "Cpu.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define AR_KERNEL_AVX2
+#define AR_INLINE static inline __attribute__((always_inline))
+#else
+#define AR_INLINE static inline
+#endif
+
+typedef struct Kernels
+{
+	void (*countBytes)( const unsigned char *data, int size, int counts[256]);
+	int (*packCodes)( const unsigned char *input, int size, const unsigned long long codes[256],
+					  const unsigned char lengths[256], unsigned char *output, int capacity, int *sizeBits);
+	int (*decodeBytes)( const unsigned char *compressed, int sizeBits, unsigned char *decoded, int uncompressed,
+						const DecodeTable *table);
+} Kernels;
+
+static Kernels kernels;
+static pthread_once_t kernelsOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Method:    countBytesBody
+ * FullName:  countBytesBody
+ * Access:    private
+ * @brief     Counts each byte value. Runs of the same byte would make every increment wait for the one before,
+ *			  so four sets of counters are used in turn and added up at the end
+ * @param 	  data - bytes to count
+ * @param 	  size - number of bytes
+ * @param 	  counts - set to the number of times each value occurs
+ **/
+AR_INLINE void countBytesBody( const unsigned char *data, int size, int counts[256])
+{
+	unsigned int partial[4][256];
+	unsigned long long word;
+	int i;
+
+	memset(partial, 0, sizeof(partial));
+	for (i = 0; i + 8 <= size; i += 8)
+	{
+		memcpy(&word, data + i, 8);
+		partial[0][word & 0xFF]++;
+		partial[1][(word >> 8) & 0xFF]++;
+		partial[2][(word >> 16) & 0xFF]++;
+		partial[3][(word >> 24) & 0xFF]++;
+		partial[0][(word >> 32) & 0xFF]++;
+		partial[1][(word >> 40) & 0xFF]++;
+		partial[2][(word >> 48) & 0xFF]++;
+		partial[3][word >> 56]++;
+	}
+	for (; i < size; i++)
+	{
+		partial[0][data[i]]++;
+	}
+	for (i = 0; i < 256; i++)
+	{
+		counts[i] = (int) (partial[0][i] + partial[1][i] + partial[2][i] + partial[3][i]);
+	}
+}
+
+/**
+ * Method:    packCodesBody
+ * FullName:  packCodesBody
+ * Access:    private
+ * @brief     Packs the code of each symbol into bytes, first bit highest. Codes collect in a 64 bit accumulator
+ *			  and leave it 32 bits at a time, instead of one bit at a time
+ * @param 	  input - symbols to encode
+ * @param 	  size - number of symbols
+ * @param 	  codes - code of each symbol, in the lowest bits
+ * @param 	  lengths - length of each symbol's code, at most AR_MAX_PACKED_CODE
+ * @param 	  output - buffer for the packed codes
+ * @param 	  capacity - size of output in bytes
+ * @param 	  sizeBits - set to the number of bits written, excluding padding
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the codes did not fit in capacity
+ **/
+AR_INLINE int packCodesBody( const unsigned char *input, int size, const unsigned long long codes[256],
+							 const unsigned char lengths[256], unsigned char *output, int capacity, int *sizeBits)
+{
+	unsigned long long acc, code;
+	unsigned int word;
+	int numBits, length, byte, i;
+
+	acc = 0;
+	numBits = 0;
+	byte = 0;
+	for (i = 0; i < size; i++)
+	{
+		code = codes[input[i]];
+		length = lengths[input[i]];
+		/*numBits stays below 32, so up to 32 more bits always fit*/
+		if ( length > 32)
+		{
+			acc = (acc << (length - 32)) | (code >> 32);
+			numBits += length - 32;
+			code &= 0xFFFFFFFFULL;
+			length = 32;
+			if ( numBits >= 32)
+			{
+				if ( byte + 4 > capacity)
+				{
+					return EXIT_FAILURE;
+				}
+				numBits -= 32;
+				word = (unsigned int) (acc >> numBits);
+				output[byte] = (unsigned char) (word >> 24);
+				output[byte + 1] = (unsigned char) (word >> 16);
+				output[byte + 2] = (unsigned char) (word >> 8);
+				output[byte + 3] = (unsigned char) word;
+				byte += 4;
+			}
+		}
+		acc = (acc << length) | code;
+		numBits += length;
+		if ( numBits >= 32)
+		{
+			if ( byte + 4 > capacity)
+			{
+				return EXIT_FAILURE;
+			}
+			numBits -= 32;
+			word = (unsigned int) (acc >> numBits);
+			output[byte] = (unsigned char) (word >> 24);
+			output[byte + 1] = (unsigned char) (word >> 16);
+			output[byte + 2] = (unsigned char) (word >> 8);
+			output[byte + 3] = (unsigned char) word;
+			byte += 4;
+		}
+	}
+
+	*sizeBits = byte * 8 + numBits;
+	if ( byte + (numBits + 7) / 8 > capacity)
+	{
+		return EXIT_FAILURE;
+	}
+	while ( numBits >= 8)
+	{
+		numBits -= 8;
+		output[byte++] = (unsigned char) (acc >> numBits);
+	}
+	if ( numBits > 0)
+	{
+		/*Last byte is padded with 0s*/
+		output[byte] = (unsigned char) (acc << (8 - numBits));
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    decodeBytesBody
+ * FullName:  decodeBytesBody
+ * Access:    private
+ * @brief     Decodes packed codes with a {@link buildDecodeTable} table. Bits are kept in a 64 bit buffer, highest
+ *			  first, which is refilled 8 bytes at a time so a lookup never waits on a byte load. Codes longer than
+ *			  the table finish one bit at a time through the table's child list
+ * @param 	  compressed - the packed codes
+ * @param 	  sizeBits - size in bits of the codes, excluding padding
+ * @param 	  decoded - buffer to save the decoded symbols to
+ * @param 	  uncompressed - capacity of decoded
+ * @param 	  table - decode table of the block's tree
+ * @return    the number of symbols decoded, or -1 if the bits do not match the tree or there are too many symbols
+ **/
+AR_INLINE int decodeBytesBody( const unsigned char *compressed, int sizeBits, unsigned char *decoded, int uncompressed,
+							   const DecodeTable *table)
+{
+	const DecodeEntry *entry;
+	unsigned long long buffer, word;
+	int numBytes, next, numBits, position, peek, symbol, node, j;
+
+	numBytes = (sizeBits + 7) / 8;
+	buffer = 0;
+	numBits = 0;
+	next = 0;
+	position = 0;
+	j = 0;
+	while ( position < sizeBits)
+	{
+		/*Refill so at least 56 bits are buffered, or everything that is left*/
+		if ( next + 8 <= numBytes)
+		{
+			memcpy(&word, compressed + next, 8);
+			buffer |= __builtin_bswap64(word) >> numBits;
+			next += (63 - numBits) >> 3;
+			numBits |= 56;
+		}
+		else
+		{
+			while ( numBits <= 56 && next < numBytes)
+			{
+				buffer |= (unsigned long long) compressed[next++] << (56 - numBits);
+				numBits += 8;
+			}
+		}
+
+		peek = (int) (buffer >> (64 - AR_DECODE_BITS));
+		entry = &table->entries[peek];
+		if ( entry->length > sizeBits - position)
+		{
+			break; /*Only padding or part of a code is left*/
+		}
+		if ( entry->symbol == -1)
+		{
+			return -1;
+		}
+		buffer <<= entry->length;
+		numBits -= entry->length;
+		position += entry->length;
+
+		symbol = entry->symbol;
+		if ( symbol == -2)
+		{
+			node = table->nodes[peek];
+			while ( node != -1 && table->children[2 * node] != -1)
+			{
+				if ( position == sizeBits)
+				{
+					return j;
+				}
+				if ( numBits == 0)
+				{
+					buffer = (unsigned long long) compressed[next++] << 56;
+					numBits = 8;
+				}
+				node = table->children[2 * node + (int) (buffer >> 63)];
+				buffer <<= 1;
+				numBits--;
+				position++;
+			}
+			if ( node == -1)
+			{
+				return -1;
+			}
+			symbol = table->symbols[node];
+		}
+
+		if ( j == uncompressed)
+		{
+			return -1;
+		}
+		decoded[j++] = (unsigned char) symbol;
+	}
+	return j;
+}
+
+/**
+ * Method:    countBytesScalar
+ * FullName:  countBytesScalar
+ * Access:    private
+ **/
+static void countBytesScalar( const unsigned char *data, int size, int counts[256])
+{
+	countBytesBody(data, size, counts);
+}
+
+/**
+ * Method:    packCodesScalar
+ * FullName:  packCodesScalar
+ * Access:    private
+ **/
+static int packCodesScalar( const unsigned char *input, int size, const unsigned long long codes[256],
+							const unsigned char lengths[256], unsigned char *output, int capacity, int *sizeBits)
+{
+	return packCodesBody(input, size, codes, lengths, output, capacity, sizeBits);
+}
+
+/**
+ * Method:    decodeBytesScalar
+ * FullName:  decodeBytesScalar
+ * Access:    private
+ **/
+static int decodeBytesScalar( const unsigned char *compressed, int sizeBits, unsigned char *decoded, int uncompressed,
+							  const DecodeTable *table)
+{
+	return decodeBytesBody(compressed, sizeBits, decoded, uncompressed, table);
+}
+
+#ifdef AR_KERNEL_AVX2
+/**
+ * Method:    countBytesAvx2
+ * FullName:  countBytesAvx2
+ * Access:    private
+ **/
+__attribute__((target("avx2,bmi,bmi2")))
+static void countBytesAvx2( const unsigned char *data, int size, int counts[256])
+{
+	countBytesBody(data, size, counts);
+}
+
+/**
+ * Method:    packCodesAvx2
+ * FullName:  packCodesAvx2
+ * Access:    private
+ **/
+__attribute__((target("avx2,bmi,bmi2")))
+static int packCodesAvx2( const unsigned char *input, int size, const unsigned long long codes[256],
+						  const unsigned char lengths[256], unsigned char *output, int capacity, int *sizeBits)
+{
+	return packCodesBody(input, size, codes, lengths, output, capacity, sizeBits);
+}
+
+/**
+ * Method:    decodeBytesAvx2
+ * FullName:  decodeBytesAvx2
+ * Access:    private
+ **/
+__attribute__((target("avx2,bmi,bmi2")))
+static int decodeBytesAvx2( const unsigned char *compressed, int sizeBits, unsigned char *decoded, int uncompressed,
+							const DecodeTable *table)
+{
+	return decodeBytesBody(compressed, sizeBits, decoded, uncompressed, table);
+}
+#endif
+
+/**
+ * Method:    initKernels
+ * FullName:  initKernels
+ * Access:    private
+ * @brief     Picks the version of each kernel to use. Run once, by whichever thread needs a kernel first
+ **/
+static void initKernels( void)
+{
+	kernels.countBytes = &countBytesScalar;
+	kernels.packCodes = &packCodesScalar;
+	kernels.decodeBytes = &decodeBytesScalar;
+#ifdef AR_KERNEL_AVX2
+	if ( (cpuFeatures() & (AR_CPU_AVX2 | AR_CPU_BMI2)) == (AR_CPU_AVX2 | AR_CPU_BMI2))
+	{
+		kernels.countBytes = &countBytesAvx2;
+		kernels.packCodes = &packCodesAvx2;
+		kernels.decodeBytes = &decodeBytesAvx2;
+	}
+#endif
+}
+
+/**
+ * Method:    countBytes
+ * FullName:  countBytes
+ * Access:    public
+ * @brief     Counts how often each byte value occurs
+ * @param 	  data - bytes to count
+ * @param 	  size - number of bytes
+ * @param 	  counts - set to the number of times each value occurs
+ **/
+void countBytes( const unsigned char *data, int size, int counts[256])
+{
+	pthread_once(&kernelsOnce, &initKernels);
+	kernels.countBytes(data, size, counts);
+}
+
+/**
+ * Method:    packCodes
+ * FullName:  packCodes
+ * Access:    public
+ * @brief     Packs the code of each symbol into bytes, with the first bit of each byte in the highest position
+ * @param 	  input - symbols to encode
+ * @param 	  size - number of symbols
+ * @param 	  codes - code of each symbol, in the lowest bits
+ * @param 	  lengths - length of each symbol's code, at most AR_MAX_PACKED_CODE
+ * @param 	  output - buffer for the packed codes
+ * @param 	  capacity - size of output in bytes
+ * @param 	  sizeBits - set to the number of bits written, excluding padding
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the codes did not fit in capacity
+ **/
+int packCodes( const unsigned char *input, int size, const unsigned long long codes[256], const unsigned char lengths[256],
+			   unsigned char *output, int capacity, int *sizeBits)
+{
+	pthread_once(&kernelsOnce, &initKernels);
+	return kernels.packCodes(input, size, codes, lengths, output, capacity, sizeBits);
+}
+
+/**
+ * Method:    decodeBytes
+ * FullName:  decodeBytes
+ * Access:    public
+ * @brief     Decodes packed codes back to bytes with a table from {@link buildDecodeTable}
+ * @param 	  compressed - the packed codes
+ * @param 	  sizeBits - size in bits of the codes, excluding padding
+ * @param 	  decoded - buffer to save the decoded symbols to
+ * @param 	  uncompressed - capacity of decoded
+ * @param 	  table - decode table of the block's tree
+ * @return    the number of symbols decoded, or -1 if the bits do not match the tree or there are too many symbols
+ **/
+int decodeBytes( const unsigned char *compressed, int sizeBits, unsigned char *decoded, int uncompressed, const DecodeTable *table)
+{
+	pthread_once(&kernelsOnce, &initKernels);
+	return kernels.decodeBytes(compressed, sizeBits, decoded, uncompressed, table);
+}
@@ -0,0 +1,19 @@
+/*
+ * File:   Kernels.h
+ * Author: adrian
+ *
+ * Inner loops of the Huffman coder, each with a plain version and one built for
+ * AVX2/BMI2 CPUs. The version is chosen at run time from cpuFeatures()
+ */
+
+#ifndef KERNELS_H
+#define	KERNELS_H
+#include "Huffman.h"
+
+#define AR_MAX_PACKED_CODE 64  /* Longest code packCodes can write */
+
+void countBytes( const unsigned char *data, int size, int counts[256]);
+int packCodes( const unsigned char *input, int size, const unsigned long long codes[256], const unsigned char lengths[256],
+			   unsigned char *output, int capacity, int *sizeBits);
+int decodeBytes( const unsigned char *compressed, int sizeBits, unsigned char *decoded, int uncompressed, const DecodeTable *table);
+#endif	/* KERNELS_H */
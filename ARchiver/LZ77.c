@@ -0,0 +1,426 @@
+/**
+ * @file   LZ77.c
+ * @author Adrian Rasmussen
+ *
+ * @brief LZ77 stage for blocks with repeated strings, such as log files. A hash chain match finder
+ *		  replaces repeats with (length, distance) pairs pointing back into the block, then the literals
+ *		  and lengths share one Huffman tree and the distances use another, as in DEFLATE. Lengths and
+ *		  distances are sent as a code followed by extra bits, using DEFLATE's tables.
+ *		  A compressed block holds the size of the literal/length tree, both serialized trees and then the codes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "LZ77.h"
+#include "Huffman.h"
+#include "Bits.h"
+#include "Format.h"
+#include "Memory.h"
+#include "Report.h"
+
+/*Shortest length and extra bits of each length code, starting at 257*/
+static const int lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+									35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const int lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+									 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+/*Shortest distance and extra bits of each distance code*/
+static const int distBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385,
+								  513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const int distExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7,
+								   8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static int findMatch( unsigned char *input, int size, int pos, int *head, int *prev, int maxChain, int *distance);
+static void insertHash( unsigned char *input, int size, int pos, int *head, int *prev);
+static int lengthCode( int length);
+static int distCode( int distance);
+
+/*Hashes the three bytes at p, the shortest string worth matching*/
+#define hash3(p) ((((unsigned int) (p)[0] << 16 | (unsigned int) (p)[1] << 8 | (p)[2]) * 2654435761u) >> (32 - AR_LZ_HASH_BITS))
+
+/**
+ * Method:    insertHash
+ * FullName:  insertHash
+ * Access:    private
+ * @brief     Adds position pos to the front of its hash chain
+ * @param 	  input - the block
+ * @param 	  size - size of the block
+ * @param 	  pos - position to add
+ * @param 	  head - most recent position for each hash, or -1
+ * @param 	  prev - previous position with the same hash, for each position
+ **/
+static void insertHash( unsigned char *input, int size, int pos, int *head, int *prev)
+{
+	unsigned int h;
+
+	if ( pos + AR_LZ_MIN_MATCH <= size)
+	{
+		h = hash3(input + pos);
+		prev[pos] = head[h];
+		head[h] = pos;
+	}
+}
+
+/**
+ * Method:    findMatch
+ * FullName:  findMatch
+ * Access:    private
+ * @brief     Walks the hash chain for pos, looking for the longest earlier string within the window
+ * @param 	  input - the block
+ * @param 	  size - size of the block
+ * @param 	  pos - position to match, not yet in the hash chains
+ * @param 	  head - most recent position for each hash, or -1
+ * @param 	  prev - previous position with the same hash, for each position
+ * @param 	  maxChain - most chain entries to try
+ * @param 	  distance - location to save the distance back to the match to
+ * @return    length of the longest match, or 0 if none is at least AR_LZ_MIN_MATCH long
+ **/
+static int findMatch( unsigned char *input, int size, int pos, int *head, int *prev, int maxChain, int *distance)
+{
+	int candidate, length, best, limit;
+
+	best = 0;
+	if ( pos + AR_LZ_MIN_MATCH > size)
+	{
+		return 0;
+	}
+	limit = size - pos < AR_LZ_MAX_MATCH ? size - pos : AR_LZ_MAX_MATCH;
+	candidate = head[hash3(input + pos)];
+	while ( candidate >= 0 && pos - candidate <= AR_LZ_WINDOW && maxChain-- > 0 && best < limit)
+	{
+		/*Check the byte that would make this match longer first, it rules most candidates out*/
+		if ( input[candidate + best] == input[pos + best])
+		{
+			length = 0;
+			while ( length < limit && input[candidate + length] == input[pos + length])
+			{
+				length++;
+			}
+			if ( length > best)
+			{
+				best = length;
+				*distance = pos - candidate;
+			}
+		}
+		candidate = prev[candidate];
+	}
+	return best >= AR_LZ_MIN_MATCH ? best : 0;
+}
+
+/**
+ * Method:    lz77Tokens
+ * FullName:  lz77Tokens
+ * Access:    public
+ * @brief     Splits a block into literals and matches. With lazy matching, a match is only taken if the
+ *			  next position does not start a longer one, otherwise a literal is sent first
+ * @param 	  input - the block
+ * @param 	  size - size of the block
+ * @param 	  tokens - location to save the tokens to, room for size entries. A literal is its byte value,
+ *			  a match is AR_LZ_MATCH_FLAG | length << 16 | distance
+ * @param 	  maxChain - most hash chain entries to try for each position, more finds longer matches but is slower
+ * @param 	  lazy - 1 to use lazy matching, 0 to always take the first match
+ * @return    number of tokens, or -1 if memory could not be allocated
+ **/
+int lz77Tokens( unsigned char *input, int size, unsigned int *tokens, int maxChain, int lazy)
+{
+	int *head, *prev;
+	int i, pos, numTokens, length, distance, nextLength, nextDistance;
+
+	head = (int*) arMalloc( (1 << AR_LZ_HASH_BITS) * sizeof(int));
+	prev = (int*) arMalloc( size * sizeof(int));
+	if ( head == NULL || prev == NULL)
+	{
+		reportError("Could not allocate memory for hash chains\n");
+		arFree(head);
+		arFree(prev);
+		return -1;
+	}
+	for ( i = 0; i < (1 << AR_LZ_HASH_BITS); i++)
+	{
+		head[i] = -1;
+	}
+
+	numTokens = 0;
+	pos = 0;
+	while ( pos < size)
+	{
+		length = findMatch( input, size, pos, head, prev, maxChain, &distance);
+		insertHash( input, size, pos, head, prev);
+		if ( length > 0 && lazy && length < AR_LZ_LAZY_LIMIT)
+		{
+			nextLength = findMatch( input, size, pos + 1, head, prev, maxChain, &nextDistance);
+			if ( nextLength > length)
+			{
+				length = 0;
+			}
+		}
+
+		if ( length > 0)
+		{
+			tokens[numTokens++] = AR_LZ_MATCH_FLAG | (unsigned int) length << 16 | (unsigned int) distance;
+			for ( i = 1; i < length; i++)
+			{
+				insertHash( input, size, pos + i, head, prev);
+			}
+			pos += length;
+		}
+		else
+		{
+			tokens[numTokens++] = input[pos];
+			pos++;
+		}
+	}
+
+	arFree(head);
+	arFree(prev);
+	return numTokens;
+}
+
+/**
+ * Method:    lengthCode
+ * FullName:  lengthCode
+ * Access:    private
+ * @param 	  length - match length, AR_LZ_MIN_MATCH to AR_LZ_MAX_MATCH
+ * @return    index of the length code in lengthBase
+ **/
+static int lengthCode( int length)
+{
+	int code = 28;
+
+	while ( lengthBase[code] > length)
+	{
+		code--;
+	}
+	return code;
+}
+
+/**
+ * Method:    distCode
+ * FullName:  distCode
+ * Access:    private
+ * @param 	  distance - match distance, 1 to AR_LZ_WINDOW
+ * @return    the distance code
+ **/
+static int distCode( int distance)
+{
+	int code = 29;
+
+	while ( distBase[code] > distance)
+	{
+		code--;
+	}
+	return code;
+}
+
+/**
+ * Method:    lz77Compress
+ * FullName:  lz77Compress
+ * Access:    public
+ * @brief     Compresses a block with {@link lz77Tokens}, then Huffman codes the tokens using one tree for
+ *			  literals and lengths and another for distances
+ * @param 	  input - the block
+ * @param 	  size - size of the block
+ * @param 	  output - buffer to save the trees and codes to
+ * @param 	  capacity - size of output
+ * @param 	  maxChain - most hash chain entries to try for each position
+ * @param 	  lazy - 1 to use lazy matching
+ * @param 	  treeSize - location to save the size of the trees section to, in bytes
+ * @param 	  compressedSize - location to save the size of the codes to, in bits without padding
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the result did not fit in capacity or memory could not be allocated
+ **/
+int lz77Compress( unsigned char *input, int size, unsigned char *output, int capacity,
+				  int maxChain, int lazy, int *treeSize, int *compressedSize)
+{
+	unsigned int *tokens;
+	int litCounts[AR_LZ_LITLEN_SYMBOLS], distCounts[AR_LZ_DIST_SYMBOLS];
+	unsigned long long litCodes[AR_LZ_LITLEN_SYMBOLS], distCodes[AR_LZ_DIST_SYMBOLS];
+	unsigned char litLengths[AR_LZ_LITLEN_SYMBOLS], distLengths[AR_LZ_DIST_SYMBOLS];
+	HuffNodeSerial *litSerial, *distSerial;
+	int numTokens, numMatches, litSize, distSize, i, length, distance, symbol, status;
+	BitWriter writer;
+
+	tokens = (unsigned int*) arMalloc( size * sizeof(unsigned int));
+	if ( tokens == NULL)
+	{
+		reportError("Could not allocate memory for tokens\n");
+		return EXIT_FAILURE;
+	}
+	numTokens = lz77Tokens( input, size, tokens, maxChain, lazy);
+	if ( numTokens < 0)
+	{
+		arFree(tokens);
+		return EXIT_FAILURE;
+	}
+
+	memset(litCounts, 0, sizeof(litCounts));
+	memset(distCounts, 0, sizeof(distCounts));
+	numMatches = 0;
+	for ( i = 0; i < numTokens; i++)
+	{
+		if ( tokens[i] & AR_LZ_MATCH_FLAG)
+		{
+			numMatches++;
+			litCounts[257 + lengthCode((tokens[i] >> 16) & 0x1FF)]++;
+			distCounts[distCode(tokens[i] & 0xFFFF)]++;
+		}
+		else
+		{
+			litCounts[tokens[i]]++;
+		}
+	}
+
+	/*There are no distances when nothing repeats*/
+	litSerial = buildCodes( litCounts, AR_LZ_LITLEN_SYMBOLS, litLengths, litCodes, &litSize);
+	distSerial = buildCodes( distCounts, AR_LZ_DIST_SYMBOLS, distLengths, distCodes, &distSize);
+
+	status = EXIT_FAILURE;
+	*treeSize = (int) sizeof(int) + litSize + distSize;
+	if ( litSerial != NULL && (numMatches == 0 || distSerial != NULL) && *treeSize < capacity)
+	{
+		putLE32( output, (unsigned int) litSize);
+		memcpy( output + sizeof(int), litSerial, litSize);
+		memcpy( output + sizeof(int) + litSize, distSerial, distSize);
+
+		initBitWriter( &writer, output + *treeSize, capacity - *treeSize);
+		for ( i = 0; i < numTokens && !writer.overflow; i++)
+		{
+			if ( tokens[i] & AR_LZ_MATCH_FLAG)
+			{
+				length = (tokens[i] >> 16) & 0x1FF;
+				distance = tokens[i] & 0xFFFF;
+				symbol = lengthCode(length);
+				putCode( &writer, litCodes[257 + symbol], litLengths[257 + symbol]);
+				putBits( &writer, length - lengthBase[symbol], lengthExtra[symbol]);
+				symbol = distCode(distance);
+				putCode( &writer, distCodes[symbol], distLengths[symbol]);
+				putBits( &writer, distance - distBase[symbol], distExtra[symbol]);
+			}
+			else
+			{
+				putCode( &writer, litCodes[tokens[i]], litLengths[tokens[i]]);
+			}
+		}
+		*compressedSize = flushBits(&writer);
+		if ( *compressedSize >= 0)
+		{
+			status = EXIT_SUCCESS;
+		}
+	}
+
+	arFree(litSerial);
+	arFree(distSerial);
+	arFree(tokens);
+	return status;
+}
+
+/**
+ * Method:    lz77Decompress
+ * FullName:  lz77Decompress
+ * Access:    public
+ * @brief     Builds decode tables from both trees and decodes literals and matches until the block is complete
+ * @param 	  input - the trees section followed by the codes
+ * @param 	  treeSize - size of the trees section in bytes
+ * @param 	  compressedSize - size of the codes in bits
+ * @param 	  output - buffer to save the block to
+ * @param 	  size - size of the block when uncompressed
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the data is corrupt
+ **/
+int lz77Decompress( unsigned char *input, int treeSize, int compressedSize, unsigned char *output, int size)
+{
+	DecodeTable *litTable, *distTable;
+	BitReader reader;
+	int litSize, distSize, pos, symbol, extra, length, distance, status;
+
+	litSize = (int) getLE32(input);
+	if ( litSize <= 0 || litSize % (int) sizeof(HuffNodeSerial) != 0 ||
+		 litSize > treeSize - (int) sizeof(int) || (treeSize - (int) sizeof(int) - litSize) % (int) sizeof(HuffNodeSerial) != 0)
+	{
+		reportError("Not a valid .ar file, bad LZ77 tree sizes\n");
+		return EXIT_FAILURE;
+	}
+
+	litTable = (DecodeTable*) arMalloc( 2 * sizeof(DecodeTable));
+	if ( litTable == NULL)
+	{
+		reportError("Could not allocate memory for decode tables\n");
+		return EXIT_FAILURE;
+	}
+	/*The distance table is only used when there is a distance tree*/
+	distTable = litTable + 1;
+	distSize = treeSize - (int) sizeof(int) - litSize;
+	if ( buildDecodeTable( (const HuffNodeSerial*) (input + sizeof(int)), litSize, AR_LZ_LITLEN_SYMBOLS, litTable)
+		 != EXIT_SUCCESS)
+	{
+		arFree(litTable);
+		reportError("Not a valid .ar file, bad LZ77 tree\n");
+		return EXIT_FAILURE;
+	}
+	if ( distSize == 0)
+	{
+		distTable = NULL;
+	}
+	else if ( buildDecodeTable( (const HuffNodeSerial*) (input + sizeof(int) + litSize), distSize,
+								AR_LZ_DIST_SYMBOLS, distTable) != EXIT_SUCCESS)
+	{
+		freeDecodeTable(litTable);
+		arFree(litTable);
+		reportError("Not a valid .ar file, bad LZ77 tree\n");
+		return EXIT_FAILURE;
+	}
+
+	initBitReader( &reader, input + treeSize, compressedSize);
+	status = EXIT_SUCCESS;
+	pos = 0;
+	while ( pos < size && status == EXIT_SUCCESS)
+	{
+		symbol = decodeSymbol( &reader, litTable);
+		if ( symbol >= 0 && symbol < 256)
+		{
+			output[pos++] = (unsigned char) symbol;
+		}
+		else if ( symbol >= 257 && symbol < AR_LZ_LITLEN_SYMBOLS && distTable != NULL)
+		{
+			symbol -= 257;
+			extra = getBits( &reader, lengthExtra[symbol]);
+			length = lengthBase[symbol] + extra;
+			symbol = decodeSymbol( &reader, distTable);
+			if ( extra < 0 || symbol < 0 || symbol >= AR_LZ_DIST_SYMBOLS)
+			{
+				status = EXIT_FAILURE;
+			}
+			else
+			{
+				extra = getBits( &reader, distExtra[symbol]);
+				distance = distBase[symbol] + extra;
+				if ( extra < 0 || distance > pos || length > size - pos)
+				{
+					status = EXIT_FAILURE;
+				}
+				else
+				{
+					/*Copy forwards a byte at a time, the match may overlap itself*/
+					while ( length-- > 0)
+					{
+						output[pos] = output[pos - distance];
+						pos++;
+					}
+				}
+			}
+		}
+		else
+		{
+			status = EXIT_FAILURE;
+		}
+	}
+	if ( status != EXIT_SUCCESS)
+	{
+		reportError("Not a valid .ar file, LZ77 block does not match its trees\n");
+	}
+
+	if ( distTable != NULL)
+	{
+		freeDecodeTable(distTable);
+	}
+	freeDecodeTable(litTable);
+	arFree(litTable);
+	return status;
+}
@@ -0,0 +1,24 @@
+/*
+ * File:   LZ77.h
+ * Author: adrian
+ *
+ * LZ77 match finding in front of Huffman coding, in the style of DEFLATE
+ */
+
+#ifndef LZ77_H
+#define	LZ77_H
+
+#define AR_LZ_WINDOW 32768  /* Furthest back a match may start */
+#define AR_LZ_MIN_MATCH 3
+#define AR_LZ_MAX_MATCH 258
+#define AR_LZ_HASH_BITS 15
+#define AR_LZ_LAZY_LIMIT 32  /* Matches this long are taken without checking the next position */
+#define AR_LZ_LITLEN_SYMBOLS 286  /* 256 literals, an unused end of block code and 29 length codes */
+#define AR_LZ_DIST_SYMBOLS 30
+#define AR_LZ_MATCH_FLAG 0x80000000u  /* Set in a token for a match, with length << 16 | distance */
+
+int lz77Tokens( unsigned char *input, int size, unsigned int *tokens, int maxChain, int lazy);
+int lz77Compress( unsigned char *input, int size, unsigned char *output, int capacity,
+				  int maxChain, int lazy, int *treeSize, int *compressedSize);
+int lz77Decompress( unsigned char *input, int treeSize, int compressedSize, unsigned char *output, int size);
+#endif	/* LZ77_H */
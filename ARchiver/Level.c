@@ -0,0 +1,217 @@
+/**
+ * @file   Level.c
+ * @author Adrian Rasmussen
+ *
+ * @brief Maps the -1 to -9 compression levels onto concrete settings, so a job can trade speed for ratio
+ *		  without knowing which stages exist. Low levels use plain Huffman coding, middle levels add LZ77
+ *		  with increasing search effort, and the top levels use the Burrows-Wheeler transform on larger blocks.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "ARHeader.h"
+#include "Level.h"
+#include "Pipeline.h"
+#include "Codec.h"
+
+/*Block sizes are only changed by setMemoryBudget, before anything is coded*/
+static ARLevel levels[AR_MAX_LEVEL] =
+{
+	{ 1, AR_METHOD_HUFFMAN,  262144,    0, 0, 0, "Huffman only, small blocks, fastest" },
+	{ 2, AR_METHOD_SPLIT,   1048576,    0, 0, 0, "Huffman only, split where the data changes (default)" },
+	{ 3, AR_METHOD_LZ77,    1048576,    4, 0, 0, "LZ77, greedy, shallow search" },
+	{ 4, AR_METHOD_LZ77,    1048576,   16, 0, 0, "LZ77, greedy" },
+	{ 5, AR_METHOD_LZ77,    1048576,   32, 1, 0, "LZ77, lazy matching" },
+	{ 6, AR_METHOD_LZ77,    1048576,  128, 1, 0, "LZ77, lazy matching, deeper search" },
+	{ 7, AR_METHOD_LZ77,    1048576, 1024, 1, 0, "LZ77, lazy matching, exhaustive search" },
+	{ 8, AR_METHOD_BWT,     1048576,    0, 0, 0, "Burrows-Wheeler transform" },
+	/*Each BWT thread needs about 17 bytes per block byte, so large blocks use fewer threads*/
+	{ 9, AR_METHOD_BWT,     4194304,    0, 0, 4, "Burrows-Wheeler transform, large blocks, best ratio" }
+};
+/*Word tokens for text and logs, chosen with -w rather than a level*/
+static ARLevel wordsLevel = { AR_DEFAULT_LEVEL, AR_METHOD_WORDS, 1048576, 0, 0, 0, "Word tokens with literal escapes, for text and logs" };
+static long long memoryBudget;  /* Bytes, 0 for no limit */
+
+static void fitBudget( ARLevel *level, long long budget);
+
+/**
+ * Method:    getLevel
+ * FullName:  getLevel
+ * Access:    public
+ * @param 	  level - compression level, AR_MIN_LEVEL to AR_MAX_LEVEL
+ * @return    settings for the level, or NULL if it is out of range
+ **/
+const ARLevel* getLevel( int level)
+{
+	if ( level < AR_MIN_LEVEL || level > AR_MAX_LEVEL)
+	{
+		return NULL;
+	}
+	return &levels[level - AR_MIN_LEVEL];
+}
+
+/**
+ * Method:    getWordsLevel
+ * FullName:  getWordsLevel
+ * Access:    public
+ * @return    settings for -w, which codes blocks as word tokens at the default level's block size
+ **/
+const ARLevel* getWordsLevel( void)
+{
+	return &wordsLevel;
+}
+
+/**
+ * Method:    levelThreads
+ * FullName:  levelThreads
+ * Access:    public
+ * @brief     Number of coder threads to use at a level, one per CPU or as set by -T, up to the level's limit and
+ *			  the memory budget
+ * @param 	  level - the level's settings
+ * @return    number of threads, at least 1
+ **/
+int levelThreads( const ARLevel *level)
+{
+	int threads = defaultThreads();
+
+	if ( level->maxThreads > 0 && threads > level->maxThreads)
+	{
+		threads = level->maxThreads;
+	}
+	return budgetThreads(level, level->blockSize, threads);
+}
+
+/**
+ * Method:    pipelineMemory
+ * FullName:  pipelineMemory
+ * Access:    public
+ * @brief     Estimates the heap a pipeline needs: the block buffers of every slot, plus each coder's working
+ *			  memory, which for LZ77 is the hash chains and tokens, for BWT the suffix array, for split
+ *			  Huffman blocks the counts and trees of each segment and for word tokens the word table.
+ *			  Plain Huffman trees are small enough to leave out
+ * @param 	  level - settings to compress with, or NULL for decompression
+ * @param 	  blockSize - uncompressed bytes per block
+ * @param 	  threads - coder threads
+ * @return    estimated bytes
+ **/
+long long pipelineMemory( const ARLevel *level, int blockSize, int threads)
+{
+	long long block = blockSize, scratch;
+
+	if ( level == NULL)
+	{
+		/*Decoding a BWT block, the worst case, needs a copy of it and an int per byte*/
+		scratch = 5 * block;
+	}
+	else if ( level->method == AR_METHOD_BWT)
+	{
+		scratch = 17 * block;
+	}
+	else if ( level->method == AR_METHOD_LZ77)
+	{
+		scratch = 8 * block + (4LL << AR_LZ_HASH_BITS);
+	}
+	else if ( level->method == AR_METHOD_SPLIT)
+	{
+		scratch = splitMemory(blockSize);
+	}
+	else if ( level->method == AR_METHOD_WORDS)
+	{
+		scratch = wordsMemory(blockSize);
+	}
+	else
+	{
+		scratch = 0;
+	}
+	/*Two slots per coder and one each for the reader and writer, see runPipeline*/
+	return (2LL * threads + 2) * (2 * block + AR_MAX_TREE_SIZE) + threads * scratch;
+}
+
+/**
+ * Method:    setMemoryBudget
+ * FullName:  setMemoryBudget
+ * Access:    public
+ * @brief     Limits the memory coding may use, for --max-memory. Each level's block size is halved until one
+ *			  coder thread fits, down to AR_MIN_BUDGET_BLOCK; thread counts are then fitted by {@link budgetThreads}.
+ *			  Only the level being coded with has to fit, so a small budget still works at a low level.
+ *			  Must be called before anything is coded
+ * @param 	  budget - bytes, or 0 for no limit
+ * @param 	  level - settings that will be coded with, or NULL if there are none, as when decompressing
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the level does not fit even with the smallest blocks
+ **/
+int setMemoryBudget( long long budget, const ARLevel *level)
+{
+	int i;
+
+	memoryBudget = budget;
+	for ( i = 0; i < AR_MAX_LEVEL && budget > 0; i++)
+	{
+		fitBudget(&levels[i], budget);
+	}
+	if ( budget > 0)
+	{
+		fitBudget(&wordsLevel, budget);
+	}
+	/*The level is one of the above, so its block size has already been fitted*/
+	return budget > 0 && level != NULL && pipelineMemory(level, level->blockSize, 1) > budget ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * Method:    fitBudget
+ * FullName:  fitBudget
+ * Access:    private
+ * @brief     Halves a level's block size until one coder thread fits the budget, down to AR_MIN_BUDGET_BLOCK
+ * @param 	  level - the level's settings
+ * @param 	  budget - bytes
+ **/
+static void fitBudget( ARLevel *level, long long budget)
+{
+	while ( level->blockSize > AR_MIN_BUDGET_BLOCK && pipelineMemory(level, level->blockSize, 1) > budget)
+	{
+		level->blockSize /= 2;
+	}
+}
+
+/**
+ * Method:    budgetThreads
+ * FullName:  budgetThreads
+ * Access:    public
+ * @brief     Lowers a thread count until the pipeline fits the memory budget
+ * @param 	  level - settings to compress with, or NULL for decompression
+ * @param 	  blockSize - uncompressed bytes per block
+ * @param 	  threads - threads wanted
+ * @return    threads to use, at least 1 even if that does not fit
+ **/
+int budgetThreads( const ARLevel *level, int blockSize, int threads)
+{
+	while ( memoryBudget > 0 && threads > 1 && pipelineMemory(level, blockSize, threads) > memoryBudget)
+	{
+		threads--;
+	}
+	return threads;
+}
+
+/**
+ * Method:    printLevelInfo
+ * FullName:  printLevelInfo
+ * Access:    public
+ * @brief     Prints a table of what each level does, for --level-info
+ * @param 	  output - stream to print to
+ **/
+void printLevelInfo( FILE *output)
+{
+	static const char *methods[] = { "huffman", "lz77", "bwt", "delta", "end", "split", "words" };
+	const ARLevel *level;
+	int i;
+
+	fprintf(output, "Level  Method   Block size  LZ77 chain  Lazy  Threads  Description\n");
+	for ( i = AR_MIN_LEVEL; i <= AR_MAX_LEVEL; i++)
+	{
+		level = getLevel(i);
+		fprintf(output, "-%-5d %-8s %7d KB  %10d  %4s  %7d  %s\n", level->level, methods[level->method],
+				level->blockSize / 1024, level->maxChain, level->lazy ? "yes" : "no", levelThreads(level),
+				level->description);
+	}
+	level = getWordsLevel();
+	fprintf(output, "-w     %-8s %7d KB  %10d  %4s  %7d  %s\n", methods[level->method], level->blockSize / 1024,
+			level->maxChain, level->lazy ? "yes" : "no", levelThreads(level), level->description);
+}
@@ -0,0 +1,36 @@
+/*
+ * File:   Level.h
+ * Author: adrian
+ *
+ * Compression levels -1 to -9, each a fixed combination of method, block size and effort,
+ * and the word token settings used by -w.
+ * A memory budget set with --max-memory lowers the thread count first, then the block size
+ */
+
+#ifndef LEVEL_H
+#define	LEVEL_H
+
+#define AR_MIN_LEVEL 1
+#define AR_MAX_LEVEL 9
+#define AR_DEFAULT_LEVEL 2  /* Huffman coding split where the data changes, used when no level is given */
+#define AR_MIN_BUDGET_BLOCK 65536  /* Smallest block size --max-memory shrinks a level to */
+
+typedef struct ARLevel
+{
+	int level;
+	int method;       /* AR_METHOD_* used for every block */
+	int blockSize;    /* Uncompressed bytes per block */
+	int maxChain;     /* LZ77 hash chain entries tried for each position */
+	int lazy;         /* 1 to use lazy LZ77 matching */
+	int maxThreads;   /* Most coder threads to use, 0 for one per CPU */
+	const char *description;
+} ARLevel;
+
+const ARLevel* getLevel( int level);
+const ARLevel* getWordsLevel( void);
+int levelThreads( const ARLevel *level);
+long long pipelineMemory( const ARLevel *level, int blockSize, int threads);
+int setMemoryBudget( long long budget, const ARLevel *level);
+int budgetThreads( const ARLevel *level, int blockSize, int threads);
+void printLevelInfo( FILE *output);
+#endif	/* LEVEL_H */
@@ -0,0 +1,376 @@
+/**
+ * @file   Memory.c
+ * @author Adrian Rasmussen
+ *
+ * @brief Allocation counting for --stats, in place of the MSVC-only crtdbg leak check. Each allocation gets a
+ *		  header holding its size and the stage it was made in, and the totals for that stage and for
+ *		  everything are kept with atomic adds, so coder threads don't share a lock. Totals cover allocations,
+ *		  bytes asked for, bytes still in use and the high-water mark. The stage comes from the calling
+ *		  thread, set by {@link startStage} while stats are on. While the library API is running, the calling
+ *		  thread's allocations come from the caller's ar_allocator instead of malloc, set by {@link setThreadAllocator}.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "Memory.h"
+
+/*Put in front of every allocation. The union keeps what follows aligned for any type*/
+typedef union MemoryHeader
+{
+	struct
+	{
+		size_t size;
+		int stage;
+		int foreign;  /* 1 if the memory came from a caller's allocator */
+		void (*release)( void *opaque, void *pointer);  /* That allocator's free, NULL if it has none */
+		void *opaque;
+	} info;
+	long double alignDouble;
+	long long alignLong;
+	void *alignPointer;
+} MemoryHeader;
+
+/*Stage, counts and allocator of one thread, only kept for threads that run timed stages or set an allocator*/
+typedef struct ThreadMemory
+{
+	int stage;
+	long long allocations;
+	long long bytes;
+	ar_allocator allocator;  /* alloc is NULL for malloc */
+} ThreadMemory;
+
+static MemoryStats totals[AR_MEMORY_SLOTS];
+static pthread_key_t threadKey;
+static pthread_once_t threadOnce = PTHREAD_ONCE_INIT;
+
+static void makeThreadKey( void);
+static ThreadMemory* threadMemory( int create);
+static MemoryHeader* allocateHeader( size_t size, int zero);
+static void addMemory( int stage, long long size, long long count);
+static void* track( MemoryHeader *header, size_t size);
+
+/**
+ * Method:    makeThreadKey
+ * FullName:  makeThreadKey
+ * Access:    private
+ **/
+static void makeThreadKey( void)
+{
+	pthread_key_create(&threadKey, &free);
+}
+
+/**
+ * Method:    threadMemory
+ * FullName:  threadMemory
+ * Access:    private
+ * @param 	  create - 1 to create the calling thread's record if it has none
+ * @return    the calling thread's record, or NULL if it has none or it could not be created
+ **/
+static ThreadMemory* threadMemory( int create)
+{
+	ThreadMemory *thread;
+
+	pthread_once(&threadOnce, &makeThreadKey);
+	thread = (ThreadMemory*) pthread_getspecific(threadKey);
+	if ( thread == NULL && create)
+	{
+		thread = (ThreadMemory*) calloc(1, sizeof(ThreadMemory));
+		if ( thread == NULL || pthread_setspecific(threadKey, thread) != 0)
+		{
+			free(thread);
+			return NULL;
+		}
+		thread->stage = AR_MEMORY_OTHER;
+	}
+	return thread;
+}
+
+/**
+ * Method:    allocateHeader
+ * FullName:  allocateHeader
+ * Access:    private
+ * @brief     Allocates memory with room for a header in front, from the calling thread's allocator if it
+ *			  has one, and says in the header where it came from
+ * @param 	  size - bytes asked for, not counting the header
+ * @param 	  zero - 1 to zero the memory
+ * @return    the allocation, or NULL if it failed
+ **/
+static MemoryHeader* allocateHeader( size_t size, int zero)
+{
+	ThreadMemory *thread = threadMemory(0);
+	MemoryHeader *header;
+
+	if ( size > (size_t) -1 - sizeof(MemoryHeader))
+	{
+		return NULL;
+	}
+	if ( thread == NULL || thread->allocator.alloc == NULL)
+	{
+		header = (MemoryHeader*) (zero ? calloc(1, sizeof(MemoryHeader) + size) : malloc(sizeof(MemoryHeader) + size));
+		if ( header != NULL)
+		{
+			header->info.foreign = 0;
+		}
+		return header;
+	}
+	header = (MemoryHeader*) thread->allocator.alloc(thread->allocator.opaque, sizeof(MemoryHeader) + size);
+	if ( header != NULL)
+	{
+		if ( zero)
+		{
+			memset(header + 1, 0, size);
+		}
+		header->info.foreign = 1;
+		header->info.release = thread->allocator.free;
+		header->info.opaque = thread->allocator.opaque;
+	}
+	return header;
+}
+
+/**
+ * Method:    addMemory
+ * FullName:  addMemory
+ * Access:    private
+ * @brief     Adds to the bytes in use by a stage and by everything, raising their high-water marks
+ * @param 	  stage - AR_STAGE_* or AR_MEMORY_OTHER
+ * @param 	  size - bytes allocated, negative for bytes freed
+ * @param 	  count - allocations to count, 0 or 1
+ **/
+static void addMemory( int stage, long long size, long long count)
+{
+	int slots[2], i;
+	long long inUse, peak;
+
+	slots[0] = stage;
+	slots[1] = AR_MEMORY_TOTAL;
+	for ( i = 0; i < 2; i++)
+	{
+		if ( count > 0)
+		{
+			__atomic_add_fetch(&totals[slots[i]].allocations, count, __ATOMIC_RELAXED);
+			__atomic_add_fetch(&totals[slots[i]].bytes, size, __ATOMIC_RELAXED);
+		}
+		inUse = __atomic_add_fetch(&totals[slots[i]].inUse, size, __ATOMIC_RELAXED);
+		peak = __atomic_load_n(&totals[slots[i]].peak, __ATOMIC_RELAXED);
+		while ( inUse > peak &&
+				!__atomic_compare_exchange_n(&totals[slots[i]].peak, &peak, inUse, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		{
+		}
+	}
+}
+
+/**
+ * Method:    track
+ * FullName:  track
+ * Access:    private
+ * @brief     Fills in the header of a new allocation and counts it against the calling thread's stage
+ * @param 	  header - the allocation, or NULL if it failed
+ * @param 	  size - bytes asked for, not counting the header
+ * @return    the memory after the header, or NULL
+ **/
+static void* track( MemoryHeader *header, size_t size)
+{
+	ThreadMemory *thread;
+
+	if ( header == NULL)
+	{
+		return NULL;
+	}
+	thread = threadMemory(0);
+	header->info.size = size;
+	header->info.stage = thread != NULL ? thread->stage : AR_MEMORY_OTHER;
+	if ( thread != NULL)
+	{
+		thread->allocations++;
+		thread->bytes += (long long) size;
+	}
+	addMemory(header->info.stage, (long long) size, 1);
+	return header + 1;
+}
+
+/**
+ * Method:    arMalloc
+ * FullName:  arMalloc
+ * Access:    public
+ * @param 	  size - bytes to allocate
+ * @return    the memory, or NULL if it could not be allocated
+ **/
+void* arMalloc( size_t size)
+{
+	return track(allocateHeader(size, 0), size);
+}
+
+/**
+ * Method:    arCalloc
+ * FullName:  arCalloc
+ * Access:    public
+ * @param 	  count - number of elements
+ * @param 	  size - bytes per element
+ * @return    the memory, zeroed, or NULL if it could not be allocated
+ **/
+void* arCalloc( size_t count, size_t size)
+{
+	if ( size != 0 && count > ((size_t) -1 - sizeof(MemoryHeader)) / size)
+	{
+		return NULL;
+	}
+	return track(allocateHeader(count * size, 1), count * size);
+}
+
+/**
+ * Method:    arRealloc
+ * FullName:  arRealloc
+ * Access:    public
+ * @brief     Resizes memory from arMalloc, arCalloc or arRealloc. The memory moves to the calling thread's
+ *			  stage, as the old size is taken off the stage it was allocated in. Memory from a caller's allocator
+ *			  is copied to a new allocation, since ar_allocator has no realloc
+ * @param 	  pointer - memory to resize, or NULL to allocate
+ * @param 	  size - new size in bytes
+ * @return    the memory, or NULL with pointer untouched if it could not be resized
+ **/
+void* arRealloc( void *pointer, size_t size)
+{
+	MemoryHeader *header, *resized;
+	void *copy;
+
+	if ( pointer == NULL)
+	{
+		return arMalloc(size);
+	}
+	header = (MemoryHeader*) pointer - 1;
+	if ( header->info.foreign)
+	{
+		copy = arMalloc(size);
+		if ( copy != NULL)
+		{
+			memcpy(copy, pointer, size < header->info.size ? size : header->info.size);
+			arFree(pointer);
+		}
+		return copy;
+	}
+	resized = (MemoryHeader*) realloc(header, sizeof(MemoryHeader) + size);
+	if ( resized == NULL)
+	{
+		return NULL;
+	}
+	addMemory(resized->info.stage, -(long long) resized->info.size, 0);
+	return track(resized, size);
+}
+
+/**
+ * Method:    arFree
+ * FullName:  arFree
+ * Access:    public
+ * @param 	  pointer - memory from arMalloc, arCalloc or arRealloc, or NULL
+ **/
+void arFree( void *pointer)
+{
+	MemoryHeader *header;
+
+	if ( pointer == NULL)
+	{
+		return;
+	}
+	header = (MemoryHeader*) pointer - 1;
+	addMemory(header->info.stage, -(long long) header->info.size, 0);
+	if ( !header->info.foreign)
+	{
+		free(header);
+	}
+	else if ( header->info.release != NULL)
+	{
+		header->info.release(header->info.opaque, header);
+	}
+}
+
+/**
+ * Method:    setMemoryStage
+ * FullName:  setMemoryStage
+ * Access:    public
+ * @brief     Sets the stage the calling thread's allocations are counted against
+ * @param 	  stage - AR_STAGE_*, or AR_MEMORY_OTHER between stages
+ **/
+void setMemoryStage( int stage)
+{
+	ThreadMemory *thread = threadMemory(1);
+
+	if ( thread != NULL)
+	{
+		thread->stage = stage;
+	}
+}
+
+/**
+ * Method:    setThreadAllocator
+ * FullName:  setThreadAllocator
+ * Access:    public
+ * @brief     Sets where the calling thread's allocations come from. Memory always goes back to the allocator
+ *			  it came from, whichever thread frees it and whatever is set by then
+ * @param 	  allocator - allocator to use, or NULL or one with alloc NULL for malloc. It is copied
+ * @param 	  previous - set to the allocator being replaced, so it can be put back, may be NULL
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the thread's record could not be allocated
+ **/
+int setThreadAllocator( const ar_allocator *allocator, ar_allocator *previous)
+{
+	ThreadMemory *thread = threadMemory(allocator != NULL && allocator->alloc != NULL);
+
+	if ( previous != NULL)
+	{
+		if ( thread != NULL)
+		{
+			*previous = thread->allocator;
+		}
+		else
+		{
+			memset(previous, 0, sizeof(*previous));
+		}
+	}
+	if ( thread == NULL)
+	{
+		return allocator != NULL && allocator->alloc != NULL ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+	if ( allocator != NULL)
+	{
+		thread->allocator = *allocator;
+	}
+	else
+	{
+		memset(&thread->allocator, 0, sizeof(thread->allocator));
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    threadAllocations
+ * FullName:  threadAllocations
+ * Access:    public
+ * @param 	  allocations - set to the allocations made by the calling thread in timed stages
+ * @param 	  bytes - set to the bytes they asked for
+ **/
+void threadAllocations( long long *allocations, long long *bytes)
+{
+	ThreadMemory *thread;
+
+	thread = threadMemory(0);
+	*allocations = thread != NULL ? thread->allocations : 0;
+	*bytes = thread != NULL ? thread->bytes : 0;
+}
+
+/**
+ * Method:    getMemoryStats
+ * FullName:  getMemoryStats
+ * Access:    public
+ * @param 	  stats - set to the totals of each stage, then AR_MEMORY_OTHER and AR_MEMORY_TOTAL
+ **/
+void getMemoryStats( MemoryStats stats[AR_MEMORY_SLOTS])
+{
+	int i;
+
+	for ( i = 0; i < AR_MEMORY_SLOTS; i++)
+	{
+		stats[i].allocations = __atomic_load_n(&totals[i].allocations, __ATOMIC_RELAXED);
+		stats[i].bytes = __atomic_load_n(&totals[i].bytes, __ATOMIC_RELAXED);
+		stats[i].inUse = __atomic_load_n(&totals[i].inUse, __ATOMIC_RELAXED);
+		stats[i].peak = __atomic_load_n(&totals[i].peak, __ATOMIC_RELAXED);
+	}
+}
@@ -0,0 +1,38 @@
+/*
+ * File:   Memory.h
+ * Author: adrian
+ *
+ * Counted allocation for the codec. Every block of memory carries a small header
+ * with its size and the stage that allocated it, so frees can be taken off the
+ * right totals. Memory allocated outside any timed stage, or with stats off, is
+ * counted as AR_MEMORY_OTHER. A thread can be given a caller's ar_allocator to
+ * take its memory from instead of malloc, which must return memory aligned
+ * for any type, as malloc does.
+ */
+
+#ifndef MEMORY_H
+#define	MEMORY_H
+#include <stddef.h>
+#include "Stats.h"
+
+#define AR_MEMORY_OTHER AR_NUM_STAGES  /* Allocated outside a timed stage */
+#define AR_MEMORY_TOTAL (AR_NUM_STAGES + 1)  /* Everything */
+#define AR_MEMORY_SLOTS (AR_NUM_STAGES + 2)
+
+typedef struct MemoryStats
+{
+	long long allocations;  /* Calls to arMalloc, arCalloc and arRealloc */
+	long long bytes;  /* Bytes they asked for */
+	long long inUse;  /* Bytes allocated and not yet freed */
+	long long peak;  /* Most bytes ever in use at once */
+} MemoryStats;
+
+void* arMalloc( size_t size);
+void* arCalloc( size_t count, size_t size);
+void* arRealloc( void *pointer, size_t size);
+void arFree( void *pointer);
+void setMemoryStage( int stage);
+int setThreadAllocator( const ar_allocator *allocator, ar_allocator *previous);
+void threadAllocations( long long *allocations, long long *bytes);
+void getMemoryStats( MemoryStats stats[AR_MEMORY_SLOTS]);
+#endif	/* MEMORY_H */
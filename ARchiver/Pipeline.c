@@ -0,0 +1,336 @@
+/**
+ * @file   Pipeline.c
+ * @author Adrian Rasmussen
+ *
+ * @brief Runs compression or decompression as a three stage pipeline. A reader thread fills
+ *		  block buffers, one or more coder threads convert them and the calling thread writes them
+ *		  out in their original order. All stages share a fixed ring of slots, so disk I/O overlaps
+ *		  with coding while memory use stays bounded by the number of slots.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "Pipeline.h"
+#include "Stats.h"
+#include "Memory.h"
+#include "Report.h"
+
+static void* readerThread( void* arg);
+static void* coderThread( void* arg);
+static int writeBlocks( Pipeline *pipeline);
+static void failPipeline( Pipeline *pipeline);
+
+static int threadCount;  /* Set by -T, 0 for one per CPU */
+
+/**
+ * Method:    setDefaultThreads
+ * FullName:  setDefaultThreads
+ * Access:    public
+ * @brief     Sets the number of coder threads, for -T. Blocks are coded on their own and written in order,
+ *			  so the count never changes the output, only how fast it is made
+ * @param 	  threads - 1 to AR_MAX_THREADS, or 0 for one per CPU
+ **/
+void setDefaultThreads( int threads)
+{
+	threadCount = threads;
+}
+
+/**
+ * Method:    defaultThreads
+ * FullName:  defaultThreads
+ * Access:    public
+ * @brief     Number of coder threads to use when none is given, the count set by -T or else one per online CPU
+ * @return    number of threads, at least 1
+ **/
+int defaultThreads( void)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if ( threadCount > 0)
+	{
+		return threadCount;
+	}
+	return cpus > 0 ? (int) cpus : 1;
+}
+
+/**
+ * Method:    runPipeline
+ * FullName:  runPipeline
+ * Access:    public
+ * @brief     Allocates the ring of block buffers, starts the reader and coder threads and writes
+ *			  coded blocks on the calling thread until the reader reaches the end of its input.
+ *			  Two slots per coder, plus one each for the reader and writer, keep every stage busy
+ * @param 	  pipeline - stages, streams and buffer sizes to use. numBlocks and bytesRead are set on return
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if memory could not be allocated or any stage failed
+ **/
+int runPipeline( Pipeline *pipeline)
+{
+	int i, started, status;
+	pthread_t reader, *coders;
+
+	pipeline->numBlocks = 0;
+	pipeline->bytesRead = 0;
+	pipeline->readSeq = 0;
+	pipeline->codeSeq = 0;
+	pipeline->writeSeq = 0;
+	pipeline->eof = 0;
+	pipeline->errState = 0;
+	if ( pipeline->numThreads < 1)
+	{
+		pipeline->numThreads = 1;
+	}
+	pipeline->numSlots = 2 * pipeline->numThreads + 2;
+
+	pipeline->slots = (Block*) arCalloc( pipeline->numSlots, sizeof(Block));
+	coders = (pthread_t*) arMalloc( pipeline->numThreads * sizeof(pthread_t));
+	if ( pipeline->slots == NULL || coders == NULL)
+	{
+		reportError("Could not allocate memory for pipeline\n");
+		arFree(pipeline->slots);
+		pipeline->slots = NULL;
+		arFree(coders);
+		return EXIT_FAILURE;
+	}
+
+	status = EXIT_SUCCESS;
+	for ( i = 0; i < pipeline->numSlots; i++)
+	{
+		pipeline->slots[i].input = (unsigned char*) arMalloc( pipeline->inputCapacity);
+		pipeline->slots[i].inputCapacity = pipeline->inputCapacity;
+		pipeline->slots[i].output = pipeline->outputCapacity > 0 ? (unsigned char*) arMalloc( pipeline->outputCapacity) : NULL;
+		pipeline->slots[i].outputCapacity = pipeline->outputCapacity;
+		pipeline->slots[i].side = pipeline->sideCapacity > 0 ? (unsigned char*) arMalloc( pipeline->sideCapacity) : NULL;
+		pipeline->slots[i].sideCapacity = pipeline->sideCapacity;
+		pipeline->slots[i].state = BLOCK_EMPTY;
+		if ( pipeline->slots[i].input == NULL || (pipeline->outputCapacity > 0 && pipeline->slots[i].output == NULL) ||
+			 (pipeline->sideCapacity > 0 && pipeline->slots[i].side == NULL))
+		{
+			reportError("Could not allocate memory for block buffer %d\n", i);
+			status = EXIT_FAILURE;
+		}
+	}
+
+	if ( status == EXIT_SUCCESS)
+	{
+		pthread_mutex_init( &pipeline->mutex, NULL);
+		pthread_cond_init( &pipeline->cond, NULL);
+
+		started = 0;
+		if ( pthread_create( &reader, NULL, &readerThread, pipeline) != 0)
+		{
+			reportError("Could not create reader thread\n");
+			status = EXIT_FAILURE;
+		}
+		else
+		{
+			while ( started < pipeline->numThreads &&
+					pthread_create( &coders[started], NULL, &coderThread, pipeline) == 0)
+			{
+				started++;
+			}
+			if ( started == 0)
+			{
+				reportError("Could not create coder threads\n");
+				failPipeline(pipeline);
+			}
+
+			status = writeBlocks(pipeline);
+
+			pthread_join( reader, NULL);
+			for ( i = 0; i < started; i++)
+			{
+				pthread_join( coders[i], NULL);
+			}
+		}
+
+		pthread_cond_destroy( &pipeline->cond);
+		pthread_mutex_destroy( &pipeline->mutex);
+	}
+
+	pipeline->numBlocks = pipeline->writeSeq;
+	for ( i = 0; i < pipeline->numSlots; i++)
+	{
+		arFree(pipeline->slots[i].input);
+		if ( pipeline->outputCapacity > 0)
+		{
+			arFree(pipeline->slots[i].output);
+		}
+		arFree(pipeline->slots[i].side);
+	}
+	arFree(pipeline->slots);
+	pipeline->slots = NULL;
+	arFree(coders);
+
+	return status;
+}
+
+/**
+ * Method:    failPipeline
+ * FullName:  failPipeline
+ * Access:    private
+ * @brief     Flags an error so that every stage stops at its next wait. Must be called without the mutex held
+ * @param 	  pipeline - the pipeline to stop
+ **/
+static void failPipeline( Pipeline *pipeline)
+{
+	pthread_mutex_lock( &pipeline->mutex);
+	pipeline->errState = 1;
+	pthread_cond_broadcast( &pipeline->cond);
+	pthread_mutex_unlock( &pipeline->mutex);
+}
+
+/**
+ * Method:    readerThread
+ * FullName:  readerThread
+ * Access:    private
+ * @brief     Reader stage. Waits for the next slot in the ring to be freed by the writer, then
+ *			  fills it outside the lock so coders and the writer can keep working
+ * @param 	  arg - the pipeline
+ * @return    NULL
+ **/
+static void* readerThread( void* arg)
+{
+	Pipeline *pipeline = (Pipeline*) arg;
+	Block *block;
+	StageTimer timer;
+
+	for (;;)
+	{
+		pthread_mutex_lock( &pipeline->mutex);
+		block = &pipeline->slots[pipeline->readSeq % pipeline->numSlots];
+		while ( block->state != BLOCK_EMPTY && pipeline->errState == 0)
+		{
+			pthread_cond_wait( &pipeline->cond, &pipeline->mutex);
+		}
+		if ( pipeline->errState != 0)
+		{
+			pthread_mutex_unlock( &pipeline->mutex);
+			return NULL;
+		}
+		block->seq = pipeline->readSeq;
+		pthread_mutex_unlock( &pipeline->mutex);
+
+		block->inputSize = 0;
+		block->sideSize = 0;
+		startStage(&timer, AR_STAGE_READ);
+		if ( pipeline->reader(pipeline, block) != EXIT_SUCCESS)
+		{
+			failPipeline(pipeline);
+			return NULL;
+		}
+		endStage(&timer, block->inputSize + block->sideSize);
+
+		pthread_mutex_lock( &pipeline->mutex);
+		if ( block->inputSize == 0 && block->sideSize == 0) /*End of stream*/
+		{
+			pipeline->eof = 1;
+			pthread_cond_broadcast( &pipeline->cond);
+			pthread_mutex_unlock( &pipeline->mutex);
+			return NULL;
+		}
+		block->state = BLOCK_READ;
+		pipeline->bytesRead += block->inputSize;
+		pipeline->readSeq++;
+		pthread_cond_broadcast( &pipeline->cond);
+		pthread_mutex_unlock( &pipeline->mutex);
+	}
+}
+
+/**
+ * Method:    coderThread
+ * FullName:  coderThread
+ * Access:    private
+ * @brief     Coder stage. Takes the oldest block that has been read but not yet claimed, and codes it.
+ *			  Several coders may run at once; the writer restores the order
+ * @param 	  arg - the pipeline
+ * @return    NULL
+ **/
+static void* coderThread( void* arg)
+{
+	Pipeline *pipeline = (Pipeline*) arg;
+	Block *block;
+	int status;
+
+	for (;;)
+	{
+		pthread_mutex_lock( &pipeline->mutex);
+		while ( pipeline->codeSeq == pipeline->readSeq && pipeline->eof == 0 && pipeline->errState == 0)
+		{
+			pthread_cond_wait( &pipeline->cond, &pipeline->mutex);
+		}
+		if ( pipeline->errState != 0 || pipeline->codeSeq == pipeline->readSeq)
+		{
+			pthread_mutex_unlock( &pipeline->mutex);
+			return NULL;
+		}
+		block = &pipeline->slots[pipeline->codeSeq % pipeline->numSlots];
+		block->state = BLOCK_CODING;
+		pipeline->codeSeq++;
+		pthread_mutex_unlock( &pipeline->mutex);
+
+		block->outputSize = 0;
+		status = pipeline->coder(pipeline, block);
+
+		pthread_mutex_lock( &pipeline->mutex);
+		if ( status != EXIT_SUCCESS)
+		{
+			pipeline->errState = 1;
+		}
+		block->state = BLOCK_CODED;
+		pthread_cond_broadcast( &pipeline->cond);
+		pthread_mutex_unlock( &pipeline->mutex);
+	}
+}
+
+/**
+ * Method:    writeBlocks
+ * FullName:  writeBlocks
+ * Access:    private
+ * @brief     Writer stage, run on the calling thread. Writes coded blocks strictly in stream order and
+ *			  returns each slot to the reader once written
+ * @param 	  pipeline - the pipeline
+ * @return    EXIT_SUCCESS if every block was written, otherwise EXIT_FAILURE
+ **/
+static int writeBlocks( Pipeline *pipeline)
+{
+	Block *block;
+	StageTimer timer;
+
+	for (;;)
+	{
+		pthread_mutex_lock( &pipeline->mutex);
+		block = &pipeline->slots[pipeline->writeSeq % pipeline->numSlots];
+		while ( pipeline->errState == 0 &&
+				!(block->state == BLOCK_CODED && block->seq == pipeline->writeSeq) &&
+				!(pipeline->eof && pipeline->writeSeq == pipeline->readSeq))
+		{
+			pthread_cond_wait( &pipeline->cond, &pipeline->mutex);
+		}
+		if ( pipeline->errState != 0)
+		{
+			pthread_mutex_unlock( &pipeline->mutex);
+			return EXIT_FAILURE;
+		}
+		if ( block->state != BLOCK_CODED) /*Reader finished and everything is written*/
+		{
+			pthread_mutex_unlock( &pipeline->mutex);
+			return EXIT_SUCCESS;
+		}
+		pthread_mutex_unlock( &pipeline->mutex);
+
+		startStage(&timer, AR_STAGE_WRITE);
+		if ( pipeline->writer(pipeline, block) != EXIT_SUCCESS)
+		{
+			failPipeline(pipeline);
+			return EXIT_FAILURE;
+		}
+		endStage(&timer, block->outputSize + block->sideSize);
+
+		pthread_mutex_lock( &pipeline->mutex);
+		block->state = BLOCK_EMPTY;
+		pipeline->writeSeq++;
+		pthread_cond_broadcast( &pipeline->cond);
+		pthread_mutex_unlock( &pipeline->mutex);
+	}
+}
@@ -0,0 +1,76 @@
+/*
+ * File:   Pipeline.h
+ * Author: adrian
+ *
+ * Three stage reader -> coder(s) -> writer pipeline, connected by a bounded
+ * ring of reusable block buffers
+ */
+
+#ifndef PIPELINE_H
+#define	PIPELINE_H
+#include <stdio.h>
+#include <pthread.h>
+#include "ARHeader.h"
+
+#define AR_MAX_THREADS 256  /* Most coder threads -T can ask for */
+
+typedef enum BlockState
+{
+	BLOCK_EMPTY,   /* Slot free, may be filled by the reader */
+	BLOCK_READ,    /* Filled by the reader, waiting for a coder */
+	BLOCK_CODING,  /* Owned by a coder thread */
+	BLOCK_CODED    /* Coded, waiting for the writer */
+} BlockState;
+
+typedef struct Block
+{
+	unsigned char *input;  /* Data read by the reader stage */
+	int inputSize;
+	int inputCapacity;
+	unsigned char *output; /* Data produced by the coder stage, in the slot's buffer or where the reader points it */
+	int outputSize;
+	int outputCapacity;
+	unsigned char *side;   /* Extra data the reader passes to the writer with the block, such as a chunk list */
+	int sideSize;
+	int sideCapacity;
+	ARBlockHeader header;  /* Block header, written by compression or read by decompression */
+	long seq;              /* Position of the block in the stream */
+	int tag;               /* Set by the reader for the writer, such as the file the block came from */
+	BlockState state;
+} Block;
+
+struct Pipeline;
+typedef int (*StageFunc)( struct Pipeline *pipeline, Block *block);
+typedef int (*CodeFunc)( struct Pipeline *pipeline, Block *block);
+
+typedef struct Pipeline
+{
+	FILE *input;
+	FILE *output;
+	void *context;        /* Passed through to every stage */
+	StageFunc reader;     /* Fills block->input, leaving inputSize and sideSize 0 at end of stream */
+	CodeFunc coder;       /* Converts block->input to block->output, may run on many threads */
+	StageFunc writer;     /* Writes block->output, called in stream order */
+	int numThreads;       /* Number of coder threads */
+	int inputCapacity;
+	int outputCapacity;   /* Size of each block's output buffer, 0 if the reader points block->output at memory of its own */
+	int sideCapacity;     /* Size of each block's side buffer, 0 if the stages don't use one */
+	long numBlocks;       /* Number of blocks that passed through the pipeline */
+	long bytesRead;       /* Sum of all block input sizes */
+
+	/*Private state, managed by runPipeline*/
+	Block *slots;
+	int numSlots;
+	long readSeq;
+	long codeSeq;
+	long writeSeq;
+	int eof;
+	int errState;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+} Pipeline;
+
+void setDefaultThreads( int threads);
+int defaultThreads( void);
+int runPipeline( Pipeline *pipeline);
+#endif	/* PIPELINE_H */
@@ -0,0 +1,62 @@
+/**
+ * @file   Report.c
+ * @author Adrian Rasmussen
+ *
+ * @brief Writes the codec's error messages. Every module says why it rejected a file or failed through
+ *		  {@link reportError} or {@link reportSystemError} rather than printf or perror, since stdout is the
+ *		  data stream with -s - and -d -, and a program using the library gets no output at all.
+ */
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include "Report.h"
+
+static FILE *errorOutput;
+
+/**
+ * Method:    setErrorOutput
+ * FullName:  setErrorOutput
+ * Access:    public
+ * @brief     Sets where error messages go. Process wide, so should be set before anything is coded
+ * @param 	  output - stream to write them to, or NULL to drop them, as the library starts out
+ **/
+void setErrorOutput( FILE *output)
+{
+	errorOutput = output;
+}
+
+/**
+ * Method:    reportError
+ * FullName:  reportError
+ * Access:    public
+ * @brief     Writes an error message, if there is somewhere to write it
+ * @param 	  format - printf format of the message, ending in a newline
+ **/
+void reportError( const char *format, ...)
+{
+	va_list arguments;
+
+	if ( errorOutput == NULL)
+	{
+		return;
+	}
+	va_start(arguments, format);
+	vfprintf(errorOutput, format, arguments);
+	va_end(arguments);
+}
+
+/**
+ * Method:    reportSystemError
+ * FullName:  reportSystemError
+ * Access:    public
+ * @brief     Writes what failed and the description of errno, like perror, if there is somewhere to write it
+ * @param 	  what - what failed, usually a file name
+ **/
+void reportSystemError( const char *what)
+{
+	if ( errorOutput != NULL)
+	{
+		fprintf(errorOutput, "%s: %s\n", what, strerror(errno));
+	}
+}
@@ -0,0 +1,18 @@
+/*
+ * File:   Report.h
+ * Author: adrian
+ *
+ * Error messages of the codec. Nothing is written until the command line tool
+ * calls setErrorOutput(stderr), so the library only reports errors through its
+ * return codes, and a stream written to stdout by -s - or -d - never has a
+ * message mixed into its data.
+ */
+
+#ifndef REPORT_H
+#define	REPORT_H
+#include <stdio.h>
+
+void setErrorOutput( FILE *output);
+void reportError( const char *format, ...);
+void reportSystemError( const char *what);
+#endif	/* REPORT_H */
@@ -0,0 +1,694 @@
+/**
+ * @file   Server.c
+ * @author Adrian Rasmussen
+ *
+ * @brief A compression server for many small files, where starting the program, its threads and its tables
+ *		  costs more than the coding. A fixed pool of worker threads is started once and each waits in accept()
+ *		  on the same socket, so a request is picked up by whichever worker is free with no queue in between.
+ *		  The client sends its open input and output files with the request, and the worker reads and writes
+ *		  them directly. Each worker keeps its buffers between requests, so a warm server allocates nothing
+ *		  for a small file no larger than one it has seen before. A buffer grown past AR_SERVE_KEEP_BUFFER
+ *		  is freed once its request is done, and no request may hold more than AR_SERVE_MAX_REQUEST.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "Server.h"
+#include "ARchiver.h"
+#include "Format.h"
+#include "libarchiver.h"
+#include "Memory.h"
+#include "Tiny.h"
+#include "Report.h"
+
+/* Buffers a worker keeps from one request to the next */
+typedef struct Worker
+{
+	int listener;  /* Socket every worker accepts on */
+	unsigned char *input;
+	size_t inputCapacity;
+	unsigned char *output;
+	size_t outputCapacity;
+} Worker;
+
+/* Room for the two passed descriptors, aligned as the kernel expects */
+typedef union Control
+{
+	struct cmsghdr header;
+	char data[CMSG_SPACE(2 * sizeof(int))];
+} Control;
+
+static void* workerThread( void *arg);
+static void serveRequest( Worker *worker, int connection);
+static int codeRequest( Worker *worker, int operation, int level, int inputFd, int outputFd, long long *written);
+static int streamDecompress( Worker *worker, size_t inputSize, int inputFd, int outputFd, long long *written);
+static int readInput( Worker *worker, int fd, size_t limit, size_t *size);
+static int reserve( unsigned char **buffer, size_t *capacity, size_t size);
+static void trimBuffers( Worker *worker);
+static int openSocket( const char *path, struct sockaddr_un *address);
+
+/**
+ * Method:    openSocket
+ * FullName:  openSocket
+ * Access:    private
+ * @brief     Creates a Unix domain stream socket and fills in the address for path
+ * @param 	  path - file name of the socket
+ * @param 	  address - set to the socket's address
+ * @return    the socket, or -1 if the path is too long or the socket could not be created
+ **/
+static int openSocket( const char *path, struct sockaddr_un *address)
+{
+	int fd;
+
+	memset(address, 0, sizeof(*address));
+	address->sun_family = AF_UNIX;
+	if ( strlen(path) >= sizeof(address->sun_path))
+	{
+		reportError("Socket path %s is too long\n", path);
+		return -1;
+	}
+	strcpy(address->sun_path, path);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if ( fd < 0)
+	{
+		perror("Could not create socket");
+	}
+	return fd;
+}
+
+/**
+ * Method:    runServer
+ * FullName:  runServer
+ * Access:    public
+ * @brief     Listens on a Unix domain socket and serves compress and decompress requests until killed.
+ *			  One worker is started per CPU, and at least AR_SERVE_MIN_WORKERS. A socket file left behind
+ *			  by an earlier server is replaced, unless a server is still answering on it
+ * @param 	  path - file name of the socket
+ * @return    EXIT_FAILURE if the server could not start, otherwise it does not return
+ **/
+int runServer( const char *path)
+{
+	struct sockaddr_un address;
+	struct stat info;
+	unsigned char warm[64];
+	size_t size;
+	pthread_t *threads;
+	Worker *workers;
+	int listener, probe, numWorkers, started, i;
+
+	listener = openSocket(path, &address);
+	if ( listener < 0)
+	{
+		return EXIT_FAILURE;
+	}
+	if ( lstat(path, &info) == 0 && S_ISSOCK(info.st_mode))
+	{
+		probe = socket(AF_UNIX, SOCK_STREAM, 0);
+		if ( probe >= 0 && connect(probe, (struct sockaddr*) &address, sizeof(address)) == 0)
+		{
+			reportError("A server is already running on %s\n", path);
+			close(probe);
+			close(listener);
+			return EXIT_FAILURE;
+		}
+		if ( probe >= 0)
+		{
+			close(probe);
+		}
+		unlink(path);
+	}
+	if ( bind(listener, (struct sockaddr*) &address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0)
+	{
+		perror(path);
+		close(listener);
+		return EXIT_FAILURE;
+	}
+	/*A client that goes away mid reply must not take the server with it*/
+	signal(SIGPIPE, SIG_IGN);
+
+	/*CPU detection, checksum tables, kernel choice and the compact frame table are made once here rather than by
+	  the first request*/
+	memcpy(warm, "{\"warm\":true}", 13);
+	ar_compress(warm, 13, warm + 16, sizeof(warm) - 16, &size, AR_DEFAULT_LEVEL, NULL);
+
+	numWorkers = defaultThreads();
+	if ( numWorkers < AR_SERVE_MIN_WORKERS)
+	{
+		numWorkers = AR_SERVE_MIN_WORKERS;
+	}
+	workers = (Worker*) arCalloc(numWorkers, sizeof(Worker));
+	threads = (pthread_t*) arMalloc(numWorkers * sizeof(pthread_t));
+	if ( workers == NULL || threads == NULL)
+	{
+		reportError("Could not allocate memory for workers\n");
+		arFree(workers);
+		arFree(threads);
+		close(listener);
+		unlink(path);
+		return EXIT_FAILURE;
+	}
+	/*Threads that fail to start leave no gap, so only the first started entries are real threads*/
+	started = 0;
+	for ( i = 0; i < numWorkers; i++)
+	{
+		workers[started].listener = listener;
+		if ( pthread_create(&threads[started], NULL, &workerThread, &workers[started]) == 0)
+		{
+			started++;
+		}
+	}
+	if ( started == 0)
+	{
+		reportError("Could not start worker threads\n");
+		arFree(workers);
+		arFree(threads);
+		close(listener);
+		unlink(path);
+		return EXIT_FAILURE;
+	}
+	printf("Serving on %s with %d workers\n", path, started);
+	fflush(stdout);
+
+	/*Workers never finish, so this waits until the process is killed*/
+	for ( i = 0; i < started; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+	return EXIT_FAILURE;
+}
+
+/**
+ * Method:    workerThread
+ * FullName:  workerThread
+ * Access:    private
+ * @brief     Takes connections off the shared socket and serves one request on each
+ * @param 	  arg - the Worker
+ * @return    never returns
+ **/
+static void* workerThread( void *arg)
+{
+	Worker *worker = (Worker*) arg;
+	int connection;
+
+	for ( ;;)
+	{
+		connection = accept(worker->listener, NULL, NULL);
+		if ( connection < 0)
+		{
+			if ( errno != EINTR && errno != ECONNABORTED)
+			{
+				perror("Could not accept connection");
+			}
+			continue;
+		}
+		serveRequest(worker, connection);
+		close(connection);
+	}
+	return NULL;
+}
+
+/**
+ * Method:    serveRequest
+ * FullName:  serveRequest
+ * Access:    private
+ * @brief     Reads a request and the two files sent with it, codes the input file into the output file
+ *			  and replies with the result
+ * @param 	  worker - worker serving the request
+ * @param 	  connection - connected client
+ **/
+static void serveRequest( Worker *worker, int connection)
+{
+	unsigned char request[AR_SERVE_REQUEST_SIZE], reply[AR_SERVE_REPLY_SIZE];
+	Control control;
+	struct msghdr message;
+	struct cmsghdr *header;
+	struct iovec vector;
+	ssize_t received;
+	long long written;
+	int fds[2], numFds, status, error, i;
+
+	memset(&message, 0, sizeof(message));
+	vector.iov_base = request;
+	vector.iov_len = sizeof(request);
+	message.msg_iov = &vector;
+	message.msg_iovlen = 1;
+	message.msg_control = control.data;
+	message.msg_controllen = sizeof(control.data);
+	do
+	{
+		received = recvmsg(connection, &message, MSG_WAITALL);
+	} while ( received < 0 && errno == EINTR);
+
+	numFds = 0;
+	for ( header = CMSG_FIRSTHDR(&message); header != NULL; header = CMSG_NXTHDR(&message, header))
+	{
+		if ( header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS)
+		{
+			numFds = (int) ((header->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+			numFds = numFds > 2 ? 2 : numFds;
+			memcpy(fds, CMSG_DATA(header), numFds * sizeof(int));
+		}
+	}
+
+	written = 0;
+	error = 0;
+	if ( received != AR_SERVE_REQUEST_SIZE || numFds != 2 || (message.msg_flags & MSG_CTRUNC) ||
+		 getLE32(request) != AR_SERVE_MAGIC ||
+		 (request[4] != AR_SERVE_COMPRESS && request[4] != AR_SERVE_DECOMPRESS))
+	{
+		status = AR_ERROR_PARAMETER;
+	}
+	else
+	{
+		status = codeRequest(worker, request[4], request[5], fds[0], fds[1], &written);
+		error = errno;
+		trimBuffers(worker);
+	}
+	for ( i = 0; i < numFds; i++)
+	{
+		close(fds[i]);
+	}
+
+	putLE32(reply, (unsigned int) status);
+	putLE32(reply + 4, status == AR_SERVE_ERROR_IO ? (unsigned int) error : 0);
+	putLE64(reply + 8, (unsigned long long) written);
+	writeAll(connection, reply, sizeof(reply));
+}
+
+/**
+ * Method:    codeRequest
+ * FullName:  codeRequest
+ * Access:    private
+ * @brief     Codes the input file into the output file. A file is compressed in memory, and so is a deduplicated
+ *			  archive, whose repeated chunks are copied from earlier output. Any other archive is decompressed as a
+ *			  stream by {@link streamDecompress}, so its header's size is never trusted for an allocation
+ * @param 	  worker - worker serving the request
+ * @param 	  operation - AR_SERVE_COMPRESS or AR_SERVE_DECOMPRESS
+ * @param 	  level - compression level
+ * @param 	  inputFd - file to read
+ * @param 	  outputFd - file to write
+ * @param 	  written - set to the number of bytes written
+ * @return    AR_OK, AR_ERROR_*, AR_SERVE_ERROR_TOO_LARGE or AR_SERVE_ERROR_IO with errno set
+ **/
+static int codeRequest( Worker *worker, int operation, int level, int inputFd, int outputFd, long long *written)
+{
+	ARHeader header;
+	size_t inputSize, outputSize, capacity;
+	int status;
+
+	*written = 0;
+	inputSize = 0;
+	if ( operation == AR_SERVE_COMPRESS)
+	{
+		status = readInput(worker, inputFd, AR_SERVE_MAX_REQUEST + 1, &inputSize);
+		if ( status != AR_OK)
+		{
+			return status;
+		}
+		capacity = ar_compress_bound(inputSize);
+		if ( reserve(&worker->output, &worker->outputCapacity, capacity) != AR_OK)
+		{
+			return AR_ERROR_MEMORY;
+		}
+		status = ar_compress(worker->input, inputSize, worker->output, capacity, &outputSize, level, NULL);
+	}
+	else
+	{
+		/*The header says whether the archive can be streamed*/
+		status = readInput(worker, inputFd, AR_HEADER_SIZE, &inputSize);
+		if ( status != AR_OK || inputSize < AR_HEADER_SIZE || isTinyTag(worker->input[0]) ||
+			 unpackHeader(worker->input, &header) != EXIT_SUCCESS || !(header.flags & AR_FLAG_DEDUP))
+		{
+			return status != AR_OK ? status : streamDecompress(worker, inputSize, inputFd, outputFd, written);
+		}
+		if ( header.uncompressedDataSize < 0)
+		{
+			return AR_ERROR_CORRUPT;
+		}
+		if ( header.uncompressedDataSize > AR_SERVE_MAX_REQUEST)
+		{
+			return AR_SERVE_ERROR_TOO_LARGE;
+		}
+		status = readInput(worker, inputFd, AR_SERVE_MAX_REQUEST + 1, &inputSize);
+		if ( status != AR_OK)
+		{
+			return status;
+		}
+		capacity = (size_t) header.uncompressedDataSize;
+		if ( reserve(&worker->output, &worker->outputCapacity, capacity) != AR_OK)
+		{
+			return AR_ERROR_MEMORY;
+		}
+		status = ar_decompress(worker->input, inputSize, worker->output, capacity, &outputSize, NULL);
+	}
+	if ( status != AR_OK)
+	{
+		return status;
+	}
+
+	if ( writeAll(outputFd, worker->output, outputSize) != EXIT_SUCCESS)
+	{
+		return AR_SERVE_ERROR_IO;
+	}
+	*written = (long long) outputSize;
+	return AR_OK;
+}
+
+/**
+ * Method:    streamDecompress
+ * FullName:  streamDecompress
+ * Access:    private
+ * @brief     Decompresses the input file into the output file AR_SERVE_STREAM_BUFFER bytes at a time, with
+ *			  the ar_stream functions, so only the stream's block buffers are held however large the file is
+ * @param 	  worker - worker serving the request, with the start of the archive already in its input buffer
+ * @param 	  inputSize - bytes of the archive already read
+ * @param 	  inputFd - file to read the rest from
+ * @param 	  outputFd - file to write
+ * @param 	  written - set to the number of bytes written
+ * @return    AR_OK, AR_ERROR_* or AR_SERVE_ERROR_IO with errno set
+ **/
+static int streamDecompress( Worker *worker, size_t inputSize, int inputFd, int outputFd, long long *written)
+{
+	ar_stream *stream;
+	size_t position, used, outputSize;
+	ssize_t got;
+	int status;
+
+	if ( reserve(&worker->input, &worker->inputCapacity, AR_SERVE_STREAM_BUFFER) != AR_OK ||
+		 reserve(&worker->output, &worker->outputCapacity, AR_SERVE_STREAM_BUFFER) != AR_OK ||
+		 (stream = ar_stream_decompress_new(NULL)) == NULL)
+	{
+		return AR_ERROR_MEMORY;
+	}
+
+	status = AR_OK;
+	position = 0;
+	while ( status == AR_OK)
+	{
+		if ( position == inputSize)
+		{
+			got = read(inputFd, worker->input, AR_SERVE_STREAM_BUFFER);
+			if ( got < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if ( got <= 0)
+			{
+				status = got < 0 ? AR_SERVE_ERROR_IO : AR_OK;
+				break;
+			}
+			inputSize = (size_t) got;
+			position = 0;
+		}
+		status = ar_stream_update(stream, worker->input + position, inputSize - position, &used,
+								  worker->output, AR_SERVE_STREAM_BUFFER, &outputSize);
+		position += used;
+		if ( outputSize > 0 && writeAll(outputFd, worker->output, outputSize) != EXIT_SUCCESS)
+		{
+			status = AR_SERVE_ERROR_IO;
+		}
+		*written += (long long) outputSize;
+	}
+
+	/*Checks the archive ended where it should, writing out the last block if it is still waiting*/
+	while ( status == AR_OK || status == AR_MORE)
+	{
+		status = ar_stream_finish(stream, worker->output, AR_SERVE_STREAM_BUFFER, &outputSize);
+		if ( outputSize > 0 && writeAll(outputFd, worker->output, outputSize) != EXIT_SUCCESS)
+		{
+			status = AR_SERVE_ERROR_IO;
+		}
+		*written += (long long) outputSize;
+		if ( status == AR_OK)
+		{
+			break;
+		}
+	}
+	ar_stream_free(stream);
+	return status;
+}
+
+/**
+ * Method:    readInput
+ * FullName:  readInput
+ * Access:    private
+ * @brief     Reads a file into the worker's input buffer, after the bytes already there, until end of file or
+ *			  limit bytes. The size of a regular file is known up front, so it is read into a buffer of the right size
+ * @param 	  worker - worker serving the request
+ * @param 	  fd - file to read
+ * @param 	  limit - most bytes to hold, AR_SERVE_MAX_REQUEST + 1 to read the whole file
+ * @param 	  size - bytes already in the buffer, updated
+ * @return    AR_OK, AR_ERROR_MEMORY, AR_SERVE_ERROR_TOO_LARGE if the whole file is more than
+ *			  AR_SERVE_MAX_REQUEST bytes, or AR_SERVE_ERROR_IO with errno set
+ **/
+static int readInput( Worker *worker, int fd, size_t limit, size_t *size)
+{
+	struct stat info;
+	ssize_t got;
+	size_t wanted;
+
+	wanted = 65536;
+	if ( fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+	{
+		if ( limit > AR_SERVE_MAX_REQUEST && info.st_size > AR_SERVE_MAX_REQUEST)
+		{
+			return AR_SERVE_ERROR_TOO_LARGE;
+		}
+		wanted = (size_t) info.st_size + 1;
+	}
+	while ( *size < limit)
+	{
+		if ( reserve(&worker->input, &worker->inputCapacity, *size + wanted < limit ? *size + wanted : limit) != AR_OK)
+		{
+			return AR_ERROR_MEMORY;
+		}
+		got = read(fd, worker->input + *size, (worker->inputCapacity < limit ? worker->inputCapacity : limit) - *size);
+		if ( got < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if ( got < 0)
+		{
+			return AR_SERVE_ERROR_IO;
+		}
+		if ( got == 0)
+		{
+			return AR_OK;
+		}
+		*size += (size_t) got;
+	}
+	/*Only reached when the limit stops the read, which for a whole file means it is too large*/
+	return limit > AR_SERVE_MAX_REQUEST ? AR_SERVE_ERROR_TOO_LARGE : AR_OK;
+}
+
+/**
+ * Method:    reserve
+ * FullName:  reserve
+ * Access:    private
+ * @brief     Grows a buffer to at least the given size, at least doubling it so repeated growth stays cheap
+ * @param 	  buffer - buffer to grow, may be NULL
+ * @param 	  capacity - current size of the buffer, updated
+ * @param 	  size - size needed
+ * @return    AR_OK, or AR_ERROR_MEMORY with the buffer unchanged
+ **/
+static int reserve( unsigned char **buffer, size_t *capacity, size_t size)
+{
+	unsigned char *grown;
+	size_t doubled;
+
+	if ( size <= *capacity)
+	{
+		return AR_OK;
+	}
+	/*Doubling stops at the most a request may read, so a large request never takes twice that*/
+	doubled = 2 * *capacity < AR_SERVE_MAX_REQUEST + 1 ? 2 * *capacity : AR_SERVE_MAX_REQUEST + 1;
+	if ( size < doubled)
+	{
+		size = doubled;
+	}
+	grown = (unsigned char*) arRealloc(*buffer, size);
+	if ( grown == NULL)
+	{
+		return AR_ERROR_MEMORY;
+	}
+	*buffer = grown;
+	*capacity = size;
+	return AR_OK;
+}
+
+/**
+ * Method:    trimBuffers
+ * FullName:  trimBuffers
+ * Access:    private
+ * @brief     Frees a worker's buffers once a request has grown them past AR_SERVE_KEEP_BUFFER, so one large
+ *			  file doesn't stay in memory for the life of the server
+ * @param 	  worker - worker whose request is done
+ **/
+static void trimBuffers( Worker *worker)
+{
+	if ( worker->inputCapacity > AR_SERVE_KEEP_BUFFER)
+	{
+		arFree(worker->input);
+		worker->input = NULL;
+		worker->inputCapacity = 0;
+	}
+	if ( worker->outputCapacity > AR_SERVE_KEEP_BUFFER)
+	{
+		arFree(worker->output);
+		worker->output = NULL;
+		worker->outputCapacity = 0;
+	}
+}
+
+/**
+ * Method:    runClient
+ * FullName:  runClient
+ * Access:    public
+ * @brief     Has a server started with --serve compress or decompress a file. The input and output are
+ *			  opened here and passed to the server, which reads and writes them itself. Output is named
+ *			  as by {@link compressFile} and {@link decompressFile}, or - uses stdin and stdout
+ * @param 	  path - file name of the server's socket
+ * @param 	  operation - AR_SERVE_COMPRESS or AR_SERVE_DECOMPRESS
+ * @param 	  level - compression level
+ * @param 	  file - file to compress or decompress, or - for stdin to stdout
+ * @return    EXIT_SUCCESS or EXIT_FAILURE
+ **/
+int runClient( const char *path, int operation, int level, char *file)
+{
+	unsigned char request[AR_SERVE_REQUEST_SIZE], reply[AR_SERVE_REPLY_SIZE];
+	Control control;
+	char name[101];
+	struct sockaddr_un address;
+	struct msghdr message;
+	struct cmsghdr *header;
+	struct iovec vector;
+	ssize_t received;
+	int fds[2], connection, useStdio, named, status;
+
+	useStdio = strcmp(file, "-") == 0;
+	fds[0] = useStdio ? STDIN_FILENO : open(file, O_RDONLY);
+	if ( fds[0] < 0)
+	{
+		perror(file);
+		return EXIT_FAILURE;
+	}
+	if ( useStdio)
+	{
+		fds[1] = STDOUT_FILENO;
+	}
+	else
+	{
+		if ( operation == AR_SERVE_COMPRESS)
+		{
+			printf("Enter name of output file.\n");
+			named = scanf("%97s", name) == 1;
+			if ( named)
+			{
+				strcat(name, ".ar");
+			}
+		}
+		else
+		{
+			printf("Enter output file name\n");
+			named = scanf("%99s", name) == 1;
+		}
+		if ( !named)
+		{
+			reportError("No output file name given\n");
+			close(fds[0]);
+			return EXIT_FAILURE;
+		}
+		fds[1] = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if ( fds[1] < 0)
+		{
+			perror(name);
+			close(fds[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	status = EXIT_FAILURE;
+	connection = openSocket(path, &address);
+	if ( connection < 0)
+	{
+		/*openSocket has said why*/
+	}
+	else if ( connect(connection, (struct sockaddr*) &address, sizeof(address)) != 0)
+	{
+		perror(path);
+	}
+	else
+	{
+		putLE32(request, AR_SERVE_MAGIC);
+		request[4] = (unsigned char) operation;
+		request[5] = (unsigned char) level;
+		request[6] = 0;
+		request[7] = 0;
+		memset(&message, 0, sizeof(message));
+		memset(&control, 0, sizeof(control));
+		vector.iov_base = request;
+		vector.iov_len = sizeof(request);
+		message.msg_iov = &vector;
+		message.msg_iovlen = 1;
+		message.msg_control = control.data;
+		message.msg_controllen = sizeof(control.data);
+		header = CMSG_FIRSTHDR(&message);
+		header->cmsg_level = SOL_SOCKET;
+		header->cmsg_type = SCM_RIGHTS;
+		header->cmsg_len = CMSG_LEN(2 * sizeof(int));
+		memcpy(CMSG_DATA(header), fds, 2 * sizeof(int));
+
+		if ( sendmsg(connection, &message, 0) != AR_SERVE_REQUEST_SIZE)
+		{
+			perror("Could not send request");
+		}
+		else if ( (received = recv(connection, reply, sizeof(reply), MSG_WAITALL)) != AR_SERVE_REPLY_SIZE)
+		{
+			reportError("Server closed the connection without replying\n");
+		}
+		else if ( (int) getLE32(reply) == AR_SERVE_ERROR_TOO_LARGE)
+		{
+			reportError("File is too large for the server, which holds at most %d MB, compress it without --connect\n",
+						AR_SERVE_MAX_REQUEST / 1048576);
+		}
+		else if ( (int) getLE32(reply) == AR_SERVE_ERROR_IO)
+		{
+			reportError("Server could not read or write the file: %s\n", strerror((int) getLE32(reply + 4)));
+		}
+		else if ( (int) getLE32(reply) != AR_OK)
+		{
+			reportError("Server failed: %s\n", ar_error_string((int) getLE32(reply)));
+		}
+		else
+		{
+			status = EXIT_SUCCESS;
+		}
+	}
+	if ( connection >= 0)
+	{
+		close(connection);
+	}
+	if ( !useStdio)
+	{
+		close(fds[0]);
+		if ( close(fds[1]) != 0)
+		{
+			perror(name);
+			status = EXIT_FAILURE;
+		}
+		if ( status == EXIT_SUCCESS)
+		{
+			printf("Done\n");
+		}
+	}
+	return status;
+}
@@ -0,0 +1,34 @@
+/*
+ * File:   Server.h
+ * Author: adrian
+ *
+ * Long running compression server on a Unix domain socket, and the client for it.
+ * The client passes its open input and output files to the server with SCM_RIGHTS,
+ * so no data goes over the socket, only a request and a reply:
+ *
+ *   request  8 bytes   magic "ARSV", operation, level, 2 reserved
+ *   reply    16 bytes  status (AR_OK, AR_ERROR_* or AR_SERVE_ERROR_*), errno, bytes written
+ *
+ * all little endian. Archives are decompressed as a stream, a block at a time.
+ * Files to compress, and deduplicated archives, are coded in memory, so they are
+ * limited to AR_SERVE_MAX_REQUEST bytes.
+ */
+
+#ifndef SERVER_H
+#define	SERVER_H
+
+#define AR_SERVE_MAGIC 0x56535241u  /* "ARSV" */
+#define AR_SERVE_REQUEST_SIZE 8
+#define AR_SERVE_REPLY_SIZE 16
+#define AR_SERVE_COMPRESS 1
+#define AR_SERVE_DECOMPRESS 2
+#define AR_SERVE_MIN_WORKERS 4  /* A request reading a pipe can wait on another request, so even one CPU gets a few workers */
+#define AR_SERVE_MAX_REQUEST 67108864  /* Most bytes of input or output a request may hold in memory */
+#define AR_SERVE_KEEP_BUFFER 4194304  /* A worker's buffers are freed after a request that grew them past this */
+#define AR_SERVE_STREAM_BUFFER 65536  /* Bytes read and written at a time when decompressing */
+#define AR_SERVE_ERROR_IO -100  /* Reading or writing a passed file failed, the reply holds errno */
+#define AR_SERVE_ERROR_TOO_LARGE -101  /* The request needs more than AR_SERVE_MAX_REQUEST bytes in memory */
+
+int runServer( const char *path);
+int runClient( const char *path, int operation, int level, char *file);
+#endif	/* SERVER_H */
@@ -0,0 +1,115 @@
+/**
+ * @file   Sha256.c
+ * @author Adrian Rasmussen
+ *
+ * @brief SHA-256 as in FIPS 180-4, in plain C. Only whole buffers are hashed, since chunks are at most
+ *		  AR_CDC_MAX_CHUNK bytes and always held in memory.
+ */
+#include <string.h>
+#include "Sha256.h"
+
+#define ROTATE(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static const unsigned int roundConstants[64] =
+{
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/**
+ * Method:    compressChunk
+ * FullName:  compressChunk
+ * Access:    private
+ * @brief     Runs the compression function over one 64 byte chunk of the message
+ * @param 	  state - the eight working hash values, updated in place
+ * @param 	  chunk - 64 bytes of message
+ **/
+static void compressChunk( unsigned int state[8], const unsigned char *chunk)
+{
+	unsigned int w[64], v[8], t1, t2;
+	int i;
+
+	for ( i = 0; i < 16; i++)
+	{
+		w[i] = (unsigned int) chunk[4 * i] << 24 | (unsigned int) chunk[4 * i + 1] << 16 |
+			   (unsigned int) chunk[4 * i + 2] << 8 | chunk[4 * i + 3];
+	}
+	for ( ; i < 64; i++)
+	{
+		w[i] = w[i - 16] + (ROTATE(w[i - 15], 7) ^ ROTATE(w[i - 15], 18) ^ (w[i - 15] >> 3)) +
+			   w[i - 7] + (ROTATE(w[i - 2], 17) ^ ROTATE(w[i - 2], 19) ^ (w[i - 2] >> 10));
+	}
+
+	memcpy(v, state, sizeof(v));
+	for ( i = 0; i < 64; i++)
+	{
+		t1 = v[7] + (ROTATE(v[4], 6) ^ ROTATE(v[4], 11) ^ ROTATE(v[4], 25)) + ((v[4] & v[5]) ^ (~v[4] & v[6])) +
+			 roundConstants[i] + w[i];
+		t2 = (ROTATE(v[0], 2) ^ ROTATE(v[0], 13) ^ ROTATE(v[0], 22)) + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+		v[7] = v[6];
+		v[6] = v[5];
+		v[5] = v[4];
+		v[4] = v[3] + t1;
+		v[3] = v[2];
+		v[2] = v[1];
+		v[1] = v[0];
+		v[0] = t1 + t2;
+	}
+	for ( i = 0; i < 8; i++)
+	{
+		state[i] += v[i];
+	}
+}
+
+/**
+ * Method:    sha256
+ * FullName:  sha256
+ * Access:    public
+ * @brief     Hashes a buffer
+ * @param 	  data - the data to hash
+ * @param 	  size - number of bytes in data
+ * @param 	  digest - array to save the 32 byte digest to
+ **/
+void sha256( const unsigned char *data, size_t size, unsigned char digest[AR_SHA256_SIZE])
+{
+	unsigned int state[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+	unsigned char last[128];
+	unsigned long long bits = (unsigned long long) size * 8;
+	size_t done, tail, padded;
+	int i;
+
+	for ( done = 0; size - done >= 64; done += 64)
+	{
+		compressChunk(state, data + done);
+	}
+
+	/*The rest, a 1 bit, zeros and the length in bits fill one or two more chunks*/
+	tail = size - done;
+	padded = tail < 56 ? 64 : 128;
+	memset(last, 0, sizeof(last));
+	memcpy(last, data + done, tail);
+	last[tail] = 0x80;
+	for ( i = 0; i < 8; i++)
+	{
+		last[padded - 1 - i] = (unsigned char) (bits >> (8 * i));
+	}
+	compressChunk(state, last);
+	if ( padded == 128)
+	{
+		compressChunk(state, last + 64);
+	}
+
+	for ( i = 0; i < 8; i++)
+	{
+		digest[4 * i] = (unsigned char) (state[i] >> 24);
+		digest[4 * i + 1] = (unsigned char) (state[i] >> 16);
+		digest[4 * i + 2] = (unsigned char) (state[i] >> 8);
+		digest[4 * i + 3] = (unsigned char) state[i];
+	}
+}
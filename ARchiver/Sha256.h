@@ -0,0 +1,16 @@
+/*
+ * File:   Sha256.h
+ * Author: adrian
+ *
+ * SHA-256 digests, used to fingerprint deduplicated chunks so two chunks that
+ * differ can't be taken as the same one
+ */
+
+#ifndef SHA256_H
+#define	SHA256_H
+#include <stddef.h>
+
+#define AR_SHA256_SIZE 32  /* Bytes in a digest */
+
+void sha256( const unsigned char *data, size_t size, unsigned char digest[AR_SHA256_SIZE]);
+#endif	/* SHA256_H */
@@ -0,0 +1,483 @@
+/**
+ * @file   Split.c
+ * @author Adrian Rasmussen
+ *
+ * @brief Huffman coding of a block in segments, so a block that is half text and half binary is not coded
+ *		  with one tree that suits neither. The block is counted in AR_SPLIT_CHUNK byte chunks, and a segment
+ *		  ends before a chunk if coding the segment and the next AR_SPLIT_WINDOW chunks with a tree each is
+ *		  smaller than coding them with one. Each segment is then coded whichever way is smallest: as more of
+ *		  the segment before it, with a new tree, or with one of the last AR_SPLIT_RECENT trees, flagged with
+ *		  AR_SEGMENT_REPEAT, so text broken up by binary sends its tree once. Every size compared is exact, as
+ *		  the bits of a Huffman code depend only on the counts and not on how ties were broken.
+ *		  The trees section is [int segments][segment entries][trees]. Each entry is the segment's size, the
+ *		  bits of its codes and the size of its new tree, or AR_SEGMENT_REPEAT and the number of the earlier tree
+ *		  counting from 0. Each segment's codes start on a byte.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Split.h"
+#include "Huffman.h"
+#include "Kernels.h"
+#include "Format.h"
+#include "Memory.h"
+#include "Report.h"
+
+/* A segment while the block is being split */
+typedef struct Segment
+{
+	int start;
+	int size;
+	int counts[256];
+	int table;  /* Code table the segment is coded with */
+	int treeSize;  /* Size of its tree, or 0 if it is coded with an earlier one */
+	long long bits;  /* Bits of its codes */
+} Segment;
+
+/* One tree of the block, serialized and as codes in the form packCodes takes */
+typedef struct CodeTable
+{
+	unsigned char tree[AR_SPLIT_MAX_TREE];
+	int treeSize;
+	unsigned long long codes[256];
+	unsigned char lengths[256];
+} CodeTable;
+
+static long long huffmanBits( const int counts[256], int *numSymbols);
+static int treeBytes( int numSymbols);
+static long long newTreeBytes( const int counts[256]);
+static long long tableBits( const int counts[256], const CodeTable *table);
+static int buildSegmentTree( const int counts[256], CodeTable *table);
+
+/**
+ * Method:    huffmanBits
+ * FullName:  huffmanBits
+ * Access:    private
+ * @brief     Works out the size of the codes a Huffman tree of the counts gives, without building the tree.
+ *			  This is the sum of the weights of the tree's internal nodes, found by merging the counts in order
+ *			  with a second queue of merged weights, which stays sorted by itself
+ * @param 	  counts - number of times each byte occurs
+ * @param 	  numSymbols - set to the number of bytes that occur
+ * @return    size of the codes in bits
+ **/
+static long long huffmanBits( const int counts[256], int *numSymbols)
+{
+	long long weights[256], merged[256], smallest[2], bits;
+	int n, i, j, m, k, s, fromMerged;
+
+	/*Counting sort would need the counts' range, so insert each into place instead*/
+	n = 0;
+	for ( s = 0; s < 256; s++)
+	{
+		if ( counts[s] > 0)
+		{
+			for ( i = n; i > 0 && weights[i - 1] > counts[s]; i--)
+			{
+				weights[i] = weights[i - 1];
+			}
+			weights[i] = counts[s];
+			n++;
+		}
+	}
+	*numSymbols = n;
+	if ( n < 2)
+	{
+		/*A single byte still has a one bit code*/
+		return n == 1 ? weights[0] : 0;
+	}
+
+	bits = 0;
+	i = 0;
+	j = 0;
+	for ( m = 0; m < n - 1; m++)
+	{
+		for ( k = 0; k < 2; k++)
+		{
+			fromMerged = j < m && (i == n || merged[j] < weights[i]);
+			smallest[k] = fromMerged ? merged[j++] : weights[i++];
+		}
+		merged[m] = smallest[0] + smallest[1];
+		bits += merged[m];
+	}
+	return bits;
+}
+
+/**
+ * Method:    treeBytes
+ * FullName:  treeBytes
+ * Access:    private
+ * @param 	  numSymbols - number of bytes in a tree, at least 1
+ * @return    size of the tree when serialized by {@link serializeLengths}
+ **/
+static int treeBytes( int numSymbols)
+{
+	/*A single symbol is given a parent with only a left child*/
+	return (numSymbols == 1 ? 2 : 2 * numSymbols - 1) * (int) sizeof(HuffNodeSerial);
+}
+
+/**
+ * Method:    newTreeBytes
+ * FullName:  newTreeBytes
+ * Access:    private
+ * @param 	  counts - number of times each byte occurs in a segment, with at least one byte
+ * @return    bytes the segment takes coded with a tree of its own, entry and tree included
+ **/
+static long long newTreeBytes( const int counts[256])
+{
+	long long bits;
+	int numSymbols;
+
+	bits = huffmanBits(counts, &numSymbols);
+	return AR_SEGMENT_SIZE + treeBytes(numSymbols) + (bits + 7) / 8;
+}
+
+/**
+ * Method:    tableBits
+ * FullName:  tableBits
+ * Access:    private
+ * @param 	  counts - number of times each byte occurs in a segment
+ * @param 	  table - codes of an earlier tree
+ * @return    bits of the segment coded with the table, or -1 if some byte in it has no code
+ **/
+static long long tableBits( const int counts[256], const CodeTable *table)
+{
+	long long bits = 0;
+	int s;
+
+	for ( s = 0; s < 256; s++)
+	{
+		if ( counts[s] > 0)
+		{
+			if ( table->lengths[s] == 0)
+			{
+				return -1;
+			}
+			bits += (long long) counts[s] * table->lengths[s];
+		}
+	}
+	return bits;
+}
+
+/**
+ * Method:    buildSegmentTree
+ * FullName:  buildSegmentTree
+ * Access:    private
+ * @brief     Builds the tree of a segment, keeping it serialized and as a table of codes
+ * @param 	  counts - number of times each byte occurs in the segment
+ * @param 	  table - table to save the tree and codes to
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if memory could not be allocated
+ **/
+static int buildSegmentTree( const int counts[256], CodeTable *table)
+{
+	HuffNodeSerial *serial;
+
+	serial = buildCodes(counts, 256, table->lengths, table->codes, &table->treeSize);
+	if ( serial == NULL)
+	{
+		return EXIT_FAILURE;
+	}
+	memcpy(table->tree, serial, table->treeSize);
+	arFree(serial);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    splitMemory
+ * FullName:  splitMemory
+ * Access:    public
+ * @param 	  blockSize - uncompressed bytes per block
+ * @return    bytes {@link splitCompress} allocates for a block of that size
+ **/
+long long splitMemory( int blockSize)
+{
+	long long chunks = blockSize / AR_SPLIT_CHUNK + 1;
+
+	return chunks * (256 * (long long) sizeof(int) + (long long) sizeof(Segment) + (long long) sizeof(CodeTable));
+}
+
+/**
+ * Method:    splitCompress
+ * FullName:  splitCompress
+ * Access:    public
+ * @brief     Splits a block into segments and codes each, as described at the top of this file. Fails if a
+ *			  single plain Huffman coded block would be no bigger, so the caller can code it that way instead
+ * @param 	  input - the block
+ * @param 	  size - size of the block
+ * @param 	  output - buffer to save the trees section and codes to
+ * @param 	  capacity - size of output
+ * @param 	  treeSize - location to save the size of the trees section to, in bytes
+ * @param 	  compressedSize - location to save the size of the codes to, in bits including each segment's padding
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if splitting would not be smaller, the result did not fit in capacity
+ *			  or memory could not be allocated
+ **/
+int splitCompress( const unsigned char *input, int size, unsigned char *output, int capacity,
+				   int *treeSize, int *compressedSize)
+{
+	Segment *segments, *segment, *last;
+	CodeTable *tables;
+	int *chunkCounts;
+	int window[256], joined[256], whole[256];
+	int numChunks, numSegments, numKept, numTables, current, repeat, bits, c, w, s, t, i, status;
+	long long total, plain, mergeBits, mergeBytes, newBytes, repeatBits, repeatBytes, tryBits;
+	unsigned char *data;
+
+	numChunks = (size + AR_SPLIT_CHUNK - 1) / AR_SPLIT_CHUNK;
+	if ( numChunks < 2)
+	{
+		/*One segment is a plain Huffman block with more overhead*/
+		return EXIT_FAILURE;
+	}
+	chunkCounts = (int*) arMalloc(numChunks * 256 * sizeof(int));
+	segments = (Segment*) arMalloc(numChunks * sizeof(Segment));
+	tables = (CodeTable*) arMalloc(numChunks * sizeof(CodeTable));
+	if ( chunkCounts == NULL || segments == NULL || tables == NULL)
+	{
+		reportError("Could not allocate memory for block segments\n");
+		arFree(chunkCounts);
+		arFree(segments);
+		arFree(tables);
+		return EXIT_FAILURE;
+	}
+	for ( c = 0; c < numChunks; c++)
+	{
+		countBytes(input + c * AR_SPLIT_CHUNK, c == numChunks - 1 ? size - c * AR_SPLIT_CHUNK : AR_SPLIT_CHUNK,
+				   chunkCounts + c * 256);
+	}
+
+	/*End a segment before a chunk if the chunks that follow code better with a tree of their own*/
+	numSegments = 1;
+	segment = &segments[0];
+	segment->start = 0;
+	memcpy(segment->counts, chunkCounts, sizeof(segment->counts));
+	for ( c = 1; c < numChunks; c++)
+	{
+		memset(window, 0, sizeof(window));
+		for ( w = c; w < c + AR_SPLIT_WINDOW && w < numChunks; w++)
+		{
+			for ( s = 0; s < 256; s++)
+			{
+				window[s] += chunkCounts[w * 256 + s];
+			}
+		}
+		for ( s = 0; s < 256; s++)
+		{
+			joined[s] = segment->counts[s] + window[s];
+		}
+		if ( newTreeBytes(segment->counts) + newTreeBytes(window) < newTreeBytes(joined))
+		{
+			segment = &segments[numSegments++];
+			segment->start = c * AR_SPLIT_CHUNK;
+			memcpy(segment->counts, chunkCounts + c * 256, sizeof(segment->counts));
+		}
+		else
+		{
+			for ( s = 0; s < 256; s++)
+			{
+				segment->counts[s] += chunkCounts[c * 256 + s];
+			}
+		}
+	}
+	for ( i = 0; i < numSegments; i++)
+	{
+		segments[i].size = (i == numSegments - 1 ? size : segments[i + 1].start) - segments[i].start;
+	}
+
+	/*Code each segment whichever way is smallest. Segments that code best as more of the one before are
+	  merged into it, and the rest are moved down over the merged ones*/
+	memset(whole, 0, sizeof(whole));
+	for ( c = 0; c < numChunks; c++)
+	{
+		for ( s = 0; s < 256; s++)
+		{
+			whole[s] += chunkCounts[c * 256 + s];
+		}
+	}
+	arFree(chunkCounts);
+	plain = newTreeBytes(whole) - AR_SEGMENT_SIZE;
+	status = EXIT_SUCCESS;
+	numKept = 0;
+	numTables = 0;
+	current = -1;
+	total = 4;
+	for ( i = 0; i < numSegments && status == EXIT_SUCCESS; i++)
+	{
+		segment = &segments[i];
+		last = numKept > 0 ? &segments[numKept - 1] : NULL;
+		mergeBits = last == NULL ? -1 : tableBits(segment->counts, &tables[current]);
+		mergeBytes = mergeBits < 0 ? -1 : (last->bits + mergeBits + 7) / 8 - (last->bits + 7) / 8;
+		repeat = -1;
+		repeatBits = -1;
+		for ( t = numTables > AR_SPLIT_RECENT ? numTables - AR_SPLIT_RECENT : 0; t < numTables; t++)
+		{
+			tryBits = t == current ? -1 : tableBits(segment->counts, &tables[t]);
+			if ( tryBits >= 0 && (repeatBits < 0 || tryBits < repeatBits))
+			{
+				repeat = t;
+				repeatBits = tryBits;
+			}
+		}
+		repeatBytes = repeatBits < 0 ? -1 : AR_SEGMENT_SIZE + (repeatBits + 7) / 8;
+		newBytes = newTreeBytes(segment->counts);
+
+		if ( mergeBytes >= 0 && mergeBytes <= newBytes && (repeatBytes < 0 || mergeBytes <= repeatBytes))
+		{
+			last->size += segment->size;
+			last->bits += mergeBits;
+			total += mergeBytes;
+			continue;
+		}
+		last = &segments[numKept++];
+		if ( last != segment)
+		{
+			*last = *segment;
+		}
+		if ( repeatBytes >= 0 && repeatBytes <= newBytes)
+		{
+			last->treeSize = 0;
+			last->bits = repeatBits;
+			last->table = repeat;
+			total += repeatBytes;
+		}
+		else
+		{
+			status = buildSegmentTree(last->counts, &tables[numTables]);
+			last->treeSize = tables[numTables].treeSize;
+			last->bits = tableBits(last->counts, &tables[numTables]);
+			last->table = numTables++;
+			total += AR_SEGMENT_SIZE + last->treeSize + (last->bits + 7) / 8;
+		}
+		current = last->table;
+	}
+	if ( status != EXIT_SUCCESS || numKept < 2 || total >= plain || total > capacity)
+	{
+		arFree(segments);
+		arFree(tables);
+		return EXIT_FAILURE;
+	}
+
+	/*Entries, then the new trees in order, then each segment's codes*/
+	putLE32(output, (unsigned int) numKept);
+	*treeSize = 4 + numKept * AR_SEGMENT_SIZE;
+	for ( i = 0; i < numKept; i++)
+	{
+		segment = &segments[i];
+		putLE32(output + 4 + i * AR_SEGMENT_SIZE, (unsigned int) segment->size);
+		putLE32(output + 8 + i * AR_SEGMENT_SIZE, (unsigned int) segment->bits);
+		putLE32(output + 12 + i * AR_SEGMENT_SIZE, segment->treeSize > 0 ? (unsigned int) segment->treeSize :
+				AR_SEGMENT_REPEAT | (unsigned int) segment->table);
+		memcpy(output + *treeSize, tables[segment->table].tree, segment->treeSize);
+		*treeSize += segment->treeSize;
+	}
+	data = output + *treeSize;
+	for ( i = 0; i < numKept && status == EXIT_SUCCESS; i++)
+	{
+		segment = &segments[i];
+		status = packCodes(input + segment->start, segment->size, tables[segment->table].codes,
+						   tables[segment->table].lengths, data, capacity - (int) (data - output), &bits);
+		data += (bits + 7) / 8;
+	}
+	*compressedSize = 8 * (int) (data - output - *treeSize);
+
+	arFree(segments);
+	arFree(tables);
+	return status;
+}
+
+/**
+ * Method:    splitDecompress
+ * FullName:  splitDecompress
+ * Access:    public
+ * @brief     Decodes a block coded by {@link splitCompress}. Where the last AR_SPLIT_RECENT trees start is kept,
+ *			  and the decode table is only rebuilt when a segment uses a different tree from the one before it
+ * @param 	  input - the trees section followed by the codes
+ * @param 	  treeSize - size of the trees section in bytes
+ * @param 	  compressedSize - size of the codes in bits, including each segment's padding
+ * @param 	  output - buffer to save the block to
+ * @param 	  size - size of the block when uncompressed
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the data is corrupt or memory could not be allocated
+ **/
+int splitDecompress( unsigned char *input, int treeSize, int compressedSize, unsigned char *output, int size)
+{
+	DecodeTable *table;
+	int trees[AR_SPLIT_RECENT], treeSizes[AR_SPLIT_RECENT];
+	unsigned char *entry, *data;
+	unsigned int segmentTree;
+	int numSegments, numTrees, segmentSize, bits, tree, current, treeOffset, dataSize, written, i, status;
+
+	numSegments = treeSize >= 4 ? (int) getLE32(input) : 0;
+	if ( numSegments < 2 || numSegments > size || numSegments > (treeSize - 4) / AR_SEGMENT_SIZE ||
+		 compressedSize % 8 != 0)
+	{
+		reportError("Not a valid .ar file, bad segment list\n");
+		return EXIT_FAILURE;
+	}
+	table = (DecodeTable*) arMalloc(sizeof(DecodeTable));
+	if ( table == NULL)
+	{
+		reportError("Could not allocate memory for decode table\n");
+		return EXIT_FAILURE;
+	}
+
+	table->children = NULL;
+	table->symbols = NULL;
+	numTrees = 0;
+	current = -1;
+	treeOffset = 4 + numSegments * AR_SEGMENT_SIZE;
+	data = input + treeSize;
+	dataSize = compressedSize / 8;
+	written = 0;
+	status = EXIT_SUCCESS;
+	for ( i = 0; i < numSegments && status == EXIT_SUCCESS; i++)
+	{
+		entry = input + 4 + i * AR_SEGMENT_SIZE;
+		segmentSize = (int) getLE32(entry);
+		bits = (int) getLE32(entry + 4);
+		segmentTree = getLE32(entry + 8);
+		tree = (segmentTree & AR_SEGMENT_REPEAT) ? (int) (segmentTree & ~AR_SEGMENT_REPEAT) : numTrees;
+		if ( segmentSize <= 0 || segmentSize > size - written || bits <= 0 || bits > 8 * dataSize ||
+			 ((segmentTree & AR_SEGMENT_REPEAT) && (tree >= numTrees || tree < numTrees - AR_SPLIT_RECENT)) ||
+			 (!(segmentTree & AR_SEGMENT_REPEAT) && (int) segmentTree > treeSize - treeOffset))
+		{
+			reportError("Not a valid .ar file, bad segment list\n");
+			status = EXIT_FAILURE;
+			break;
+		}
+		if ( tree == numTrees)
+		{
+			/*The new tree replaces the oldest one kept*/
+			trees[tree % AR_SPLIT_RECENT] = treeOffset;
+			treeSizes[tree % AR_SPLIT_RECENT] = (int) segmentTree;
+			treeOffset += (int) segmentTree;
+			numTrees++;
+		}
+		if ( tree != current)
+		{
+			freeDecodeTable(table);
+			if ( buildDecodeTable((HuffNodeSerial*) (input + trees[tree % AR_SPLIT_RECENT]),
+								  treeSizes[tree % AR_SPLIT_RECENT], 256, table) != EXIT_SUCCESS)
+			{
+				reportError("Not a valid .ar file, bad segment tree\n");
+				status = EXIT_FAILURE;
+				break;
+			}
+			current = tree;
+		}
+		if ( decodeBytes(data, bits, output + written, segmentSize, table) != segmentSize)
+		{
+			reportError("Not a valid .ar file, segment does not match its tree\n");
+			status = EXIT_FAILURE;
+		}
+		written += segmentSize;
+		data += (bits + 7) / 8;
+		dataSize -= (bits + 7) / 8;
+	}
+	if ( status == EXIT_SUCCESS && (written != size || treeOffset != treeSize || dataSize != 0))
+	{
+		reportError("Not a valid .ar file, bad segment list\n");
+		status = EXIT_FAILURE;
+	}
+
+	freeDecodeTable(table);
+	arFree(table);
+	return status;
+}
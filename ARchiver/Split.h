@@ -0,0 +1,23 @@
+/*
+ * File:   Split.h
+ * Author: adrian
+ *
+ * Huffman blocks split into segments where the byte statistics change, each segment
+ * coded with a tree of its own or with the tree of the segment before it
+ */
+
+#ifndef SPLIT_H
+#define	SPLIT_H
+
+#define AR_SPLIT_CHUNK 16384  /* Segments start and end on multiples of this many bytes */
+#define AR_SPLIT_WINDOW 4  /* Chunks after a candidate split whose counts decide it */
+#define AR_SEGMENT_SIZE 12  /* Bytes of each segment's entry in the trees section */
+#define AR_SEGMENT_REPEAT 0x80000000u  /* Set in place of the tree size of a segment coded with an earlier tree */
+#define AR_SPLIT_RECENT 16  /* Earlier trees of the block a segment can be coded with */
+#define AR_SPLIT_MAX_TREE (511 * 6)  /* Largest serialized tree of 256 symbols, 6 bytes a node */
+
+long long splitMemory( int blockSize);
+int splitCompress( const unsigned char *input, int size, unsigned char *output, int capacity,
+				   int *treeSize, int *compressedSize);
+int splitDecompress( unsigned char *input, int treeSize, int compressedSize, unsigned char *output, int size);
+#endif	/* SPLIT_H */
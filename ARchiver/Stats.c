@@ -0,0 +1,414 @@
+/**
+ * @file   Stats.c
+ * @author Adrian Rasmussen
+ *
+ * @brief Times the stages of coding a block, to find out which one a slow job is spending its time in. Each
+ *		  thread opens its own perf_event_open group on first use, with cycles leading instructions, cache
+ *		  misses and branch misses, so a stage costs two reads of the group. Where perf_event_open is missing
+ *		  or not permitted, only clock_gettime is used. Every measurement goes to the callback as it is made.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include "Stats.h"
+#include "Memory.h"
+#include "Kernels.h"
+
+#if defined(__linux__) && defined(__GNUC__) && defined(__has_include)
+#if __has_include(<linux/perf_event.h>)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#ifdef __NR_perf_event_open
+#define AR_STATS_PERF
+#endif
+#endif
+#endif
+
+static const char *stageNames[AR_NUM_STAGES] = { "read", "histogram", "tree", "encode", "read tree", "decode", "write" };
+static ar_stats_callback callback;
+static void *callbackOpaque;
+
+static long long nanoseconds( void);
+static int readCounters( unsigned long long counters[AR_NUM_COUNTERS]);
+
+#ifdef AR_STATS_PERF
+/*A thread's counters*/
+typedef struct CounterGroup
+{
+	int fds[AR_NUM_COUNTERS];  /* File descriptors, -1 where not open */
+} CounterGroup;
+
+static pthread_key_t groupKey;
+static pthread_once_t groupOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Method:    closeGroup
+ * FullName:  closeGroup
+ * Access:    private
+ * @brief     Closes a thread's counters when the thread exits
+ * @param 	  group - the thread's CounterGroup
+ **/
+static void closeGroup( void *group)
+{
+	CounterGroup *counters = (CounterGroup*) group;
+	int i;
+
+	for ( i = 0; i < AR_NUM_COUNTERS; i++)
+	{
+		if ( counters->fds[i] >= 0)
+		{
+			close(counters->fds[i]);
+		}
+	}
+	arFree(counters);
+}
+
+/**
+ * Method:    makeGroupKey
+ * FullName:  makeGroupKey
+ * Access:    private
+ **/
+static void makeGroupKey( void)
+{
+	pthread_key_create(&groupKey, &closeGroup);
+}
+
+/**
+ * Method:    openGroup
+ * FullName:  openGroup
+ * Access:    private
+ * @brief     Opens the calling thread's counters. Kernel time is left out so perf_event_paranoid 2, the usual
+ *			  default, still allows it
+ * @return    the thread's counters, with the first file descriptor -1 if they could not be opened, or NULL if
+ *			  there was no memory for them
+ **/
+static CounterGroup* openGroup( void)
+{
+	static const unsigned long long events[AR_NUM_COUNTERS] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+																PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+	struct perf_event_attr attr;
+	CounterGroup *group;
+	ar_allocator previous;
+	int *fds;
+	int i;
+
+	/*Kept until the thread exits, so it comes from the codec's heap rather than a caller's allocator*/
+	setThreadAllocator(NULL, &previous);
+	group = (CounterGroup*) arMalloc(sizeof(CounterGroup));
+	setThreadAllocator(&previous, NULL);
+	if ( group == NULL)
+	{
+		return NULL;
+	}
+	fds = group->fds;
+	for ( i = 0; i < AR_NUM_COUNTERS; i++)
+	{
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = events[i];
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP;
+		fds[i] = (int) syscall(__NR_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0);
+		if ( fds[i] < 0)
+		{
+			/*All or nothing, so every sample has the same counters*/
+			while ( --i >= 0)
+			{
+				close(fds[i]);
+			}
+			fds[0] = -1;
+			for ( i = 1; i < AR_NUM_COUNTERS; i++)
+			{
+				fds[i] = -1;
+			}
+			break;
+		}
+	}
+	pthread_setspecific(groupKey, group);
+	return group;
+}
+#endif
+
+/**
+ * Method:    setStatsCallback
+ * FullName:  setStatsCallback
+ * Access:    public
+ * @brief     Starts or stops measuring. Should only be called while no blocks are being coded
+ * @param 	  statsCallback - called with every measurement, or NULL to stop measuring
+ * @param 	  opaque - passed to the callback
+ **/
+void setStatsCallback( ar_stats_callback statsCallback, void *opaque)
+{
+	callbackOpaque = opaque;
+	callback = statsCallback;
+}
+
+/**
+ * Method:    statsEnabled
+ * FullName:  statsEnabled
+ * Access:    public
+ * @return    1 if stages are being measured
+ **/
+int statsEnabled( void)
+{
+	return callback != NULL;
+}
+
+/**
+ * Method:    nanoseconds
+ * FullName:  nanoseconds
+ * Access:    private
+ * @return    the monotonic clock in nanoseconds
+ **/
+static long long nanoseconds( void)
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (long long) time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+/**
+ * Method:    readCounters
+ * FullName:  readCounters
+ * Access:    private
+ * @param 	  counters - set to the calling thread's counters
+ * @return    1 if they were read, 0 if this thread has none
+ **/
+static int readCounters( unsigned long long counters[AR_NUM_COUNTERS])
+{
+#ifdef AR_STATS_PERF
+	unsigned long long values[1 + AR_NUM_COUNTERS];
+	CounterGroup *group;
+
+	pthread_once(&groupOnce, &makeGroupKey);
+	group = (CounterGroup*) pthread_getspecific(groupKey);
+	if ( group == NULL)
+	{
+		group = openGroup();
+	}
+	if ( group != NULL && group->fds[0] >= 0 && read(group->fds[0], values, sizeof(values)) == (ssize_t) sizeof(values) &&
+		 values[0] == AR_NUM_COUNTERS)
+	{
+		memcpy(counters, values + 1, sizeof(values) - sizeof(values[0]));
+		return 1;
+	}
+#endif
+	memset(counters, 0, AR_NUM_COUNTERS * sizeof(counters[0]));
+	return 0;
+}
+
+/**
+ * Method:    startStage
+ * FullName:  startStage
+ * Access:    public
+ * @brief     Starts timing a stage, does nothing unless a callback is set. Allocations by the calling
+ *			  thread are counted against the stage until it ends
+ * @param 	  timer - timer to start
+ * @param 	  stage - AR_STAGE_*
+ **/
+void startStage( StageTimer *timer, int stage)
+{
+	if ( callback == NULL)
+	{
+		return;
+	}
+	timer->stage = stage;
+	setMemoryStage(stage);
+	threadAllocations(&timer->allocations, &timer->allocatedBytes);
+	timer->hardware = readCounters(timer->counters);
+	timer->start = nanoseconds();
+}
+
+/**
+ * Method:    endStage
+ * FullName:  endStage
+ * Access:    public
+ * @brief     Stops timing a stage and passes the measurement to the callback
+ * @param 	  timer - timer started by {@link startStage}
+ * @param 	  bytes - bytes the stage worked on
+ **/
+void endStage( StageTimer *timer, long long bytes)
+{
+	endCodingStage(timer, NULL, bytes, 0);
+}
+
+/**
+ * Method:    endCodingStage
+ * FullName:  endCodingStage
+ * Access:    public
+ * @brief     Stops timing an encode or decode stage. The entropy of the block is worked out after the clock
+ *			  has stopped, so it is not counted in the stage
+ * @param 	  timer - timer started by {@link startStage}
+ * @param 	  data - the uncompressed block, or NULL for a stage that doesn't code
+ * @param 	  size - bytes the stage worked on
+ * @param 	  codedBits - size of the coded data in bits, without the tree
+ **/
+void endCodingStage( StageTimer *timer, const unsigned char *data, long long size, long long codedBits)
+{
+	unsigned long long counters[AR_NUM_COUNTERS];
+	ar_stage_stats stats;
+	long long allocations, allocatedBytes;
+	int counts[256];
+	int i;
+
+	if ( callback == NULL)
+	{
+		return;
+	}
+	memset(&stats, 0, sizeof(stats));
+	stats.nanoseconds = (unsigned long long) (nanoseconds() - timer->start);
+	stats.hardware = timer->hardware && readCounters(counters);
+	if ( stats.hardware)
+	{
+		stats.cycles = counters[0] - timer->counters[0];
+		stats.instructions = counters[1] - timer->counters[1];
+		stats.cacheMisses = counters[2] - timer->counters[2];
+		stats.branchMisses = counters[3] - timer->counters[3];
+	}
+	threadAllocations(&allocations, &allocatedBytes);
+	setMemoryStage(AR_MEMORY_OTHER);
+	stats.allocations = (unsigned long long) (allocations - timer->allocations);
+	stats.allocatedBytes = (unsigned long long) (allocatedBytes - timer->allocatedBytes);
+	stats.stage = stageNames[timer->stage];
+	stats.bytes = (unsigned long long) size;
+	if ( data != NULL && size > 0)
+	{
+		countBytes(data, (int) size, counts);
+		for ( i = 0; i < 256; i++)
+		{
+			if ( counts[i] > 0)
+			{
+				stats.entropyBits -= counts[i] * log2((double) counts[i] / size);
+			}
+		}
+		stats.symbols = (unsigned long long) size;
+		stats.codedBits = (double) codedBits;
+	}
+	callback(callbackOpaque, &stats);
+}
+
+/**
+ * Method:    initStatsTable
+ * FullName:  initStatsTable
+ * Access:    public
+ * @param 	  table - table to empty
+ **/
+void initStatsTable( StatsTable *table)
+{
+	memset(table, 0, sizeof(*table));
+	pthread_mutex_init(&table->mutex, NULL);
+}
+
+/**
+ * Method:    collectStats
+ * FullName:  collectStats
+ * Access:    public
+ * @brief     Callback for --stats, adds a measurement to its stage's totals
+ * @param 	  opaque - the StatsTable
+ * @param 	  stats - the measurement
+ **/
+void collectStats( void *opaque, const ar_stage_stats *stats)
+{
+	StatsTable *table = (StatsTable*) opaque;
+	ar_stage_stats *total;
+	int stage;
+
+	for ( stage = 0; stage < AR_NUM_STAGES && strcmp(stageNames[stage], stats->stage) != 0; stage++)
+	{
+	}
+	if ( stage == AR_NUM_STAGES)
+	{
+		return;
+	}
+	pthread_mutex_lock(&table->mutex);
+	total = &table->totals[stage];
+	table->calls[stage]++;
+	total->hardware += stats->hardware;
+	total->nanoseconds += stats->nanoseconds;
+	total->bytes += stats->bytes;
+	total->cycles += stats->cycles;
+	total->instructions += stats->instructions;
+	total->cacheMisses += stats->cacheMisses;
+	total->branchMisses += stats->branchMisses;
+	total->allocations += stats->allocations;
+	total->allocatedBytes += stats->allocatedBytes;
+	total->symbols += stats->symbols;
+	total->entropyBits += stats->entropyBits;
+	total->codedBits += stats->codedBits;
+	pthread_mutex_unlock(&table->mutex);
+}
+
+/**
+ * Method:    printStats
+ * FullName:  printStats
+ * Access:    public
+ * @brief     Prints the totals of each stage that ran, for --stats, then the memory each stage allocated. Times
+ *			  are summed over all threads, so with several coder threads the coding stages can add up to more
+ *			  than the job took
+ * @param 	  output - stream to print to
+ * @param 	  table - totals from {@link collectStats}
+ **/
+void printStats( FILE *output, StatsTable *table)
+{
+	const ar_stage_stats *total;
+	MemoryStats memory[AR_MEMORY_SLOTS];
+	int stage, hardware = 0;
+
+	fprintf(output, "Stage       Calls         MB        ms     MB/s        Cycles  Instructions   IPC  Cache misses  Branch misses  Entropy  Coded\n");
+	for ( stage = 0; stage < AR_NUM_STAGES; stage++)
+	{
+		total = &table->totals[stage];
+		if ( table->calls[stage] == 0)
+		{
+			continue;
+		}
+		fprintf(output, "%-10s %6llu %10.2f %9.2f %8.1f", stageNames[stage], table->calls[stage], total->bytes / 1e6,
+				total->nanoseconds / 1e6, total->nanoseconds > 0 ? total->bytes * 1e3 / total->nanoseconds : 0.0);
+		if ( (unsigned long long) total->hardware == table->calls[stage])
+		{
+			fprintf(output, " %13llu %13llu %5.2f %13llu %14llu", total->cycles, total->instructions,
+					total->cycles > 0 ? (double) total->instructions / total->cycles : 0.0,
+					total->cacheMisses, total->branchMisses);
+			hardware = 1;
+		}
+		else
+		{
+			fprintf(output, " %13s %13s %5s %13s %14s", "-", "-", "-", "-", "-");
+		}
+		if ( total->symbols > 0)
+		{
+			/*Bits per symbol*/
+			fprintf(output, " %8.3f %6.3f\n", total->entropyBits / total->symbols, total->codedBits / total->symbols);
+		}
+		else
+		{
+			fprintf(output, " %8s %6s\n", "-", "-");
+		}
+	}
+	if ( !hardware)
+	{
+		fprintf(output, "Hardware counters unavailable (perf_event_open not supported or not permitted), times are from clock_gettime\n");
+	}
+	fprintf(output, "Times are summed over all threads. Entropy and coded are bits per symbol, coded without the tree\n");
+
+	/*Memory is counted whether or not a stage ran, so anything left over shows up under other*/
+	getMemoryStats(memory);
+	fprintf(output, "\nMemory     Allocations  Allocated MB   Peak MB  In use MB\n");
+	for ( stage = 0; stage < AR_MEMORY_SLOTS; stage++)
+	{
+		if ( memory[stage].allocations > 0 || stage == AR_MEMORY_TOTAL)
+		{
+			fprintf(output, "%-10s %11lld %13.2f %9.2f %10.2f\n", stage < AR_NUM_STAGES ? stageNames[stage] :
+					stage == AR_MEMORY_OTHER ? "other" : "total", memory[stage].allocations, memory[stage].bytes / 1e6,
+					memory[stage].peak / 1e6, memory[stage].inUse / 1e6);
+		}
+	}
+	fprintf(output, "Peak is the most held at once, in use is what is still held now\n");
+}
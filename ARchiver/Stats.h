@@ -0,0 +1,53 @@
+/*
+ * File:   Stats.h
+ * Author: adrian
+ *
+ * Per stage timing for --stats and ar_set_stats_callback(). Each stage of each block
+ * is timed with clock_gettime, and on Linux also counted with perf_event_open where
+ * the kernel allows it, and its allocations are counted by Memory.c. Nothing is
+ * measured unless a callback is set.
+ */
+
+#ifndef STATS_H
+#define	STATS_H
+#include <stdio.h>
+#include <pthread.h>
+#include "libarchiver.h"
+
+#define AR_STAGE_READ 0  /* Reader stage of the pipeline */
+#define AR_STAGE_HISTOGRAM 1  /* Counting the bytes of a Huffman block */
+#define AR_STAGE_TREE 2  /* Building its codes and serialized tree */
+#define AR_STAGE_ENCODE 3  /* Coding a block, the whole of it for LZ77, BWT and delta blocks */
+#define AR_STAGE_READ_TREE 4  /* Building a Huffman block's decode table from its tree */
+#define AR_STAGE_DECODE 5  /* Decoding a block */
+#define AR_STAGE_WRITE 6  /* Writer stage of the pipeline */
+#define AR_NUM_STAGES 7
+#define AR_NUM_COUNTERS 4  /* cycles, instructions, cache misses, branch misses */
+
+typedef struct StageTimer
+{
+	int stage;  /* AR_STAGE_* */
+	long long start;  /* Nanoseconds */
+	long long allocations;  /* The thread's allocation counts at the start */
+	long long allocatedBytes;
+	unsigned long long counters[AR_NUM_COUNTERS];
+	int hardware;  /* 1 if counters were read */
+} StageTimer;
+
+/* Totals for --stats */
+typedef struct StatsTable
+{
+	pthread_mutex_t mutex;
+	ar_stage_stats totals[AR_NUM_STAGES];  /* hardware counts the samples that had counters */
+	unsigned long long calls[AR_NUM_STAGES];
+} StatsTable;
+
+void setStatsCallback( ar_stats_callback callback, void *opaque);
+int statsEnabled( void);
+void startStage( StageTimer *timer, int stage);
+void endStage( StageTimer *timer, long long bytes);
+void endCodingStage( StageTimer *timer, const unsigned char *data, long long size, long long codedBits);
+void initStatsTable( StatsTable *table);
+void collectStats( void *opaque, const ar_stage_stats *stats);
+void printStats( FILE *output, StatsTable *table);
+#endif	/* STATS_H */
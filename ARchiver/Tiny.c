@@ -0,0 +1,275 @@
+/**
+ * @file   Tiny.c
+ * @author Adrian Rasmussen
+ *
+ * @brief Compact frames for small messages. A full archive spends 88 bytes on its header, 24 on the block header,
+ *		  up to 3 KB on the tree and 288 on the index, so a 200 byte message never gets smaller. A compact frame
+ *		  spends a tag byte, one or two bytes of size and a 4 byte checksum. Its data is stored, stored once if it
+ *		  is a single byte repeated, or coded with a Huffman table built into the program, trained on JSON, log
+ *		  lines, HTTP headers and English text. That table is a fixed list of code lengths with canonical codes,
+ *		  so it never changes with how trees are built, and its decode table is made once per process, so no
+ *		  message builds, sends or reads a tree. Whichever mode is smallest is used, so a frame is never more than
+ *		  7 bytes bigger than its data.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "Tiny.h"
+#include "ARHeader.h"
+#include "Huffman.h"
+#include "Kernels.h"
+#include "Crc32c.h"
+#include "Format.h"
+#include "Memory.h"
+#include "Report.h"
+
+/* Code length of each byte in the built in table. Made once from byte counts of the samples, with every byte
+   counted at least once so any data can be coded. Codes are canonical: shorter first, then lower bytes first */
+static const unsigned char trainedLengths[256] =
+{
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 6, 15, 15, 7, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	4, 11, 4, 15, 15, 15, 15, 15, 15, 15, 8, 15, 6, 6, 6, 6,
+	5, 5, 5, 6, 5, 6, 6, 6, 6, 6, 5, 15, 15, 15, 15, 11,
+	15, 8, 8, 8, 9, 7, 9, 9, 9, 9, 15, 15, 9, 13, 8, 8,
+	9, 15, 9, 10, 7, 8, 15, 10, 15, 14, 15, 7, 15, 7, 15, 15,
+	15, 5, 8, 6, 6, 4, 8, 7, 6, 5, 9, 7, 6, 6, 5, 5,
+	6, 15, 5, 5, 5, 6, 7, 7, 10, 7, 15, 7, 15, 7, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15
+};
+
+/* The built in table, in the forms packCodes and decodeBytes take. Kept for the life of the process */
+typedef struct TrainedTable
+{
+	int ready;  /* 0 if memory could not be allocated for it */
+	unsigned long long codes[256];
+	DecodeTable table;
+} TrainedTable;
+
+static TrainedTable trained;
+static pthread_once_t trainedOnce = PTHREAD_ONCE_INIT;
+
+static void buildTrainedTable( void);
+static int readFrameHeader( const unsigned char *frame, size_t frameSize, int *size);
+
+/**
+ * Method:    buildTrainedTable
+ * FullName:  buildTrainedTable
+ * Access:    private
+ * @brief     Gives each byte its canonical code, then builds the tree of the codes and its decode table. Run once,
+ *			  by whichever thread needs it first. The table is kept until the program exits, so it comes from malloc
+ *			  even when the thread is running the library API with the caller's allocator
+ **/
+static void buildTrainedTable( void)
+{
+	HuffNodeSerial *serial;
+	ar_allocator previous;
+	int serialSize;
+
+	setThreadAllocator(NULL, &previous);
+	canonicalCodes(trainedLengths, 256, trained.codes);
+	serial = serializeLengths(trainedLengths, trained.codes, 256, &serialSize);
+	if ( serial != NULL && buildDecodeTable(serial, serialSize, 256, &trained.table) == EXIT_SUCCESS)
+	{
+		trained.ready = 1;
+	}
+	arFree(serial);
+	setThreadAllocator(&previous, NULL);
+}
+
+/**
+ * Method:    isTinyTag
+ * FullName:  isTinyTag
+ * Access:    public
+ * @param 	  byte - first byte of an archive, or EOF
+ * @return    1 if it starts a compact frame, otherwise 0
+ **/
+int isTinyTag( int byte)
+{
+	return byte >= 0 && (byte & 0xE0) == AR_TINY_TAG && (byte & 3) != 0;
+}
+
+/**
+ * Method:    tinyCompress
+ * FullName:  tinyCompress
+ * Access:    public
+ * @brief     Writes data as a compact frame, with whichever mode makes it smallest
+ * @param 	  input - data to compress
+ * @param 	  size - bytes of input, at most AR_TINY_MAX
+ * @param 	  output - buffer for the frame
+ * @param 	  capacity - size of output, AR_TINY_BOUND(size) is always enough
+ * @param 	  outputSize - set to the size of the frame
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if size is too big or the frame did not fit
+ **/
+int tinyCompress( const unsigned char *input, int size, unsigned char *output, int capacity, int *outputSize)
+{
+	int header, payload, mode, sizeBits, i;
+
+	*outputSize = 0;
+	if ( size < 0 || size > AR_TINY_MAX || capacity < 3)
+	{
+		return EXIT_FAILURE;
+	}
+	/*Size goes 7 bits at a time, lowest first, with the top bit set on all but the last byte*/
+	if ( size >= 0x80)
+	{
+		output[1] = (unsigned char) ((size & 0x7F) | 0x80);
+		output[2] = (unsigned char) (size >> 7);
+		header = 3;
+	}
+	else
+	{
+		output[1] = (unsigned char) size;
+		header = 2;
+	}
+
+	for ( i = 1; i < size && input[i] == input[0]; i++)
+	{
+	}
+	mode = AR_TINY_RAW;
+	payload = size;
+	sizeBits = 0;
+	if ( size > 1 && i == size)
+	{
+		mode = AR_TINY_RUN;
+		payload = 1;
+	}
+	else if ( size > 1)
+	{
+		pthread_once(&trainedOnce, &buildTrainedTable);
+		/*Only worth it if it saves a byte*/
+		if ( trained.ready &&
+			 packCodes(input, size, trained.codes, trainedLengths, output + header, size - 1 < capacity - header - 4 ?
+					   size - 1 : capacity - header - 4, &sizeBits) == EXIT_SUCCESS)
+		{
+			mode = AR_TINY_TRAINED;
+			payload = (sizeBits + 7) / 8;
+		}
+	}
+	if ( header + payload + 4 > capacity)
+	{
+		return EXIT_FAILURE;
+	}
+	if ( mode != AR_TINY_TRAINED)
+	{
+		memcpy(output + header, input, payload);
+	}
+	output[0] = (unsigned char) (AR_TINY_TAG | (mode == AR_TINY_TRAINED ? (8 * payload - sizeBits) << 2 : 0) | mode);
+	putLE32(output + header + payload, crc32c(0, input, size));
+	*outputSize = header + payload + 4;
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    readFrameHeader
+ * FullName:  readFrameHeader
+ * Access:    private
+ * @brief     Reads the tag and size of a frame
+ * @param 	  frame - the frame
+ * @param 	  frameSize - bytes of frame
+ * @param 	  size - set to the size of the data
+ * @return    bytes of tag and size, or -1 if they are invalid
+ **/
+static int readFrameHeader( const unsigned char *frame, size_t frameSize, int *size)
+{
+	/*Tag, one byte of size and the checksum*/
+	if ( frameSize < 6 || !isTinyTag(frame[0]))
+	{
+		return -1;
+	}
+	*size = frame[1] & 0x7F;
+	if ( !(frame[1] & 0x80))
+	{
+		return 2;
+	}
+	*size |= frame[2] << 7;
+	/*Only AR_TINY_MAX fits in two bytes, and a second byte of 0 would be a longer way to write a small size*/
+	return frame[2] == 0 || *size > AR_TINY_MAX ? -1 : 3;
+}
+
+/**
+ * Method:    tinySize
+ * FullName:  tinySize
+ * Access:    public
+ * @param 	  frame - a compact frame
+ * @param 	  frameSize - bytes of frame
+ * @return    size of the data the frame holds, or -1 if it is not a compact frame
+ **/
+int tinySize( const unsigned char *frame, size_t frameSize)
+{
+	int size;
+
+	return readFrameHeader(frame, frameSize, &size) < 0 ? -1 : size;
+}
+
+/**
+ * Method:    tinyDecompress
+ * FullName:  tinyDecompress
+ * Access:    public
+ * @brief     Decodes a compact frame, and checks it against its checksum. Nothing may follow the frame
+ * @param 	  frame - the frame
+ * @param 	  frameSize - size of the frame
+ * @param 	  output - buffer for the data
+ * @param 	  capacity - size of output, at least {@link tinySize}
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the frame is corrupt or the data does not fit
+ **/
+int tinyDecompress( const unsigned char *frame, size_t frameSize, unsigned char *output, int capacity)
+{
+	int header, size, payload, mode, padding;
+
+	header = readFrameHeader(frame, frameSize, &size);
+	if ( header < 0 || frameSize < (size_t) header + 4)
+	{
+		reportError("Not a valid .ar file\n");
+		return EXIT_FAILURE;
+	}
+	if ( size > capacity)
+	{
+		return EXIT_FAILURE;
+	}
+	payload = (int) frameSize - header - 4;
+	mode = frame[0] & 3;
+	padding = (frame[0] >> 2) & 7;
+	if ( mode == AR_TINY_RAW && payload == size && padding == 0)
+	{
+		memcpy(output, frame + header, size);
+	}
+	else if ( mode == AR_TINY_RUN && payload == 1 && padding == 0 && size > 1)
+	{
+		memset(output, frame[header], size);
+	}
+	else if ( mode == AR_TINY_TRAINED && payload > 0 && payload < size)
+	{
+		pthread_once(&trainedOnce, &buildTrainedTable);
+		if ( !trained.ready)
+		{
+			reportError("Could not allocate memory for the built in table\n");
+			return EXIT_FAILURE;
+		}
+		if ( decodeBytes(frame + header, 8 * payload - padding, output, size, &trained.table) != size)
+		{
+			reportError("Not a valid .ar file, data does not match the built in table\n");
+			return EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		reportError("Not a valid .ar file, bad compact frame\n");
+		return EXIT_FAILURE;
+	}
+
+	if ( crc32c(0, output, size) != getLE32(frame + header + payload))
+	{
+		reportError("Archive is corrupt, data does not match its checksum\n");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,22 @@
+/*
+ * File:   Tiny.h
+ * Author: adrian
+ *
+ * Compact frames for inputs of at most AR_TINY_MAX bytes, where the archive header,
+ * block header, tree and index would cost more than the data. A frame is the tag
+ * byte, the size as a varint, the data as the tag says and a CRC32C of the data.
+ */
+
+#ifndef TINY_H
+#define	TINY_H
+#include <stddef.h>
+
+#define AR_TINY_MAX 1024  /* Largest input given a compact frame */
+#define AR_TINY_BOUND(size) (1 + 2 + (size) + 4)  /* Largest frame for size bytes, a varint of AR_TINY_MAX is 2 bytes */
+#define AR_TINY_FRAME_MAX AR_TINY_BOUND(AR_TINY_MAX)
+
+int isTinyTag( int byte);
+int tinyCompress( const unsigned char *input, int size, unsigned char *output, int capacity, int *outputSize);
+int tinySize( const unsigned char *frame, size_t frameSize);
+int tinyDecompress( const unsigned char *frame, size_t frameSize, unsigned char *output, int capacity);
+#endif	/* TINY_H */
@@ -0,0 +1,451 @@
+/**
+ * @file   Words.c
+ * @author Adrian Rasmussen
+ *
+ * @brief Word token coding for text and logs, where a few thousand words make up most of the data. The block
+ *		  is cut into words, runs of letters, digits, '_' and UTF-8 bytes, and single bytes of anything else,
+ *		  and each word is counted in an open addressing hash table. Words that save more than their place in
+ *		  the dictionary costs, going by the bits their bytes would take as literals, become the symbols from
+ *		  256 up. One Huffman tree codes those and the literal bytes 0 to 255, which are the escape every other
+ *		  byte is sent with.
+ *		  The trees section is [int words][int dictionary size][dictionary][tree], the dictionary holding each
+ *		  word's length in a byte and then its bytes, in symbol order.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "Words.h"
+#include "Huffman.h"
+#include "Bits.h"
+#include "Kernels.h"
+#include "Format.h"
+#include "Memory.h"
+#include "Report.h"
+
+#define AR_WORDS_MIN_TABLE 1024  /* Fewest hash table slots */
+
+/* Hash table slot of a word, found by its bytes in the block */
+typedef struct WordSlot
+{
+	int offset;  /* Position of the word's first occurrence, or -1 if the slot is empty */
+	int length;
+	int count;  /* Occurrences, then once the dictionary is chosen its symbol less 256, or -1 if it is not in it */
+} WordSlot;
+
+/* A word that may go in the dictionary */
+typedef struct Candidate
+{
+	double gain;  /* Estimated bits saved by giving it a symbol */
+	int slot;
+} Candidate;
+
+static int isWordByte( unsigned char byte);
+static int tableSlots( int blockSize);
+static int findWord( WordSlot *slots, int mask, const unsigned char *input, int offset, int length, int *numWords);
+static int compareCandidates( const void *a, const void *b);
+
+/**
+ * Method:    isWordByte
+ * FullName:  isWordByte
+ * Access:    private
+ * @param 	  byte - a byte of the block
+ * @return    1 if the byte can be part of a word, otherwise 0
+ **/
+static int isWordByte( unsigned char byte)
+{
+	return (byte >= 'a' && byte <= 'z') || (byte >= 'A' && byte <= 'Z') || (byte >= '0' && byte <= '9') ||
+		   byte == '_' || byte >= 0x80;
+}
+
+/**
+ * Method:    tableSlots
+ * FullName:  tableSlots
+ * Access:    private
+ * @param 	  blockSize - size of the block
+ * @return    number of hash table slots to use for the block, a power of two
+ **/
+static int tableSlots( int blockSize)
+{
+	int slots = AR_WORDS_MIN_TABLE;
+
+	while ( slots < blockSize / 4)
+	{
+		slots *= 2;
+	}
+	return slots;
+}
+
+/**
+ * Method:    findWord
+ * FullName:  findWord
+ * Access:    private
+ * @brief     Looks a word up in the hash table by its bytes, adding it if it is new. The table is only filled to
+ *			  three quarters, so lookups stay short
+ * @param 	  slots - the hash table
+ * @param 	  mask - number of slots less one
+ * @param 	  input - the block
+ * @param 	  offset - position of the word
+ * @param 	  length - length of the word
+ * @param 	  numWords - number of words in the table, increased if one is added
+ * @return    the word's slot, or -1 if it is new and the table is full
+ **/
+static int findWord( WordSlot *slots, int mask, const unsigned char *input, int offset, int length, int *numWords)
+{
+	unsigned int hash = 2166136261u;
+	int i, slot;
+
+	/*FNV-1a*/
+	for ( i = 0; i < length; i++)
+	{
+		hash = (hash ^ input[offset + i]) * 16777619u;
+	}
+	for ( slot = (int) (hash & (unsigned int) mask); slots[slot].offset >= 0; slot = (slot + 1) & mask)
+	{
+		if ( slots[slot].length == length && memcmp(input + slots[slot].offset, input + offset, length) == 0)
+		{
+			return slot;
+		}
+	}
+	if ( *numWords >= (mask + 1) / 4 * 3)
+	{
+		return -1;
+	}
+	slots[slot].offset = offset;
+	slots[slot].length = length;
+	slots[slot].count = 0;
+	(*numWords)++;
+	return slot;
+}
+
+/**
+ * Method:    compareCandidates
+ * FullName:  compareCandidates
+ * Access:    private
+ * @brief     Orders candidates by most bits saved, then by slot so the order never depends on qsort
+ * @param 	  a - a Candidate
+ * @param 	  b - another Candidate
+ * @return    negative if a goes first, positive if b does
+ **/
+static int compareCandidates( const void *a, const void *b)
+{
+	const Candidate *first = (const Candidate*) a, *second = (const Candidate*) b;
+
+	if ( first->gain != second->gain)
+	{
+		return first->gain > second->gain ? -1 : 1;
+	}
+	return first->slot - second->slot;
+}
+
+/**
+ * Method:    wordsMemory
+ * FullName:  wordsMemory
+ * Access:    public
+ * @param 	  blockSize - uncompressed bytes per block
+ * @return    bytes {@link wordsCompress} allocates for a block of that size, less the serialized tree
+ **/
+long long wordsMemory( int blockSize)
+{
+	long long slots = tableSlots(blockSize);
+
+	return slots * (long long) sizeof(WordSlot) + slots / 4 * 3 * (long long) sizeof(Candidate) +
+		   (long long) blockSize * (long long) sizeof(int) + AR_WORDS_SYMBOLS * (long long) (sizeof(int) + sizeof(unsigned long long) + 1);
+}
+
+/**
+ * Method:    wordsCompress
+ * FullName:  wordsCompress
+ * Access:    public
+ * @brief     Builds the block's dictionary and Huffman codes its words and literal bytes, as described at the top
+ *			  of this file
+ * @param 	  input - the block
+ * @param 	  size - size of the block
+ * @param 	  output - buffer to save the trees section and codes to
+ * @param 	  capacity - size of output
+ * @param 	  treeSize - location to save the size of the trees section to, in bytes
+ * @param 	  compressedSize - location to save the size of the codes to, in bits without padding
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if no word is worth a symbol, the result did not fit in capacity or
+ *			  memory could not be allocated
+ **/
+int wordsCompress( unsigned char *input, int size, unsigned char *output, int capacity, int *treeSize, int *compressedSize)
+{
+	WordSlot *slots, *word;
+	Candidate *candidates;
+	HuffNodeSerial *serial;
+	BitWriter writer;
+	unsigned long long *codes;
+	unsigned char *lengths;
+	int *tokens, *counts;
+	int byteCounts[256];
+	double byteBits[256], bits;
+	int numSlots, numWords, numTokens, numCandidates, numDict, dictSize, serialSize;
+	int pos, end, slot, i, j, status;
+	unsigned char *dict;
+
+	numSlots = tableSlots(size);
+	slots = (WordSlot*) arMalloc(numSlots * sizeof(WordSlot));
+	candidates = (Candidate*) arMalloc(numSlots / 4 * 3 * sizeof(Candidate));
+	tokens = (int*) arMalloc(size * sizeof(int));
+	counts = (int*) arMalloc(AR_WORDS_SYMBOLS * sizeof(int));
+	codes = (unsigned long long*) arMalloc(AR_WORDS_SYMBOLS * sizeof(unsigned long long));
+	lengths = (unsigned char*) arMalloc(AR_WORDS_SYMBOLS);
+	if ( slots == NULL || candidates == NULL || tokens == NULL || counts == NULL || codes == NULL || lengths == NULL)
+	{
+		reportError("Could not allocate memory for word tokens\n");
+		arFree(slots);
+		arFree(candidates);
+		arFree(tokens);
+		arFree(counts);
+		arFree(codes);
+		arFree(lengths);
+		return EXIT_FAILURE;
+	}
+
+	/*Cut the block into words and single bytes, counting each word. Tokens are a word's slot, or -1 less a byte*/
+	for ( i = 0; i < numSlots; i++)
+	{
+		slots[i].offset = -1;
+	}
+	numWords = 0;
+	numTokens = 0;
+	pos = 0;
+	while ( pos < size)
+	{
+		for ( end = pos; end < size && end - pos < AR_WORDS_MAX_LENGTH && isWordByte(input[end]); end++)
+		{
+		}
+		slot = end - pos >= AR_WORDS_MIN_LENGTH ? findWord(slots, numSlots - 1, input, pos, end - pos, &numWords) : -1;
+		if ( slot >= 0)
+		{
+			slots[slot].count++;
+			tokens[numTokens++] = slot;
+			pos = end;
+		}
+		else
+		{
+			/*Punctuation, short words and words the full table had no room for are literals*/
+			for ( end = end > pos ? end : pos + 1; pos < end; pos++)
+			{
+				tokens[numTokens++] = -1 - input[pos];
+			}
+		}
+	}
+
+	/*Estimate what each word saves from the bits its bytes would take as literals, less its dictionary entry
+	  and the two tree nodes its symbol adds*/
+	countBytes(input, size, byteCounts);
+	for ( i = 0; i < 256; i++)
+	{
+		byteBits[i] = byteCounts[i] > 0 ? log2((double) size / byteCounts[i]) : 8.0;
+	}
+	numCandidates = 0;
+	for ( i = 0; i < numSlots; i++)
+	{
+		word = &slots[i];
+		if ( word->offset >= 0 && word->count >= 2)
+		{
+			bits = 0;
+			for ( j = 0; j < word->length; j++)
+			{
+				bits += byteBits[input[word->offset + j]];
+			}
+			candidates[numCandidates].gain = word->count * (bits - log2((double) numTokens / word->count)) -
+											 8.0 * (word->length + 1 + 2 * (int) sizeof(HuffNodeSerial));
+			candidates[numCandidates].slot = i;
+			if ( candidates[numCandidates].gain > 0)
+			{
+				numCandidates++;
+			}
+		}
+		word->count = -1;
+	}
+	qsort(candidates, numCandidates, sizeof(Candidate), &compareCandidates);
+	numDict = numCandidates < AR_WORDS_MAX_TOKENS ? numCandidates : AR_WORDS_MAX_TOKENS;
+	dictSize = 0;
+	for ( i = 0; i < numDict; i++)
+	{
+		slots[candidates[i].slot].count = i;
+		dictSize += 1 + slots[candidates[i].slot].length;
+	}
+
+	/*Count the symbols, with words outside the dictionary as their bytes*/
+	memset(counts, 0, AR_WORDS_SYMBOLS * sizeof(int));
+	for ( i = 0; i < numTokens; i++)
+	{
+		word = tokens[i] < 0 ? NULL : &slots[tokens[i]];
+		if ( word == NULL)
+		{
+			counts[-1 - tokens[i]]++;
+		}
+		else if ( word->count >= 0)
+		{
+			counts[256 + word->count]++;
+		}
+		else
+		{
+			for ( j = 0; j < word->length; j++)
+			{
+				counts[input[word->offset + j]]++;
+			}
+		}
+	}
+
+	serial = NULL;
+	serialSize = 0;
+	/*With no word worth a symbol, plain Huffman coding does as well*/
+	if ( numDict > 0)
+	{
+		serial = buildCodes(counts, 256 + numDict, lengths, codes, &serialSize);
+	}
+
+	status = EXIT_FAILURE;
+	*treeSize = 8 + dictSize + serialSize;
+	if ( serial != NULL && *treeSize < capacity)
+	{
+		putLE32(output, (unsigned int) numDict);
+		putLE32(output + 4, (unsigned int) dictSize);
+		dict = output + 8;
+		for ( i = 0; i < numDict; i++)
+		{
+			word = &slots[candidates[i].slot];
+			*dict++ = (unsigned char) word->length;
+			memcpy(dict, input + word->offset, word->length);
+			dict += word->length;
+		}
+		memcpy(dict, serial, serialSize);
+
+		initBitWriter(&writer, output + *treeSize, capacity - *treeSize);
+		for ( i = 0; i < numTokens && !writer.overflow; i++)
+		{
+			word = tokens[i] < 0 ? NULL : &slots[tokens[i]];
+			if ( word == NULL)
+			{
+				putCode(&writer, codes[-1 - tokens[i]], lengths[-1 - tokens[i]]);
+			}
+			else if ( word->count >= 0)
+			{
+				putCode(&writer, codes[256 + word->count], lengths[256 + word->count]);
+			}
+			else
+			{
+				for ( j = 0; j < word->length; j++)
+				{
+					putCode(&writer, codes[input[word->offset + j]], lengths[input[word->offset + j]]);
+				}
+			}
+		}
+		*compressedSize = flushBits(&writer);
+		if ( *compressedSize >= 0)
+		{
+			status = EXIT_SUCCESS;
+		}
+	}
+
+	arFree(serial);
+	arFree(slots);
+	arFree(candidates);
+	arFree(tokens);
+	arFree(counts);
+	arFree(codes);
+	arFree(lengths);
+	return status;
+}
+
+/**
+ * Method:    wordsDecompress
+ * FullName:  wordsDecompress
+ * Access:    public
+ * @brief     Reads the dictionary and builds a decode table from the tree, then decodes literals and words until the block is complete
+ * @param 	  input - the trees section followed by the codes
+ * @param 	  treeSize - size of the trees section in bytes
+ * @param 	  compressedSize - size of the codes in bits
+ * @param 	  output - buffer to save the block to
+ * @param 	  size - size of the block when uncompressed
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the data is corrupt or memory could not be allocated
+ **/
+int wordsDecompress( unsigned char *input, int treeSize, int compressedSize, unsigned char *output, int size)
+{
+	DecodeTable *table;
+	BitReader reader;
+	int *words;
+	int numDict, dictSize, offset, length, pos, symbol, i, status;
+
+	numDict = treeSize >= 8 ? (int) getLE32(input) : 0;
+	dictSize = treeSize >= 8 ? (int) getLE32(input + 4) : 0;
+	if ( numDict <= 0 || numDict > AR_WORDS_MAX_TOKENS || dictSize < numDict * (1 + AR_WORDS_MIN_LENGTH) ||
+		 dictSize > treeSize - 8)
+	{
+		reportError("Not a valid .ar file, bad word dictionary\n");
+		return EXIT_FAILURE;
+	}
+	words = (int*) arMalloc(numDict * sizeof(int));
+	table = (DecodeTable*) arMalloc(sizeof(DecodeTable));
+	if ( words == NULL || table == NULL)
+	{
+		reportError("Could not allocate memory for word dictionary\n");
+		arFree(words);
+		arFree(table);
+		return EXIT_FAILURE;
+	}
+
+	/*Find where each word starts*/
+	status = EXIT_SUCCESS;
+	offset = 8;
+	for ( i = 0; i < numDict && status == EXIT_SUCCESS; i++)
+	{
+		words[i] = offset;
+		length = input[offset];
+		if ( length < AR_WORDS_MIN_LENGTH || length > AR_WORDS_MAX_LENGTH || length >= 8 + dictSize - offset)
+		{
+			status = EXIT_FAILURE;
+		}
+		offset += 1 + length;
+	}
+	if ( status != EXIT_SUCCESS || offset != 8 + dictSize)
+	{
+		reportError("Not a valid .ar file, bad word dictionary\n");
+		arFree(words);
+		arFree(table);
+		return EXIT_FAILURE;
+	}
+	if ( buildDecodeTable((HuffNodeSerial*) (input + 8 + dictSize), treeSize - 8 - dictSize, 256 + numDict, table)
+		 != EXIT_SUCCESS)
+	{
+		reportError("Not a valid .ar file, bad word tree\n");
+		arFree(words);
+		arFree(table);
+		return EXIT_FAILURE;
+	}
+
+	initBitReader(&reader, input + treeSize, compressedSize);
+	status = EXIT_SUCCESS;
+	pos = 0;
+	while ( pos < size && status == EXIT_SUCCESS)
+	{
+		symbol = decodeSymbol(&reader, table);
+		if ( symbol >= 0 && symbol < 256)
+		{
+			output[pos++] = (unsigned char) symbol;
+		}
+		else if ( symbol >= 256 && symbol < 256 + numDict && input[words[symbol - 256]] <= size - pos)
+		{
+			length = input[words[symbol - 256]];
+			memcpy(output + pos, input + words[symbol - 256] + 1, length);
+			pos += length;
+		}
+		else
+		{
+			status = EXIT_FAILURE;
+		}
+	}
+	if ( status != EXIT_SUCCESS)
+	{
+		reportError("Not a valid .ar file, word block does not match its tree\n");
+	}
+
+	freeDecodeTable(table);
+	arFree(table);
+	arFree(words);
+	return status;
+}
@@ -0,0 +1,20 @@
+/*
+ * File:   Words.h
+ * Author: adrian
+ *
+ * Huffman coding of text as word tokens from a dictionary built for each block,
+ * with bytes of words outside the dictionary coded as literals
+ */
+
+#ifndef WORDS_H
+#define	WORDS_H
+
+#define AR_WORDS_MAX_TOKENS 16128  /* Largest dictionary, so symbols and tree indexes fit the 16 bit fields of HuffNodeSerial */
+#define AR_WORDS_SYMBOLS (256 + AR_WORDS_MAX_TOKENS)  /* 256 literal bytes, then one symbol per dictionary word */
+#define AR_WORDS_MIN_LENGTH 2  /* Shorter words are always literals */
+#define AR_WORDS_MAX_LENGTH 64  /* Longer words are split into pieces of this length */
+
+long long wordsMemory( int blockSize);
+int wordsCompress( unsigned char *input, int size, unsigned char *output, int capacity, int *treeSize, int *compressedSize);
+int wordsDecompress( unsigned char *input, int treeSize, int compressedSize, unsigned char *output, int size);
+#endif	/* WORDS_H */
@@ -0,0 +1,968 @@
+/**
+ * @file   bench.c
+ * @author Adrian Rasmussen
+ *
+ * @brief End to end benchmark. Generates a deterministic corpus of each kind, compresses and decompresses it
+ *		  in each mode, and prints MB/s, ratio, peak RSS and allocation counts as JSON. The stream mode goes
+ *		  through the ar_stream API at each level. The pipeline, words and dedup modes run the command line
+ *		  tool with -T and each thread count, and -1 to -9, -w or -D, then -d, so they measure the threaded
+ *		  pipeline, word tokens and deduplication as a user sees them. The corpus comes from a fixed seed, so every run and every machine sees the same bytes, and it
+ *		  is generated a chunk at a time, so sizes up to 4 GB need no more memory than 1 KB. Compressed data
+ *		  goes to a temporary file between the two phases. Each phase runs in its own child process, so its
+ *		  peak RSS is its own, and is repeated until it has taken at least --min-time seconds. Only the
+ *		  library calls are timed, not generating the corpus, checksumming or the temporary file.
+ *
+ *		  Allocations and the heap high-water mark come from the library's own counts in Memory.c. The tool
+ *		  modes time the whole process from fork to exit, including start up and reading and writing files,
+ *		  and have no allocation counts. They need the corpus in a file, so the temporary directory needs room
+ *		  for it, the archive and the output. Build and run with bench/run.sh, which builds the tool too.
+ *
+ *		  ./bench [--sizes 1K,64K,1M,16M] [--levels 1,6,9] [--corpus logs,json,...] [--modes stream,pipeline,...]
+ *				  [--threads 1,4] [--tool path] [--min-time 0.2] [--tmp dir]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "libarchiver.h"
+#include "Crc32c.h"
+#include "Cpu.h"
+#include "Memory.h"
+#include "Level.h"
+#include "Pipeline.h"
+
+#define BENCH_VERSION 1
+#define BENCH_CHUNK 65536  /* Corpus is generated and fed to the library this much at a time */
+#define BENCH_OUTPUT 1048576  /* Output buffer handed to the library */
+#define BENCH_LINE 256  /* Longest generated line of text or JSON */
+#define BENCH_MAX_LIST 16
+#define BENCH_MAX_REPEATS 100000
+#define BENCH_MAX_NAME 97  /* Longest file name the command line tool reads from stdin */
+#define BENCH_TOOL_FAILED 2  /* Phase status when the command line tool exits with an error */
+
+#define BENCH_DEFAULT_SIZES "1K,64K,1M,16M"
+#define BENCH_DEFAULT_LEVELS "1,6,9"
+#define BENCH_DEFAULT_CORPORA "logs,json,binary,random,single,skewed"
+#define BENCH_DEFAULT_MODES "stream,pipeline,words,dedup"
+#define BENCH_DEFAULT_THREADS "1,4"
+
+enum { CORPUS_LOGS, CORPUS_JSON, CORPUS_BINARY, CORPUS_RANDOM, CORPUS_SINGLE, CORPUS_SKEWED, NUM_CORPORA };
+static const char *corpusNames[NUM_CORPORA] = { "logs", "json", "binary", "random", "single", "skewed" };
+
+enum { MODE_STREAM, MODE_PIPELINE, MODE_WORDS, MODE_DEDUP, NUM_MODES };
+static const char *modeNames[NUM_MODES] = { "stream", "pipeline", "words", "dedup" };
+
+/*Generator for one corpus, the same seed always gives the same bytes*/
+typedef struct Corpus
+{
+	int kind;
+	unsigned long long state;
+	unsigned char line[BENCH_LINE];  /* Record being handed out */
+	int lineSize;
+	int linePosition;
+	unsigned int counter;
+	unsigned int value;
+} Corpus;
+
+/*What a child sends back for one phase*/
+typedef struct Phase
+{
+	int status;  /* AR_OK, AR_ERROR_*, 1 if the data did not match or BENCH_TOOL_FAILED */
+	int repeats;
+	double seconds;  /* Total over all repeats */
+	long long compressedSize;
+	long long allocations;  /* In the first repeat */
+	long long peakHeap;  /* Most bytes the library held at once */
+	unsigned int checksum;  /* CRC32C of the uncompressed data */
+} Phase;
+
+
+static unsigned long long nextRandom( Corpus *corpus);
+static void startCorpus( Corpus *corpus, int kind);
+static void makeRecord( Corpus *corpus);
+static void fillCorpus( Corpus *corpus, unsigned char *buffer, int size);
+static double now( void);
+static int compressPhase( int kind, long long size, int level, const char *path, double minTime, Phase *phase);
+static int decompressPhase( long long size, const char *path, double minTime, Phase *phase);
+static int runPhase( int decompress, int kind, long long size, int level, const char *path, double minTime,
+					 Phase *phase, long *maxRss);
+static int writeCorpus( int kind, long long size, const char *path, unsigned int *checksum);
+static int runTool( char **arguments, const char *answer, double *seconds, long *maxRss);
+static int toolPhase( int decompress, int mode, int level, int threads, const char *tool, const char *path,
+					  long long size, double minTime, Phase *phase, long *maxRss);
+static const char* describeStatus( int status);
+static void printPhase( const char *name, long long size, const Phase *phase, long maxRss, int counted);
+static int parseList( const char *text, long long *values, int isSize, long long maximum);
+static int parseNames( const char *text, const char **names, int numNames, int *values);
+
+int main( int argc, char** argv)
+{
+	const char *sizeText = BENCH_DEFAULT_SIZES, *levelText = BENCH_DEFAULT_LEVELS, *corpusText = BENCH_DEFAULT_CORPORA;
+	const char *modeText = BENCH_DEFAULT_MODES, *threadText = BENCH_DEFAULT_THREADS, *tool = NULL;
+	const char *directory;
+	char path[4096], file[4096];
+	long long sizes[BENCH_MAX_LIST], levels[BENCH_MAX_LIST], threads[BENCH_MAX_LIST];
+	int kinds[NUM_CORPORA], modes[NUM_MODES];
+	int numSizes, numLevels, numThreads, numKinds, numModes, useTool, i, j, k, m, t, fd, first, status, level, failed;
+	unsigned int checksum;
+	double minTime = 0.2;
+	Phase packed, unpacked;
+	long packedRss, unpackedRss;
+
+	directory = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+	for ( i = 1; i < argc; i++)
+	{
+		if ( i + 1 < argc && strcmp(argv[i], "--sizes") == 0)
+		{
+			sizeText = argv[++i];
+		}
+		else if ( i + 1 < argc && strcmp(argv[i], "--levels") == 0)
+		{
+			levelText = argv[++i];
+		}
+		else if ( i + 1 < argc && strcmp(argv[i], "--corpus") == 0)
+		{
+			corpusText = argv[++i];
+		}
+		else if ( i + 1 < argc && strcmp(argv[i], "--modes") == 0)
+		{
+			modeText = argv[++i];
+		}
+		else if ( i + 1 < argc && strcmp(argv[i], "--threads") == 0)
+		{
+			threadText = argv[++i];
+		}
+		else if ( i + 1 < argc && strcmp(argv[i], "--tool") == 0)
+		{
+			tool = argv[++i];
+		}
+		else if ( i + 1 < argc && strcmp(argv[i], "--min-time") == 0)
+		{
+			minTime = atof(argv[++i]);
+		}
+		else if ( i + 1 < argc && strcmp(argv[i], "--tmp") == 0)
+		{
+			directory = argv[++i];
+		}
+		else
+		{
+			fprintf(stderr, "Usage: %s [--sizes %s] [--levels %s] [--corpus %s] [--modes %s] [--threads %s] "
+					"[--tool path] [--min-time 0.2] [--tmp dir]\n", argv[0], BENCH_DEFAULT_SIZES, BENCH_DEFAULT_LEVELS,
+					BENCH_DEFAULT_CORPORA, BENCH_DEFAULT_MODES, BENCH_DEFAULT_THREADS);
+			return EXIT_FAILURE;
+		}
+	}
+	numSizes = parseList(sizeText, sizes, 1, 0);
+	numLevels = parseList(levelText, levels, 0, AR_MAX_LEVEL);
+	numThreads = parseList(threadText, threads, 0, AR_MAX_THREADS);
+	numKinds = parseNames(corpusText, corpusNames, NUM_CORPORA, kinds);
+	numModes = parseNames(modeText, modeNames, NUM_MODES, modes);
+	if ( numSizes <= 0 || numLevels <= 0 || numThreads <= 0 || numKinds <= 0 || numModes <= 0)
+	{
+		fprintf(stderr, "Invalid --sizes, --levels, --threads, --corpus or --modes\n");
+		return EXIT_FAILURE;
+	}
+	for ( m = 0, useTool = 0; m < numModes; m++)
+	{
+		useTool |= modes[m] != MODE_STREAM;
+	}
+	if ( useTool && tool == NULL)
+	{
+		fprintf(stderr, "--tool with the path to ARchiver is needed for the pipeline, words and dedup modes\n");
+		return EXIT_FAILURE;
+	}
+
+	snprintf(path, sizeof(path), "%s/archiver-bench-XXXXXX", directory);
+	/*The tool adds .ar to the name it reads, and the output is the name with .out on the end*/
+	if ( useTool && strlen(path) + 4 > BENCH_MAX_NAME)
+	{
+		fprintf(stderr, "%s is too long for the tool to read, use a shorter --tmp\n", directory);
+		return EXIT_FAILURE;
+	}
+	fd = mkstemp(path);
+	if ( fd < 0)
+	{
+		perror(path);
+		return EXIT_FAILURE;
+	}
+	close(fd);
+
+	printf("{\n  \"version\": %d,\n  \"kernels\": \"%s\",\n  \"cpus\": %ld,\n  \"results\": [", BENCH_VERSION,
+		   cpuName(), sysconf(_SC_NPROCESSORS_ONLN));
+	first = 1;
+	status = EXIT_SUCCESS;
+	for ( i = 0; i < numKinds; i++)
+	{
+		for ( j = 0; j < numSizes; j++)
+		{
+			checksum = 0;
+			snprintf(file, sizeof(file), "%s.in", path);
+			if ( useTool && writeCorpus(kinds[i], sizes[j], file, &checksum) != EXIT_SUCCESS)
+			{
+				status = EXIT_FAILURE;
+				break;
+			}
+			for ( m = 0; m < numModes; m++)
+			{
+				/*Words and dedup have a level of their own, and the stream API has no threads*/
+				for ( k = 0; k < (modes[m] == MODE_STREAM || modes[m] == MODE_PIPELINE ? numLevels : 1); k++)
+				{
+					for ( t = 0; t < (modes[m] == MODE_STREAM ? 1 : numThreads); t++)
+					{
+						level = modes[m] == MODE_WORDS ? 0 : modes[m] == MODE_DEDUP ? AR_DEFAULT_LEVEL : (int) levels[k];
+						printf("%s\n    {\"corpus\": \"%s\", \"size\": %lld, \"mode\": \"%s\", \"threads\": %d, ",
+							   first ? "" : ",", corpusNames[kinds[i]], sizes[j], modeNames[modes[m]],
+							   modes[m] == MODE_STREAM ? 1 : (int) threads[t]);
+						if ( level > 0)
+						{
+							printf("\"level\": %d, ", level);
+						}
+						first = 0;
+						if ( modes[m] == MODE_STREAM)
+						{
+							failed = runPhase(0, kinds[i], sizes[j], level, path, minTime, &packed, &packedRss) != EXIT_SUCCESS ||
+									 runPhase(1, kinds[i], sizes[j], level, path, minTime, &unpacked, &unpackedRss) != EXIT_SUCCESS ||
+									 unpacked.checksum != packed.checksum;
+						}
+						else
+						{
+							failed = toolPhase(0, modes[m], level, (int) threads[t], tool, path, sizes[j], minTime, &packed,
+											   &packedRss) != EXIT_SUCCESS ||
+									 toolPhase(1, modes[m], level, (int) threads[t], tool, path, sizes[j], minTime, &unpacked,
+											   &unpackedRss) != EXIT_SUCCESS ||
+									 unpacked.checksum != checksum;
+						}
+						if ( failed)
+						{
+							printf("\"error\": \"%s\"}", describeStatus(packed.status != AR_OK ? packed.status :
+								   unpacked.status != AR_OK ? unpacked.status : 1));
+							status = EXIT_FAILURE;
+							fflush(stdout);
+							continue;
+						}
+						printf("\"compressed\": %lld, \"ratio\": %.4f, ", packed.compressedSize,
+							   packed.compressedSize > 0 ? (double) sizes[j] / packed.compressedSize : 0.0);
+						printPhase("compress", sizes[j], &packed, packedRss, modes[m] == MODE_STREAM);
+						printf(", ");
+						printPhase("decompress", sizes[j], &unpacked, unpackedRss, modes[m] == MODE_STREAM);
+						printf("}");
+						fflush(stdout);
+					}
+				}
+			}
+		}
+	}
+	printf("\n  ]\n}\n");
+	unlink(path);
+	if ( useTool)
+	{
+		unlink(file);
+		snprintf(file, sizeof(file), "%s.ar", path);
+		unlink(file);
+		snprintf(file, sizeof(file), "%s.out", path);
+		unlink(file);
+	}
+	return status;
+}
+
+/**
+ * Method:    nextRandom
+ * FullName:  nextRandom
+ * Access:    private
+ * @brief     splitmix64, small and the same everywhere
+ * @param 	  corpus - generator to step
+ * @return    the next 64 random bits
+ **/
+static unsigned long long nextRandom( Corpus *corpus)
+{
+	unsigned long long z;
+
+	corpus->state += 0x9E3779B97F4A7C15ULL;
+	z = corpus->state;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/**
+ * Method:    startCorpus
+ * FullName:  startCorpus
+ * Access:    private
+ * @param 	  corpus - generator to start from the beginning
+ * @param 	  kind - CORPUS_*, which is also the seed
+ **/
+static void startCorpus( Corpus *corpus, int kind)
+{
+	memset(corpus, 0, sizeof(*corpus));
+	corpus->kind = kind;
+	corpus->state = (unsigned long long) kind + 1;
+	corpus->value = 100000;
+}
+
+/**
+ * Method:    makeRecord
+ * FullName:  makeRecord
+ * Access:    private
+ * @brief     Generates the next log line, JSON object or binary record into the corpus's line
+ * @param 	  corpus - logs, json or binary generator
+ **/
+static void makeRecord( Corpus *corpus)
+{
+	static const char *levels[] = { "INFO", "INFO", "INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR" };
+	static const char *paths[] = { "/api/v1/items", "/api/v1/users", "/api/v1/orders", "/health", "/static/app.js" };
+	static const char *tags[] = { "new", "sale", "featured", "archived", "limited" };
+	static const int codes[] = { 200, 200, 200, 200, 200, 200, 304, 404, 500 };
+	unsigned long long bits = nextRandom(corpus);
+	unsigned int seconds;
+	int i;
+
+	corpus->counter++;
+	if ( corpus->kind == CORPUS_LOGS)
+	{
+		seconds = corpus->counter / 8;
+		corpus->lineSize = snprintf((char*) corpus->line, BENCH_LINE,
+				"2024-03-%02u %02u:%02u:%02u.%03u %-5s [worker-%u] GET %s/%u %d %uB %ums\n",
+				1 + seconds / 86400 % 28, seconds / 3600 % 24, seconds / 60 % 60, seconds % 60,
+				(unsigned int) (bits % 1000), levels[(bits >> 10) % 8], (unsigned int) (bits >> 13) % 16,
+				paths[(bits >> 17) % 5], (unsigned int) (bits >> 20) % 5000, codes[(bits >> 33) % 9],
+				(unsigned int) (bits >> 37) % 65536, (unsigned int) (bits >> 53) % 900 + 1);
+	}
+	else if ( corpus->kind == CORPUS_JSON)
+	{
+		corpus->lineSize = snprintf((char*) corpus->line, BENCH_LINE,
+				"{\"id\":%u,\"user\":\"user%04u\",\"active\":%s,\"score\":%u.%02u,\"tags\":[\"%s\",\"%s\"]}\n",
+				corpus->counter, (unsigned int) (bits % 5000), (bits >> 13) & 1 ? "true" : "false",
+				(unsigned int) (bits >> 14) % 100, (unsigned int) (bits >> 21) % 100,
+				tags[(bits >> 28) % 5], tags[(bits >> 31) % 5]);
+	}
+	else
+	{
+		/*Telemetry like records: a slowly rising timestamp, one of a few sensor ids and a wandering reading*/
+		corpus->value += (unsigned int) (bits % 201) - 100;
+		for ( i = 0; i < 4; i++)
+		{
+			corpus->line[i] = (unsigned char) ((corpus->counter * 10 + (unsigned int) (bits >> 8) % 10) >> (8 * i));
+			corpus->line[4 + i] = (unsigned char) (((unsigned int) (bits >> 16) % 40) >> (8 * i));
+			corpus->line[8 + i] = (unsigned char) (corpus->value >> (8 * i));
+			corpus->line[12 + i] = (unsigned char) (i == 0 ? (bits >> 24) % 4 : 0);
+		}
+		corpus->lineSize = 16;
+	}
+	corpus->linePosition = 0;
+}
+
+/**
+ * Method:    fillCorpus
+ * FullName:  fillCorpus
+ * Access:    private
+ * @brief     Generates the next bytes of the corpus. The bytes don't depend on how they are split into calls
+ * @param 	  corpus - the generator
+ * @param 	  buffer - where to put them
+ * @param 	  size - how many
+ **/
+static void fillCorpus( Corpus *corpus, unsigned char *buffer, int size)
+{
+	unsigned long long bits;
+	int i, copy;
+
+	if ( corpus->kind == CORPUS_SINGLE)
+	{
+		memset(buffer, 'a', size);
+		return;
+	}
+	for ( i = 0; i < size; )
+	{
+		if ( corpus->kind == CORPUS_RANDOM)
+		{
+			buffer[i++] = (unsigned char) nextRandom(corpus);
+		}
+		else if ( corpus->kind == CORPUS_SKEWED)
+		{
+			/*Byte k turns up with probability 2^-(k+1)*/
+			bits = nextRandom(corpus);
+			buffer[i++] = bits == 0 ? 64 : (unsigned char) __builtin_ctzll(bits);
+		}
+		else
+		{
+			if ( corpus->linePosition == corpus->lineSize)
+			{
+				makeRecord(corpus);
+			}
+			copy = corpus->lineSize - corpus->linePosition < size - i ? corpus->lineSize - corpus->linePosition : size - i;
+			memcpy(buffer + i, corpus->line + corpus->linePosition, copy);
+			corpus->linePosition += copy;
+			i += copy;
+		}
+	}
+}
+
+/**
+ * Method:    now
+ * FullName:  now
+ * Access:    private
+ * @return    seconds on the monotonic clock
+ **/
+static double now( void)
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * Method:    compressPhase
+ * FullName:  compressPhase
+ * Access:    private
+ * @brief     Compresses the corpus into the file at path, as many times as it takes to fill minTime
+ * @param 	  kind - CORPUS_*
+ * @param 	  size - bytes of corpus
+ * @param 	  level - compression level
+ * @param 	  path - file for the archive
+ * @param 	  minTime - seconds to keep repeating for
+ * @param 	  phase - filled in with the results
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE with phase->status set
+ **/
+static int compressPhase( int kind, long long size, int level, const char *path, double minTime, Phase *phase)
+{
+	unsigned char *input = (unsigned char*) malloc(BENCH_CHUNK), *output = (unsigned char*) malloc(BENCH_OUTPUT);
+	Corpus corpus;
+	ar_stream *stream;
+	FILE *file;
+	MemoryStats memory[AR_MEMORY_SLOTS];
+	long long done, allocations;
+	size_t used, taken, produced;
+	double start;
+	int chunk;
+
+	memset(phase, 0, sizeof(*phase));
+	while ( phase->status == AR_OK && phase->repeats < BENCH_MAX_REPEATS && (phase->repeats == 0 || phase->seconds < minTime))
+	{
+		file = fopen(path, "wb");
+		if ( file == NULL || input == NULL || output == NULL)
+		{
+			phase->status = AR_ERROR_MEMORY;
+			break;
+		}
+		startCorpus(&corpus, kind);
+		phase->compressedSize = 0;
+		getMemoryStats(memory);
+		allocations = memory[AR_MEMORY_TOTAL].allocations;
+		start = now();
+		stream = ar_stream_compress_new(level, NULL);
+		phase->seconds += now() - start;
+		phase->status = stream != NULL ? AR_OK : AR_ERROR_PARAMETER;
+		for ( done = 0; done < size && phase->status == AR_OK; done += chunk)
+		{
+			chunk = size - done < BENCH_CHUNK ? (int) (size - done) : BENCH_CHUNK;
+			fillCorpus(&corpus, input, chunk);
+			if ( phase->repeats == 0)
+			{
+				phase->checksum = crc32c(phase->checksum, input, chunk);
+			}
+			for ( used = 0; used < (size_t) chunk && phase->status == AR_OK; used += taken)
+			{
+				start = now();
+				phase->status = ar_stream_update(stream, input + used, chunk - used, &taken, output, BENCH_OUTPUT, &produced);
+				phase->seconds += now() - start;
+				phase->compressedSize += (long long) fwrite(output, 1, produced, file);
+			}
+		}
+		do
+		{
+			start = now();
+			phase->status = phase->status == AR_OK || phase->status == AR_MORE ?
+							ar_stream_finish(stream, output, BENCH_OUTPUT, &produced) : phase->status;
+			phase->seconds += now() - start;
+			if ( phase->status == AR_OK || phase->status == AR_MORE)
+			{
+				phase->compressedSize += (long long) fwrite(output, 1, produced, file);
+			}
+		} while ( phase->status == AR_MORE);
+		start = now();
+		ar_stream_free(stream);
+		phase->seconds += now() - start;
+		if ( phase->repeats == 0)
+		{
+			getMemoryStats(memory);
+			phase->allocations = memory[AR_MEMORY_TOTAL].allocations - allocations;
+		}
+		phase->repeats++;
+		if ( fclose(file) != 0)
+		{
+			phase->status = AR_ERROR_DST_SIZE;
+		}
+	}
+	free(input);
+	free(output);
+	getMemoryStats(memory);
+	phase->peakHeap = memory[AR_MEMORY_TOTAL].peak;
+	return phase->status == AR_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Method:    decompressPhase
+ * FullName:  decompressPhase
+ * Access:    private
+ * @brief     Decompresses the archive at path, as many times as it takes to fill minTime, checksumming the
+ *			  output of the first time through
+ * @param 	  size - bytes the archive should decompress to
+ * @param 	  path - file holding the archive
+ * @param 	  minTime - seconds to keep repeating for
+ * @param 	  phase - filled in with the results
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE with phase->status set
+ **/
+static int decompressPhase( long long size, const char *path, double minTime, Phase *phase)
+{
+	unsigned char *input = (unsigned char*) malloc(BENCH_CHUNK), *output = (unsigned char*) malloc(BENCH_OUTPUT);
+	ar_stream *stream;
+	FILE *file;
+	MemoryStats memory[AR_MEMORY_SLOTS];
+	long long produced, allocations;
+	size_t read, used, taken, made;
+	double start;
+
+	memset(phase, 0, sizeof(*phase));
+	while ( phase->status == AR_OK && phase->repeats < BENCH_MAX_REPEATS && (phase->repeats == 0 || phase->seconds < minTime))
+	{
+		file = fopen(path, "rb");
+		if ( file == NULL || input == NULL || output == NULL)
+		{
+			phase->status = AR_ERROR_MEMORY;
+			break;
+		}
+		produced = 0;
+		getMemoryStats(memory);
+		allocations = memory[AR_MEMORY_TOTAL].allocations;
+		start = now();
+		stream = ar_stream_decompress_new(NULL);
+		phase->seconds += now() - start;
+		phase->status = stream != NULL ? AR_OK : AR_ERROR_MEMORY;
+		while ( phase->status == AR_OK && (read = fread(input, 1, BENCH_CHUNK, file)) > 0)
+		{
+			for ( used = 0; used < read && phase->status == AR_OK; used += taken)
+			{
+				start = now();
+				phase->status = ar_stream_update(stream, input + used, read - used, &taken, output, BENCH_OUTPUT, &made);
+				phase->seconds += now() - start;
+				if ( phase->repeats == 0)
+				{
+					phase->checksum = crc32c(phase->checksum, output, made);
+				}
+				produced += (long long) made;
+			}
+		}
+		do
+		{
+			start = now();
+			phase->status = phase->status == AR_OK || phase->status == AR_MORE ?
+							ar_stream_finish(stream, output, BENCH_OUTPUT, &made) : phase->status;
+			phase->seconds += now() - start;
+			if ( (phase->status == AR_OK || phase->status == AR_MORE) && phase->repeats == 0)
+			{
+				phase->checksum = crc32c(phase->checksum, output, made);
+			}
+			produced += phase->status == AR_OK || phase->status == AR_MORE ? (long long) made : 0;
+		} while ( phase->status == AR_MORE);
+		start = now();
+		ar_stream_free(stream);
+		phase->seconds += now() - start;
+		if ( phase->repeats == 0)
+		{
+			getMemoryStats(memory);
+			phase->allocations = memory[AR_MEMORY_TOTAL].allocations - allocations;
+		}
+		phase->repeats++;
+		fclose(file);
+		if ( phase->status == AR_OK && produced != size)
+		{
+			phase->status = 1;
+		}
+	}
+	free(input);
+	free(output);
+	getMemoryStats(memory);
+	phase->peakHeap = memory[AR_MEMORY_TOTAL].peak;
+	return phase->status == AR_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Method:    runPhase
+ * FullName:  runPhase
+ * Access:    private
+ * @brief     Runs one phase in a child process and collects its results and peak RSS
+ * @param 	  decompress - 1 to decompress, 0 to compress
+ * @param 	  kind - CORPUS_*
+ * @param 	  size - bytes of corpus
+ * @param 	  level - compression level
+ * @param 	  path - file for the archive
+ * @param 	  minTime - seconds to keep repeating for
+ * @param 	  phase - filled in with the results
+ * @param 	  maxRss - set to the child's peak RSS in KB
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the phase failed
+ **/
+static int runPhase( int decompress, int kind, long long size, int level, const char *path, double minTime,
+					 Phase *phase, long *maxRss)
+{
+	struct rusage usage;
+	int channel[2], status;
+	pid_t child;
+
+	memset(phase, 0, sizeof(*phase));
+	phase->status = AR_ERROR_MEMORY;
+	*maxRss = 0;
+	if ( pipe(channel) != 0)
+	{
+		perror("pipe");
+		return EXIT_FAILURE;
+	}
+	fflush(stdout);
+	child = fork();
+	if ( child == 0)
+	{
+		close(channel[0]);
+		if ( decompress)
+		{
+			decompressPhase(size, path, minTime, phase);
+		}
+		else
+		{
+			compressPhase(kind, size, level, path, minTime, phase);
+		}
+		_exit(write(channel[1], phase, sizeof(*phase)) == (ssize_t) sizeof(*phase) ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	close(channel[1]);
+	if ( child < 0)
+	{
+		perror("fork");
+		close(channel[0]);
+		return EXIT_FAILURE;
+	}
+	if ( read(channel[0], phase, sizeof(*phase)) != (ssize_t) sizeof(*phase))
+	{
+		phase->status = AR_ERROR_MEMORY;
+	}
+	close(channel[0]);
+	while ( wait4(child, &status, 0, &usage) < 0 && errno == EINTR)
+	{
+	}
+	*maxRss = usage.ru_maxrss;
+	return phase->status == AR_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Method:    writeCorpus
+ * FullName:  writeCorpus
+ * Access:    private
+ * @brief     Writes the corpus to a file for the command line tool to read
+ * @param 	  kind - CORPUS_*
+ * @param 	  size - bytes of corpus
+ * @param 	  path - file to write
+ * @param 	  checksum - set to the CRC32C of the corpus
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the file could not be written
+ **/
+static int writeCorpus( int kind, long long size, const char *path, unsigned int *checksum)
+{
+	unsigned char *buffer = (unsigned char*) malloc(BENCH_CHUNK);
+	Corpus corpus;
+	FILE *file = fopen(path, "wb");
+	long long done;
+	int chunk, status = EXIT_SUCCESS;
+
+	if ( file == NULL || buffer == NULL)
+	{
+		perror(path);
+		free(buffer);
+		if ( file != NULL)
+		{
+			fclose(file);
+		}
+		return EXIT_FAILURE;
+	}
+	startCorpus(&corpus, kind);
+	*checksum = 0;
+	for ( done = 0; done < size && status == EXIT_SUCCESS; done += chunk)
+	{
+		chunk = size - done < BENCH_CHUNK ? (int) (size - done) : BENCH_CHUNK;
+		fillCorpus(&corpus, buffer, chunk);
+		*checksum = crc32c(*checksum, buffer, chunk);
+		status = fwrite(buffer, 1, chunk, file) == (size_t) chunk ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	if ( fclose(file) != 0 || status != EXIT_SUCCESS)
+	{
+		perror(path);
+		status = EXIT_FAILURE;
+	}
+	free(buffer);
+	return status;
+}
+
+/**
+ * Method:    runTool
+ * FullName:  runTool
+ * Access:    private
+ * @brief     Runs the command line tool once, answering its prompt for a file name
+ * @param 	  arguments - path to the tool and its arguments, ending in NULL
+ * @param 	  answer - line to give the tool on stdin
+ * @param 	  seconds - set to the time from starting the tool to it exiting
+ * @param 	  maxRss - raised to the tool's peak RSS in KB if that is higher
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the tool could not be run or failed
+ **/
+static int runTool( char **arguments, const char *answer, double *seconds, long *maxRss)
+{
+	struct rusage usage;
+	int channel[2], status, null;
+	double start;
+	pid_t child;
+
+	/*The answer fits in the pipe, so it is written before the tool starts and can't race it exiting*/
+	if ( pipe(channel) != 0)
+	{
+		perror("pipe");
+		return EXIT_FAILURE;
+	}
+	if ( write(channel[1], answer, strlen(answer)) != (ssize_t) strlen(answer))
+	{
+		perror("write");
+		close(channel[0]);
+		close(channel[1]);
+		return EXIT_FAILURE;
+	}
+	fflush(stdout);
+	start = now();
+	child = fork();
+	if ( child == 0)
+	{
+		/*Prompts go to /dev/null so stdout stays JSON, errors still reach stderr*/
+		close(channel[1]);
+		null = open("/dev/null", O_WRONLY);
+		if ( null < 0 || dup2(channel[0], STDIN_FILENO) < 0 || dup2(null, STDOUT_FILENO) < 0)
+		{
+			_exit(EXIT_FAILURE);
+		}
+		execv(arguments[0], arguments);
+		perror(arguments[0]);
+		_exit(EXIT_FAILURE);
+	}
+	close(channel[0]);
+	close(channel[1]);
+	if ( child < 0)
+	{
+		perror("fork");
+		return EXIT_FAILURE;
+	}
+	while ( wait4(child, &status, 0, &usage) < 0)
+	{
+		if ( errno != EINTR)
+		{
+			perror("wait4");
+			return EXIT_FAILURE;
+		}
+	}
+	*seconds = now() - start;
+	*maxRss = usage.ru_maxrss > *maxRss ? usage.ru_maxrss : *maxRss;
+	return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Method:    toolPhase
+ * FullName:  toolPhase
+ * Access:    private
+ * @brief     Compresses path.in to path.ar or decompresses path.ar to path.out with the command line tool, as
+ *			  many times as it takes to fill minTime, then checks the archive or checksums the output
+ * @param 	  decompress - 1 to decompress, 0 to compress
+ * @param 	  mode - MODE_PIPELINE, MODE_WORDS or MODE_DEDUP
+ * @param 	  level - compression level for MODE_PIPELINE
+ * @param 	  threads - coder threads to give -T
+ * @param 	  tool - path to ARchiver
+ * @param 	  path - temporary file the other names are made from
+ * @param 	  size - bytes of corpus
+ * @param 	  minTime - seconds to keep repeating for
+ * @param 	  phase - filled in with the results, without allocation counts
+ * @param 	  maxRss - set to the tool's peak RSS in KB
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE with phase->status set
+ **/
+static int toolPhase( int decompress, int mode, int level, int threads, const char *tool, const char *path,
+					  long long size, double minTime, Phase *phase, long *maxRss)
+{
+	char threadText[16], flag[4], input[4096], archive[4096], output[4096], answer[4096 + 8];
+	char *arguments[6];
+	unsigned char *buffer;
+	struct stat info;
+	FILE *file;
+	size_t read;
+	long long produced = 0;
+	double seconds;
+
+	memset(phase, 0, sizeof(*phase));
+	*maxRss = 0;
+	snprintf(threadText, sizeof(threadText), "%d", threads);
+	snprintf(flag, sizeof(flag), mode == MODE_WORDS ? "-w" : mode == MODE_DEDUP ? "-D" : "-%d", level);
+	snprintf(input, sizeof(input), "%s.in", path);
+	snprintf(archive, sizeof(archive), "%s.ar", path);
+	snprintf(output, sizeof(output), "%s.out", path);
+	snprintf(answer, sizeof(answer), "%s\n", decompress ? output : path);
+	arguments[0] = (char*) tool;
+	arguments[1] = (char*) "-T";
+	arguments[2] = threadText;
+	arguments[3] = decompress ? (char*) "-d" : flag;
+	arguments[4] = decompress ? archive : input;
+	arguments[5] = NULL;
+	while ( phase->status == AR_OK && phase->repeats < BENCH_MAX_REPEATS && (phase->repeats == 0 || phase->seconds < minTime))
+	{
+		if ( runTool(arguments, answer, &seconds, maxRss) != EXIT_SUCCESS)
+		{
+			phase->status = BENCH_TOOL_FAILED;
+			return EXIT_FAILURE;
+		}
+		phase->seconds += seconds;
+		phase->repeats++;
+	}
+
+	if ( !decompress)
+	{
+		phase->status = stat(archive, &info) == 0 ? AR_OK : BENCH_TOOL_FAILED;
+		phase->compressedSize = info.st_size;
+		return phase->status == AR_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	buffer = (unsigned char*) malloc(BENCH_CHUNK);
+	file = fopen(output, "rb");
+	if ( buffer == NULL || file == NULL)
+	{
+		phase->status = buffer == NULL ? AR_ERROR_MEMORY : BENCH_TOOL_FAILED;
+	}
+	else
+	{
+		while ( (read = fread(buffer, 1, BENCH_CHUNK, file)) > 0)
+		{
+			phase->checksum = crc32c(phase->checksum, buffer, read);
+			produced += (long long) read;
+		}
+		phase->status = produced == size ? AR_OK : 1;
+	}
+	if ( file != NULL)
+	{
+		fclose(file);
+	}
+	free(buffer);
+	return phase->status == AR_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Method:    describeStatus
+ * FullName:  describeStatus
+ * Access:    private
+ * @param 	  status - Phase status
+ * @return    what went wrong, for the JSON
+ **/
+static const char* describeStatus( int status)
+{
+	if ( status == BENCH_TOOL_FAILED)
+	{
+		return "command line tool failed";
+	}
+	return status < 0 ? ar_error_string(status) : "output does not match input";
+}
+
+/**
+ * Method:    printPhase
+ * FullName:  printPhase
+ * Access:    private
+ * @brief     Prints one phase's JSON object
+ * @param 	  name - compress or decompress
+ * @param 	  size - bytes of corpus
+ * @param 	  phase - its results
+ * @param 	  maxRss - its peak RSS in KB
+ * @param 	  counted - 1 if the allocation counts are the library's own, 0 if there are none
+ **/
+static void printPhase( const char *name, long long size, const Phase *phase, long maxRss, int counted)
+{
+	printf("\"%s\": {\"mb_per_s\": %.2f, \"repeats\": %d, \"peak_rss_kb\": %ld", name,
+		   size * (double) phase->repeats / phase->seconds / 1e6, phase->repeats, maxRss);
+	if ( counted)
+	{
+		printf(", \"allocations\": %lld, \"peak_heap_kb\": %lld", phase->allocations, phase->peakHeap / 1024);
+	}
+	printf("}");
+}
+
+/**
+ * Method:    parseList
+ * FullName:  parseList
+ * Access:    private
+ * @brief     Reads a comma separated list of numbers, sizes may end in K, M or G
+ * @param 	  text - the list
+ * @param 	  values - where to put the numbers, BENCH_MAX_LIST of them
+ * @param 	  isSize - 1 for sizes, 0 for levels and thread counts
+ * @param 	  maximum - largest level or thread count allowed, unused for sizes
+ * @return    how many numbers there were, or -1 if one is invalid
+ **/
+static int parseList( const char *text, long long *values, int isSize, long long maximum)
+{
+	char *end;
+	int count = 0;
+
+	while ( *text != '\0' && count < BENCH_MAX_LIST)
+	{
+		values[count] = strtoll(text, &end, 10);
+		if ( end == text || values[count] <= 0)
+		{
+			return -1;
+		}
+		if ( isSize && (*end == 'K' || *end == 'M' || *end == 'G'))
+		{
+			values[count] <<= *end == 'K' ? 10 : *end == 'M' ? 20 : 30;
+			end++;
+		}
+		if ( !isSize && values[count] > maximum)
+		{
+			return -1;
+		}
+		count++;
+		text = *end == ',' ? end + 1 : end;
+		if ( *end != ',' && *end != '\0')
+		{
+			return -1;
+		}
+	}
+	return count;
+}
+
+/**
+ * Method:    parseNames
+ * FullName:  parseNames
+ * Access:    private
+ * @param 	  text - comma separated corpus or mode names
+ * @param 	  names - the names allowed
+ * @param 	  numNames - how many names there are
+ * @param 	  values - where to put the index of each name, numNames of them
+ * @return    how many there were, or -1 if one is unknown
+ **/
+static int parseNames( const char *text, const char **names, int numNames, int *values)
+{
+	size_t length;
+	int count = 0, i;
+
+	while ( *text != '\0' && count < numNames)
+	{
+		length = strcspn(text, ",");
+		for ( i = 0; i < numNames && (strlen(names[i]) != length || strncmp(text, names[i], length) != 0); i++)
+		{
+		}
+		if ( i == numNames)
+		{
+			return -1;
+		}
+		values[count++] = i;
+		text += length + (text[length] == ',');
+	}
+	return count;
+}
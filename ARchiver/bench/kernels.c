@@ -0,0 +1,647 @@
+/**
+ * @file   kernels.c
+ * @author Adrian Rasmussen
+ *
+ * @brief Micro-benchmarks of the Huffman coder's kernels, one at a time, on fixed buffers in memory. Each buffer
+ *		  holds a block of symbols with an exact, seeded distribution: flat (every code 8 bits), zipf, skewed
+ *		  (byte k with probability 2^-(k+1)), and depthN, whose Fibonacci counts force the longest code to be
+ *		  exactly N bits. There is no length limited code builder, so the depths stand in for code length
+ *		  caps, and show what happens to the decoders once codes outgrow the AR_DECODE_BITS lookup.
+ *
+ *		  Every kernel is called over and over on the same block until --min-time has passed, and the fastest
+ *		  call is kept, so results show what the code can do rather than what else the machine was doing.
+ *		  ns_per_byte is per byte of the block for every kernel, so the kernels of one block add up to the
+ *		  cost of coding it. cycles_per_symbol is per byte of the block for the kernels that touch every byte,
+ *		  and per distinct symbol for those that only see the tree. Cycles come from perf_event_open where
+ *		  the kernel allows it, otherwise from the time stamp counter, and the source is named in the output.
+ *		  Set ARCHIVER_CPU to compare the versions of the kernels. Build and run with bench/run.sh kernels.
+ *
+ *		  ./kernels [--sizes 4K,1M] [--dists flat,zipf,skewed] [--depths 12,16,20,24] [--kernels ...] [--min-time 0.1]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "Huffman.h"
+#include "Kernels.h"
+#include "Bits.h"
+#include "Crc32c.h"
+#include "Cpu.h"
+#include "Memory.h"
+
+#if defined(__linux__) && defined(__GNUC__) && defined(__has_include)
+#if __has_include(<linux/perf_event.h>)
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#ifdef __NR_perf_event_open
+#define KERNELS_PERF
+#endif
+#endif
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define KERNELS_TSC
+#endif
+
+#define KERNELS_VERSION 1
+#define KERNELS_MAX_LIST 16
+#define KERNELS_MIN_REPEATS 5
+#define KERNELS_MAX_REPEATS 1000000
+
+#define KERNELS_DEFAULT_SIZES "4K,1M"
+#define KERNELS_DEFAULT_DISTS "flat,zipf,skewed"
+#define KERNELS_DEFAULT_DEPTHS "12,16,20,24"
+#define KERNELS_DEFAULT_KERNELS "histogram,code_lengths,serialize_tree,check_tree,build_decode_table,pack_codes,bit_writer,table_decode,symbol_decode,crc32c"
+
+enum { DIST_FLAT, DIST_ZIPF, DIST_SKEWED, DIST_DEPTH, NUM_DISTS };
+static const char *distNames[NUM_DISTS] = { "flat", "zipf", "skewed", "depth" };
+
+enum { KERNEL_HISTOGRAM, KERNEL_CODE_LENGTHS, KERNEL_SERIALIZE_TREE, KERNEL_CHECK_TREE, KERNEL_BUILD_DECODE_TABLE,
+	   KERNEL_PACK_CODES, KERNEL_BIT_WRITER, KERNEL_TABLE_DECODE, KERNEL_SYMBOL_DECODE, KERNEL_CRC32C, NUM_KERNELS };
+static const char *kernelNames[NUM_KERNELS] = { "histogram", "code_lengths", "serialize_tree", "check_tree",
+												"build_decode_table", "pack_codes", "bit_writer", "table_decode",
+												"symbol_decode", "crc32c" };
+
+/*One block and everything the kernels need to run on it*/
+typedef struct Input
+{
+	unsigned char *data;
+	int size;
+	int counts[256];
+	int numSymbols;  /* Distinct symbols */
+	int maxLength;  /* Longest code */
+	unsigned long long codes[256];
+	unsigned char lengths[256];
+	HuffNodeSerial *tree;
+	int treeSize;  /* Bytes */
+	DecodeTable *table;
+	unsigned char *packed;  /* The block packed by packCodes */
+	int packedBits;
+	unsigned char *scratch;  /* Output of the kernel being timed, as big as the block or its packed codes */
+	int scratchSize;
+} Input;
+
+/*Fastest call of one kernel*/
+typedef struct Timing
+{
+	int repeats;
+	double nanoseconds;
+	double cycles;  /* -1 without a cycle counter */
+} Timing;
+
+static unsigned long long state;
+static volatile unsigned int sink;  /* Keeps results the compiler could otherwise drop */
+static const char *cycleSource = "none";
+#ifdef KERNELS_PERF
+static int cycleCounter = -1;
+#endif
+
+static unsigned long long nextRandom( void);
+static void makeCounts( int dist, int depth, int size, int counts[256]);
+static int makeInput( Input *input, int dist, int depth, int size);
+static void freeInput( Input *input);
+static int runKernel( int kernel, Input *input);
+static int timeKernel( int kernel, Input *input, double minTime, Timing *timing);
+static void openCycleCounter( void);
+static unsigned long long readCycles( void);
+static double now( void);
+static int parseList( const char *text, long long *values, int isSize);
+static int parseNames( const char *text, const char **names, int numNames, int *indexes);
+
+int main( int argc, char** argv)
+{
+	const char *sizeText = KERNELS_DEFAULT_SIZES, *distText = KERNELS_DEFAULT_DISTS, *depthText = KERNELS_DEFAULT_DEPTHS;
+	const char *kernelText = KERNELS_DEFAULT_KERNELS;
+	long long sizes[KERNELS_MAX_LIST], depths[KERNELS_MAX_LIST];
+	int dists[NUM_DISTS], kernels[NUM_KERNELS];
+	int numSizes, numDists, numDepths, numKernels, numShapes, dist, depth, i, j, k, first, status;
+	double minTime = 0.1;
+	Input input;
+	Timing timing;
+
+	for ( i = 1; i < argc; i++)
+	{
+		if ( i + 1 < argc && strcmp(argv[i], "--sizes") == 0)
+		{
+			sizeText = argv[++i];
+		}
+		else if ( i + 1 < argc && strcmp(argv[i], "--dists") == 0)
+		{
+			distText = argv[++i];
+		}
+		else if ( i + 1 < argc && strcmp(argv[i], "--depths") == 0)
+		{
+			depthText = argv[++i];
+		}
+		else if ( i + 1 < argc && strcmp(argv[i], "--kernels") == 0)
+		{
+			kernelText = argv[++i];
+		}
+		else if ( i + 1 < argc && strcmp(argv[i], "--min-time") == 0)
+		{
+			minTime = atof(argv[++i]);
+		}
+		else
+		{
+			fprintf(stderr, "Usage: %s [--sizes %s] [--dists %s] [--depths %s] [--kernels %s] [--min-time 0.1]\n",
+					argv[0], KERNELS_DEFAULT_SIZES, KERNELS_DEFAULT_DISTS, KERNELS_DEFAULT_DEPTHS, KERNELS_DEFAULT_KERNELS);
+			return EXIT_FAILURE;
+		}
+	}
+	numSizes = parseList(sizeText, sizes, 1);
+	numDists = *distText == '\0' ? 0 : parseNames(distText, distNames, DIST_DEPTH, dists);
+	numDepths = *depthText == '\0' ? 0 : parseList(depthText, depths, 0);
+	numKernels = parseNames(kernelText, kernelNames, NUM_KERNELS, kernels);
+	if ( numSizes <= 0 || numDists < 0 || numDepths < 0 || numKernels <= 0 || numDists + numDepths == 0)
+	{
+		fprintf(stderr, "Invalid --sizes, --dists, --depths or --kernels\n");
+		return EXIT_FAILURE;
+	}
+	for ( j = 0; j < numDepths; j++)
+	{
+		if ( depths[j] < 2 || depths[j] > 32)
+		{
+			fprintf(stderr, "Invalid depth %lld, must be from 2 to 32\n", depths[j]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	openCycleCounter();
+	printf("{\n  \"version\": %d,\n  \"kernels\": \"%s\",\n  \"decode_bits\": %d,\n  \"cycles\": \"%s\",\n  \"results\": [",
+		   KERNELS_VERSION, cpuName(), AR_DECODE_BITS, cycleSource);
+	first = 1;
+	status = EXIT_SUCCESS;
+	numShapes = numDists + numDepths;
+	for ( i = 0; i < numSizes; i++)
+	{
+		for ( j = 0; j < numShapes; j++)
+		{
+			dist = j < numDists ? dists[j] : DIST_DEPTH;
+			depth = j < numDists ? 0 : (int) depths[j - numDists];
+			if ( makeInput(&input, dist, depth, (int) sizes[i]) != EXIT_SUCCESS)
+			{
+				printf("%s\n    {\"dist\": \"%s\", \"size\": %lld, \"error\": \"could not build the block\"}",
+					   first ? "" : ",", distNames[dist], sizes[i]);
+				first = 0;
+				freeInput(&input);
+				status = EXIT_FAILURE;
+				continue;
+			}
+			for ( k = 0; k < numKernels; k++)
+			{
+				printf("%s\n    {\"kernel\": \"%s\", \"dist\": \"%s", first ? "" : ",", kernelNames[kernels[k]],
+					   distNames[dist]);
+				if ( dist == DIST_DEPTH)
+				{
+					printf("%d", depth);
+				}
+				printf("\", \"size\": %d, \"symbols\": %d, \"max_code_length\": %d, ", input.size, input.numSymbols,
+					   input.maxLength);
+				first = 0;
+				if ( timeKernel(kernels[k], &input, minTime, &timing) != EXIT_SUCCESS)
+				{
+					printf("\"error\": \"kernel failed or gave the wrong output\"}");
+					status = EXIT_FAILURE;
+					continue;
+				}
+				printf("\"repeats\": %d, \"ns_per_call\": %.1f, \"ns_per_byte\": %.4f, \"cycles_per_symbol\": ",
+					   timing.repeats, timing.nanoseconds, timing.nanoseconds / input.size);
+				if ( timing.cycles < 0)
+				{
+					printf("null}");
+				}
+				else
+				{
+					printf("%.4f}", timing.cycles / (kernels[k] == KERNEL_HISTOGRAM || kernels[k] >= KERNEL_PACK_CODES ?
+													 input.size : input.numSymbols));
+				}
+				fflush(stdout);
+			}
+			freeInput(&input);
+		}
+	}
+	printf("\n  ]\n}\n");
+	return status;
+}
+
+/**
+ * Method:    nextRandom
+ * FullName:  nextRandom
+ * Access:    private
+ * @brief     splitmix64, as in bench.c
+ * @return    the next 64 random bits
+ **/
+static unsigned long long nextRandom( void)
+{
+	unsigned long long z;
+
+	state += 0x9E3779B97F4A7C15ULL;
+	z = state;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/**
+ * Method:    makeCounts
+ * FullName:  makeCounts
+ * Access:    private
+ * @brief     Works out how often each byte turns up in a block, adding up to exactly size
+ * @param 	  dist - DIST_*
+ * @param 	  depth - longest code wanted, for DIST_DEPTH
+ * @param 	  size - bytes in the block
+ * @param 	  counts - set to the count of each byte
+ **/
+static void makeCounts( int dist, int depth, int size, int counts[256])
+{
+	double weights[256], total;
+	long long fibonacci[33], sum;
+	int used, i;
+
+	memset(counts, 0, 256 * sizeof(int));
+	if ( dist == DIST_DEPTH)
+	{
+		/*Counts 1, 1, 2, 3, 5... on depth + 1 symbols build a tree depth deep, and so does any multiple of them*/
+		fibonacci[0] = 1;
+		fibonacci[1] = 1;
+		sum = 0;
+		for ( i = 0; i <= depth; i++)
+		{
+			if ( i >= 2)
+			{
+				fibonacci[i] = fibonacci[i - 1] + fibonacci[i - 2];
+			}
+			sum += fibonacci[i];
+		}
+		used = 0;
+		for ( i = 0; i <= depth; i++)
+		{
+			counts[i] = (int) (fibonacci[i] * (size / sum > 0 ? size / sum : 1));
+			used += counts[i];
+		}
+		/*Whatever is left over goes to the most common symbol, which only ever shortens its code*/
+		counts[depth] += size - used > 0 ? size - used : 0;
+		return;
+	}
+
+	total = 0;
+	for ( i = 0; i < 256; i++)
+	{
+		weights[i] = dist == DIST_FLAT ? 1.0 : dist == DIST_ZIPF ? 1.0 / (i + 1) : (i < 62 ? 1.0 / (1ULL << i) : 0.0);
+		total += weights[i];
+	}
+	used = 0;
+	for ( i = 0; i < 256; i++)
+	{
+		counts[i] = (int) (weights[i] / total * size);
+		used += counts[i];
+	}
+	counts[0] += size - used;
+}
+
+/**
+ * Method:    makeInput
+ * FullName:  makeInput
+ * Access:    private
+ * @brief     Generates a block with the distribution's counts in a seeded random order, then builds its tree,
+ *			  codes, decode table and packed codes, which is what the kernels after the first few start from
+ * @param 	  input - filled in. Free with {@link freeInput} even on failure
+ * @param 	  dist - DIST_*
+ * @param 	  depth - longest code wanted, for DIST_DEPTH
+ * @param 	  size - bytes in the block. A depth block can come out bigger, to fit its smallest counts
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if memory could not be allocated or the codes are too long to pack
+ **/
+static int makeInput( Input *input, int dist, int depth, int size)
+{
+	unsigned char swap;
+	int symbol, position, i, j;
+
+	memset(input, 0, sizeof(*input));
+	makeCounts(dist, depth, size, input->counts);
+	for ( i = 0; i < 256; i++)
+	{
+		input->size += input->counts[i];
+	}
+	input->scratchSize = 2 * input->size + 64;
+	input->data = (unsigned char*) malloc(input->size);
+	input->packed = (unsigned char*) malloc(input->scratchSize);
+	input->scratch = (unsigned char*) malloc(input->scratchSize);
+	if ( input->data == NULL || input->packed == NULL || input->scratch == NULL)
+	{
+		return EXIT_FAILURE;
+	}
+	position = 0;
+	for ( symbol = 0; symbol < 256; symbol++)
+	{
+		memset(input->data + position, symbol, input->counts[symbol]);
+		position += input->counts[symbol];
+	}
+	state = (unsigned long long) dist * 100 + depth + 1;
+	for ( i = input->size - 1; i > 0; i--)
+	{
+		j = (int) (nextRandom() % (unsigned long long) (i + 1));
+		swap = input->data[i];
+		input->data[i] = input->data[j];
+		input->data[j] = swap;
+	}
+
+	input->tree = buildCodes(input->counts, 256, input->lengths, input->codes, &input->treeSize);
+	for ( i = 0; i < 256; i++)
+	{
+		input->numSymbols += input->lengths[i] > 0;
+		input->maxLength = input->lengths[i] > input->maxLength ? input->lengths[i] : input->maxLength;
+	}
+	input->table = (DecodeTable*) calloc(1, sizeof(DecodeTable));
+	if ( input->tree == NULL || input->table == NULL || input->maxLength > AR_MAX_PACKED_CODE ||
+		 buildDecodeTable(input->tree, input->treeSize, 256, input->table) != EXIT_SUCCESS)
+	{
+		return EXIT_FAILURE;
+	}
+	return packCodes(input->data, input->size, input->codes, input->lengths, input->packed, input->scratchSize,
+					 &input->packedBits);
+}
+
+/**
+ * Method:    freeInput
+ * FullName:  freeInput
+ * Access:    private
+ * @param 	  input - block from {@link makeInput}
+ **/
+static void freeInput( Input *input)
+{
+	free(input->data);
+	free(input->packed);
+	free(input->scratch);
+	if ( input->table != NULL)
+	{
+		freeDecodeTable(input->table);
+	}
+	free(input->table);
+	arFree(input->tree);
+	memset(input, 0, sizeof(*input));
+}
+
+/**
+ * Method:    runKernel
+ * FullName:  runKernel
+ * Access:    private
+ * @brief     Calls one kernel once on the block, freeing anything it allocates. The decoders leave the block
+ *			  in input->scratch
+ * @param 	  kernel - KERNEL_*
+ * @param 	  input - the block
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if the kernel failed
+ **/
+static int runKernel( int kernel, Input *input)
+{
+	unsigned char lengths[256];
+	unsigned long long codes[256];
+	int counts[256];
+	HuffNodeSerial *tree;
+	BitWriter writer;
+	BitReader reader;
+	int size, symbol, i;
+
+	switch ( kernel)
+	{
+		case KERNEL_HISTOGRAM:
+			countBytes(input->data, input->size, counts);
+			sink = (unsigned int) counts[0];
+			return EXIT_SUCCESS;
+		case KERNEL_CODE_LENGTHS:
+			if ( buildLengths(input->counts, 256, lengths) != input->numSymbols)
+			{
+				return EXIT_FAILURE;
+			}
+			canonicalCodes(lengths, 256, codes);
+			sink = (unsigned int) codes[input->data[0]];
+			return EXIT_SUCCESS;
+		case KERNEL_SERIALIZE_TREE:
+			tree = serializeLengths(input->lengths, input->codes, 256, &size);
+			arFree(tree);
+			return tree != NULL ? EXIT_SUCCESS : EXIT_FAILURE;
+		case KERNEL_CHECK_TREE:
+			return checkTree(input->tree, input->treeSize, 256);
+		case KERNEL_BUILD_DECODE_TABLE:
+			freeDecodeTable(input->table);
+			return buildDecodeTable(input->tree, input->treeSize, 256, input->table);
+		case KERNEL_PACK_CODES:
+			return packCodes(input->data, input->size, input->codes, input->lengths, input->scratch, input->scratchSize,
+							 &size) == EXIT_SUCCESS && size == input->packedBits ? EXIT_SUCCESS : EXIT_FAILURE;
+		case KERNEL_BIT_WRITER:
+			initBitWriter(&writer, input->scratch, input->scratchSize);
+			for ( i = 0; i < input->size; i++)
+			{
+				putCode(&writer, input->codes[input->data[i]], input->lengths[input->data[i]]);
+			}
+			return flushBits(&writer) == input->packedBits ? EXIT_SUCCESS : EXIT_FAILURE;
+		case KERNEL_TABLE_DECODE:
+			size = decodeBytes(input->packed, input->packedBits, input->scratch, input->size, input->table);
+			return size == input->size ? EXIT_SUCCESS : EXIT_FAILURE;
+		case KERNEL_SYMBOL_DECODE:
+			initBitReader(&reader, input->packed, input->packedBits);
+			for ( i = 0; i < input->size; i++)
+			{
+				symbol = decodeSymbol(&reader, input->table);
+				if ( symbol < 0)
+				{
+					return EXIT_FAILURE;
+				}
+				input->scratch[i] = (unsigned char) symbol;
+			}
+			return EXIT_SUCCESS;
+		case KERNEL_CRC32C:
+			sink = crc32c(0, input->data, input->size);
+			return EXIT_SUCCESS;
+	}
+	return EXIT_FAILURE;
+}
+
+/**
+ * Method:    timeKernel
+ * FullName:  timeKernel
+ * Access:    private
+ * @brief     Calls a kernel until minTime has passed, at least KERNELS_MIN_REPEATS times, keeping the fastest call,
+ *			  then checks what the decoders gave back
+ * @param 	  kernel - KERNEL_*
+ * @param 	  input - the block
+ * @param 	  minTime - seconds to keep repeating for
+ * @param 	  timing - set to the fastest call
+ * @return    EXIT_SUCCESS, or EXIT_FAILURE if a call failed
+ **/
+static int timeKernel( int kernel, Input *input, double minTime, Timing *timing)
+{
+	unsigned long long cycles;
+	double start, end, total;
+
+	timing->repeats = 0;
+	timing->nanoseconds = -1;
+	timing->cycles = -1;
+	total = 0;
+	while ( timing->repeats < KERNELS_MAX_REPEATS && (timing->repeats < KERNELS_MIN_REPEATS || total < minTime))
+	{
+		start = now();
+		cycles = readCycles();
+		if ( runKernel(kernel, input) != EXIT_SUCCESS)
+		{
+			return EXIT_FAILURE;
+		}
+		cycles = readCycles() - cycles;
+		end = now();
+		if ( timing->nanoseconds < 0 || (end - start) * 1e9 < timing->nanoseconds)
+		{
+			timing->nanoseconds = (end - start) * 1e9;
+		}
+		if ( strcmp(cycleSource, "none") != 0 && (timing->cycles < 0 || (double) cycles < timing->cycles))
+		{
+			timing->cycles = (double) cycles;
+		}
+		total += end - start;
+		timing->repeats++;
+	}
+	/*Checked once afterwards, so comparing isn't timed*/
+	if ( (kernel == KERNEL_TABLE_DECODE || kernel == KERNEL_SYMBOL_DECODE) && memcmp(input->scratch, input->data, input->size) != 0)
+	{
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Method:    openCycleCounter
+ * FullName:  openCycleCounter
+ * Access:    private
+ * @brief     Opens a counter of this thread's cycles, or falls back to the time stamp counter, which ticks at
+ *			  a fixed rate rather than with the core's clock
+ **/
+static void openCycleCounter( void)
+{
+#ifdef KERNELS_PERF
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_CPU_CYCLES;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	cycleCounter = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	if ( cycleCounter >= 0)
+	{
+		cycleSource = "perf";
+		return;
+	}
+#endif
+#ifdef KERNELS_TSC
+	cycleSource = "tsc";
+#endif
+}
+
+/**
+ * Method:    readCycles
+ * FullName:  readCycles
+ * Access:    private
+ * @return    the cycle count from the source {@link openCycleCounter} picked, or 0 without one
+ **/
+static unsigned long long readCycles( void)
+{
+	unsigned long long cycles = 0;
+
+#ifdef KERNELS_PERF
+	if ( cycleCounter >= 0)
+	{
+		return read(cycleCounter, &cycles, sizeof(cycles)) == (ssize_t) sizeof(cycles) ? cycles : 0;
+	}
+#endif
+#ifdef KERNELS_TSC
+	cycles = __rdtsc();
+#endif
+	return cycles;
+}
+
+/**
+ * Method:    now
+ * FullName:  now
+ * Access:    private
+ * @return    seconds on the monotonic clock
+ **/
+static double now( void)
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * Method:    parseList
+ * FullName:  parseList
+ * Access:    private
+ * @brief     Reads a comma separated list of numbers, sizes may end in K or M
+ * @param 	  text - the list
+ * @param 	  values - where to put the numbers, KERNELS_MAX_LIST of them
+ * @param 	  isSize - 1 for sizes, 0 for depths
+ * @return    how many numbers there were, or -1 if one is invalid
+ **/
+static int parseList( const char *text, long long *values, int isSize)
+{
+	char *end;
+	int count = 0;
+
+	while ( *text != '\0' && count < KERNELS_MAX_LIST)
+	{
+		values[count] = strtoll(text, &end, 10);
+		if ( end == text || values[count] <= 0)
+		{
+			return -1;
+		}
+		if ( isSize && (*end == 'K' || *end == 'M'))
+		{
+			values[count] <<= *end == 'K' ? 10 : 20;
+			end++;
+		}
+		/*Blocks are coded with int sizes, and the packed copy is twice as big*/
+		if ( isSize && values[count] > 256 << 20)
+		{
+			return -1;
+		}
+		count++;
+		text = *end == ',' ? end + 1 : end;
+		if ( *end != ',' && *end != '\0')
+		{
+			return -1;
+		}
+	}
+	return count;
+}
+
+/**
+ * Method:    parseNames
+ * FullName:  parseNames
+ * Access:    private
+ * @param 	  text - comma separated names
+ * @param 	  names - the names allowed
+ * @param 	  numNames - how many names are allowed
+ * @param 	  indexes - where to put the index in names of each one, numNames of them
+ * @return    how many there were, or -1 if one is unknown
+ **/
+static int parseNames( const char *text, const char **names, int numNames, int *indexes)
+{
+	size_t length;
+	int count = 0, i;
+
+	while ( *text != '\0' && count < numNames)
+	{
+		length = strcspn(text, ",");
+		for ( i = 0; i < numNames && (strlen(names[i]) != length || strncmp(text, names[i], length) != 0); i++)
+		{
+		}
+		if ( i == numNames)
+		{
+			return -1;
+		}
+		indexes[count++] = i;
+		text += length + (text[length] == ',');
+	}
+	return count;
+}
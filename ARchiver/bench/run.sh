@@ -0,0 +1,37 @@
+#!/bin/sh
+# Builds the benchmark from the ARchiver sources and runs it, passing on any arguments.
+# The command line tool is built next to it for the pipeline, words and dedup modes.
+# With kernels first, builds and runs the kernel micro-benchmarks instead.
+#
+#   bench/run.sh > results.json
+#   bench/run.sh --sizes 1K,64K,1M,16M,256M,4G --levels 1,9 > results.json
+#   bench/run.sh --modes pipeline,dedup --threads 1,2,4,8 > threads.json
+#   bench/run.sh kernels --dists skewed --depths 11,12 > kernels.json
+#
+# CC and CFLAGS are used if set. The binary goes in BENCH_BUILD, or a directory under TMPDIR.
+set -e
+here=$(cd "$(dirname "$0")" && pwd)
+source=$(dirname "$here")
+build=${BENCH_BUILD:-${TMPDIR:-/tmp}/archiver-bench-build}
+mkdir -p "$build"
+program=bench
+if [ "$1" = kernels ]; then
+	program=kernels
+	shift
+fi
+
+# The library is every source file except the command line tool
+files=
+for file in "$source"/*.c; do
+	case $(basename "$file") in
+		ARchiver.c|Server.c) ;;
+		*) files="$files $file" ;;
+	esac
+done
+
+${CC:-cc} -std=gnu99 ${CFLAGS:--O2 -g} -I"$source" -o "$build/$program" "$here/$program.c" $files -lpthread -lm
+if [ $program = kernels ]; then
+	exec "$build/$program" "$@"
+fi
+${CC:-cc} -std=gnu99 ${CFLAGS:--O2 -g} -I"$source" -o "$build/ARchiver" "$source"/*.c -lpthread -lm
+exec "$build/$program" --tool "$build/ARchiver" "$@"
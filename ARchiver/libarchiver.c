@@ -0,0 +1,1168 @@
+/**
+ * @file   libarchiver.c
+ * @author Adrian Rasmussen
+ *
+ * @brief Buffer to buffer and streaming compression, for programs that link the codec in instead of running
+ *		  the command line tool. Blocks are coded by the same {@link compressBlock} and {@link decompressBlock}
+ *		  as the tool uses, one at a time on the calling thread, so archives are interchangeable with the tool's.
+ *		  Buffers the API allocates come from the caller's allocator, and so does the scratch memory the block
+ *		  coders allocate on the calling thread while a call is running, through {@link setThreadAllocator}.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libarchiver.h"
+#include "Codec.h"
+#include "Format.h"
+#include "Stats.h"
+#include "Memory.h"
+#include "Tiny.h"
+
+typedef enum StreamState
+{
+	STREAM_HEADER,        /* Reading the file header */
+	STREAM_BLOCK_HEADER,  /* Reading a block header */
+	STREAM_BLOCK_DATA,    /* Reading a block's trees and data */
+	STREAM_OUTPUT,        /* Writing out a decoded block */
+	STREAM_TINY,          /* Collecting a compact frame, which is decoded at the end */
+	STREAM_DONE           /* Every block has been read, anything after is ignored */
+} StreamState;
+
+struct ar_stream
+{
+	ar_allocator allocator;
+	int compressing;
+	int status;  /* AR_OK, or the first error, which every later call returns */
+	StreamState state;  /* Decompression only */
+	ARHeader header;
+	ARContext context;
+	Pipeline pipeline;  /* Only its context is used, to run the block coders */
+	Block block;
+	unsigned char frame[AR_HEADER_SIZE];  /* Header being written before the block output, or being read */
+	int frameSize;  /* Bytes of frame to write or read */
+	int framePosition;  /* Bytes of frame written or read so far */
+	int outputPosition;  /* Bytes of block.output written so far */
+	int needed;  /* Bytes of block data to read, when decompressing */
+	int ended;  /* Set once the end marker has been added, when compressing */
+	unsigned int checksum;  /* CRC32C of all the data so far */
+};
+
+static void* allocate( const ar_allocator *allocator, size_t size);
+static void release( const ar_allocator *allocator, void *pointer);
+static int drainStream( ar_stream *stream, unsigned char *output, size_t capacity, size_t *outputSize);
+static int compressStreamBlock( ar_stream *stream);
+static int startDecompress( ar_stream *stream);
+static int readStreamBlockHeader( ar_stream *stream);
+static int decompressStreamBlock( ar_stream *stream);
+static int startTinyStream( ar_stream *stream);
+static int decompressTinyStream( ar_stream *stream);
+static int compressBuffer( const void *input, size_t inputSize, void *output, size_t outputCapacity, size_t *outputSize,
+						   int level, const ar_allocator *allocator);
+static int decompressBuffer( const void *input, size_t inputSize, void *output, size_t outputCapacity, size_t *outputSize,
+							 const ar_allocator *allocator);
+static int updateStream( ar_stream *stream, const void *input, size_t inputSize, size_t *inputUsed,
+						 void *output, size_t outputCapacity, size_t *outputSize);
+static int finishStream( ar_stream *stream, void *output, size_t outputCapacity, size_t *outputSize);
+static int checkIndex( const unsigned char *input, size_t inputSize, const ARHeader *header, const unsigned char *output, size_t size);
+
+/**
+ * Method:    allocate
+ * FullName:  allocate
+ * Access:    private
+ * @param 	  allocator - caller's allocator, with alloc NULL for malloc
+ * @param 	  size - bytes to allocate
+ * @return    the memory, or NULL
+ **/
+static void* allocate( const ar_allocator *allocator, size_t size)
+{
+	return allocator->alloc != NULL ? allocator->alloc(allocator->opaque, size) : arMalloc(size);
+}
+
+/**
+ * Method:    release
+ * FullName:  release
+ * Access:    private
+ * @param 	  allocator - allocator the memory came from
+ * @param 	  pointer - memory to free, may be NULL
+ **/
+static void release( const ar_allocator *allocator, void *pointer)
+{
+	if ( pointer == NULL)
+	{
+		return;
+	}
+	if ( allocator->alloc == NULL)
+	{
+		arFree(pointer);
+	}
+	else if ( allocator->free != NULL)
+	{
+		allocator->free(allocator->opaque, pointer);
+	}
+}
+
+/**
+ * Method:    ar_compress_bound
+ * FullName:  ar_compress_bound
+ * Access:    public
+ * @brief     Largest output {@link ar_compress} or a compressing stream can produce. A block that would grow
+ *			  is stored, so this is the input plus the headers of the most blocks any level could use
+ * @param 	  inputSize - bytes to compress
+ * @return    output buffer size that is always enough
+ **/
+size_t ar_compress_bound( size_t inputSize)
+{
+	size_t blockSize, numBlocks;
+	int i;
+
+	blockSize = (size_t) getLevel(AR_MIN_LEVEL)->blockSize;
+	for ( i = AR_MIN_LEVEL + 1; i <= AR_MAX_LEVEL; i++)
+	{
+		if ( (size_t) getLevel(i)->blockSize < blockSize)
+		{
+			blockSize = (size_t) getLevel(i)->blockSize;
+		}
+	}
+	numBlocks = inputSize / blockSize + 1;
+	/*The extra block header is a stream's end marker*/
+	return AR_HEADER_SIZE + (numBlocks + 1) * AR_BLOCK_HEADER_SIZE + inputSize + AR_MEMBER_SIZE;
+}
+
+/**
+ * Method:    ar_compress
+ * FullName:  ar_compress
+ * Access:    public
+ * @brief     Compresses a buffer into a complete archive with a one member index. Blocks are coded straight
+ *			  into the output buffer when there is room, so only a small buffer is allocated. Up to AR_TINY_MAX
+ *			  bytes are written as a compact frame instead, with no header, tree or index
+ * @param 	  input - data to compress, may be NULL if inputSize is 0
+ * @param 	  inputSize - bytes of input
+ * @param 	  output - buffer for the archive, {@link ar_compress_bound} bytes is always enough
+ * @param 	  outputCapacity - size of output
+ * @param 	  outputSize - set to the size of the archive
+ * @param 	  level - compression level, 1 to 9
+ * @param 	  allocator - allocator to use, or NULL for malloc
+ * @return    AR_OK, or AR_ERROR_*
+ **/
+int ar_compress( const void *input, size_t inputSize, void *output, size_t outputCapacity, size_t *outputSize,
+				 int level, const ar_allocator *allocator)
+{
+	ar_allocator previous;
+	int status;
+
+	/*Scratch memory the block coders allocate comes from the caller's allocator too*/
+	if ( setThreadAllocator(allocator, &previous) != EXIT_SUCCESS)
+	{
+		return AR_ERROR_MEMORY;
+	}
+	status = compressBuffer(input, inputSize, output, outputCapacity, outputSize, level, allocator);
+	setThreadAllocator(&previous, NULL);
+	return status;
+}
+
+/**
+ * Method:    compressBuffer
+ * FullName:  compressBuffer
+ * Access:    private
+ * @brief     Does the work of {@link ar_compress}, with the calling thread's allocator set
+ **/
+static int compressBuffer( const void *input, size_t inputSize, void *output, size_t outputCapacity, size_t *outputSize,
+						   int level, const ar_allocator *allocator)
+{
+	const ARLevel *settings = getLevel(level);
+	const unsigned char *in = (const unsigned char*) input;
+	unsigned char *out = (unsigned char*) output;
+	unsigned char *scratch;
+	ar_allocator defaultAllocator;
+	ARHeader header;
+	ARMember member;
+	ARContext context;
+	Pipeline pipeline;
+	Block block;
+	size_t position, used, room;
+	int direct, frameSize, status;
+
+	if ( outputSize == NULL || settings == NULL || (input == NULL && inputSize > 0) || output == NULL)
+	{
+		return AR_ERROR_PARAMETER;
+	}
+	*outputSize = 0;
+	if ( inputSize <= AR_TINY_MAX)
+	{
+		if ( tinyCompress(in, (int) inputSize, out, outputCapacity < AR_TINY_FRAME_MAX ? (int) outputCapacity :
+						  AR_TINY_FRAME_MAX, &frameSize) != EXIT_SUCCESS)
+		{
+			return AR_ERROR_DST_SIZE;
+		}
+		*outputSize = (size_t) frameSize;
+		return AR_OK;
+	}
+	if ( allocator == NULL)
+	{
+		memset(&defaultAllocator, 0, sizeof(defaultAllocator));
+		allocator = &defaultAllocator;
+	}
+	if ( outputCapacity < AR_HEADER_SIZE + AR_MEMBER_SIZE)
+	{
+		return AR_ERROR_DST_SIZE;
+	}
+	scratch = (unsigned char*) allocate(allocator, settings->blockSize + AR_MAX_TREE_SIZE);
+	if ( scratch == NULL)
+	{
+		return AR_ERROR_MEMORY;
+	}
+
+	memset(&context, 0, sizeof(context));
+	context.level = settings;
+	pipeline.context = &context;
+	memset(&block, 0, sizeof(block));
+	block.inputCapacity = settings->blockSize;
+	block.outputCapacity = settings->blockSize + AR_MAX_TREE_SIZE;
+	memset(&member, 0, sizeof(member));
+	member.offset = AR_HEADER_SIZE;
+	member.level = level;
+
+	status = AR_OK;
+	position = AR_HEADER_SIZE;
+	for ( used = 0; used < inputSize; used += (size_t) block.inputSize)
+	{
+		block.input = (unsigned char*) in + used;
+		block.inputSize = inputSize - used < (size_t) settings->blockSize ? (int) (inputSize - used) : settings->blockSize;
+		room = outputCapacity - position;
+		direct = room >= (size_t) (AR_BLOCK_HEADER_SIZE + block.inputSize + AR_MAX_TREE_SIZE);
+		block.output = direct ? out + position + AR_BLOCK_HEADER_SIZE : scratch;
+		if ( compressBlock(&pipeline, &block) != EXIT_SUCCESS)
+		{
+			status = AR_ERROR_MEMORY;
+			break;
+		}
+		if ( room < (size_t) (AR_BLOCK_HEADER_SIZE + block.outputSize))
+		{
+			status = AR_ERROR_DST_SIZE;
+			break;
+		}
+		packBlockHeader(&block.header, out + position);
+		if ( !direct)
+		{
+			memcpy(out + position + AR_BLOCK_HEADER_SIZE, scratch, block.outputSize);
+		}
+		position += AR_BLOCK_HEADER_SIZE + block.outputSize;
+		member.checksum = crc32cCombine(member.checksum, block.header.checksum, block.inputSize);
+		member.numBlocks++;
+	}
+	release(allocator, scratch);
+
+	if ( status == AR_OK && outputCapacity - position < AR_MEMBER_SIZE)
+	{
+		status = AR_ERROR_DST_SIZE;
+	}
+	if ( status == AR_OK)
+	{
+		member.uncompressedDataSize = (long long) inputSize;
+		packMember(&member, out + position);
+
+		memset(&header, 0, sizeof(header));
+		header.blockSize = settings->blockSize;
+		header.numBlocks = member.numBlocks;
+		header.uncompressedDataSize = (long long) inputSize;
+		header.indexOffset = (long long) position;
+		header.numMembers = 1;
+		packHeader(&header, out);
+		*outputSize = position + AR_MEMBER_SIZE;
+	}
+	return status;
+}
+
+/**
+ * Method:    ar_decompress
+ * FullName:  ar_decompress
+ * Access:    public
+ * @brief     Decompresses a whole archive from a buffer. Blocks are decoded straight into the output buffer,
+ *			  and repeated chunks of a deduplicated archive are copied from where they were first decoded.
+ *			  Every block is checked against its checksum, and every member too when the index is present.
+ *			  A compact frame from a small input must fill the whole of input
+ * @param 	  input - the archive
+ * @param 	  inputSize - bytes of input
+ * @param 	  output - buffer for the data, the archive header's uncompressed size is enough
+ * @param 	  outputCapacity - size of output
+ * @param 	  outputSize - set to the size of the data
+ * @param 	  allocator - allocator to use, or NULL for malloc
+ * @return    AR_OK, or AR_ERROR_*
+ **/
+int ar_decompress( const void *input, size_t inputSize, void *output, size_t outputCapacity, size_t *outputSize,
+				   const ar_allocator *allocator)
+{
+	ar_allocator previous;
+	int status;
+
+	/*Scratch memory the block coders allocate comes from the caller's allocator too*/
+	if ( setThreadAllocator(allocator, &previous) != EXIT_SUCCESS)
+	{
+		return AR_ERROR_MEMORY;
+	}
+	status = decompressBuffer(input, inputSize, output, outputCapacity, outputSize, allocator);
+	setThreadAllocator(&previous, NULL);
+	return status;
+}
+
+/**
+ * Method:    decompressBuffer
+ * FullName:  decompressBuffer
+ * Access:    private
+ * @brief     Does the work of {@link ar_decompress}, with the calling thread's allocator set
+ **/
+static int decompressBuffer( const void *input, size_t inputSize, void *output, size_t outputCapacity, size_t *outputSize,
+							 const ar_allocator *allocator)
+{
+	const unsigned char *in = (const unsigned char*) input;
+	unsigned char *out = (unsigned char*) output;
+	unsigned char *scratch;
+	ar_allocator defaultAllocator;
+	ARHeader header;
+	ARContext context;
+	ARChunkRef ref;
+	Pipeline pipeline;
+	Block block;
+	size_t position, written;
+	long long numBlocks;
+	int numRefs, size, piece, i, status;
+
+	if ( outputSize == NULL || input == NULL || (output == NULL && outputCapacity > 0))
+	{
+		return AR_ERROR_PARAMETER;
+	}
+	*outputSize = 0;
+	if ( allocator == NULL)
+	{
+		memset(&defaultAllocator, 0, sizeof(defaultAllocator));
+		allocator = &defaultAllocator;
+	}
+	if ( inputSize > 0 && isTinyTag(in[0]))
+	{
+		size = tinySize(in, inputSize);
+		if ( size < 0)
+		{
+			return AR_ERROR_CORRUPT;
+		}
+		if ( outputCapacity < (size_t) size)
+		{
+			return AR_ERROR_DST_SIZE;
+		}
+		if ( tinyDecompress(in, inputSize, out, size) != EXIT_SUCCESS)
+		{
+			return AR_ERROR_CORRUPT;
+		}
+		*outputSize = (size_t) size;
+		return AR_OK;
+	}
+	if ( inputSize < AR_HEADER_SIZE || unpackHeader(in, &header) != EXIT_SUCCESS)
+	{
+		return AR_ERROR_CORRUPT;
+	}
+	if ( header.flags & (AR_FLAG_ADAPTIVE | AR_FLAG_DELTA))
+	{
+		return AR_ERROR_UNSUPPORTED;
+	}
+	if ( header.blockSize <= 0 || header.blockSize > AR_MAX_BLOCK_SIZE || header.numBlocks < 0)
+	{
+		return AR_ERROR_CORRUPT;
+	}
+	/*New chunks of a deduplicated block are decoded aside, then put in place around the repeats*/
+	scratch = NULL;
+	if ( header.flags & AR_FLAG_DEDUP)
+	{
+		scratch = (unsigned char*) allocate(allocator, header.blockSize);
+		if ( scratch == NULL)
+		{
+			return AR_ERROR_MEMORY;
+		}
+	}
+
+	memset(&context, 0, sizeof(context));
+	pipeline.context = &context;
+	memset(&block, 0, sizeof(block));
+	status = AR_OK;
+	position = AR_HEADER_SIZE;
+	written = 0;
+	for ( numBlocks = 0; (header.flags & AR_FLAG_STREAMED) || numBlocks < header.numBlocks; numBlocks++)
+	{
+		if ( inputSize - position < AR_BLOCK_HEADER_SIZE)
+		{
+			status = AR_ERROR_CORRUPT;
+			break;
+		}
+		unpackBlockHeader(in + position, &block.header);
+		position += AR_BLOCK_HEADER_SIZE;
+		if ( block.header.method == AR_METHOD_END && (header.flags & AR_FLAG_STREAMED))
+		{
+			if ( crc32c(0, out, written) != block.header.checksum)
+			{
+				status = AR_ERROR_CORRUPT;
+			}
+			break;
+		}
+
+		numRefs = 0;
+		if ( header.flags & AR_FLAG_DEDUP)
+		{
+			if ( inputSize - position < 4)
+			{
+				status = AR_ERROR_CORRUPT;
+				break;
+			}
+			numRefs = (int) getLE32(in + position);
+			if ( numRefs <= 0 || numRefs > AR_DEDUP_MAX_REFS(header.blockSize) ||
+				 (inputSize - position - 4) / AR_CHUNK_REF_SIZE < (size_t) numRefs)
+			{
+				status = AR_ERROR_CORRUPT;
+				break;
+			}
+			position += 4;
+		}
+		if ( checkBlockHeader(&block.header, header.blockSize, 0, numRefs > 0) != EXIT_SUCCESS)
+		{
+			status = AR_ERROR_CORRUPT;
+			break;
+		}
+		size = block.header.huffTreeSize + (block.header.compressedDataSize + 7) / 8;
+		if ( inputSize - position - (size_t) numRefs * AR_CHUNK_REF_SIZE < (size_t) size)
+		{
+			status = AR_ERROR_CORRUPT;
+			break;
+		}
+		block.input = (unsigned char*) in + position + numRefs * AR_CHUNK_REF_SIZE;
+		block.inputSize = size;
+		if ( scratch != NULL)
+		{
+			block.output = scratch;
+		}
+		else if ( outputCapacity - written < (size_t) block.header.uncompressedDataSize)
+		{
+			status = AR_ERROR_DST_SIZE;
+			break;
+		}
+		else
+		{
+			block.output = out + written;
+		}
+		if ( decompressBlock(&pipeline, &block) != EXIT_SUCCESS)
+		{
+			status = AR_ERROR_CORRUPT;
+			break;
+		}
+
+		if ( scratch == NULL)
+		{
+			written += (size_t) block.outputSize;
+		}
+		else
+		{
+			piece = 0;
+			for ( i = 0; i < numRefs && status == AR_OK; i++)
+			{
+				unpackChunkRef(in + position + i * AR_CHUNK_REF_SIZE, &ref);
+				if ( ref.size <= 0 || ref.size > AR_CDC_MAX_CHUNK || ref.offset < -1 ||
+					 (ref.offset < 0 && ref.size > block.outputSize - piece) ||
+					 (ref.offset >= 0 && (size_t) (ref.offset + ref.size) > written))
+				{
+					status = AR_ERROR_CORRUPT;
+				}
+				else if ( outputCapacity - written < (size_t) ref.size)
+				{
+					status = AR_ERROR_DST_SIZE;
+				}
+				else
+				{
+					memcpy(out + written, ref.offset < 0 ? scratch + piece : out + ref.offset, ref.size);
+					if ( ref.offset < 0)
+					{
+						piece += ref.size;
+					}
+					written += (size_t) ref.size;
+				}
+			}
+			if ( status == AR_OK && piece != block.outputSize)
+			{
+				status = AR_ERROR_CORRUPT;
+			}
+			if ( status != AR_OK)
+			{
+				break;
+			}
+		}
+		position += numRefs * AR_CHUNK_REF_SIZE + size;
+	}
+	release(allocator, scratch);
+
+	if ( status == AR_OK && !(header.flags & AR_FLAG_STREAMED) && header.indexOffset > 0)
+	{
+		status = checkIndex(in, inputSize, &header, out, written);
+	}
+	if ( status == AR_OK)
+	{
+		*outputSize = written;
+	}
+	return status;
+}
+
+/**
+ * Method:    checkIndex
+ * FullName:  checkIndex
+ * Access:    private
+ * @brief     Checks the decompressed data of each member in an archive's index against the member's checksum
+ * @param 	  input - the archive
+ * @param 	  inputSize - bytes of input
+ * @param 	  header - the archive's header
+ * @param 	  output - the decompressed data of every member, one after another
+ * @param 	  size - bytes of output
+ * @return    AR_OK, or AR_ERROR_CORRUPT if the index is bad or a member does not match
+ **/
+static int checkIndex( const unsigned char *input, size_t inputSize, const ARHeader *header, const unsigned char *output, size_t size)
+{
+	ARMember member;
+	size_t start;
+	int i;
+
+	if ( header->numMembers < 0 || header->indexOffset < AR_HEADER_SIZE || (size_t) header->indexOffset > inputSize ||
+		 (inputSize - (size_t) header->indexOffset) / AR_MEMBER_SIZE < (size_t) header->numMembers)
+	{
+		return AR_ERROR_CORRUPT;
+	}
+	start = 0;
+	for ( i = 0; i < header->numMembers; i++)
+	{
+		unpackMember(input + header->indexOffset + (size_t) i * AR_MEMBER_SIZE, &member);
+		if ( member.uncompressedDataSize < 0 || (size_t) member.uncompressedDataSize > size - start ||
+			 crc32c(0, output + start, (size_t) member.uncompressedDataSize) != member.checksum)
+		{
+			return AR_ERROR_CORRUPT;
+		}
+		start += (size_t) member.uncompressedDataSize;
+	}
+	return start == size ? AR_OK : AR_ERROR_CORRUPT;
+}
+
+/**
+ * Method:    ar_stream_compress_new
+ * FullName:  ar_stream_compress_new
+ * Access:    public
+ * @brief     Starts compressing data that arrives a piece at a time. Input is collected into blocks of the
+ *			  level's block size, so at most one block of input and one of output are held
+ * @param 	  level - compression level, 1 to 9
+ * @param 	  allocator - allocator to use for the stream, or NULL for malloc. It is copied
+ * @return    the stream, or NULL if the level is invalid or memory could not be allocated
+ **/
+ar_stream* ar_stream_compress_new( int level, const ar_allocator *allocator)
+{
+	const ARLevel *settings = getLevel(level);
+	ar_allocator chosen;
+	ar_stream *stream;
+
+	memset(&chosen, 0, sizeof(chosen));
+	if ( allocator != NULL)
+	{
+		chosen = *allocator;
+	}
+	if ( settings == NULL)
+	{
+		return NULL;
+	}
+	stream = (ar_stream*) allocate(&chosen, sizeof(ar_stream));
+	if ( stream == NULL)
+	{
+		return NULL;
+	}
+	memset(stream, 0, sizeof(*stream));
+	stream->allocator = chosen;
+	stream->compressing = 1;
+	stream->context.level = settings;
+	stream->context.flags = AR_FLAG_STREAMED;
+	stream->pipeline.context = &stream->context;
+	stream->block.inputCapacity = settings->blockSize;
+	stream->block.outputCapacity = settings->blockSize + AR_MAX_TREE_SIZE;
+	stream->block.input = (unsigned char*) allocate(&chosen, stream->block.inputCapacity);
+	stream->block.output = (unsigned char*) allocate(&chosen, stream->block.outputCapacity);
+	if ( stream->block.input == NULL || stream->block.output == NULL)
+	{
+		ar_stream_free(stream);
+		return NULL;
+	}
+
+	/*The block count is never known, so the header is final from the start*/
+	stream->header.blockSize = settings->blockSize;
+	stream->header.flags = AR_FLAG_STREAMED;
+	packHeader(&stream->header, stream->frame);
+	stream->frameSize = AR_HEADER_SIZE;
+	return stream;
+}
+
+/**
+ * Method:    ar_stream_decompress_new
+ * FullName:  ar_stream_decompress_new
+ * Access:    public
+ * @brief     Starts decompressing an archive that arrives a piece at a time. Block buffers are allocated
+ *			  once the header has been read
+ * @param 	  allocator - allocator to use for the stream, or NULL for malloc. It is copied
+ * @return    the stream, or NULL if memory could not be allocated
+ **/
+ar_stream* ar_stream_decompress_new( const ar_allocator *allocator)
+{
+	ar_allocator chosen;
+	ar_stream *stream;
+
+	memset(&chosen, 0, sizeof(chosen));
+	if ( allocator != NULL)
+	{
+		chosen = *allocator;
+	}
+	stream = (ar_stream*) allocate(&chosen, sizeof(ar_stream));
+	if ( stream == NULL)
+	{
+		return NULL;
+	}
+	memset(stream, 0, sizeof(*stream));
+	stream->allocator = chosen;
+	stream->pipeline.context = &stream->context;
+	stream->state = STREAM_HEADER;
+	stream->frameSize = AR_HEADER_SIZE;
+	return stream;
+}
+
+/**
+ * Method:    drainStream
+ * FullName:  drainStream
+ * Access:    private
+ * @brief     Copies as much of the pending frame and block output as fits into the caller's buffer
+ * @param 	  stream - the stream
+ * @param 	  output - caller's buffer
+ * @param 	  capacity - size of output
+ * @param 	  outputSize - bytes of output used so far, increased by what is copied
+ * @return    1 if nothing is left pending, otherwise 0
+ **/
+static int drainStream( ar_stream *stream, unsigned char *output, size_t capacity, size_t *outputSize)
+{
+	size_t size;
+
+	size = (size_t) (stream->frameSize - stream->framePosition);
+	if ( size > capacity - *outputSize)
+	{
+		size = capacity - *outputSize;
+	}
+	if ( size > 0)
+	{
+		memcpy(output + *outputSize, stream->frame + stream->framePosition, size);
+		stream->framePosition += (int) size;
+		*outputSize += size;
+	}
+	if ( stream->framePosition < stream->frameSize)
+	{
+		return 0;
+	}
+
+	size = (size_t) (stream->block.outputSize - stream->outputPosition);
+	if ( size > capacity - *outputSize)
+	{
+		size = capacity - *outputSize;
+	}
+	if ( size > 0)
+	{
+		memcpy(output + *outputSize, stream->block.output + stream->outputPosition, size);
+		stream->outputPosition += (int) size;
+		*outputSize += size;
+	}
+	if ( stream->outputPosition < stream->block.outputSize)
+	{
+		return 0;
+	}
+
+	stream->frameSize = 0;
+	stream->framePosition = 0;
+	stream->block.outputSize = 0;
+	stream->outputPosition = 0;
+	return 1;
+}
+
+/**
+ * Method:    compressStreamBlock
+ * FullName:  compressStreamBlock
+ * Access:    private
+ * @brief     Compresses the collected input, leaving its block header in frame and its data in block.output
+ * @param 	  stream - compressing stream, with nothing pending
+ * @return    AR_OK, or AR_ERROR_MEMORY
+ **/
+static int compressStreamBlock( ar_stream *stream)
+{
+	if ( compressBlock(&stream->pipeline, &stream->block) != EXIT_SUCCESS)
+	{
+		return AR_ERROR_MEMORY;
+	}
+	stream->checksum = crc32cCombine(stream->checksum, stream->block.header.checksum, stream->block.inputSize);
+	packBlockHeader(&stream->block.header, stream->frame);
+	stream->frameSize = AR_BLOCK_HEADER_SIZE;
+	stream->framePosition = 0;
+	stream->outputPosition = 0;
+	stream->block.inputSize = 0;
+	return AR_OK;
+}
+
+/**
+ * Method:    startDecompress
+ * FullName:  startDecompress
+ * Access:    private
+ * @brief     Decodes the file header once it has been read, and allocates the block buffers
+ * @param 	  stream - decompressing stream, with the header in frame
+ * @return    AR_OK, or AR_ERROR_*
+ **/
+static int startDecompress( ar_stream *stream)
+{
+	ARHeader *header = &stream->header;
+
+	if ( unpackHeader(stream->frame, header) != EXIT_SUCCESS)
+	{
+		return AR_ERROR_CORRUPT;
+	}
+	if ( header->flags & (AR_FLAG_ADAPTIVE | AR_FLAG_DELTA | AR_FLAG_DEDUP))
+	{
+		return AR_ERROR_UNSUPPORTED;
+	}
+	if ( header->blockSize <= 0 || header->blockSize > AR_MAX_BLOCK_SIZE || header->numBlocks < 0)
+	{
+		return AR_ERROR_CORRUPT;
+	}
+	stream->block.inputCapacity = header->blockSize + AR_MAX_TREE_SIZE;
+	stream->block.outputCapacity = header->blockSize;
+	stream->block.input = (unsigned char*) allocate(&stream->allocator, stream->block.inputCapacity);
+	stream->block.output = (unsigned char*) allocate(&stream->allocator, stream->block.outputCapacity);
+	if ( stream->block.input == NULL || stream->block.output == NULL)
+	{
+		return AR_ERROR_MEMORY;
+	}
+
+	stream->context.remaining = (header->flags & AR_FLAG_STREAMED) ? -1 : header->numBlocks;
+	stream->state = stream->context.remaining == 0 ? STREAM_DONE : STREAM_BLOCK_HEADER;
+	stream->frameSize = AR_BLOCK_HEADER_SIZE;
+	stream->framePosition = 0;
+	return AR_OK;
+}
+
+/**
+ * Method:    readStreamBlockHeader
+ * FullName:  readStreamBlockHeader
+ * Access:    private
+ * @brief     Decodes a block header once it has been read. The end marker of a streamed archive is checked
+ *			  against the checksum of everything decoded
+ * @param 	  stream - decompressing stream, with the block header in frame
+ * @return    AR_OK, or AR_ERROR_CORRUPT
+ **/
+static int readStreamBlockHeader( ar_stream *stream)
+{
+	ARBlockHeader *header = &stream->block.header;
+
+	unpackBlockHeader(stream->frame, header);
+	if ( header->method == AR_METHOD_END && (stream->header.flags & AR_FLAG_STREAMED))
+	{
+		stream->state = STREAM_DONE;
+		return header->checksum == stream->checksum ? AR_OK : AR_ERROR_CORRUPT;
+	}
+	if ( checkBlockHeader(header, stream->header.blockSize, 0, 0) != EXIT_SUCCESS)
+	{
+		return AR_ERROR_CORRUPT;
+	}
+	stream->needed = header->huffTreeSize + (header->compressedDataSize + 7) / 8;
+	stream->block.inputSize = 0;
+	stream->state = STREAM_BLOCK_DATA;
+	return AR_OK;
+}
+
+/**
+ * Method:    decompressStreamBlock
+ * FullName:  decompressStreamBlock
+ * Access:    private
+ * @brief     Decodes a block once all of its data has been read, leaving it in block.output to be written
+ * @param 	  stream - decompressing stream, with the block data in block.input
+ * @return    AR_OK, or AR_ERROR_CORRUPT
+ **/
+static int decompressStreamBlock( ar_stream *stream)
+{
+	if ( decompressBlock(&stream->pipeline, &stream->block) != EXIT_SUCCESS)
+	{
+		return AR_ERROR_CORRUPT;
+	}
+	stream->checksum = crc32cCombine(stream->checksum, stream->block.header.checksum, stream->block.outputSize);
+	stream->frameSize = 0;
+	stream->framePosition = 0;
+	stream->outputPosition = 0;
+	stream->state = STREAM_OUTPUT;
+	return AR_OK;
+}
+
+/**
+ * Method:    startTinyStream
+ * FullName:  startTinyStream
+ * Access:    private
+ * @brief     Allocates the buffers for a compact frame, once its tag has been seen
+ * @param 	  stream - decompressing stream, with nothing of the header read yet
+ * @return    AR_OK, or AR_ERROR_MEMORY
+ **/
+static int startTinyStream( ar_stream *stream)
+{
+	stream->block.inputCapacity = AR_TINY_FRAME_MAX;
+	stream->block.outputCapacity = AR_TINY_MAX;
+	stream->block.input = (unsigned char*) allocate(&stream->allocator, stream->block.inputCapacity);
+	stream->block.output = (unsigned char*) allocate(&stream->allocator, stream->block.outputCapacity);
+	if ( stream->block.input == NULL || stream->block.output == NULL)
+	{
+		return AR_ERROR_MEMORY;
+	}
+	stream->block.inputSize = 0;
+	stream->state = STREAM_TINY;
+	return AR_OK;
+}
+
+/**
+ * Method:    decompressTinyStream
+ * FullName:  decompressTinyStream
+ * Access:    private
+ * @brief     Decodes a compact frame once all of the input has been seen, leaving it in block.output to be written
+ * @param 	  stream - decompressing stream, with the frame in block.input
+ * @return    AR_OK, or AR_ERROR_CORRUPT
+ **/
+static int decompressTinyStream( ar_stream *stream)
+{
+	int size = tinySize(stream->block.input, (size_t) stream->block.inputSize);
+
+	if ( size < 0 || tinyDecompress(stream->block.input, (size_t) stream->block.inputSize, stream->block.output,
+									 stream->block.outputCapacity) != EXIT_SUCCESS)
+	{
+		return AR_ERROR_CORRUPT;
+	}
+	stream->block.outputSize = size;
+	stream->context.remaining = 1;
+	stream->frameSize = 0;
+	stream->framePosition = 0;
+	stream->outputPosition = 0;
+	stream->state = STREAM_OUTPUT;
+	return AR_OK;
+}
+
+/**
+ * Method:    ar_stream_update
+ * FullName:  ar_stream_update
+ * Access:    public
+ * @brief     Passes more input to a stream and collects whatever output is ready. Input is taken until the
+ *			  output buffer fills, so call again with the rest of the input once the output has been used
+ * @param 	  stream - the stream
+ * @param 	  input - next piece of input, may be NULL if inputSize is 0
+ * @param 	  inputSize - bytes of input
+ * @param 	  inputUsed - set to the bytes of input taken
+ * @param 	  output - buffer for output
+ * @param 	  outputCapacity - size of output
+ * @param 	  outputSize - set to the bytes of output written
+ * @return    AR_OK, or AR_ERROR_*. After an error the stream can only be freed
+ **/
+int ar_stream_update( ar_stream *stream, const void *input, size_t inputSize, size_t *inputUsed,
+					  void *output, size_t outputCapacity, size_t *outputSize)
+{
+	ar_allocator previous;
+	int status;
+
+	/*Scratch memory the block coders allocate comes from the caller's allocator too*/
+	if ( setThreadAllocator(stream != NULL ? &stream->allocator : NULL, &previous) != EXIT_SUCCESS)
+	{
+		return AR_ERROR_MEMORY;
+	}
+	status = updateStream(stream, input, inputSize, inputUsed, output, outputCapacity, outputSize);
+	setThreadAllocator(&previous, NULL);
+	return status;
+}
+
+/**
+ * Method:    updateStream
+ * FullName:  updateStream
+ * Access:    private
+ * @brief     Does the work of {@link ar_stream_update}, with the calling thread's allocator set
+ **/
+static int updateStream( ar_stream *stream, const void *input, size_t inputSize, size_t *inputUsed,
+						 void *output, size_t outputCapacity, size_t *outputSize)
+{
+	const unsigned char *in = (const unsigned char*) input;
+	unsigned char *out = (unsigned char*) output;
+	unsigned char *target;
+	size_t size;
+	int needed;
+
+	if ( stream == NULL || inputUsed == NULL || outputSize == NULL || (input == NULL && inputSize > 0) ||
+		 (output == NULL && outputCapacity > 0) || (stream->compressing && stream->ended))
+	{
+		return AR_ERROR_PARAMETER;
+	}
+	*inputUsed = 0;
+	*outputSize = 0;
+
+	while ( stream->status == AR_OK)
+	{
+		if ( stream->compressing)
+		{
+			if ( !drainStream(stream, out, outputCapacity, outputSize) || *inputUsed == inputSize)
+			{
+				break;
+			}
+			size = (size_t) (stream->block.inputCapacity - stream->block.inputSize);
+			if ( size > inputSize - *inputUsed)
+			{
+				size = inputSize - *inputUsed;
+			}
+			memcpy(stream->block.input + stream->block.inputSize, in + *inputUsed, size);
+			stream->block.inputSize += (int) size;
+			*inputUsed += size;
+			if ( stream->block.inputSize == stream->block.inputCapacity)
+			{
+				stream->status = compressStreamBlock(stream);
+			}
+		}
+		else if ( stream->state == STREAM_OUTPUT)
+		{
+			if ( !drainStream(stream, out, outputCapacity, outputSize))
+			{
+				break;
+			}
+			if ( stream->context.remaining > 0)
+			{
+				stream->context.remaining--;
+			}
+			stream->state = stream->context.remaining == 0 ? STREAM_DONE : STREAM_BLOCK_HEADER;
+			stream->frameSize = AR_BLOCK_HEADER_SIZE;
+			stream->framePosition = 0;
+		}
+		else if ( stream->state == STREAM_DONE)
+		{
+			/*The index of a complete archive follows the blocks, and isn't needed*/
+			*inputUsed = inputSize;
+			break;
+		}
+		else if ( stream->state == STREAM_TINY)
+		{
+			/*A compact frame doesn't say where it ends, so everything up to ar_stream_finish is part of it*/
+			size = inputSize - *inputUsed;
+			if ( size > (size_t) (stream->block.inputCapacity - stream->block.inputSize))
+			{
+				stream->status = AR_ERROR_CORRUPT;
+				break;
+			}
+			memcpy(stream->block.input + stream->block.inputSize, in + *inputUsed, size);
+			stream->block.inputSize += (int) size;
+			*inputUsed = inputSize;
+			break;
+		}
+		else if ( stream->state == STREAM_HEADER && stream->framePosition == 0 && *inputUsed < inputSize &&
+				  isTinyTag(in[*inputUsed]))
+		{
+			stream->status = startTinyStream(stream);
+		}
+		else
+		{
+			if ( stream->state == STREAM_BLOCK_DATA)
+			{
+				target = stream->block.input + stream->block.inputSize;
+				needed = stream->needed - stream->block.inputSize;
+			}
+			else
+			{
+				target = stream->frame + stream->framePosition;
+				needed = stream->frameSize - stream->framePosition;
+			}
+			size = inputSize - *inputUsed < (size_t) needed ? inputSize - *inputUsed : (size_t) needed;
+			if ( size > 0)
+			{
+				memcpy(target, in + *inputUsed, size);
+				*inputUsed += size;
+			}
+			if ( size < (size_t) needed)
+			{
+				if ( stream->state == STREAM_BLOCK_DATA)
+				{
+					stream->block.inputSize += (int) size;
+				}
+				else
+				{
+					stream->framePosition += (int) size;
+				}
+				break;
+			}
+
+			if ( stream->state == STREAM_HEADER)
+			{
+				stream->status = startDecompress(stream);
+			}
+			else if ( stream->state == STREAM_BLOCK_HEADER)
+			{
+				stream->status = readStreamBlockHeader(stream);
+			}
+			else
+			{
+				stream->block.inputSize = stream->needed;
+				stream->status = decompressStreamBlock(stream);
+			}
+		}
+	}
+	return stream->status;
+}
+
+/**
+ * Method:    ar_stream_finish
+ * FullName:  ar_stream_finish
+ * Access:    public
+ * @brief     Ends a stream. When compressing, the last partial block and the end marker are written. When
+ *			  decompressing, the rest of the decoded data is written and the archive is checked to be complete.
+ *			  A compact frame is only decoded here, so all of its data comes from this call
+ * @param 	  stream - the stream
+ * @param 	  output - buffer for output
+ * @param 	  outputCapacity - size of output
+ * @param 	  outputSize - set to the bytes of output written
+ * @return    AR_OK once everything has been written, AR_MORE if it should be called again with more room,
+ *			  or AR_ERROR_*
+ **/
+int ar_stream_finish( ar_stream *stream, void *output, size_t outputCapacity, size_t *outputSize)
+{
+	ar_allocator previous;
+	int status;
+
+	/*Scratch memory the block coders allocate comes from the caller's allocator too*/
+	if ( setThreadAllocator(stream != NULL ? &stream->allocator : NULL, &previous) != EXIT_SUCCESS)
+	{
+		return AR_ERROR_MEMORY;
+	}
+	status = finishStream(stream, output, outputCapacity, outputSize);
+	setThreadAllocator(&previous, NULL);
+	return status;
+}
+
+/**
+ * Method:    finishStream
+ * FullName:  finishStream
+ * Access:    private
+ * @brief     Does the work of {@link ar_stream_finish}, with the calling thread's allocator set
+ **/
+static int finishStream( ar_stream *stream, void *output, size_t outputCapacity, size_t *outputSize)
+{
+	unsigned char *out = (unsigned char*) output;
+	ARBlockHeader end;
+	size_t used;
+
+	if ( stream == NULL || outputSize == NULL || (output == NULL && outputCapacity > 0))
+	{
+		return AR_ERROR_PARAMETER;
+	}
+	*outputSize = 0;
+	if ( !stream->compressing)
+	{
+		if ( stream->state == STREAM_TINY && stream->status == AR_OK)
+		{
+			stream->status = decompressTinyStream(stream);
+		}
+		if ( updateStream(stream, NULL, 0, &used, output, outputCapacity, outputSize) != AR_OK)
+		{
+			return stream->status;
+		}
+		if ( stream->state == STREAM_OUTPUT)
+		{
+			return AR_MORE;
+		}
+		if ( stream->state != STREAM_DONE)
+		{
+			stream->status = AR_ERROR_CORRUPT;
+		}
+		return stream->status;
+	}
+
+	while ( stream->status == AR_OK)
+	{
+		if ( !drainStream(stream, out, outputCapacity, outputSize))
+		{
+			return AR_MORE;
+		}
+		if ( stream->block.inputSize > 0)
+		{
+			stream->status = compressStreamBlock(stream);
+		}
+		else if ( !stream->ended)
+		{
+			memset(&end, 0, sizeof(end));
+			end.method = AR_METHOD_END;
+			end.checksum = stream->checksum;
+			packBlockHeader(&end, stream->frame);
+			stream->frameSize = AR_BLOCK_HEADER_SIZE;
+			stream->framePosition = 0;
+			stream->ended = 1;
+		}
+		else
+		{
+			return AR_OK;
+		}
+	}
+	return stream->status;
+}
+
+/**
+ * Method:    ar_stream_free
+ * FullName:  ar_stream_free
+ * Access:    public
+ * @param 	  stream - stream to free, may be NULL
+ **/
+void ar_stream_free( ar_stream *stream)
+{
+	ar_allocator allocator;
+
+	if ( stream == NULL)
+	{
+		return;
+	}
+	allocator = stream->allocator;
+	release(&allocator, stream->block.input);
+	release(&allocator, stream->block.output);
+	release(&allocator, stream);
+}
+
+/**
+ * Method:    ar_error_string
+ * FullName:  ar_error_string
+ * Access:    public
+ * @param 	  code - AR_OK, AR_MORE or AR_ERROR_*
+ * @return    description of the code
+ **/
+const char* ar_error_string( int code)
+{
+	switch ( code)
+	{
+	case AR_OK:
+		return "Success";
+	case AR_MORE:
+		return "More output is waiting";
+	case AR_ERROR_DST_SIZE:
+		return "Output buffer is too small";
+	case AR_ERROR_CORRUPT:
+		return "Not a valid archive, or it is truncated or corrupt";
+	case AR_ERROR_MEMORY:
+		return "Could not allocate memory";
+	case AR_ERROR_PARAMETER:
+		return "Invalid parameter";
+	case AR_ERROR_UNSUPPORTED:
+		return "Archive needs a base file or the command line tool";
+	default:
+		return "Unknown error";
+	}
+}
+
+/**
+ * Method:    ar_set_stats_callback
+ * FullName:  ar_set_stats_callback
+ * Access:    public
+ * @brief     Times every stage of every block coded from now on, by this API or the pipeline, and passes each
+ *			  measurement to the callback. Process wide, so only call it while nothing is being coded
+ * @param 	  callback - called with each measurement, or NULL to stop timing
+ * @param 	  opaque - passed to the callback
+ **/
+void ar_set_stats_callback( ar_stats_callback callback, void *opaque)
+{
+	setStatsCallback(callback, opaque);
+}
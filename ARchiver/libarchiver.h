@@ -0,0 +1,85 @@
+/*
+ * File:   libarchiver.h
+ * Author: adrian
+ *
+ * In-memory compression API. Everything here works on caller supplied buffers,
+ * with no files, prompts or output: errors are only reported by the return codes.
+ * Build the library from every .c file except ARchiver.c and Server.c, which
+ * hold the command line tool.
+ *
+ * ar_compress() writes a complete .ar archive, with a one member index, that the
+ * command line tool can decompress, verify and add to. The ar_stream functions
+ * write an AR_FLAG_STREAMED archive front to back, for data whose size is not
+ * known in advance; the tool can decompress and verify those too.
+ * Inputs of at most 1 KB are written by ar_compress() as a compact frame of a few
+ * bytes plus the data, coded with a built in table when that is smaller. The
+ * tool and both decompressors read them, but the tool cannot add files to them.
+ * Archives made with -D can be decompressed by ar_decompress() but not by a
+ * stream. Archives made against a base file or with -s need the tool.
+ *
+ * Every call is independent, so different threads may use different streams at once.
+ * ar_set_stats_callback() is the exception: it is process wide, and should be set
+ * while nothing is being coded. Passing NULL turns the timing off again.
+ */
+
+#ifndef LIBARCHIVER_H
+#define	LIBARCHIVER_H
+#include <stddef.h>
+
+#define AR_OK 0
+#define AR_MORE 1  /* ar_stream_finish() has more output, call it again with more room */
+#define AR_ERROR_DST_SIZE -1  /* Output buffer is too small */
+#define AR_ERROR_CORRUPT -2  /* Input is not a valid archive, or is truncated */
+#define AR_ERROR_MEMORY -3  /* The allocator returned NULL */
+#define AR_ERROR_PARAMETER -4  /* Bad level, NULL buffer or a stream used the wrong way */
+#define AR_ERROR_UNSUPPORTED -5  /* Archive needs a base file, is a -s stream or is deduplicated and being streamed */
+
+/* Every allocation made during a call comes from here: the API's own buffers, and the scratch memory
+   of the block coders on the calling thread. Memory that lasts the whole program, such as the built in
+   table for small inputs, is still taken from malloc. alloc must return memory aligned for any type, as
+   malloc does, and free may be NULL to never free. NULL for malloc and free */
+typedef struct ar_allocator
+{
+	void* (*alloc)( void *opaque, size_t size);
+	void (*free)( void *opaque, void *pointer);
+	void *opaque;  /* Passed to alloc and free */
+} ar_allocator;
+
+typedef struct ar_stream ar_stream;
+
+/* One timed stage of one block, passed to the stats callback */
+typedef struct ar_stage_stats
+{
+	const char *stage;  /* "read", "histogram", "tree", "encode", "read tree", "decode" or "write" */
+	int hardware;  /* 1 if the four counters came from perf_event_open, otherwise they are 0 */
+	unsigned long long nanoseconds;  /* Wall time on the thread that ran the stage */
+	unsigned long long bytes;  /* Bytes the stage worked on */
+	unsigned long long cycles;
+	unsigned long long instructions;
+	unsigned long long cacheMisses;
+	unsigned long long branchMisses;
+	unsigned long long allocations;  /* Allocations the stage made */
+	unsigned long long allocatedBytes;  /* Bytes they asked for */
+	unsigned long long symbols;  /* For encode and decode, bytes of the block, otherwise 0 */
+	double entropyBits;  /* Order-0 entropy of those symbols, the least a Huffman code could use */
+	double codedBits;  /* Bits they were coded to, without the tree */
+} ar_stage_stats;
+
+/* Called from whichever thread ran the stage, so it may be called from several threads at once */
+typedef void (*ar_stats_callback)( void *opaque, const ar_stage_stats *stats);
+
+size_t ar_compress_bound( size_t inputSize);
+int ar_compress( const void *input, size_t inputSize, void *output, size_t outputCapacity, size_t *outputSize,
+				 int level, const ar_allocator *allocator);
+int ar_decompress( const void *input, size_t inputSize, void *output, size_t outputCapacity, size_t *outputSize,
+				   const ar_allocator *allocator);
+
+ar_stream* ar_stream_compress_new( int level, const ar_allocator *allocator);
+ar_stream* ar_stream_decompress_new( const ar_allocator *allocator);
+int ar_stream_update( ar_stream *stream, const void *input, size_t inputSize, size_t *inputUsed,
+					  void *output, size_t outputCapacity, size_t *outputSize);
+int ar_stream_finish( ar_stream *stream, void *output, size_t outputCapacity, size_t *outputSize);
+void ar_stream_free( ar_stream *stream);
+const char* ar_error_string( int code);
+void ar_set_stats_callback( ar_stats_callback callback, void *opaque);
+#endif	/* LIBARCHIVER_H */